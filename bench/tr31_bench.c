@@ -0,0 +1,372 @@
+/**
+ * @file tr31_bench.c
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "tr31.h"
+#include "tr31_bench_util.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <argp.h>
+
+// key block protection key configurations
+struct tr31_bench_kbpk_t {
+	const char* name;
+	unsigned int algorithm;
+	size_t length;
+};
+
+static const struct tr31_bench_kbpk_t tr31_bench_kbpks[] = {
+	{ "TDES2", TR31_KEY_ALGORITHM_TDES, 16 },
+	{ "TDES3", TR31_KEY_ALGORITHM_TDES, 24 },
+	{ "AES-128", TR31_KEY_ALGORITHM_AES, 16 },
+	{ "AES-192", TR31_KEY_ALGORITHM_AES, 24 },
+	{ "AES-256", TR31_KEY_ALGORITHM_AES, 32 },
+};
+
+static const enum tr31_version_t tr31_bench_versions[] = {
+	TR31_VERSION_A,
+	TR31_VERSION_B,
+	TR31_VERSION_C,
+	TR31_VERSION_D,
+};
+
+// optional block data; PB is added by tr31_export() when padding is required
+static const uint8_t tr31_bench_opt_block_KS[] = { 0xFF, 0xFF, 0x00, 0xA0, 0x20, 0x00, 0x00, 0x1E, 0x00, 0x00 };
+static const uint8_t tr31_bench_opt_block_IK[] = { 0x12, 0x34, 0x56, 0x78, 0x90, 0x12, 0x34, 0x56 };
+static const char tr31_bench_opt_blocks_name[] = "KS,IK,KC,KP,PB";
+
+// benchmark case state
+struct tr31_bench_case_t {
+	enum tr31_version_t version;
+	const struct tr31_bench_kbpk_t* kbpk_cfg;
+	bool opt_blocks;
+
+	struct tr31_key_t kbpk;
+	struct tr31_key_t key;
+	char key_block[1024];
+};
+
+// benchmark operation
+typedef int (*tr31_bench_op_t)(struct tr31_bench_case_t* bench_case);
+
+// argp configuration
+static struct argp argp_config = {
+	tr31_bench_argp_options,
+	tr31_bench_argp_parser,
+	NULL,
+	"Measure TR-31 import and export throughput and latency, and report the results as JSON.",
+};
+
+static int tr31_bench_add_opt_blocks(struct tr31_ctx_t* ctx)
+{
+	int r;
+
+	r = tr31_opt_block_add(ctx, TR31_OPT_BLOCK_KS, tr31_bench_opt_block_KS, sizeof(tr31_bench_opt_block_KS));
+	if (r) {
+		return r;
+	}
+	r = tr31_opt_block_add(ctx, TR31_OPT_BLOCK_IK, tr31_bench_opt_block_IK, sizeof(tr31_bench_opt_block_IK));
+	if (r) {
+		return r;
+	}
+	r = tr31_opt_block_add_KC(ctx);
+	if (r) {
+		return r;
+	}
+	r = tr31_opt_block_add_KP(ctx);
+	if (r) {
+		return r;
+	}
+
+	return 0;
+}
+
+static int tr31_bench_export(struct tr31_bench_case_t* bench_case)
+{
+	int r;
+	struct tr31_ctx_t ctx;
+
+	r = tr31_init(bench_case->version, &bench_case->key, &ctx);
+	if (r) {
+		return r;
+	}
+
+	if (bench_case->opt_blocks) {
+		r = tr31_bench_add_opt_blocks(&ctx);
+		if (r) {
+			goto exit;
+		}
+	}
+
+	r = tr31_export(&ctx, &bench_case->kbpk, bench_case->key_block, sizeof(bench_case->key_block));
+
+exit:
+	tr31_release(&ctx);
+	return r;
+}
+
+static int tr31_bench_import(struct tr31_bench_case_t* bench_case)
+{
+	int r;
+	struct tr31_ctx_t ctx;
+
+	r = tr31_import(bench_case->key_block, &bench_case->kbpk, &ctx);
+	tr31_release(&ctx);
+
+	return r;
+}
+
+static int tr31_bench_case_init(
+	enum tr31_version_t version,
+	const struct tr31_bench_kbpk_t* kbpk_cfg,
+	bool opt_blocks,
+	struct tr31_bench_case_t* bench_case
+)
+{
+	int r;
+	uint8_t kbpk_data[32];
+	uint8_t key_data[32];
+
+	memset(bench_case, 0, sizeof(*bench_case));
+	bench_case->version = version;
+	bench_case->kbpk_cfg = kbpk_cfg;
+	bench_case->opt_blocks = opt_blocks;
+
+	// fixed key values keep results comparable across runs
+	for (size_t i = 0; i < kbpk_cfg->length; ++i) {
+		kbpk_data[i] = 0x11 * (i + 1);
+		key_data[i] = 0xEE - i;
+	}
+
+	r = tr31_key_init(
+		TR31_KEY_USAGE_TR31_KBPK,
+		kbpk_cfg->algorithm,
+		TR31_KEY_MODE_OF_USE_ENC_DEC,
+		"00",
+		TR31_KEY_EXPORT_NONE,
+		kbpk_data,
+		kbpk_cfg->length,
+		&bench_case->kbpk
+	);
+	if (r) {
+		return r;
+	}
+
+	// wrapped key is of the same strength as the KBPK
+	r = tr31_key_init(
+		TR31_KEY_USAGE_DUKPT_IPEK,
+		kbpk_cfg->algorithm,
+		TR31_KEY_MODE_OF_USE_DERIVE,
+		"00",
+		TR31_KEY_EXPORT_NONE,
+		key_data,
+		kbpk_cfg->length,
+		&bench_case->key
+	);
+	if (r) {
+		tr31_key_release(&bench_case->kbpk);
+		return r;
+	}
+
+	// export once to provide key block for import benchmark
+	r = tr31_bench_export(bench_case);
+	if (r) {
+		tr31_key_release(&bench_case->kbpk);
+		tr31_key_release(&bench_case->key);
+		return r;
+	}
+
+	return 0;
+}
+
+static void tr31_bench_case_release(struct tr31_bench_case_t* bench_case)
+{
+	tr31_key_release(&bench_case->kbpk);
+	tr31_key_release(&bench_case->key);
+}
+
+static int tr31_bench_run(
+	const struct tr31_bench_options_t* options,
+	const char* operation,
+	tr31_bench_op_t op,
+	struct tr31_bench_case_t* bench_case,
+	uint64_t* samples,
+	FILE* out,
+	bool* first
+)
+{
+	int r;
+	char name[128];
+	uint64_t start;
+	uint64_t elapsed;
+	struct tr31_bench_stats_t stats;
+
+	snprintf(name, sizeof(name), "%s/%c/%s/%s",
+		operation,
+		bench_case->version,
+		bench_case->kbpk_cfg->name,
+		bench_case->opt_blocks ? "opt" : "none"
+	);
+	if (!tr31_bench_selected(options, name)) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < options->warmup; ++i) {
+		r = op(bench_case);
+		if (r) {
+			fprintf(stderr, "%s failed; error %d: %s\n", name, r, tr31_get_error_string(r));
+			return 1;
+		}
+	}
+
+	elapsed = tr31_bench_now();
+	for (size_t i = 0; i < options->iterations; ++i) {
+		start = tr31_bench_now();
+		r = op(bench_case);
+		samples[i] = tr31_bench_now() - start;
+		if (r) {
+			fprintf(stderr, "%s failed; error %d: %s\n", name, r, tr31_get_error_string(r));
+			return 1;
+		}
+	}
+	elapsed = tr31_bench_now() - elapsed;
+
+	tr31_bench_stats(samples, options->iterations, 1, elapsed, &stats);
+
+	fprintf(out,
+		"%s\n"
+		"    {\n"
+		"      \"name\": \"%s\",\n"
+		"      \"operation\": \"%s\",\n"
+		"      \"format_version\": \"%c\",\n"
+		"      \"kbpk\": \"%s\",\n"
+		"      \"opt_blocks\": \"%s\",\n"
+		"      \"key_block_length\": %zu,\n"
+		"      \"iterations\": %zu,\n"
+		"      ",
+		*first ? "" : ",",
+		name,
+		operation,
+		bench_case->version,
+		bench_case->kbpk_cfg->name,
+		bench_case->opt_blocks ? tr31_bench_opt_blocks_name : "",
+		strlen(bench_case->key_block),
+		options->iterations
+	);
+	tr31_bench_print_stats(out, &stats);
+	fprintf(out, "\n    }");
+	*first = false;
+
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	int r;
+	struct tr31_bench_options_t options;
+	uint64_t* samples;
+	FILE* out = stdout;
+	bool first = true;
+
+	tr31_bench_options_init(&options);
+
+	// parse command line options
+	r = argp_parse(&argp_config, argc, argv, 0, 0, &options);
+	if (r) {
+		fprintf(stderr, "Failed to parse command line\n");
+		return 1;
+	}
+
+	samples = calloc(options.iterations, sizeof(*samples));
+	if (!samples) {
+		fprintf(stderr, "Failed to allocate %zu samples\n", options.iterations);
+		return 1;
+	}
+
+	if (options.output) {
+		out = fopen(options.output, "w");
+		if (!out) {
+			fprintf(stderr, "Failed to open %s\n", options.output);
+			free(samples);
+			return 1;
+		}
+	}
+
+	fprintf(out,
+		"{\n"
+		"  \"library\": \"tr31\",\n"
+		"  \"library_version\": \"%s\",\n"
+		"  \"iterations\": %zu,\n"
+		"  \"warmup\": %zu,\n"
+		"  \"results\": [",
+		tr31_lib_version_string(),
+		options.iterations,
+		options.warmup
+	);
+
+	for (size_t i = 0; i < sizeof(tr31_bench_versions) / sizeof(tr31_bench_versions[0]); ++i) {
+		enum tr31_version_t version = tr31_bench_versions[i];
+
+		for (size_t j = 0; j < sizeof(tr31_bench_kbpks) / sizeof(tr31_bench_kbpks[0]); ++j) {
+			const struct tr31_bench_kbpk_t* kbpk_cfg = &tr31_bench_kbpks[j];
+
+			// format version D requires an AES KBPK and the other format
+			// versions require a TDES KBPK
+			if ((version == TR31_VERSION_D) != (kbpk_cfg->algorithm == TR31_KEY_ALGORITHM_AES)) {
+				continue;
+			}
+
+			for (int opt_blocks = 0; opt_blocks <= 1; ++opt_blocks) {
+				struct tr31_bench_case_t bench_case;
+
+				r = tr31_bench_case_init(version, kbpk_cfg, opt_blocks, &bench_case);
+				if (r) {
+					fprintf(stderr, "Failed to prepare %c/%s benchmark; error %d: %s\n", version, kbpk_cfg->name, r, tr31_get_error_string(r));
+					goto exit;
+				}
+
+				r = tr31_bench_run(&options, "export", &tr31_bench_export, &bench_case, samples, out, &first);
+				if (!r) {
+					r = tr31_bench_run(&options, "import", &tr31_bench_import, &bench_case, samples, out, &first);
+				}
+				tr31_bench_case_release(&bench_case);
+				if (r) {
+					goto exit;
+				}
+			}
+		}
+	}
+
+	fprintf(out, "\n  ]\n}\n");
+	r = 0;
+
+exit:
+	if (out != stdout) {
+		fclose(out);
+	}
+	free(samples);
+
+	return r ? 1 : 0;
+}
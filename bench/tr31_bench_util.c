@@ -0,0 +1,169 @@
+/**
+ * @file tr31_bench_util.c
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L // for clock_gettime
+
+#include "tr31_bench_util.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <argp.h>
+
+// argp option keys
+enum tr31_bench_option_keys_t {
+	TR31_BENCH_OPTION_ITERATIONS = 1,
+	TR31_BENCH_OPTION_WARMUP,
+	TR31_BENCH_OPTION_OUTPUT,
+	TR31_BENCH_OPTION_FILTER,
+};
+
+// argp option structure
+struct argp_option tr31_bench_argp_options[] = {
+	{ "iterations", TR31_BENCH_OPTION_ITERATIONS, "N", 0, "Number of measured samples per benchmark. Default is 1000." },
+	{ "warmup", TR31_BENCH_OPTION_WARMUP, "N", 0, "Number of unmeasured samples per benchmark. Default is 100." },
+	{ "output", TR31_BENCH_OPTION_OUTPUT, "FILE", 0, "Write JSON results to FILE instead of stdout." },
+	{ "filter", TR31_BENCH_OPTION_FILTER, "STRING", 0, "Only run benchmarks of which the name contains STRING." },
+
+	{ 0 },
+};
+
+// argp parser helper function
+error_t tr31_bench_argp_parser(int key, char* arg, struct argp_state* state)
+{
+	struct tr31_bench_options_t* options;
+	char* endptr;
+	unsigned long long value;
+
+	options = state->input;
+	if (!options) {
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	switch (key) {
+		case TR31_BENCH_OPTION_ITERATIONS:
+		case TR31_BENCH_OPTION_WARMUP:
+			value = strtoull(arg, &endptr, 10);
+			if (!*arg || *endptr || *arg == '-') {
+				argp_error(state, "N must be a decimal number");
+			}
+			if (key == TR31_BENCH_OPTION_ITERATIONS) {
+				if (!value) {
+					argp_error(state, "Number of iterations must be at least 1");
+				}
+				options->iterations = value;
+			} else {
+				options->warmup = value;
+			}
+			return 0;
+
+		case TR31_BENCH_OPTION_OUTPUT:
+			options->output = arg;
+			return 0;
+
+		case TR31_BENCH_OPTION_FILTER:
+			options->filter = arg;
+			return 0;
+
+		default:
+			return ARGP_ERR_UNKNOWN;
+	}
+}
+
+void tr31_bench_options_init(struct tr31_bench_options_t* options)
+{
+	memset(options, 0, sizeof(*options));
+	options->iterations = 1000;
+	options->warmup = 100;
+}
+
+int tr31_bench_selected(const struct tr31_bench_options_t* options, const char* name)
+{
+	return !options->filter || strstr(name, options->filter);
+}
+
+uint64_t tr31_bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static int tr31_bench_cmp_u64(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*)a;
+	uint64_t y = *(const uint64_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint64_t tr31_bench_percentile(const uint64_t* sorted, size_t count, unsigned int percentile)
+{
+	// nearest-rank method
+	size_t rank = ((count * percentile) + 99) / 100;
+	if (rank < 1) {
+		rank = 1;
+	}
+	return sorted[rank - 1];
+}
+
+void tr31_bench_stats(
+	uint64_t* samples,
+	size_t count,
+	size_t ops_per_sample,
+	uint64_t elapsed,
+	struct tr31_bench_stats_t* stats
+)
+{
+	uint64_t total = 0;
+
+	qsort(samples, count, sizeof(samples[0]), &tr31_bench_cmp_u64);
+	for (size_t i = 0; i < count; ++i) {
+		total += samples[i];
+	}
+
+	stats->ops_per_sec = elapsed ? (count * ops_per_sample * 1e9) / elapsed : 0;
+	stats->min = samples[0] / ops_per_sample;
+	stats->mean = total / count / ops_per_sample;
+	stats->p50 = tr31_bench_percentile(samples, count, 50) / ops_per_sample;
+	stats->p90 = tr31_bench_percentile(samples, count, 90) / ops_per_sample;
+	stats->p99 = tr31_bench_percentile(samples, count, 99) / ops_per_sample;
+	stats->max = samples[count - 1] / ops_per_sample;
+}
+
+void tr31_bench_print_stats(FILE* out, const struct tr31_bench_stats_t* stats)
+{
+	fprintf(out,
+		"\"ops_per_sec\": %.1f, "
+		"\"latency_ns\": { \"min\": %llu, \"mean\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu }",
+		stats->ops_per_sec,
+		(unsigned long long)stats->min,
+		(unsigned long long)stats->mean,
+		(unsigned long long)stats->p50,
+		(unsigned long long)stats->p90,
+		(unsigned long long)stats->p99,
+		(unsigned long long)stats->max
+	);
+}
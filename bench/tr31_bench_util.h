@@ -0,0 +1,101 @@
+/**
+ * @file tr31_bench_util.h
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TR31_BENCH_UTIL_H
+#define TR31_BENCH_UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <argp.h>
+
+// common command line options
+struct tr31_bench_options_t {
+	size_t iterations;
+	size_t warmup;
+	const char* output;
+	const char* filter;
+};
+
+// throughput and latency statistics; latency is per operation in nanoseconds
+struct tr31_bench_stats_t {
+	double ops_per_sec;
+	uint64_t min;
+	uint64_t mean;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t max;
+};
+
+/// Common argp options for use in the program's argp configuration
+extern struct argp_option tr31_bench_argp_options[];
+
+/**
+ * Common argp parser for use in the program's argp configuration.
+ * Expects @ref tr31_bench_options_t as input.
+ */
+error_t tr31_bench_argp_parser(int key, char* arg, struct argp_state* state);
+
+/**
+ * Initialise common command line options with defaults
+ * @param options Command line options
+ */
+void tr31_bench_options_init(struct tr31_bench_options_t* options);
+
+/**
+ * Determine whether benchmark should run according to command line options
+ * @param options Command line options
+ * @param name Benchmark name
+ * @return Non-zero if benchmark should run
+ */
+int tr31_bench_selected(const struct tr31_bench_options_t* options, const char* name);
+
+/**
+ * Retrieve monotonic time
+ * @return Time in nanoseconds
+ */
+uint64_t tr31_bench_now(void);
+
+/**
+ * Compute statistics from samples. Samples will be sorted.
+ * @param samples Duration of each sample in nanoseconds
+ * @param count Number of samples
+ * @param ops_per_sample Number of operations measured by each sample
+ * @param elapsed Total duration of all samples in nanoseconds
+ * @param stats Statistics output
+ */
+void tr31_bench_stats(
+	uint64_t* samples,
+	size_t count,
+	size_t ops_per_sample,
+	uint64_t elapsed,
+	struct tr31_bench_stats_t* stats
+);
+
+/**
+ * Print statistics as JSON object members, without leading indentation or
+ * trailing newline.
+ * @param out Output stream
+ * @param stats Statistics
+ */
+void tr31_bench_print_stats(FILE* out, const struct tr31_bench_stats_t* stats);
+
+#endif
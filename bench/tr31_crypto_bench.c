@@ -0,0 +1,385 @@
+/**
+ * @file tr31_crypto_bench.c
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "tr31_crypto.h"
+#include "tr31_bench_util.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <argp.h>
+
+// provided by build system
+#ifndef TR31_CRYPTO_BENCH_BACKEND
+#define TR31_CRYPTO_BENCH_BACKEND "unknown"
+#endif
+#ifndef TR31_CRYPTO_BENCH_ENGINES
+#define TR31_CRYPTO_BENCH_ENGINES ""
+#endif
+
+// primitives are fast compared to the clock source and are therefore timed in
+// batches of operations
+#define TR31_CRYPTO_BENCH_OPS_PER_SAMPLE (32)
+
+#define TR31_CRYPTO_BENCH_MAX_DATA_LEN (64)
+
+// benchmark state shared by all operations of a benchmark
+struct tr31_crypto_bench_state_t {
+	uint8_t key[32];
+	size_t key_len;
+	uint8_t iv[AES_BLOCK_SIZE];
+	uint8_t data[TR31_CRYPTO_BENCH_MAX_DATA_LEN];
+	size_t data_len;
+	uint8_t out[TR31_CRYPTO_BENCH_MAX_DATA_LEN];
+	uint8_t kbek[32];
+	uint8_t kbak[32];
+	struct tr31_cipher_t* cipher;
+	struct tr31_rand_pool_t rand_pool;
+};
+
+// benchmark operation
+typedef int (*tr31_crypto_bench_op_t)(struct tr31_crypto_bench_state_t* state);
+
+// benchmark configuration
+struct tr31_crypto_bench_t {
+	const char* function;
+	const char* algorithm;
+	size_t key_len;
+	size_t data_len;
+	tr31_crypto_bench_op_t op;
+};
+
+static int tr31_crypto_bench_tdes_cmac(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_tdes_cmac(state->key, state->key_len, state->data, state->data_len, state->out);
+}
+
+static int tr31_crypto_bench_aes_cmac(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_aes_cmac(state->key, state->key_len, state->data, state->data_len, state->out);
+}
+
+static int tr31_crypto_bench_tdes_encrypt_cbc(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_tdes_encrypt_cbc(state->key, state->key_len, state->iv, state->data, state->data_len, state->out);
+}
+
+static int tr31_crypto_bench_tdes_decrypt_cbc(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_tdes_decrypt_cbc(state->key, state->key_len, state->iv, state->data, state->data_len, state->out);
+}
+
+static int tr31_crypto_bench_aes_encrypt_cbc(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_aes_encrypt_cbc(state->key, state->key_len, state->iv, state->data, state->data_len, state->out);
+}
+
+static int tr31_crypto_bench_aes_decrypt_cbc(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_aes_decrypt_cbc(state->key, state->key_len, state->iv, state->data, state->data_len, state->out);
+}
+
+static int tr31_crypto_bench_tdes_kbpk_variant(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_tdes_kbpk_variant(state->key, state->key_len, state->kbek, state->kbak);
+}
+
+static int tr31_crypto_bench_tdes_kbpk_derive(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_tdes_kbpk_derive(state->key, state->key_len, state->kbek, state->kbak);
+}
+
+static int tr31_crypto_bench_aes_kbpk_derive(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_aes_kbpk_derive(state->key, state->key_len, state->kbek, state->kbak);
+}
+
+static int tr31_crypto_bench_tdes_kcv(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_tdes_kcv(state->key, state->key_len, state->out);
+}
+
+static int tr31_crypto_bench_aes_kcv(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_aes_kcv(state->key, state->key_len, state->out);
+}
+
+static int tr31_crypto_bench_cipher_cmac(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_cipher_cmac(state->cipher, state->data, state->data_len, state->out);
+}
+
+static int tr31_crypto_bench_cipher_encrypt_cbc(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_cipher_encrypt_cbc(state->cipher, state->iv, state->data, state->data_len, state->out);
+}
+
+static int tr31_crypto_bench_cipher_decrypt_cbc(struct tr31_crypto_bench_state_t* state)
+{
+	return tr31_cipher_decrypt_cbc(state->cipher, state->iv, state->data, state->data_len, state->out);
+}
+
+static int tr31_crypto_bench_rand(struct tr31_crypto_bench_state_t* state)
+{
+	tr31_rand(state->out, state->data_len);
+	return 0;
+}
+
+static int tr31_crypto_bench_rand_pool_get(struct tr31_crypto_bench_state_t* state)
+{
+	tr31_rand_pool_get(&state->rand_pool, state->out, state->data_len);
+	return 0;
+}
+
+// data lengths correspond to typical key block payloads and authenticator input
+static const struct tr31_crypto_bench_t tr31_crypto_benches[] = {
+	{ "tr31_tdes_cmac", "TDES2", TDES2_KEY_SIZE, 48, &tr31_crypto_bench_tdes_cmac },
+	{ "tr31_tdes_cmac", "TDES3", TDES3_KEY_SIZE, 48, &tr31_crypto_bench_tdes_cmac },
+	{ "tr31_aes_cmac", "AES-128", AES128_KEY_SIZE, 64, &tr31_crypto_bench_aes_cmac },
+	{ "tr31_aes_cmac", "AES-192", AES192_KEY_SIZE, 64, &tr31_crypto_bench_aes_cmac },
+	{ "tr31_aes_cmac", "AES-256", AES256_KEY_SIZE, 64, &tr31_crypto_bench_aes_cmac },
+	{ "tr31_tdes_encrypt_cbc", "TDES2", TDES2_KEY_SIZE, 24, &tr31_crypto_bench_tdes_encrypt_cbc },
+	{ "tr31_tdes_encrypt_cbc", "TDES3", TDES3_KEY_SIZE, 32, &tr31_crypto_bench_tdes_encrypt_cbc },
+	{ "tr31_tdes_decrypt_cbc", "TDES2", TDES2_KEY_SIZE, 24, &tr31_crypto_bench_tdes_decrypt_cbc },
+	{ "tr31_tdes_decrypt_cbc", "TDES3", TDES3_KEY_SIZE, 32, &tr31_crypto_bench_tdes_decrypt_cbc },
+	{ "tr31_aes_encrypt_cbc", "AES-128", AES128_KEY_SIZE, 32, &tr31_crypto_bench_aes_encrypt_cbc },
+	{ "tr31_aes_encrypt_cbc", "AES-256", AES256_KEY_SIZE, 48, &tr31_crypto_bench_aes_encrypt_cbc },
+	{ "tr31_aes_decrypt_cbc", "AES-128", AES128_KEY_SIZE, 32, &tr31_crypto_bench_aes_decrypt_cbc },
+	{ "tr31_aes_decrypt_cbc", "AES-256", AES256_KEY_SIZE, 48, &tr31_crypto_bench_aes_decrypt_cbc },
+	{ "tr31_tdes_kbpk_variant", "TDES2", TDES2_KEY_SIZE, 0, &tr31_crypto_bench_tdes_kbpk_variant },
+	{ "tr31_tdes_kbpk_variant", "TDES3", TDES3_KEY_SIZE, 0, &tr31_crypto_bench_tdes_kbpk_variant },
+	{ "tr31_tdes_kbpk_derive", "TDES2", TDES2_KEY_SIZE, 0, &tr31_crypto_bench_tdes_kbpk_derive },
+	{ "tr31_tdes_kbpk_derive", "TDES3", TDES3_KEY_SIZE, 0, &tr31_crypto_bench_tdes_kbpk_derive },
+	{ "tr31_aes_kbpk_derive", "AES-128", AES128_KEY_SIZE, 0, &tr31_crypto_bench_aes_kbpk_derive },
+	{ "tr31_aes_kbpk_derive", "AES-192", AES192_KEY_SIZE, 0, &tr31_crypto_bench_aes_kbpk_derive },
+	{ "tr31_aes_kbpk_derive", "AES-256", AES256_KEY_SIZE, 0, &tr31_crypto_bench_aes_kbpk_derive },
+	{ "tr31_tdes_kcv", "TDES2", TDES2_KEY_SIZE, 0, &tr31_crypto_bench_tdes_kcv },
+	{ "tr31_tdes_kcv", "TDES3", TDES3_KEY_SIZE, 0, &tr31_crypto_bench_tdes_kcv },
+	{ "tr31_aes_kcv", "AES-128", AES128_KEY_SIZE, 0, &tr31_crypto_bench_aes_kcv },
+	{ "tr31_aes_kcv", "AES-256", AES256_KEY_SIZE, 0, &tr31_crypto_bench_aes_kcv },
+	{ "tr31_cipher_cmac", "TDES3", TDES3_KEY_SIZE, 48, &tr31_crypto_bench_cipher_cmac },
+	{ "tr31_cipher_cmac", "AES-256", AES256_KEY_SIZE, 64, &tr31_crypto_bench_cipher_cmac },
+	{ "tr31_cipher_encrypt_cbc", "TDES3", TDES3_KEY_SIZE, 32, &tr31_crypto_bench_cipher_encrypt_cbc },
+	{ "tr31_cipher_encrypt_cbc", "AES-256", AES256_KEY_SIZE, 48, &tr31_crypto_bench_cipher_encrypt_cbc },
+	{ "tr31_cipher_decrypt_cbc", "TDES3", TDES3_KEY_SIZE, 32, &tr31_crypto_bench_cipher_decrypt_cbc },
+	{ "tr31_cipher_decrypt_cbc", "AES-256", AES256_KEY_SIZE, 48, &tr31_crypto_bench_cipher_decrypt_cbc },
+	{ "tr31_rand", "", 0, 16, &tr31_crypto_bench_rand },
+	{ "tr31_rand_pool_get", "", 0, 16, &tr31_crypto_bench_rand_pool_get },
+};
+
+// argp configuration
+static struct argp argp_config = {
+	tr31_bench_argp_options,
+	tr31_bench_argp_parser,
+	NULL,
+	"Measure throughput and latency of the crypto primitives used by the TR-31 library, and report the results as JSON.",
+};
+
+static int tr31_crypto_bench_state_init(const struct tr31_crypto_bench_t* bench, struct tr31_crypto_bench_state_t* state)
+{
+	int r;
+
+	memset(state, 0, sizeof(*state));
+
+	// fixed values keep results comparable across runs
+	for (size_t i = 0; i < sizeof(state->key); ++i) {
+		state->key[i] = 0x11 * (i + 1);
+	}
+	for (size_t i = 0; i < sizeof(state->data); ++i) {
+		state->data[i] = i;
+	}
+	state->key_len = bench->key_len;
+	state->data_len = bench->data_len;
+	tr31_rand_pool_init(&state->rand_pool);
+
+	// cipher object benchmarks exclude the key schedule
+	if (strncmp(bench->function, "tr31_cipher_", 12) == 0) {
+		if (strncmp(bench->algorithm, "TDES", 4) == 0) {
+			r = tr31_tdes_cipher_new(state->key, state->key_len, &state->cipher);
+		} else {
+			r = tr31_aes_cipher_new(state->key, state->key_len, &state->cipher);
+		}
+		if (r) {
+			return r;
+		}
+	}
+
+	return 0;
+}
+
+static void tr31_crypto_bench_state_release(struct tr31_crypto_bench_state_t* state)
+{
+	tr31_cipher_free(state->cipher);
+	tr31_rand_pool_cleanse(&state->rand_pool);
+	tr31_cleanse(state, sizeof(*state));
+}
+
+static int tr31_crypto_bench_run(
+	const struct tr31_bench_options_t* options,
+	const struct tr31_crypto_bench_t* bench,
+	uint64_t* samples,
+	FILE* out,
+	bool* first
+)
+{
+	int r;
+	char name[128];
+	struct tr31_crypto_bench_state_t state;
+	uint64_t start;
+	uint64_t elapsed;
+	struct tr31_bench_stats_t stats;
+
+	if (bench->key_len) {
+		snprintf(name, sizeof(name), "%s/%s/%zu", bench->function, bench->algorithm, bench->data_len);
+	} else {
+		snprintf(name, sizeof(name), "%s/%zu", bench->function, bench->data_len);
+	}
+	if (!tr31_bench_selected(options, name)) {
+		return 0;
+	}
+
+	r = tr31_crypto_bench_state_init(bench, &state);
+	if (r) {
+		fprintf(stderr, "Failed to prepare %s; r=%d\n", name, r);
+		goto exit;
+	}
+
+	for (size_t i = 0; i < options->warmup; ++i) {
+		for (size_t j = 0; j < TR31_CRYPTO_BENCH_OPS_PER_SAMPLE; ++j) {
+			r = bench->op(&state);
+			if (r) {
+				fprintf(stderr, "%s failed; r=%d\n", name, r);
+				goto exit;
+			}
+		}
+	}
+
+	elapsed = tr31_bench_now();
+	for (size_t i = 0; i < options->iterations; ++i) {
+		start = tr31_bench_now();
+		for (size_t j = 0; j < TR31_CRYPTO_BENCH_OPS_PER_SAMPLE; ++j) {
+			r = bench->op(&state);
+			if (r) {
+				fprintf(stderr, "%s failed; r=%d\n", name, r);
+				goto exit;
+			}
+		}
+		samples[i] = tr31_bench_now() - start;
+	}
+	elapsed = tr31_bench_now() - elapsed;
+
+	tr31_bench_stats(samples, options->iterations, TR31_CRYPTO_BENCH_OPS_PER_SAMPLE, elapsed, &stats);
+
+	fprintf(out,
+		"%s\n"
+		"    {\n"
+		"      \"name\": \"%s\",\n"
+		"      \"function\": \"%s\",\n"
+		"      \"algorithm\": \"%s\",\n"
+		"      \"data_length\": %zu,\n"
+		"      \"iterations\": %zu,\n"
+		"      \"ops_per_iteration\": %u,\n"
+		"      ",
+		*first ? "" : ",",
+		name,
+		bench->function,
+		bench->algorithm,
+		bench->data_len,
+		options->iterations,
+		TR31_CRYPTO_BENCH_OPS_PER_SAMPLE
+	);
+	tr31_bench_print_stats(out, &stats);
+	fprintf(out, "\n    }");
+	*first = false;
+
+	r = 0;
+
+exit:
+	tr31_crypto_bench_state_release(&state);
+	return r ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+	int r;
+	struct tr31_bench_options_t options;
+	uint64_t* samples;
+	FILE* out = stdout;
+	bool first = true;
+
+	tr31_bench_options_init(&options);
+
+	// parse command line options
+	r = argp_parse(&argp_config, argc, argv, 0, 0, &options);
+	if (r) {
+		fprintf(stderr, "Failed to parse command line\n");
+		return 1;
+	}
+
+	samples = calloc(options.iterations, sizeof(*samples));
+	if (!samples) {
+		fprintf(stderr, "Failed to allocate %zu samples\n", options.iterations);
+		return 1;
+	}
+
+	if (options.output) {
+		out = fopen(options.output, "w");
+		if (!out) {
+			fprintf(stderr, "Failed to open %s\n", options.output);
+			free(samples);
+			return 1;
+		}
+	}
+
+	fprintf(out,
+		"{\n"
+		"  \"crypto_backend\": \"%s\",\n"
+		"  \"builtin_engines\": \"%s\",\n"
+		"  \"iterations\": %zu,\n"
+		"  \"warmup\": %zu,\n"
+		"  \"results\": [",
+		TR31_CRYPTO_BENCH_BACKEND,
+		TR31_CRYPTO_BENCH_ENGINES,
+		options.iterations,
+		options.warmup
+	);
+
+	for (size_t i = 0; i < sizeof(tr31_crypto_benches) / sizeof(tr31_crypto_benches[0]); ++i) {
+		r = tr31_crypto_bench_run(&options, &tr31_crypto_benches[i], samples, out, &first);
+		if (r) {
+			goto exit;
+		}
+	}
+
+	fprintf(out, "\n  ]\n}\n");
+	r = 0;
+
+exit:
+	if (out != stdout) {
+		fclose(out);
+	}
+	free(samples);
+
+	return r ? 1 : 0;
+}
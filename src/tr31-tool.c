@@ -18,7 +18,10 @@
  * <https://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L // for getline and fmemopen
+
 #include "tr31.h"
+#include "tr31_config.h"
 
 #include <stddef.h>
 #include <stdbool.h>
@@ -31,11 +34,37 @@
 
 #include <ctype.h> // for isalnum and friends
 #include <arpa/inet.h> // for ntohs and friends
+#include <sys/types.h> // for ssize_t
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define TR31_TOOL_BULK_MAX_JOBS (256) // Maximum number of bulk processing jobs
+#define TR31_TOOL_BULK_CHUNK_LINES (1024) // Number of input lines per bulk processing job at a time
+#define TR31_TOOL_BULK_OUTPUT_SIZE (64 * 1024) // Initial size of bulk processing job output buffer
+
+// output format of imported and exported TR-31 key blocks
+enum tr31_tool_format_t {
+	TR31_TOOL_FORMAT_TEXT = 0,
+	TR31_TOOL_FORMAT_JSONL,
+	TR31_TOOL_FORMAT_CSV,
+};
 
 // command line options
 struct tr31_tool_options_t {
 	bool import;
 	bool export;
+	bool bulk_import;
+	bool bulk_export;
+	bool translate;
 	bool kbpk;
 
 	// import parameters
@@ -58,6 +87,26 @@ struct tr31_tool_options_t {
 	bool export_opt_block_KC;
 	bool export_opt_block_KP;
 
+	// translate parameters
+	// valid if translate is true
+	size_t translate_kbpk_buf_len;
+	uint8_t translate_kbpk_buf[32]; // max 256-bit KBPK
+	unsigned int translate_format_version;
+	unsigned int translate_exportability;
+	bool translate_opt_block_KC;
+	bool translate_opt_block_KP;
+	bool translate_drop_opt_blocks;
+
+	// bulk parameters
+	// valid if bulk_import, bulk_export or translate is true
+	const char* input_path;
+	const char* output_path;
+	unsigned int jobs;
+
+	// output parameters
+	enum tr31_tool_format_t format;
+	bool omit_key;
+
 	// kbpk parameters
 	// valid if kbpk is true
 	size_t kbpk_buf_len;
@@ -66,8 +115,10 @@ struct tr31_tool_options_t {
 
 // helper functions
 static error_t argp_parser_helper(int key, char* arg, struct argp_state* state);
-static int parse_hex(const char* hex, void* bin, size_t bin_len);
-static void print_hex(const void* buf, size_t length);
+static void print_hex(FILE* f, const void* buf, size_t length);
+static void print_record_header(FILE* f, const struct tr31_tool_options_t* options, bool line_number);
+static void print_import_record(FILE* f, const struct tr31_tool_options_t* options, size_t line_number, const char* error, struct tr31_ctx_t* tr31_ctx);
+static void print_export_record(FILE* f, const struct tr31_tool_options_t* options, size_t line_number, const char* error, const char* key_block);
 
 // argp option keys
 enum tr31_tool_option_keys_t {
@@ -81,6 +132,20 @@ enum tr31_tool_option_keys_t {
 	TR31_TOOL_OPTION_EXPORT_OPT_BLOCK_KS,
 	TR31_TOOL_OPTION_EXPORT_OPT_BLOCK_KC,
 	TR31_TOOL_OPTION_EXPORT_OPT_BLOCK_KP,
+	TR31_TOOL_OPTION_BULK_IMPORT,
+	TR31_TOOL_OPTION_BULK_EXPORT,
+	TR31_TOOL_OPTION_TRANSLATE,
+	TR31_TOOL_OPTION_TRANSLATE_KBPK,
+	TR31_TOOL_OPTION_TRANSLATE_FORMAT_VERSION,
+	TR31_TOOL_OPTION_TRANSLATE_EXPORTABILITY,
+	TR31_TOOL_OPTION_TRANSLATE_OPT_BLOCK_KC,
+	TR31_TOOL_OPTION_TRANSLATE_OPT_BLOCK_KP,
+	TR31_TOOL_OPTION_TRANSLATE_DROP_OPT_BLOCKS,
+	TR31_TOOL_OPTION_INPUT,
+	TR31_TOOL_OPTION_OUTPUT,
+	TR31_TOOL_OPTION_JOBS,
+	TR31_TOOL_OPTION_FORMAT,
+	TR31_TOOL_OPTION_OMIT_KEY,
 	TR31_TOOL_OPTION_KBPK,
 	TR31_TOOL_OPTION_VERSION,
 };
@@ -89,6 +154,8 @@ enum tr31_tool_option_keys_t {
 static struct argp_option argp_options[] = {
 	{ NULL, 0, NULL, 0, "Options for decoding/decrypting TR-31 key blocks:", 1 },
 	{ "import", TR31_TOOL_OPTION_IMPORT, "KEYBLOCK", 0, "Import TR-31 key block to decode/decrypt. Optionally specify KBPK (--kbpk) to decrypt." },
+	{ "format", TR31_TOOL_OPTION_FORMAT, "text|jsonl|csv", 0, "Output format of --import, --bulk-import, --bulk-export and --translate. Default is text." },
+	{ "omit-key", TR31_TOOL_OPTION_OMIT_KEY, NULL, 0, "Omit decrypted key value from jsonl or csv output. The KCV is still included." },
 
 	{ NULL, 0, NULL, 0, "Options for encoding/encrypting TR-31 key blocks:", 2 },
 	{ "export", TR31_TOOL_OPTION_EXPORT, "KEY", 0, "Export TR-31 key block containing KEY. Requires KBPK (--kbpk). Requires either --export-key-algorithm, --export-format-version and --export-template, or only --export-header" },
@@ -101,7 +168,23 @@ static struct argp_option argp_options[] = {
 	{ "export-opt-block-KP", TR31_TOOL_OPTION_EXPORT_OPT_BLOCK_KP, NULL, 0, "Add optional block KP (KCV of KBPK) during TR-31 export. May be used with either --export-template or --export-header." },
 	{ "export-opt-block-KC", TR31_TOOL_OPTION_EXPORT_OPT_BLOCK_KC, NULL, 0, "Add optional block KC (KCV of wrapped key) during TR-31 export. May be used with either --export-template or --export-header." },
 
-	{ NULL, 0, NULL, 0, "Options for decrypting/encrypting TR-31 key blocks:", 3 },
+	{ NULL, 0, NULL, 0, "Options for bulk decoding/decrypting and encoding/encrypting of TR-31 key blocks:", 3 },
+	{ "bulk-import", TR31_TOOL_OPTION_BULK_IMPORT, NULL, 0, "Import TR-31 key blocks, one per line, from input (--input). Optionally specify KBPK (--kbpk) to decrypt." },
+	{ "bulk-export", TR31_TOOL_OPTION_BULK_EXPORT, NULL, 0, "Export TR-31 key blocks for KEYs, one per line, from input (--input). Requires KBPK (--kbpk). Requires the same options as --export, except for KEY itself." },
+	{ "translate", TR31_TOOL_OPTION_TRANSLATE, NULL, 0, "Translate TR-31 key blocks, one per line, from input (--input) by decrypting them using KBPK (--kbpk) and encrypting them using the translation KBPK (--translate-kbpk). Header fields and optional blocks are retained unless specified otherwise." },
+	{ "input", TR31_TOOL_OPTION_INPUT, "FILE", 0, "Read bulk input from FILE instead of stdin." },
+	{ "output", TR31_TOOL_OPTION_OUTPUT, "FILE", 0, "Write bulk results to FILE instead of stdout." },
+	{ "jobs", TR31_TOOL_OPTION_JOBS, "N", 0, "Process bulk input using N parallel jobs. Results are written in input order. Default is 1." },
+
+	{ NULL, 0, NULL, 0, "Options for translating TR-31 key blocks:", 4 },
+	{ "translate-kbpk", TR31_TOOL_OPTION_TRANSLATE_KBPK, "KEY", 0, "TR-31 key block protection key value (hex encoded) to use for the translated key blocks." },
+	{ "translate-format-version", TR31_TOOL_OPTION_TRANSLATE_FORMAT_VERSION, "A|B|C|D", 0, "TR-31 format version to use for the translated key blocks. Default is the format version of each input key block." },
+	{ "translate-exportability", TR31_TOOL_OPTION_TRANSLATE_EXPORTABILITY, "E|N|S", 0, "Exportability to use for the translated key blocks. Default is the exportability of each input key block." },
+	{ "translate-opt-block-KC", TR31_TOOL_OPTION_TRANSLATE_OPT_BLOCK_KC, NULL, 0, "Add optional block KC (KCV of wrapped key) to the translated key blocks, if not present." },
+	{ "translate-opt-block-KP", TR31_TOOL_OPTION_TRANSLATE_OPT_BLOCK_KP, NULL, 0, "Add optional block KP (KCV of KBPK) to the translated key blocks, if not present. Existing optional blocks KP are always recomputed." },
+	{ "translate-drop-opt-blocks", TR31_TOOL_OPTION_TRANSLATE_DROP_OPT_BLOCKS, NULL, 0, "Omit the optional blocks of the input key blocks from the translated key blocks." },
+
+	{ NULL, 0, NULL, 0, "Options for decrypting/encrypting TR-31 key blocks:", 5 },
 	{ "kbpk", TR31_TOOL_OPTION_KBPK, "KEY", 0, "TR-31 key block protection key value (hex encoded)" },
 	{ "version", TR31_TOOL_OPTION_VERSION, NULL, 0, "Display TR-31 library version" },
 
@@ -114,7 +197,9 @@ static struct argp argp_config = {
 	argp_parser_helper,
 	NULL,
 	" \v" // force the text to be after the options in the help message
-	"The import (decoding/decrypting) and export (encoding/encrypting) options cannot be specified simultaneously.\n\n"
+	"The import (decoding/decrypting), export (encoding/encrypting) and translate options cannot be specified simultaneously.\n\n"
+	"Bulk processing writes one result line per non-empty input line, consisting of tab separated fields: the input line number, the status (OK or ERROR), and either the decrypted key and its KCV (import), the key block (export or translate), or the error message.\n\n"
+	"The jsonl and csv output formats write one record per key block, consisting of the input line number (bulk only), the status (OK or ERROR), the error message, and either the header fields, optional blocks, decrypted key and KCV (import), or the key block (export or translate). The csv output format starts with a header line containing the field names.\n\n"
 	"NOTE: All KEY values are strings of hex digits representing binary data.",
 };
 
@@ -148,7 +233,7 @@ static error_t argp_parser_helper(int key, char* arg, struct argp_state* state)
 			}
 			options->export_key_buf_len = strlen(arg) / 2;
 
-			r = parse_hex(arg, options->export_key_buf, options->export_key_buf_len);
+			r = tr31_hex_to_bin(arg, options->export_key_buf, options->export_key_buf_len);
 			if (r) {
 				argp_error(state, "KEY string must consist of hex digits");
 			}
@@ -171,6 +256,22 @@ static error_t argp_parser_helper(int key, char* arg, struct argp_state* state)
 			options->export_template = arg;
 			return 0;
 
+		case TR31_TOOL_OPTION_FORMAT:
+			if (strcmp(arg, "text") == 0) {
+				options->format = TR31_TOOL_FORMAT_TEXT;
+			} else if (strcmp(arg, "jsonl") == 0) {
+				options->format = TR31_TOOL_FORMAT_JSONL;
+			} else if (strcmp(arg, "csv") == 0) {
+				options->format = TR31_TOOL_FORMAT_CSV;
+			} else {
+				argp_error(state, "Output format must be text, jsonl or csv");
+			}
+			return 0;
+
+		case TR31_TOOL_OPTION_OMIT_KEY:
+			options->omit_key = true;
+			return 0;
+
 		case TR31_TOOL_OPTION_EXPORT_HEADER:
 			if (strlen(arg) < 16) {
 				argp_error(state, "Export header must be at least 16 characters/bytes");
@@ -192,7 +293,7 @@ static error_t argp_parser_helper(int key, char* arg, struct argp_state* state)
 			}
 			options->export_opt_block_IK_buf_len = strlen(arg) / 2;
 
-			r = parse_hex(arg, options->export_opt_block_IK_buf, options->export_opt_block_IK_buf_len);
+			r = tr31_hex_to_bin(arg, options->export_opt_block_IK_buf, options->export_opt_block_IK_buf_len);
 			if (r) {
 				argp_error(state, "Export optional block IK must consist of hex digits");
 			}
@@ -207,7 +308,7 @@ static error_t argp_parser_helper(int key, char* arg, struct argp_state* state)
 			}
 			options->export_opt_block_KS_buf_len = strlen(arg) / 2;
 
-			r = parse_hex(arg, options->export_opt_block_KS_buf, options->export_opt_block_KS_buf_len);
+			r = tr31_hex_to_bin(arg, options->export_opt_block_KS_buf, options->export_opt_block_KS_buf_len);
 			if (r) {
 				argp_error(state, "Export optional block KS must consist of hex digits");
 			}
@@ -221,6 +322,86 @@ static error_t argp_parser_helper(int key, char* arg, struct argp_state* state)
 			options->export_opt_block_KP = true;
 			return 0;
 
+		case TR31_TOOL_OPTION_BULK_IMPORT:
+			options->bulk_import = true;
+			return 0;
+
+		case TR31_TOOL_OPTION_BULK_EXPORT:
+			options->bulk_export = true;
+			return 0;
+
+		case TR31_TOOL_OPTION_TRANSLATE:
+			options->translate = true;
+			return 0;
+
+		case TR31_TOOL_OPTION_TRANSLATE_KBPK:
+			if (strlen(arg) > sizeof(options->translate_kbpk_buf) * 2) {
+				argp_error(state, "KEY string may not have more than %zu digits (thus %zu bytes)",
+					sizeof(options->translate_kbpk_buf) * 2,
+					sizeof(options->translate_kbpk_buf)
+				);
+			}
+			if (strlen(arg) % 2 != 0) {
+				argp_error(state, "KEY string must have even number of digits");
+			}
+			options->translate_kbpk_buf_len = strlen(arg) / 2;
+
+			r = tr31_hex_to_bin(arg, options->translate_kbpk_buf, options->translate_kbpk_buf_len);
+			if (r) {
+				argp_error(state, "KEY string must consist of hex digits");
+			}
+			return 0;
+
+		case TR31_TOOL_OPTION_TRANSLATE_FORMAT_VERSION:
+			if (strlen(arg) != 1) {
+				argp_error(state, "Translate format version must be a single digit");
+			}
+			options->translate_format_version = *arg;
+			return 0;
+
+		case TR31_TOOL_OPTION_TRANSLATE_EXPORTABILITY:
+			if (strlen(arg) != 1) {
+				argp_error(state, "Translate exportability must be a single character");
+			}
+			options->translate_exportability = *arg;
+			return 0;
+
+		case TR31_TOOL_OPTION_TRANSLATE_OPT_BLOCK_KC:
+			options->translate_opt_block_KC = true;
+			return 0;
+
+		case TR31_TOOL_OPTION_TRANSLATE_OPT_BLOCK_KP:
+			options->translate_opt_block_KP = true;
+			return 0;
+
+		case TR31_TOOL_OPTION_TRANSLATE_DROP_OPT_BLOCKS:
+			options->translate_drop_opt_blocks = true;
+			return 0;
+
+		case TR31_TOOL_OPTION_INPUT:
+			options->input_path = arg;
+			return 0;
+
+		case TR31_TOOL_OPTION_OUTPUT:
+			options->output_path = arg;
+			return 0;
+
+		case TR31_TOOL_OPTION_JOBS: {
+			char* endptr = NULL;
+			unsigned long jobs;
+
+			jobs = strtoul(arg, &endptr, 10);
+			if (!isdigit((unsigned char)arg[0]) ||
+				*endptr ||
+				jobs < 1 ||
+				jobs > TR31_TOOL_BULK_MAX_JOBS
+			) {
+				argp_error(state, "Number of jobs must be from 1 to %u", TR31_TOOL_BULK_MAX_JOBS);
+			}
+			options->jobs = jobs;
+			return 0;
+		}
+
 		case TR31_TOOL_OPTION_KBPK:
 			if (strlen(arg) > sizeof(options->kbpk_buf) * 2) {
 				argp_error(state, "KEY string may not have more than %zu digits (thus %zu bytes)",
@@ -233,7 +414,7 @@ static error_t argp_parser_helper(int key, char* arg, struct argp_state* state)
 			}
 			options->kbpk_buf_len = strlen(arg) / 2;
 
-			r = parse_hex(arg, options->kbpk_buf, options->kbpk_buf_len);
+			r = tr31_hex_to_bin(arg, options->kbpk_buf, options->kbpk_buf_len);
 			if (r) {
 				argp_error(state, "KEY string must consist of hex digits");
 			}
@@ -255,24 +436,66 @@ static error_t argp_parser_helper(int key, char* arg, struct argp_state* state)
 		}
 
 		case ARGP_KEY_END: {
+			bool export = options->export || options->bulk_export;
+			unsigned int mode_count = options->import + options->export + options->bulk_import + options->bulk_export + options->translate;
+
 			// check for required options
-			if (!options->import && !options->export) {
-				argp_error(state, "Either --import option or --export option is required");
+			if (!mode_count) {
+				argp_error(state, "Either --import, --export, --bulk-import, --bulk-export or --translate option is required");
 			}
 
 			// check for conflicting options
-			if (options->import && options->export) {
-				argp_error(state, "The --import option and --export option cannot be specified simultaneously");
+			if (mode_count > 1) {
+				argp_error(state, "The --import, --export, --bulk-import, --bulk-export and --translate options cannot be specified simultaneously");
+			}
+
+			// check for bulk options
+			if ((options->input_path || options->output_path || options->jobs) &&
+				!options->bulk_import &&
+				!options->bulk_export &&
+				!options->translate
+			) {
+				argp_error(state, "The --input, --output and --jobs options require either --bulk-import, --bulk-export or --translate");
+			}
+			if (options->bulk_export && !options->kbpk) {
+				argp_error(state, "The --bulk-export option requires --kbpk");
+			}
+
+			// check for translate options
+			if (options->translate &&
+				(!options->kbpk || !options->translate_kbpk_buf_len)
+			) {
+				argp_error(state, "The --translate option requires --kbpk and --translate-kbpk");
+			}
+			if ((options->translate_kbpk_buf_len ||
+				options->translate_format_version ||
+				options->translate_exportability ||
+				options->translate_opt_block_KC ||
+				options->translate_opt_block_KP ||
+				options->translate_drop_opt_blocks) &&
+				!options->translate
+			) {
+				argp_error(state, "The --translate-* options require --translate");
+			}
+
+			// check for output options
+			if (options->format != TR31_TOOL_FORMAT_TEXT && options->export) {
+				argp_error(state, "The --format option requires either --import, --bulk-import, --bulk-export or --translate");
+			}
+			if (options->omit_key &&
+				(options->format == TR31_TOOL_FORMAT_TEXT || (!options->import && !options->bulk_import))
+			) {
+				argp_error(state, "The --omit-key option requires --format jsonl or csv, and either --import or --bulk-import");
 			}
 
 			// check for required --export options
-			if (options->export &&
+			if (export &&
 				(!options->export_key_algorithm || !options->export_format_version || !options->export_template) &&
 				!options->export_header
 			) {
-				argp_error(state, "The --export option requires either --export-key-algorithm, --export-format-version and --export-template, or only --export-header");
+				argp_error(state, "The --export and --bulk-export options require either --export-key-algorithm, --export-format-version and --export-template, or only --export-header");
 			}
-			if (options->export &&
+			if (export &&
 				options->export_template &&
 				strcmp(options->export_template, "IK") == 0 &&
 				!options->export_opt_block_IK_buf_len &&
@@ -282,7 +505,7 @@ static error_t argp_parser_helper(int key, char* arg, struct argp_state* state)
 			}
 
 			// check for conflicting --export options
-			if (options->export && options->export_template && options->export_header) {
+			if (export && options->export_template && options->export_header) {
 				argp_error(state, "The --export-template option and --export-header option cannot be specified simultaneously");
 			}
 
@@ -294,40 +517,303 @@ static error_t argp_parser_helper(int key, char* arg, struct argp_state* state)
 	}
 }
 
-// hex parser helper function
-static int parse_hex(const char* hex, void* bin, size_t bin_len)
+// hex output helper function
+static void print_hex(FILE* f, const void* buf, size_t length)
 {
-	size_t hex_len = bin_len * 2;
+	const uint8_t* ptr = buf;
+	char hex[64];
 
-	for (size_t i = 0; i < hex_len; ++i) {
-		if (!isxdigit(hex[i])) {
-			return -1;
+	while (length) {
+		size_t chunk_len = length < sizeof(hex) / 2 ? length : sizeof(hex) / 2;
+
+		tr31_bin_to_hex(ptr, chunk_len, hex, sizeof(hex));
+		fwrite(hex, 1, chunk_len * 2, f);
+
+		ptr += chunk_len;
+		length -= chunk_len;
+	}
+}
+
+// structured record output state
+struct tr31_tool_record_t {
+	FILE* f;
+	enum tr31_tool_format_t format;
+	unsigned int field_count;
+};
+
+// fields of import records
+static const char* const import_record_fields[] = {
+	"status",
+	"error",
+	"version",
+	"length",
+	"key_usage",
+	"algorithm",
+	"mode_of_use",
+	"key_version",
+	"exportability",
+	"opt_blocks",
+	"key",
+	"kcv",
+};
+
+// fields of export records
+static const char* const export_record_fields[] = {
+	"status",
+	"error",
+	"key_block",
+};
+
+static void print_json_string(FILE* f, const char* str)
+{
+	fputc('"', f);
+	for (; *str; ++str) {
+		unsigned char c = *str;
+
+		if (c == '"' || c == '\\') {
+			fputc('\\', f);
+			fputc(c, f);
+		} else if (c < 0x20) {
+			fprintf(f, "\\u%04x", c);
+		} else {
+			fputc(c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+static void print_csv_string(FILE* f, const char* str)
+{
+	if (!strpbrk(str, ",\"\r\n")) {
+		fputs(str, f);
+		return;
+	}
+
+	// quote field and escape quotes by doubling them
+	fputc('"', f);
+	for (; *str; ++str) {
+		if (*str == '"') {
+			fputc('"', f);
 		}
+		fputc(*str, f);
 	}
+	fputc('"', f);
+}
 
-	while (*hex && bin_len--) {
-		uint8_t* ptr = bin;
+static void record_begin(struct tr31_tool_record_t* rec, FILE* f, enum tr31_tool_format_t format)
+{
+	rec->f = f;
+	rec->format = format;
+	rec->field_count = 0;
+	if (rec->format == TR31_TOOL_FORMAT_JSONL) {
+		fputc('{', rec->f);
+	}
+}
 
-		char str[3];
-		strncpy(str, hex, 2);
-		str[2] = 0;
+static void record_field_begin(struct tr31_tool_record_t* rec, const char* name)
+{
+	if (rec->field_count++) {
+		fputc(',', rec->f);
+	}
+	if (rec->format == TR31_TOOL_FORMAT_JSONL) {
+		print_json_string(rec->f, name);
+		fputc(':', rec->f);
+	}
+}
 
-		*ptr = strtoul(str, NULL, 16);
+static void record_end(struct tr31_tool_record_t* rec)
+{
+	if (rec->format == TR31_TOOL_FORMAT_JSONL) {
+		fputc('}', rec->f);
+	}
+	fputc('\n', rec->f);
+}
 
-		hex += 2;
-		++bin;
+static void record_skip(struct tr31_tool_record_t* rec, const char* name)
+{
+	// JSON omits unavailable fields while CSV requires an empty column
+	if (rec->format == TR31_TOOL_FORMAT_CSV) {
+		record_field_begin(rec, name);
 	}
+}
 
-	return 0;
+static void record_string(struct tr31_tool_record_t* rec, const char* name, const char* str)
+{
+	record_field_begin(rec, name);
+	if (rec->format == TR31_TOOL_FORMAT_JSONL) {
+		print_json_string(rec->f, str);
+	} else {
+		print_csv_string(rec->f, str);
+	}
 }
 
-// hex output helper function
-static void print_hex(const void* buf, size_t length)
+static void record_char(struct tr31_tool_record_t* rec, const char* name, unsigned int c)
 {
-	const uint8_t* ptr = buf;
-	for (size_t i = 0; i < length; i++) {
-		printf("%02X", ptr[i]);
+	char str[2] = { c, 0 };
+	record_string(rec, name, str);
+}
+
+static void record_number(struct tr31_tool_record_t* rec, const char* name, size_t value)
+{
+	record_field_begin(rec, name);
+	fprintf(rec->f, "%zu", value);
+}
+
+static void record_hex(struct tr31_tool_record_t* rec, const char* name, const void* buf, size_t length)
+{
+	record_field_begin(rec, name);
+	if (rec->format == TR31_TOOL_FORMAT_JSONL) {
+		fputc('"', rec->f);
+	}
+	print_hex(rec->f, buf, length);
+	if (rec->format == TR31_TOOL_FORMAT_JSONL) {
+		fputc('"', rec->f);
+	}
+}
+
+static void print_record_header(FILE* f, const struct tr31_tool_options_t* options, bool line_number)
+{
+	const char* const* fields;
+	size_t field_count;
+
+	// only CSV has a header
+	if (options->format != TR31_TOOL_FORMAT_CSV) {
+		return;
+	}
+
+	if (options->import || options->bulk_import) {
+		fields = import_record_fields;
+		field_count = sizeof(import_record_fields) / sizeof(import_record_fields[0]);
+	} else {
+		fields = export_record_fields;
+		field_count = sizeof(export_record_fields) / sizeof(export_record_fields[0]);
+	}
+
+	if (line_number) {
+		fputs("line,", f);
 	}
+	for (size_t i = 0; i < field_count; ++i) {
+		if (i) {
+			fputc(',', f);
+		}
+		fputs(fields[i], f);
+	}
+	fputc('\n', f);
+}
+
+static void print_import_record(
+	FILE* f,
+	const struct tr31_tool_options_t* options,
+	size_t line_number,
+	const char* error,
+	struct tr31_ctx_t* tr31_ctx
+)
+{
+	struct tr31_tool_record_t rec;
+	char ascii_buf[3]; // temporary ascii buffer
+
+	record_begin(&rec, f, options->format);
+	if (line_number) {
+		record_number(&rec, "line", line_number);
+	}
+
+	if (error) {
+		record_string(&rec, "status", "ERROR");
+		record_string(&rec, "error", error);
+		for (size_t i = 2; i < sizeof(import_record_fields) / sizeof(import_record_fields[0]); ++i) {
+			record_skip(&rec, import_record_fields[i]);
+		}
+		record_end(&rec);
+		return;
+	}
+
+	// header fields
+	record_string(&rec, "status", "OK");
+	record_skip(&rec, "error");
+	record_char(&rec, "version", tr31_ctx->version);
+	record_number(&rec, "length", tr31_ctx->length);
+	record_string(&rec, "key_usage", tr31_get_key_usage_ascii(tr31_ctx->key.usage, ascii_buf, sizeof(ascii_buf)));
+	record_char(&rec, "algorithm", tr31_ctx->key.algorithm);
+	record_char(&rec, "mode_of_use", tr31_ctx->key.mode_of_use);
+	if (tr31_key_get_key_version(&tr31_ctx->key, ascii_buf) == 0) {
+		ascii_buf[2] = 0;
+		record_string(&rec, "key_version", ascii_buf);
+	} else {
+		record_skip(&rec, "key_version");
+	}
+	record_char(&rec, "exportability", tr31_ctx->key.exportability);
+
+	// optional blocks as JSON array of objects or as CSV list of ID=DATA
+	record_field_begin(&rec, "opt_blocks");
+	if (rec.format == TR31_TOOL_FORMAT_JSONL) {
+		fputc('[', f);
+	}
+	for (size_t i = 0; tr31_ctx->opt_blocks && i < tr31_ctx->opt_blocks_count; ++i) {
+		const char* id = tr31_get_opt_block_id_ascii(tr31_ctx->opt_blocks[i].id, ascii_buf, sizeof(ascii_buf));
+
+		if (rec.format == TR31_TOOL_FORMAT_JSONL) {
+			fputs(i ? ",{\"id\":" : "{\"id\":", f);
+			print_json_string(f, id);
+			fputs(",\"data\":\"", f);
+			print_hex(f, tr31_ctx->opt_blocks[i].data, tr31_ctx->opt_blocks[i].data_length);
+			fputs("\"}", f);
+		} else {
+			if (i) {
+				fputc(';', f);
+			}
+			fputs(id, f);
+			fputc('=', f);
+			print_hex(f, tr31_ctx->opt_blocks[i].data, tr31_ctx->opt_blocks[i].data_length);
+		}
+	}
+	if (rec.format == TR31_TOOL_FORMAT_JSONL) {
+		fputc(']', f);
+	}
+
+	// decrypted key and KCV, if available
+	if (tr31_ctx->key.data && tr31_ctx->key.length) {
+		if (options->omit_key) {
+			record_skip(&rec, "key");
+		} else {
+			record_hex(&rec, "key", tr31_ctx->key.data, tr31_ctx->key.length);
+		}
+		if (tr31_key_get_kcv(&tr31_ctx->key) == 0) {
+			record_hex(&rec, "kcv", tr31_ctx->key.kcv, tr31_ctx->key.kcv_len);
+		} else {
+			record_skip(&rec, "kcv");
+		}
+	} else {
+		record_skip(&rec, "key");
+		record_skip(&rec, "kcv");
+	}
+
+	record_end(&rec);
+}
+
+static void print_export_record(
+	FILE* f,
+	const struct tr31_tool_options_t* options,
+	size_t line_number,
+	const char* error,
+	const char* key_block
+)
+{
+	struct tr31_tool_record_t rec;
+
+	record_begin(&rec, f, options->format);
+	if (line_number) {
+		record_number(&rec, "line", line_number);
+	}
+	if (error) {
+		record_string(&rec, "status", "ERROR");
+		record_string(&rec, "error", error);
+		record_skip(&rec, "key_block");
+	} else {
+		record_string(&rec, "status", "OK");
+		record_skip(&rec, "error");
+		record_string(&rec, "key_block", key_block);
+	}
+	record_end(&rec);
 }
 
 // TR-31 KBPK populating helper function
@@ -392,6 +878,19 @@ static int do_tr31_import(const struct tr31_tool_options_t* options)
 		// parse TR-31 key block
 		r = tr31_import(options->key_block, NULL, &tr31_ctx);
 	}
+
+	if (options->format != TR31_TOOL_FORMAT_TEXT) {
+		// print key block record
+		print_record_header(stdout, options, false);
+		print_import_record(stdout, options, 0, r ? tr31_get_error_string(r) : NULL, &tr31_ctx);
+
+		// cleanup
+		tr31_key_release(&kbpk);
+		tr31_release(&tr31_ctx);
+
+		return 0;
+	}
+
 	// check for errors
 	if (r) {
 		fprintf(stderr, "TR-31 import error %d: %s\n", r, tr31_get_error_string(r));
@@ -441,10 +940,10 @@ static int do_tr31_import(const struct tr31_tool_options_t* options)
 			) {
 				// for optional blocks involving KCVs, skip the first byte (KCV algorithm)
 				// the first byte will be decoded by tr31_get_opt_block_data_string()
-				print_hex(tr31_ctx.opt_blocks[i].data + 1, tr31_ctx.opt_blocks[i].data_length - 1);
+				print_hex(stdout, tr31_ctx.opt_blocks[i].data + 1, tr31_ctx.opt_blocks[i].data_length - 1);
 			} else {
 				// print all optional block data
-				print_hex(tr31_ctx.opt_blocks[i].data, tr31_ctx.opt_blocks[i].data_length);
+				print_hex(stdout, tr31_ctx.opt_blocks[i].data, tr31_ctx.opt_blocks[i].data_length);
 			}
 
 			opt_block_data_str = tr31_get_opt_block_data_string(&tr31_ctx.opt_blocks[i]);
@@ -461,10 +960,10 @@ static int do_tr31_import(const struct tr31_tool_options_t* options)
 		if (tr31_ctx.key.data) {
 			printf("Key length: %zu\n", tr31_ctx.key.length);
 			printf("Key value: ");
-			print_hex(tr31_ctx.key.data, tr31_ctx.key.length);
-			if (tr31_ctx.key.kcv_len) {
+			print_hex(stdout, tr31_ctx.key.data, tr31_ctx.key.length);
+			if (tr31_key_get_kcv(&tr31_ctx.key) == 0) {
 				printf(" (KCV: ");
-				print_hex(tr31_ctx.key.kcv, tr31_ctx.key.kcv_len);
+				print_hex(stdout, tr31_ctx.key.kcv, tr31_ctx.key.kcv_len);
 				printf(")");
 			}
 			printf("\n");
@@ -483,7 +982,12 @@ static int do_tr31_import(const struct tr31_tool_options_t* options)
 }
 
 // TR-31 export template helper function
-static int populate_tr31_from_template(const struct tr31_tool_options_t* options, struct tr31_ctx_t* tr31_ctx)
+static int populate_tr31_from_template(
+	const struct tr31_tool_options_t* options,
+	const void* key_data,
+	size_t key_data_len,
+	struct tr31_ctx_t* tr31_ctx
+)
 {
 	int r;
 	struct tr31_key_t key;
@@ -527,8 +1031,8 @@ static int populate_tr31_from_template(const struct tr31_tool_options_t* options
 
 	// populate key data
 	// avoid tr31_key_set_data() here to avoid tr31_key_release() later
-	key.length = options->export_key_buf_len;
-	key.data = (void*)options->export_key_buf;
+	key.length = key_data_len;
+	key.data = (void*)key_data;
 
 	// populate TR-31 context object
 	r = tr31_init(options->export_format_version, &key, tr31_ctx);
@@ -541,7 +1045,12 @@ static int populate_tr31_from_template(const struct tr31_tool_options_t* options
 }
 
 // TR-31 export header helper function
-static int populate_tr31_from_header(const struct tr31_tool_options_t* options, struct tr31_ctx_t* tr31_ctx)
+static int populate_tr31_from_header(
+	const struct tr31_tool_options_t* options,
+	const void* key_data,
+	size_t key_data_len,
+	struct tr31_ctx_t* tr31_ctx
+)
 {
 	int r;
 
@@ -575,7 +1084,7 @@ static int populate_tr31_from_header(const struct tr31_tool_options_t* options,
 	}
 
 	// populate key data
-	r = tr31_key_set_data(&tr31_ctx->key, options->export_key_buf, options->export_key_buf_len);
+	r = tr31_key_set_data(&tr31_ctx->key, key_data, key_data_len);
 	if (r) {
 		fprintf(stderr, "tr31_key_set_data() failed; r=%d\n", r);
 		return 1;
@@ -649,14 +1158,14 @@ static int do_tr31_export(const struct tr31_tool_options_t* options)
 		export_format_version = options->export_format_version;
 
 		// populate key from template
-		r = populate_tr31_from_template(options, &tr31_ctx);
+		r = populate_tr31_from_template(options, options->export_key_buf, options->export_key_buf_len, &tr31_ctx);
 
 	} else if (options->export_header) {
 		// header determines the TR-31 format version to use
 		export_format_version = options->export_header[0];
 
 		// populate key from TR-31 header
-		r = populate_tr31_from_header(options, &tr31_ctx);
+		r = populate_tr31_from_header(options, options->export_key_buf, options->export_key_buf_len, &tr31_ctx);
 
 	} else {
 		// Internal error
@@ -694,6 +1203,856 @@ static int do_tr31_export(const struct tr31_tool_options_t* options)
 	return 0;
 }
 
+// prepared key block protection key for bulk processing
+struct tr31_tool_bulk_kbpk_t {
+	bool ready; // whether preparation was attempted
+	int error; // preparation result
+	struct tr31_kbpk_t* kbpk;
+};
+
+// bulk processing state
+struct tr31_tool_bulk_t {
+	const struct tr31_tool_options_t* options;
+	FILE* out;
+	size_t line_number;
+
+	// key block protection keys are prepared once per algorithm, on first
+	// use, because the KBPK algorithm depends on the format version of each
+	// key block
+	struct tr31_tool_bulk_kbpk_t kbpk_tdes;
+	struct tr31_tool_bulk_kbpk_t kbpk_aes;
+
+	// key block protection keys for translated key blocks
+	struct tr31_tool_bulk_kbpk_t translate_kbpk_tdes;
+	struct tr31_tool_bulk_kbpk_t translate_kbpk_aes;
+};
+
+// bulk KBPK helper function
+static int bulk_get_kbpk(struct tr31_tool_bulk_t* bulk, bool translate, unsigned int format_version, struct tr31_kbpk_t** kbpk)
+{
+	struct tr31_tool_bulk_kbpk_t* bulk_kbpk;
+	unsigned int algorithm;
+	const uint8_t* kbpk_buf;
+	size_t kbpk_buf_len;
+	struct tr31_key_t key;
+
+	// determine key block protection key algorithm from keyblock format version
+	switch (format_version) {
+		case TR31_VERSION_A:
+		case TR31_VERSION_B:
+		case TR31_VERSION_C:
+			bulk_kbpk = translate ? &bulk->translate_kbpk_tdes : &bulk->kbpk_tdes;
+			algorithm = TR31_KEY_ALGORITHM_TDES;
+			break;
+
+		case TR31_VERSION_D:
+			bulk_kbpk = translate ? &bulk->translate_kbpk_aes : &bulk->kbpk_aes;
+			algorithm = TR31_KEY_ALGORITHM_AES;
+			break;
+
+		default:
+			return TR31_ERROR_UNSUPPORTED_VERSION;
+	}
+
+	if (translate) {
+		kbpk_buf = bulk->options->translate_kbpk_buf;
+		kbpk_buf_len = bulk->options->translate_kbpk_buf_len;
+	} else {
+		kbpk_buf = bulk->options->kbpk_buf;
+		kbpk_buf_len = bulk->options->kbpk_buf_len;
+	}
+
+	if (!bulk_kbpk->ready) {
+		bulk_kbpk->ready = true;
+		bulk_kbpk->error = tr31_key_init(
+			TR31_KEY_USAGE_TR31_KBPK,
+			algorithm,
+			TR31_KEY_MODE_OF_USE_ENC_DEC,
+			"00",
+			TR31_KEY_EXPORT_NONE,
+			kbpk_buf,
+			kbpk_buf_len,
+			&key
+		);
+		if (!bulk_kbpk->error) {
+			bulk_kbpk->error = tr31_kbpk_prepare(&key, &bulk_kbpk->kbpk);
+			tr31_key_release(&key);
+		}
+	}
+
+	*kbpk = bulk_kbpk->kbpk;
+	return bulk_kbpk->error;
+}
+
+// bulk KBPK cleanup helper function
+static void bulk_release(struct tr31_tool_bulk_t* bulk)
+{
+	tr31_kbpk_free(bulk->kbpk_tdes.kbpk);
+	tr31_kbpk_free(bulk->kbpk_aes.kbpk);
+	tr31_kbpk_free(bulk->translate_kbpk_tdes.kbpk);
+	tr31_kbpk_free(bulk->translate_kbpk_aes.kbpk);
+}
+
+// bulk error output helper function
+static void bulk_write_error(struct tr31_tool_bulk_t* bulk, const char* error)
+{
+	if (bulk->options->format == TR31_TOOL_FORMAT_TEXT) {
+		fprintf(bulk->out, "%zu\tERROR\t%s\n", bulk->line_number, error);
+	} else if (bulk->options->bulk_import) {
+		print_import_record(bulk->out, bulk->options, bulk->line_number, error, NULL);
+	} else {
+		print_export_record(bulk->out, bulk->options, bulk->line_number, error, NULL);
+	}
+}
+
+// bulk TR-31 import helper function
+static int bulk_import_line(struct tr31_tool_bulk_t* bulk, const char* line, size_t line_len)
+{
+	int r;
+	struct tr31_kbpk_t* kbpk;
+	struct tr31_ctx_t tr31_ctx;
+
+	// ensure that the context object can be released regardless of where
+	// the import failed
+	memset(&tr31_ctx, 0, sizeof(tr31_ctx));
+
+	if (bulk->options->kbpk) { // if key block protection key was provided
+		r = bulk_get_kbpk(bulk, false, line[0], &kbpk);
+		if (r) {
+			bulk_write_error(bulk, tr31_get_error_string(r));
+			return 0;
+		}
+
+		// parse and decrypt TR-31 key block
+		r = tr31_import_buf_prepared(line, line_len, kbpk, &tr31_ctx);
+	} else { // else if no key block protection key was provided
+		// parse TR-31 key block
+		r = tr31_import_buf(line, line_len, NULL, &tr31_ctx);
+	}
+	if (r) {
+		bulk_write_error(bulk, tr31_get_error_string(r));
+		tr31_release(&tr31_ctx);
+		return 0;
+	}
+
+	if (bulk->options->format != TR31_TOOL_FORMAT_TEXT) {
+		print_import_record(bulk->out, bulk->options, bulk->line_number, NULL, &tr31_ctx);
+		tr31_release(&tr31_ctx);
+		return 0;
+	}
+
+	// print decrypted key and KCV, if available
+	fprintf(bulk->out, "%zu\tOK\t", bulk->line_number);
+	if (tr31_ctx.key.data && tr31_ctx.key.length) {
+		print_hex(bulk->out, tr31_ctx.key.data, tr31_ctx.key.length);
+		fputc('\t', bulk->out);
+		if (tr31_key_get_kcv(&tr31_ctx.key) == 0) {
+			print_hex(bulk->out, tr31_ctx.key.kcv, tr31_ctx.key.kcv_len);
+		}
+	} else {
+		fputc('\t', bulk->out);
+	}
+	fputc('\n', bulk->out);
+
+	tr31_release(&tr31_ctx);
+	return 0;
+}
+
+// bulk TR-31 export helper function
+static int bulk_export_line(struct tr31_tool_bulk_t* bulk, const char* line, size_t line_len)
+{
+	int r;
+	const struct tr31_tool_options_t* options = bulk->options;
+	uint8_t key_buf[32]; // max 256-bit wrapped key
+	size_t key_len;
+	unsigned int export_format_version;
+	struct tr31_kbpk_t* kbpk;
+	struct tr31_ctx_t tr31_ctx;
+	char key_block[1024];
+
+	// parse key to be exported
+	if (line_len > sizeof(key_buf) * 2 || line_len % 2 != 0) {
+		bulk_write_error(bulk, "Invalid KEY length");
+		return 0;
+	}
+	key_len = line_len / 2;
+	r = tr31_hex_to_bin(line, key_buf, key_len);
+	if (r) {
+		bulk_write_error(bulk, "KEY must consist of hex digits");
+		return 0;
+	}
+
+	// populate TR-31 context object
+	// failures are due to the export options, not the current line, and
+	// therefore processing is stopped
+	if (options->export_template) {
+		// options determine the TR-31 format version to use
+		export_format_version = options->export_format_version;
+
+		// populate key from template
+		r = populate_tr31_from_template(options, key_buf, key_len, &tr31_ctx);
+
+	} else {
+		// header determines the TR-31 format version to use
+		export_format_version = options->export_header[0];
+
+		// populate key from TR-31 header
+		r = populate_tr31_from_header(options, key_buf, key_len, &tr31_ctx);
+	}
+	memset(key_buf, 0, sizeof(key_buf));
+	if (r) {
+		return r;
+	}
+
+	// populate additional optional blocks
+	r = populate_opt_blocks(options, &tr31_ctx);
+	if (r) {
+		tr31_release(&tr31_ctx);
+		return r;
+	}
+
+	// export TR-31 key block
+	r = bulk_get_kbpk(bulk, false, export_format_version, &kbpk);
+	if (!r) {
+		r = tr31_export_prepared(&tr31_ctx, kbpk, key_block, sizeof(key_block));
+	}
+	if (r) {
+		bulk_write_error(bulk, tr31_get_error_string(r));
+	} else if (options->format != TR31_TOOL_FORMAT_TEXT) {
+		print_export_record(bulk->out, options, bulk->line_number, NULL, key_block);
+	} else {
+		fprintf(bulk->out, "%zu\tOK\t%s\n", bulk->line_number, key_block);
+	}
+
+	tr31_release(&tr31_ctx);
+	return 0;
+}
+
+// bulk TR-31 translate helper function
+static int bulk_translate_line(struct tr31_tool_bulk_t* bulk, const char* line, size_t line_len)
+{
+	int r;
+	const struct tr31_tool_options_t* options = bulk->options;
+	struct tr31_translate_t translate;
+	struct tr31_kbpk_t* import_kbpk;
+	struct tr31_kbpk_t* export_kbpk;
+	char key_block[10000]; // max key block length
+
+	memset(&translate, 0, sizeof(translate));
+	translate.version = options->translate_format_version;
+	translate.exportability = options->translate_exportability;
+	if (options->translate_drop_opt_blocks) {
+		translate.flags |= TR31_TRANSLATE_DROP_OPT_BLOCKS;
+	}
+	if (options->translate_opt_block_KC) {
+		translate.flags |= TR31_TRANSLATE_ADD_KC;
+	}
+	if (options->translate_opt_block_KP) {
+		translate.flags |= TR31_TRANSLATE_ADD_KP;
+	}
+
+	// the output format version determines the algorithm of the translation
+	// KBPK and defaults to the format version of the input key block
+	r = bulk_get_kbpk(bulk, false, line[0], &import_kbpk);
+	if (!r) {
+		r = bulk_get_kbpk(
+			bulk,
+			true,
+			translate.version ? translate.version : (unsigned char)line[0],
+			&export_kbpk
+		);
+	}
+	if (!r) {
+		// decrypt and encrypt TR-31 key block
+		r = tr31_translate_prepared(
+			line,
+			line_len,
+			import_kbpk,
+			export_kbpk,
+			&translate,
+			key_block,
+			sizeof(key_block)
+		);
+	}
+	if (r) {
+		bulk_write_error(bulk, tr31_get_error_string(r));
+	} else if (options->format != TR31_TOOL_FORMAT_TEXT) {
+		print_export_record(bulk->out, options, bulk->line_number, NULL, key_block);
+	} else {
+		fprintf(bulk->out, "%zu\tOK\t%s\n", bulk->line_number, key_block);
+	}
+
+	return 0;
+}
+
+// bulk input state
+struct tr31_tool_bulk_input_t {
+	// input stream; used if input file is not mapped
+	FILE* in;
+	char* line;
+	size_t line_size;
+
+	// input file mapping; lines are parsed directly from the mapping
+	const char* map;
+	size_t map_len;
+	size_t map_pos;
+
+	size_t line_number;
+};
+
+// bulk input line
+struct tr31_tool_bulk_line_t {
+	size_t line_number;
+	size_t offset; // offset of line in job input data or input file mapping
+	size_t len;
+};
+
+// bulk processing job
+struct tr31_tool_bulk_job_t {
+	// each job has its own processing state, including prepared key block
+	// protection keys, because these are not thread safe
+	struct tr31_tool_bulk_t bulk;
+
+	// chunk of input lines to be processed
+	// lines are copied to data unless the input file is mapped
+	const char* base; // either data or input file mapping
+	char* data;
+	size_t data_len;
+	size_t data_size;
+	struct tr31_tool_bulk_line_t* lines;
+	size_t line_count;
+
+	// results of processing
+	// results are written to out_buf using bulk.out
+	char* out_buf;
+	size_t out_len;
+	size_t out_size;
+	int r;
+
+#ifdef HAVE_PTHREAD
+	pthread_t thread;
+	bool thread_valid;
+#endif
+};
+
+// bulk input helper function
+// returns the next non-empty line, or NULL at the end of the input
+static const char* bulk_read_line(struct tr31_tool_bulk_input_t* input, size_t* line_len)
+{
+	ssize_t r;
+
+	if (input->map) {
+		while (input->map_pos < input->map_len) {
+			const char* line = input->map + input->map_pos;
+			const char* line_end;
+			size_t len;
+
+			++input->line_number;
+			line_end = memchr(line, '\n', input->map_len - input->map_pos);
+			if (line_end) {
+				len = line_end - line;
+				input->map_pos += len + 1;
+			} else {
+				len = input->map_len - input->map_pos;
+				input->map_pos += len;
+			}
+
+			// ignore line ending and surrounding whitespace because the
+			// mapping is read-only
+			while (len && isspace((unsigned char)line[0])) {
+				++line;
+				--len;
+			}
+			while (len && isspace((unsigned char)line[len - 1])) {
+				--len;
+			}
+			if (!len) {
+				// skip empty lines
+				continue;
+			}
+
+			*line_len = len;
+			return line;
+		}
+
+		return NULL;
+	}
+
+	while ((r = getline(&input->line, &input->line_size, input->in)) >= 0) {
+		++input->line_number;
+
+		const char* line = input->line;
+
+		// remove line ending and surrounding whitespace
+		while (r && isspace((unsigned char)input->line[r - 1])) {
+			input->line[--r] = 0;
+		}
+		while (r && isspace((unsigned char)line[0])) {
+			++line;
+			--r;
+		}
+		if (!r) {
+			// skip empty lines
+			continue;
+		}
+
+		*line_len = r;
+		return line;
+	}
+
+	return NULL;
+}
+
+// bulk line processing helper function
+static int bulk_process_line(struct tr31_tool_bulk_t* bulk, const char* line, size_t line_len)
+{
+	if (bulk->options->bulk_import) {
+		return bulk_import_line(bulk, line, line_len);
+	} else if (bulk->options->translate) {
+		return bulk_translate_line(bulk, line, line_len);
+	} else {
+		return bulk_export_line(bulk, line, line_len);
+	}
+}
+
+// serial bulk processing helper function
+static int bulk_run_serial(const struct tr31_tool_options_t* options, struct tr31_tool_bulk_input_t* input, FILE* out)
+{
+	int r = 0;
+	struct tr31_tool_bulk_t bulk;
+	const char* line;
+	size_t line_len;
+
+	memset(&bulk, 0, sizeof(bulk));
+	bulk.options = options;
+	bulk.out = out;
+
+	while ((line = bulk_read_line(input, &line_len))) {
+		bulk.line_number = input->line_number;
+		r = bulk_process_line(&bulk, line, line_len);
+		if (r) {
+			fprintf(stderr, "Failed to process line %zu\n", bulk.line_number);
+			break;
+		}
+	}
+
+	bulk_release(&bulk);
+
+	return r;
+}
+
+// bulk job input helper function
+static int bulk_job_add_line(
+	struct tr31_tool_bulk_job_t* job,
+	const struct tr31_tool_bulk_input_t* input,
+	const char* line,
+	size_t line_len
+)
+{
+	struct tr31_tool_bulk_line_t* job_line;
+
+	if (input->map) {
+		// refer to line in input file mapping instead of copying it
+		job_line = &job->lines[job->line_count++];
+		job_line->line_number = input->line_number;
+		job_line->offset = line - input->map;
+		job_line->len = line_len;
+		return 0;
+	}
+
+	if (job->data_len + line_len + 1 > job->data_size) {
+		size_t data_size = job->data_size ? job->data_size : 64 * 1024;
+		char* data;
+
+		while (data_size < job->data_len + line_len + 1) {
+			data_size *= 2;
+		}
+
+		// input may contain key values and therefore the previous buffer
+		// is cleared instead of using realloc()
+		data = malloc(data_size);
+		if (!data) {
+			return -1;
+		}
+		if (job->data) {
+			memcpy(data, job->data, job->data_len);
+			memset(job->data, 0, job->data_size);
+			free(job->data);
+		}
+		job->data = data;
+		job->data_size = data_size;
+	}
+
+	job_line = &job->lines[job->line_count++];
+	job_line->line_number = input->line_number;
+	job_line->offset = job->data_len;
+	job_line->len = line_len;
+	memcpy(job->data + job->data_len, line, line_len);
+	job->data_len += line_len;
+	job->data[job->data_len++] = 0;
+
+	return 0;
+}
+
+// bulk job output helper function
+// retains the current output and positions the output stream after it
+static int bulk_job_grow_output(struct tr31_tool_bulk_job_t* job)
+{
+	size_t out_size = job->out_size ? job->out_size * 2 : TR31_TOOL_BULK_OUTPUT_SIZE;
+	char* out_buf;
+	FILE* f;
+
+	out_buf = malloc(out_size);
+	if (!out_buf) {
+		return -1;
+	}
+	f = fmemopen(out_buf, out_size, "r+");
+	if (!f) {
+		free(out_buf);
+		return -1;
+	}
+	// write directly to the output buffer such that no stdio buffer
+	// contains key values
+	setvbuf(f, NULL, _IONBF, 0);
+
+	// output may contain key values and therefore the previous buffer is
+	// cleared instead of using realloc()
+	if (job->out_buf) {
+		memcpy(out_buf, job->out_buf, job->out_len);
+		fclose(job->bulk.out);
+		memset(job->out_buf, 0, job->out_size);
+		free(job->out_buf);
+	}
+	job->bulk.out = f;
+	job->out_buf = out_buf;
+	job->out_size = out_size;
+
+	if (fseek(f, job->out_len, SEEK_SET)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+// bulk job output helper function
+static void bulk_job_release_output(struct tr31_tool_bulk_job_t* job)
+{
+	if (job->bulk.out) {
+		fclose(job->bulk.out);
+		job->bulk.out = NULL;
+	}
+	if (job->out_buf) {
+		// output may contain key values
+		memset(job->out_buf, 0, job->out_size);
+		free(job->out_buf);
+		job->out_buf = NULL;
+	}
+	job->out_len = 0;
+	job->out_size = 0;
+}
+
+// bulk job output helper function
+// returns non-zero if the output of the current line did not fit
+static bool bulk_job_output_overflow(struct tr31_tool_bulk_job_t* job)
+{
+	long pos;
+
+	// output that reaches the end of the buffer may have been truncated
+	pos = ftell(job->bulk.out);
+	return ferror(job->bulk.out) || pos < 0 || (size_t)pos + 1 >= job->out_size;
+}
+
+// bulk job processing function
+// may be invoked by worker threads
+static void* bulk_job_run(void* arg)
+{
+	struct tr31_tool_bulk_job_t* job = arg;
+
+	// buffer results in memory such that they can be written in input order
+	// the output buffer is retained for subsequent chunks
+	job->bulk.line_number = job->lines[0].line_number;
+	job->out_len = 0;
+	if (!job->bulk.out) {
+		job->r = bulk_job_grow_output(job);
+		if (job->r) {
+			return NULL;
+		}
+	}
+	clearerr(job->bulk.out);
+	if (fseek(job->bulk.out, 0, SEEK_SET)) {
+		job->r = -1;
+		return NULL;
+	}
+
+	job->r = 0;
+	for (size_t i = 0; i < job->line_count; ++i) {
+		const struct tr31_tool_bulk_line_t* job_line = &job->lines[i];
+
+		job->bulk.line_number = job_line->line_number;
+		job->r = bulk_process_line(&job->bulk, job->base + job_line->offset, job_line->len);
+		while (!job->r && bulk_job_output_overflow(job)) {
+			// grow output buffer and process the same line again
+			clearerr(job->bulk.out);
+			job->r = bulk_job_grow_output(job);
+			if (!job->r) {
+				job->r = bulk_process_line(&job->bulk, job->base + job_line->offset, job_line->len);
+			}
+		}
+		if (job->r) {
+			break;
+		}
+		job->out_len = ftell(job->bulk.out);
+	}
+
+	return NULL;
+}
+
+// parallel bulk processing helper function
+static int bulk_run_parallel(const struct tr31_tool_options_t* options, struct tr31_tool_bulk_input_t* input, FILE* out)
+{
+	int r;
+	unsigned int job_count = options->jobs;
+	struct tr31_tool_bulk_job_t* jobs;
+	const char* line;
+	size_t line_len;
+	bool eof = false;
+
+	jobs = calloc(job_count, sizeof(*jobs));
+	if (!jobs) {
+		fprintf(stderr, "Failed to allocate bulk processing jobs\n");
+		return 1;
+	}
+	for (unsigned int i = 0; i < job_count; ++i) {
+		jobs[i].bulk.options = options;
+		jobs[i].lines = calloc(TR31_TOOL_BULK_CHUNK_LINES, sizeof(*jobs[i].lines));
+		if (!jobs[i].lines) {
+			fprintf(stderr, "Failed to allocate bulk processing jobs\n");
+			r = 1;
+			goto exit;
+		}
+	}
+
+	while (!eof) {
+		unsigned int active_count = 0;
+
+		// read the next chunk of input lines for each job
+		for (unsigned int i = 0; i < job_count && !eof; ++i) {
+			struct tr31_tool_bulk_job_t* job = &jobs[i];
+
+			job->data_len = 0;
+			job->line_count = 0;
+			while (job->line_count < TR31_TOOL_BULK_CHUNK_LINES) {
+				line = bulk_read_line(input, &line_len);
+				if (!line) {
+					eof = true;
+					break;
+				}
+
+				r = bulk_job_add_line(job, input, line, line_len);
+				if (r) {
+					fprintf(stderr, "Failed to allocate input buffer for line %zu\n", input->line_number);
+					r = 1;
+					goto exit;
+				}
+			}
+			if (job->line_count) {
+				job->base = input->map ? input->map : job->data;
+				++active_count;
+			}
+		}
+		if (!active_count) {
+			break;
+		}
+
+		// process chunks using worker threads while the calling thread
+		// processes the first chunk
+#ifdef HAVE_PTHREAD
+		for (unsigned int i = 1; i < active_count; ++i) {
+			jobs[i].thread_valid = pthread_create(&jobs[i].thread, NULL, &bulk_job_run, &jobs[i]) == 0;
+		}
+#endif
+		bulk_job_run(&jobs[0]);
+		for (unsigned int i = 1; i < active_count; ++i) {
+#ifdef HAVE_PTHREAD
+			if (jobs[i].thread_valid) {
+				pthread_join(jobs[i].thread, NULL);
+				jobs[i].thread_valid = false;
+				continue;
+			}
+#endif
+			// no thread available; the calling thread processes the chunk
+			bulk_job_run(&jobs[i]);
+		}
+
+		// write results in input order
+		for (unsigned int i = 0; i < active_count; ++i) {
+			struct tr31_tool_bulk_job_t* job = &jobs[i];
+
+			if (job->out_len &&
+				fwrite(job->out_buf, 1, job->out_len, out) != job->out_len
+			) {
+				fprintf(stderr, "Failed to write output\n");
+				r = 1;
+				goto exit;
+			}
+
+			if (job->r) {
+				// results of subsequent chunks are discarded such that the
+				// output is the same as for serial processing
+				fprintf(stderr, "Failed to process line %zu\n", job->bulk.line_number);
+				r = 1;
+				goto exit;
+			}
+		}
+	}
+
+	r = 0;
+	goto exit;
+
+exit:
+	for (unsigned int i = 0; i < job_count; ++i) {
+		struct tr31_tool_bulk_job_t* job = &jobs[i];
+
+		bulk_job_release_output(job);
+		if (job->data) {
+			// input may contain key values
+			memset(job->data, 0, job->data_size);
+			free(job->data);
+		}
+		free(job->lines);
+		bulk_release(&job->bulk);
+	}
+	free(jobs);
+
+	return r;
+}
+
+// bulk input mapping helper function
+// returns zero if the input file was mapped, or non-zero if the input file
+// must be read as a stream instead
+static int bulk_input_map(struct tr31_tool_bulk_input_t* input, const char* path)
+{
+#ifdef HAVE_MMAP
+	int fd;
+	struct stat st;
+	void* map;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	// only regular files that are not empty can be mapped
+	if (fstat(fd, &st) ||
+		!S_ISREG(st.st_mode) ||
+		st.st_size <= 0 ||
+		(uintmax_t)st.st_size > SIZE_MAX
+	) {
+		close(fd);
+		return 1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+
+	// input is processed once from beginning to end and therefore the
+	// kernel may read ahead aggressively and release processed pages early
+	posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	input->map = map;
+	input->map_len = st.st_size;
+	input->map_pos = 0;
+
+	return 0;
+#else
+	(void)input;
+	(void)path;
+	return 1;
+#endif
+}
+
+// TR-31 bulk helper function
+static int do_tr31_bulk(const struct tr31_tool_options_t* options)
+{
+	int r;
+	struct tr31_tool_bulk_input_t input;
+	FILE* out = stdout;
+
+	memset(&input, 0, sizeof(input));
+	input.in = stdin;
+
+	if (options->input_path && strcmp(options->input_path, "-") != 0) {
+		// map input file if possible to avoid copying the input
+		if (bulk_input_map(&input, options->input_path) == 0) {
+			input.in = NULL;
+		} else {
+			input.in = fopen(options->input_path, "r");
+		}
+		if (!input.map && !input.in) {
+			fprintf(stderr, "Failed to open input file \"%s\"\n", options->input_path);
+			return 1;
+		}
+	}
+	if (options->output_path && strcmp(options->output_path, "-") != 0) {
+		out = fopen(options->output_path, "w");
+		if (!out) {
+			fprintf(stderr, "Failed to open output file \"%s\"\n", options->output_path);
+			r = 1;
+			goto exit;
+		}
+	}
+
+	// results are typically consumed by another program and therefore
+	// output is fully buffered even if it is a terminal
+	setvbuf(out, NULL, _IOFBF, 64 * 1024);
+	print_record_header(out, options, true);
+
+	if (options->jobs > 1) {
+		r = bulk_run_parallel(options, &input, out);
+	} else {
+		r = bulk_run_serial(options, &input, out);
+	}
+	if (r) {
+		r = 1;
+		goto exit;
+	}
+	if (input.in && ferror(input.in)) {
+		fprintf(stderr, "Failed to read input\n");
+		r = 1;
+		goto exit;
+	}
+
+	r = 0;
+	goto exit;
+
+exit:
+	if (input.line) {
+		// input may contain key values
+		memset(input.line, 0, input.line_size);
+		free(input.line);
+	}
+	if (input.in && input.in != stdin) {
+		fclose(input.in);
+	}
+#ifdef HAVE_MMAP
+	if (input.map) {
+		munmap((void*)input.map, input.map_len);
+	}
+#endif
+	if (out && fflush(out)) {
+		fprintf(stderr, "Failed to write output\n");
+		r = 1;
+	}
+	if (out && out != stdout) {
+		fclose(out);
+	}
+
+	return r;
+}
+
 int main(int argc, char** argv)
 {
 	int r;
@@ -721,4 +2080,8 @@ int main(int argc, char** argv)
 	if (options.export) {
 		return do_tr31_export(&options);
 	}
+
+	if (options.bulk_import || options.bulk_export || options.translate) {
+		return do_tr31_bulk(&options);
+	}
 }
@@ -21,12 +21,23 @@
 #include "tr31.h"
 #include "tr31_config.h"
 #include "tr31_crypto.h"
+#include "tr31_secmem.h"
+#include "tr31_alloc.h"
+#include "tr31_stats.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h> // for sysconf
+#endif
+
 #include <arpa/inet.h> // for ntohs and friends
 
 #define sizeof_field(TYPE, FIELD) sizeof(((TYPE*)0)->FIELD)
@@ -63,19 +74,89 @@ struct tr31_payload_t {
 #define TR31_MIN_PAYLOAD_LENGTH (DES_BLOCK_SIZE)
 #define TR31_MIN_KEY_BLOCK_LENGTH (sizeof(struct tr31_header_t) + TR31_MIN_PAYLOAD_LENGTH + 8) // Minimum TR-31 key block length: header + minimum payload + authenticator
 
+// prepared TR-31 key block protection key
+// the keyed cipher objects are created on first use because the binding
+// method (and therefore which of them are required) depends on the format
+// version of the key block being processed
+struct tr31_kbpk_t {
+	struct tr31_key_t key; // shallow copy of KBPK; key data points to key_data
+	uint8_t key_data[AES256_KEY_SIZE];
+
+	// key variant binding method (TDES; format versions A and C)
+	struct tr31_cipher_t* variant_kbek;
+	struct tr31_cipher_t* variant_kbak;
+
+	// key derivation binding method (TDES or AES; format versions B and D)
+	struct tr31_cipher_t* derived_kbek;
+	struct tr31_cipher_t* derived_kbak;
+
+	// optional random data pool for key block padding
+	// if absent, random data is requested for every exported key block
+	struct tr31_rand_pool_t* rand_pool;
+};
+
+// KCV computation mode; see tr31_set_kcv_mode()
+static atomic_int tr31_kcv_mode = TR31_KCV_MODE_LAZY;
+
+#define TR31_ARENA_ALIGNMENT (_Alignof(max_align_t)) // Alignment of context object allocations from caller provided arena
+#define TR31_MAX_KEY_BLOCK_LENGTH (9999) // Maximum key block length that the key block length field can encode
+#define TR31_BATCH_CHUNK_SIZE (32) // Number of key blocks claimed by a batch worker at a time
+#define TR31_BATCH_MAX_WORKERS (256) // Maximum number of batch workers
+
+// batch job shared by all batch workers
+struct tr31_batch_job_t {
+	void (*process_chunk)(struct tr31_batch_job_t* job, struct tr31_kbpk_t* kbpk, size_t begin, size_t end);
+	const struct tr31_key_t* kbpk;
+	size_t count;
+	atomic_size_t next; // index of next key block to be claimed by a worker
+
+	const struct tr31_key_block_ref_t* key_blocks_in; // import only
+	char* const* key_blocks_out; // export only
+	const size_t* key_block_lens; // export only
+	struct tr31_ctx_t* ctx;
+	int* results;
+};
+
+// key block authentication that is deferred by batch import and export such
+// that the authenticators of a chunk of key blocks are processed together
+// using tr31_cmac_multi() or tr31_cmac_verify_multi()
+struct tr31_deferred_auth_t {
+	bool pending; // whether authentication was deferred
+	struct tr31_cmac_job_t* cmac_job; // provided by caller
+	size_t key_length; // import only
+	uint8_t decrypted_payload[TR31_AES256_KEY_UNDER_AES_LENGTH];
+};
+
 // helper functions
 static int dec_to_int(const char* str, size_t str_len);
 static void int_to_dec(unsigned int value, char* str, size_t str_len);
 static int hex_to_int(const char* str, size_t str_len);
 static void int_to_hex(unsigned int value, char* str, size_t str_len);
-static int hex_to_bin(const char* hex, void* bin, size_t bin_len);
-static int bin_to_hex(const void* bin, size_t bin_len, char* str, size_t str_len);
-static int tr31_tdes_decrypt_verify_variant_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk);
-static int tr31_tdes_encrypt_sign_variant_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk);
-static int tr31_tdes_decrypt_verify_derivation_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk);
-static int tr31_tdes_encrypt_sign_derivation_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk);
-static int tr31_aes_decrypt_verify_derivation_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk);
-static int tr31_aes_encrypt_sign_derivation_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk);
+static int tr31_kbpk_init(const struct tr31_key_t* key, struct tr31_kbpk_t* kbpk);
+static void tr31_kbpk_cleanup(struct tr31_kbpk_t* kbpk);
+static int tr31_kbpk_setup_variant(struct tr31_kbpk_t* kbpk);
+static int tr31_kbpk_setup_derivation(struct tr31_kbpk_t* kbpk);
+static void tr31_kbpk_rand(struct tr31_kbpk_t* kbpk, void* buf, size_t len);
+static int tr31_key_update_kcv(struct tr31_key_t* key);
+static int tr31_key_compute_kcv(struct tr31_key_t* key);
+static int tr31_ctx_alloc(struct tr31_ctx_t* ctx, size_t length, void** ptr);
+static int tr31_ctx_set_key_data(struct tr31_ctx_t* ctx, const void* data, size_t length);
+static int tr31_import_internal(const char* key_block, size_t key_block_len, struct tr31_kbpk_t* kbpk, void* arena, size_t arena_len, struct tr31_ctx_t* ctx, struct tr31_deferred_auth_t* deferred);
+static int tr31_import_unwrap(const char* key_block, size_t key_block_len, struct tr31_kbpk_t* kbpk, void* arena, size_t arena_len, struct tr31_ctx_t* ctx, struct tr31_deferred_auth_t* deferred);
+static int tr31_import_validate_key_length(const struct tr31_ctx_t* ctx);
+static int tr31_import_deferred_finish(struct tr31_ctx_t* ctx, struct tr31_deferred_auth_t* deferred);
+static int tr31_export_internal(struct tr31_ctx_t* ctx, struct tr31_kbpk_t* kbpk, char* key_block, size_t key_block_len, struct tr31_deferred_auth_t* deferred);
+static int tr31_export_wrap(struct tr31_ctx_t* ctx, struct tr31_kbpk_t* kbpk, char* key_block, size_t key_block_len, struct tr31_deferred_auth_t* deferred);
+static int tr31_export_deferred_finish(struct tr31_ctx_t* ctx, struct tr31_kbpk_t* kbpk, struct tr31_deferred_auth_t* deferred, char* key_block);
+static int tr31_export_finish(struct tr31_ctx_t* ctx, char* key_block);
+static void tr31_export_clear(const struct tr31_ctx_t* ctx, char* key_block, size_t key_block_len);
+static int tr31_translate_detach(struct tr31_ctx_t* ctx);
+static int tr31_translate_remap(struct tr31_ctx_t* ctx, const struct tr31_translate_t* translate);
+static unsigned int tr31_translate_key_strength(const struct tr31_key_t* key);
+static int tr31_tdes_decrypt_verify_variant_binding(struct tr31_ctx_t* ctx, struct tr31_kbpk_t* kbpk);
+static int tr31_tdes_encrypt_sign_variant_binding(struct tr31_ctx_t* ctx, struct tr31_kbpk_t* kbpk);
+static int tr31_decrypt_verify_derivation_binding(struct tr31_ctx_t* ctx, struct tr31_kbpk_t* kbpk, struct tr31_deferred_auth_t* deferred);
+static int tr31_encrypt_sign_derivation_binding(struct tr31_ctx_t* ctx, struct tr31_kbpk_t* kbpk, struct tr31_deferred_auth_t* deferred);
 static const char* tr31_get_opt_block_kcv_string(const struct tr31_opt_ctx_t* opt_block);
 static const char* tr31_get_opt_block_hmac_string(const struct tr31_opt_ctx_t* opt_block);
 
@@ -155,65 +236,6 @@ static void int_to_hex(unsigned int value, char* str, size_t str_len)
 	}
 }
 
-static int hex_to_bin(const char* hex, void* bin, size_t bin_len)
-{
-	size_t hex_len = bin_len * 2;
-
-	for (size_t i = 0; i < hex_len; ++i) {
-		if (!isxdigit(hex[i])) {
-			return -1;
-		}
-	}
-
-	while (*hex && bin_len--) {
-		uint8_t* ptr = bin;
-
-		char str[3];
-		strncpy(str, hex, 2);
-		str[2] = 0;
-
-		*ptr = strtoul(str, NULL, 16);
-
-		hex += 2;
-		++bin;
-	}
-
-	return 0;
-}
-
-static int bin_to_hex(const void* bin, size_t bin_len, char* hex, size_t hex_len)
-{
-	const uint8_t* buf = bin;
-
-	// minimum string length
-	if (hex_len < bin_len * 2) {
-		return -1;
-	}
-
-	// pack hex digits, left justified
-	for (unsigned int i = 0; i < bin_len; ++i) {
-		uint8_t digit;
-
-		// convert most significant nibble
-		digit = buf[i] >> 4;
-		if (digit < 0xA) {
-			hex[(i * 2)] = digit + '0';
-		} else {
-			hex[(i * 2)] = digit - 0xA + 'A';
-		}
-
-		// convert least significant nibble
-		digit = buf[i] & 0xf;
-		if (digit < 0xA) {
-			hex[(i * 2) + 1] = digit + '0';
-		} else {
-			hex[(i * 2) + 1] = digit - 0xA + 'A';
-		}
-	}
-
-	return 0;
-}
-
 const char* tr31_lib_version_string(void)
 {
 	return TR31_LIB_VERSION_STRING;
@@ -362,8 +384,7 @@ int tr31_key_init(
 void tr31_key_release(struct tr31_key_t* key)
 {
 	if (key->data) {
-		tr31_cleanse(key->data, key->length);
-		free(key->data);
+		tr31_secmem_free(key->data, key->length);
 		key->data = NULL;
 	}
 }
@@ -400,8 +421,6 @@ int tr31_key_copy(
 
 int tr31_key_set_data(struct tr31_key_t* key, const void* data, size_t length)
 {
-	int r;
-
 	if (!key || !data || !length) {
 		return 1;
 	}
@@ -409,20 +428,75 @@ int tr31_key_set_data(struct tr31_key_t* key, const void* data, size_t length)
 	tr31_key_release(key);
 
 	// copy key data
+	key->data = tr31_secmem_alloc(length);
+	if (!key->data) {
+		return -1;
+	}
 	key->length = length;
-	key->data = calloc(1, key->length);
 	memcpy(key->data, data, key->length);
 
-	// update KCV
+	return tr31_key_update_kcv(key);
+}
+
+int tr31_key_get_kcv(struct tr31_key_t* key)
+{
+	int r;
+
+	if (!key) {
+		return -1;
+	}
+	if (key->kcv_len) {
+		// already available
+		return 0;
+	}
+	if (!key->data || !key->length) {
+		return TR31_ERROR_KCV_NOT_AVAILABLE;
+	}
+
+	r = tr31_key_compute_kcv(key);
+	if (r) {
+		// return error value as-is
+		return r;
+	}
+	if (!key->kcv_len) {
+		// KCV not supported for this key algorithm
+		return TR31_ERROR_KCV_NOT_AVAILABLE;
+	}
+
+	return 0;
+}
+
+void tr31_set_kcv_mode(enum tr31_kcv_mode_t mode)
+{
+	atomic_store_explicit(&tr31_kcv_mode, mode, memory_order_relaxed);
+}
+
+static int tr31_key_update_kcv(struct tr31_key_t* key)
+{
+	// invalidate KCV of previous key data
 	key->kcv_len = 0;
 	memset(&key->kcv, 0, sizeof(key->kcv));
+
+	// defer KCV computation unless requested otherwise
+	if (atomic_load_explicit(&tr31_kcv_mode, memory_order_relaxed) != TR31_KCV_MODE_EAGER) {
+		return 0;
+	}
+
+	return tr31_key_compute_kcv(key);
+}
+
+static int tr31_key_compute_kcv(struct tr31_key_t* key)
+{
+	int r;
+	uint64_t stage_begin = tr31_stats_stage_begin();
+
 	if (key->algorithm == TR31_KEY_ALGORITHM_TDES) {
 		// use legacy KCV for TDES key
 		key->kcv_algorithm = TR31_OPT_BLOCK_KCV_LEGACY;
 		r = tr31_tdes_kcv(key->data, key->length, key->kcv);
 		if (r) {
 			// return error value as-is
-			return r;
+			goto exit;
 		}
 		key->kcv_len = TDES_KCV_SIZE;
 
@@ -432,14 +506,65 @@ int tr31_key_set_data(struct tr31_key_t* key, const void* data, size_t length)
 		r = tr31_aes_kcv(key->data, key->length, key->kcv);
 		if (r) {
 			// return error value as-is
-			return r;
+			goto exit;
 		}
 		key->kcv_len = AES_KCV_SIZE;
 	}
 
+	r = 0;
+	goto exit;
+
+exit:
+	// failed KCV computations are also recorded
+	tr31_stats_stage_end(TR31_STATS_STAGE_KCV, stage_begin);
+	return r;
+}
+
+static int tr31_ctx_alloc(struct tr31_ctx_t* ctx, size_t length, void** ptr)
+{
+	size_t offset;
+
+	if (!ctx->arena) {
+		*ptr = tr31_alloc(length);
+		if (!*ptr) {
+			return -1;
+		}
+		return 0;
+	}
+
+	// allocate from caller provided arena
+	offset = (ctx->arena_used + TR31_ARENA_ALIGNMENT - 1) & ~(TR31_ARENA_ALIGNMENT - 1);
+	if (offset > ctx->arena_length || length > ctx->arena_length - offset) {
+		*ptr = NULL;
+		return TR31_ERROR_INSUFFICIENT_ARENA;
+	}
+	*ptr = (uint8_t*)ctx->arena + offset;
+	memset(*ptr, 0, length);
+	ctx->arena_used = offset + length;
+
 	return 0;
 }
 
+static int tr31_ctx_set_key_data(struct tr31_ctx_t* ctx, const void* data, size_t length)
+{
+	int r;
+
+	if (!ctx->arena) {
+		return tr31_key_set_data(&ctx->key, data, length);
+	}
+
+	// copy key data
+	r = tr31_ctx_alloc(ctx, length, &ctx->key.data);
+	if (r) {
+		// return error value as-is
+		return r;
+	}
+	ctx->key.length = length;
+	memcpy(ctx->key.data, data, length);
+
+	return tr31_key_update_kcv(&ctx->key);
+}
+
 int tr31_key_set_key_version(struct tr31_key_t* key, const char* key_version)
 {
 	if (!key || !key_version) {
@@ -542,22 +667,38 @@ int tr31_opt_block_add(
 	size_t length
 )
 {
+	struct tr31_opt_ctx_t* opt_blocks;
 	struct tr31_opt_ctx_t* opt_blk;
 
 	if (!ctx) {
 		return -1;
 	}
+	if (ctx->arena) {
+		// optional block array cannot grow within caller provided arena
+		return -2;
+	}
 
 	// grow optional block array
+	opt_blocks = tr31_realloc(
+		ctx->opt_blocks,
+		ctx->opt_blocks_count * sizeof(struct tr31_opt_ctx_t),
+		(ctx->opt_blocks_count + 1) * sizeof(struct tr31_opt_ctx_t)
+	);
+	if (!opt_blocks) {
+		return -1;
+	}
+	ctx->opt_blocks = opt_blocks;
 	ctx->opt_blocks_count++;
-	ctx->opt_blocks = realloc(ctx->opt_blocks, ctx->opt_blocks_count * sizeof(struct tr31_opt_ctx_t));
 
 	// add optional block
 	opt_blk = &ctx->opt_blocks[ctx->opt_blocks_count - 1];
 	opt_blk->id = id;
 	if (data && length) {
+		opt_blk->data = tr31_alloc(length);
+		if (!opt_blk->data) {
+			return -1;
+		}
 		opt_blk->data_length = length;
-		opt_blk->data = calloc(1, opt_blk->data_length);
 		memcpy(opt_blk->data, data, opt_blk->data_length);
 	} else {
 		opt_blk->data_length = 0;
@@ -587,143 +728,566 @@ int tr31_opt_block_add_HM(
 	return tr31_opt_block_add(ctx, TR31_OPT_BLOCK_HM, &hash_algorithm, 1);
 }
 
+int tr31_kbpk_prepare(const struct tr31_key_t* key, struct tr31_kbpk_t** kbpk)
+{
+	int r;
+	struct tr31_kbpk_t* prepared_kbpk;
+
+	if (!key || !kbpk) {
+		return -1;
+	}
+
+	prepared_kbpk = tr31_alloc(sizeof(*prepared_kbpk));
+	if (!prepared_kbpk) {
+		return -2;
+	}
+
+	r = tr31_kbpk_init(key, prepared_kbpk);
+	if (r) {
+		tr31_kbpk_cleanup(prepared_kbpk);
+		tr31_free_cleansed(prepared_kbpk, sizeof(*prepared_kbpk));
+		// return error value as-is
+		return r;
+	}
+
+	// prepared key block protection keys are typically used for many key
+	// blocks and therefore random padding is served from a pool
+	prepared_kbpk->rand_pool = tr31_alloc(sizeof(*prepared_kbpk->rand_pool));
+	if (prepared_kbpk->rand_pool) {
+		tr31_rand_pool_init(prepared_kbpk->rand_pool);
+	}
+
+	*kbpk = prepared_kbpk;
+	return 0;
+}
+
+void tr31_kbpk_free(struct tr31_kbpk_t* kbpk)
+{
+	if (!kbpk) {
+		return;
+	}
+
+	struct tr31_rand_pool_t* rand_pool = kbpk->rand_pool;
+
+	tr31_kbpk_cleanup(kbpk);
+	tr31_free_cleansed(rand_pool, sizeof(*rand_pool));
+	tr31_free_cleansed(kbpk, sizeof(*kbpk));
+}
+
 int tr31_import(
 	const char* key_block,
 	const struct tr31_key_t* kbpk,
 	struct tr31_ctx_t* ctx
 )
+{
+	if (!key_block || !ctx) {
+		return -1;
+	}
+
+	return tr31_import_buf(key_block, strlen(key_block), kbpk, ctx);
+}
+
+int tr31_import_buf(
+	const char* key_block,
+	size_t key_block_len,
+	const struct tr31_key_t* kbpk,
+	struct tr31_ctx_t* ctx
+)
 {
 	int r;
-	size_t key_block_len;
-	const struct tr31_header_t* header;
-	size_t opt_blk_len_total = 0;
-	unsigned int enc_block_size;
-	const void* ptr;
+	struct tr31_kbpk_t prepared_kbpk;
 
 	if (!key_block || !ctx) {
 		return -1;
 	}
 
-	key_block_len = strlen(key_block);
-	header = (const struct tr31_header_t*)key_block;
-
-	// validate minimum length
-	if (key_block_len < TR31_MIN_KEY_BLOCK_LENGTH) {
-		return TR31_ERROR_INVALID_LENGTH;
+	// if no key block protection key was provided, only decode the key block
+	if (!kbpk) {
+		return tr31_import_internal(key_block, key_block_len, NULL, NULL, 0, ctx, NULL);
 	}
 
-	// initialise TR-31 context object
-	r = tr31_init(header->version_id, NULL, ctx);
+	r = tr31_kbpk_init(kbpk, &prepared_kbpk);
 	if (r) {
+		tr31_kbpk_cleanup(&prepared_kbpk);
 		// return error value as-is
 		return r;
 	}
 
-	// decode key block length field
-	ctx->length = dec_to_int(header->length, sizeof(header->length));
-	if (ctx->length != key_block_len) {
-		return TR31_ERROR_INVALID_LENGTH_FIELD;
-	}
+	r = tr31_import_internal(key_block, key_block_len, &prepared_kbpk, NULL, 0, ctx, NULL);
+	tr31_kbpk_cleanup(&prepared_kbpk);
 
-	// decode header fields associated with wrapped key
-	r = tr31_key_init(
-		ntohs(header->key_usage),
-		header->algorithm,
-		header->mode_of_use,
-		header->key_version,
-		header->exportability,
-		NULL,
-		0,
-		&ctx->key
-	);
-	if (r) {
-		tr31_key_release(&ctx->key);
-		// return error value as-is
-		return r;
+	return r;
+}
+
+int tr31_import_prepared(
+	const char* key_block,
+	struct tr31_kbpk_t* kbpk,
+	struct tr31_ctx_t* ctx
+)
+{
+	if (!key_block || !ctx) {
+		return -1;
 	}
 
-	// decode number of optional blocks field
-	int opt_blocks_count = dec_to_int(header->opt_blocks_count, sizeof(header->opt_blocks_count));
-	if (opt_blocks_count < 0) {
-		return TR31_ERROR_INVALID_NUMBER_OF_OPTIONAL_BLOCKS_FIELD;
+	return tr31_import_internal(key_block, strlen(key_block), kbpk, NULL, 0, ctx, NULL);
+}
+
+int tr31_import_buf_prepared(
+	const char* key_block,
+	size_t key_block_len,
+	struct tr31_kbpk_t* kbpk,
+	struct tr31_ctx_t* ctx
+)
+{
+	if (!key_block || !ctx) {
+		return -1;
 	}
-	ctx->opt_blocks_count = opt_blocks_count;
 
-	// decode optional blocks
-	// see TR-31:2018, A.5.6
-	ptr = header + 1; // optional blocks, if any, are after the header
-	if (ctx->opt_blocks_count) {
-		ctx->opt_blocks = calloc(ctx->opt_blocks_count, sizeof(ctx->opt_blocks[0]));
+	return tr31_import_internal(key_block, key_block_len, kbpk, NULL, 0, ctx, NULL);
+}
+
+int tr31_import_arena(
+	const char* key_block,
+	size_t key_block_len,
+	struct tr31_kbpk_t* kbpk,
+	void* arena,
+	size_t arena_len,
+	struct tr31_ctx_t* ctx
+)
+{
+	if (!key_block || !arena || !ctx) {
+		return -1;
 	}
-	for (int i = 0; i < opt_blocks_count; ++i) {
-		// ensure that current pointer is valid for minimal optional block
-		if (ptr + sizeof(struct tr31_opt_blk_t) - (void*)header > key_block_len) {
-			r = TR31_ERROR_INVALID_LENGTH;
-			goto error;
+
+	return tr31_import_internal(key_block, key_block_len, kbpk, arena, arena_len, ctx, NULL);
+}
+
+static void tr31_batch_import_chunk(struct tr31_batch_job_t* job, struct tr31_kbpk_t* kbpk, size_t begin, size_t end)
+{
+	int r;
+	struct tr31_deferred_auth_t deferred[TR31_BATCH_CHUNK_SIZE];
+	struct tr31_cmac_job_t cmac_jobs[TR31_BATCH_CHUNK_SIZE];
+	size_t cmac_job_count = 0;
+
+	// decode and decrypt key blocks but defer verification of authenticators
+	for (size_t i = begin; i < end; ++i) {
+		struct tr31_deferred_auth_t* d = &deferred[i - begin];
+
+		d->pending = false;
+		d->cmac_job = &cmac_jobs[cmac_job_count];
+
+		// ensure that the context object can be released regardless of
+		// where the import failed
+		memset(&job->ctx[i], 0, sizeof(job->ctx[i]));
+
+		if (!job->key_blocks_in[i].key_block) {
+			job->results[i] = -1;
+			continue;
 		}
-		const struct tr31_opt_blk_t* opt_blk = ptr;
 
-		// ensure that optional block length is valid
-		int opt_blk_len = hex_to_int(opt_blk->length, sizeof(opt_blk->length));
-		if (opt_blk_len < 0) {
-			// parse error
-			r = TR31_ERROR_INVALID_LENGTH;
-			goto error;
+		job->results[i] = tr31_import_internal(
+			job->key_blocks_in[i].key_block,
+			job->key_blocks_in[i].length,
+			kbpk,
+			NULL,
+			0,
+			&job->ctx[i],
+			d
+		);
+		if (job->results[i]) {
+			tr31_release(&job->ctx[i]);
+			continue;
 		}
-		if (opt_blk_len == 0) {
-			// extended optional block length not supported
-			r = TR31_ERROR_INVALID_LENGTH;
-			goto error;
+		if (d->pending) {
+			++cmac_job_count;
 		}
-		if (opt_blk_len < sizeof(struct tr31_opt_blk_t)) {
-			// optional block length must be at least 4 bytes (2 byte id + 2 byte length)
-			r = TR31_ERROR_INVALID_LENGTH;
-			goto error;
+	}
+
+	// verify authenticators of all key blocks together
+	uint64_t stage_begin = tr31_stats_stage_begin();
+	r = tr31_cmac_verify_multi(cmac_jobs, cmac_job_count);
+	tr31_stats_stage_end(TR31_STATS_STAGE_MAC_VERIFY, stage_begin);
+
+	// complete key blocks for which verification was deferred
+	for (size_t i = begin; i < end; ++i) {
+		struct tr31_deferred_auth_t* d = &deferred[i - begin];
+
+		if (!d->pending) {
+			continue;
 		}
-		if (ptr + opt_blk_len - (void*)header > key_block_len) {
-			// optional block length exceeds total key block length
-			r = TR31_ERROR_INVALID_LENGTH;
-			goto error;
+		if (r) {
+			// report internal error for each deferred key block
+			job->results[i] = r;
+			tr31_stats_import_done(r);
+			tr31_release(&job->ctx[i]);
+			tr31_cleanse(d, sizeof(*d));
+			continue;
 		}
-		opt_blk_len_total += opt_blk_len;
 
-		// copy optional block field
-		ctx->opt_blocks[i].id = ntohs(opt_blk->id);
-		ctx->opt_blocks[i].data_length = (opt_blk_len - 4) / 2;
-		ctx->opt_blocks[i].data = calloc(1, ctx->opt_blocks[i].data_length);
-		r = hex_to_bin(opt_blk->data, ctx->opt_blocks[i].data, ctx->opt_blocks[i].data_length);
+		job->results[i] = tr31_import_deferred_finish(&job->ctx[i], d);
+	}
+}
+
+static void tr31_batch_export_chunk(struct tr31_batch_job_t* job, struct tr31_kbpk_t* kbpk, size_t begin, size_t end)
+{
+	int r;
+	struct tr31_deferred_auth_t deferred[TR31_BATCH_CHUNK_SIZE];
+	struct tr31_cmac_job_t cmac_jobs[TR31_BATCH_CHUNK_SIZE];
+	size_t cmac_job_count = 0;
+
+	// build key blocks but defer generation of authenticators
+	for (size_t i = begin; i < end; ++i) {
+		struct tr31_deferred_auth_t* d = &deferred[i - begin];
+
+		d->pending = false;
+		d->cmac_job = &cmac_jobs[cmac_job_count];
+
+		job->results[i] = tr31_export_internal(
+			&job->ctx[i],
+			kbpk,
+			job->key_blocks_out[i],
+			job->key_block_lens[i],
+			d
+		);
+		if (!job->results[i] && d->pending) {
+			++cmac_job_count;
+		}
+	}
+
+	// generate authenticators of all key blocks together
+	uint64_t stage_begin = tr31_stats_stage_begin();
+	r = tr31_cmac_multi(cmac_jobs, cmac_job_count);
+	tr31_stats_stage_end(TR31_STATS_STAGE_MAC_GENERATE, stage_begin);
+
+	// complete key blocks for which authentication was deferred
+	for (size_t i = begin; i < end; ++i) {
+		struct tr31_deferred_auth_t* d = &deferred[i - begin];
+
+		if (!d->pending) {
+			continue;
+		}
 		if (r) {
-			r = TR31_ERROR_INVALID_OPTIONAL_BLOCK_DATA;
-			goto error;
+			// report internal error for each deferred key block
+			job->results[i] = r;
+			tr31_stats_export_done(r);
+			tr31_cleanse(d, sizeof(*d));
+			tr31_export_clear(&job->ctx[i], job->key_blocks_out[i], job->ctx[i].length + 1);
+			continue;
 		}
 
-		// advance current pointer
-		ptr += opt_blk_len;
+		job->results[i] = tr31_export_deferred_finish(&job->ctx[i], kbpk, d, job->key_blocks_out[i]);
 	}
+}
 
-	// validate key block format version
-	// set associated authenticator length
+static void tr31_batch_work(struct tr31_batch_job_t* job, struct tr31_kbpk_t* kbpk)
+{
+	struct tr31_rand_pool_t rand_pool;
+
+	// serve random padding of exported key blocks from a per-worker pool such
+	// that the random number generator is invoked in bulk
+	if (kbpk && job->key_blocks_out) {
+		tr31_rand_pool_init(&rand_pool);
+		kbpk->rand_pool = &rand_pool;
+	}
+
+	// claim chunks of key blocks until none remain such that faster workers
+	// process more chunks than slower workers
+	while (true) {
+		size_t begin = atomic_fetch_add(&job->next, TR31_BATCH_CHUNK_SIZE);
+		size_t end;
+
+		if (begin >= job->count) {
+			break;
+		}
+		end = begin + TR31_BATCH_CHUNK_SIZE;
+		if (end > job->count) {
+			end = job->count;
+		}
+
+		// each key block has a fixed index in the result arrays and
+		// therefore the result order does not depend on the workers
+		job->process_chunk(job, kbpk, begin, end);
+	}
+
+	if (kbpk && job->key_blocks_out) {
+		tr31_rand_pool_cleanse(&rand_pool);
+		kbpk->rand_pool = NULL;
+	}
+}
+
+#ifdef HAVE_PTHREAD
+static void tr31_batch_fail(struct tr31_batch_job_t* job, int error)
+{
+	// report the error for every remaining key block such that the results
+	// are always populated
+	while (true) {
+		size_t begin = atomic_fetch_add(&job->next, TR31_BATCH_CHUNK_SIZE);
+		size_t end;
+
+		if (begin >= job->count) {
+			break;
+		}
+		end = begin + TR31_BATCH_CHUNK_SIZE;
+		if (end > job->count) {
+			end = job->count;
+		}
+
+		for (size_t i = begin; i < end; ++i) {
+			if (job->key_blocks_in) {
+				// imported key block context must be safe to release
+				memset(&job->ctx[i], 0, sizeof(job->ctx[i]));
+			}
+			job->results[i] = error;
+		}
+	}
+}
+
+static void* tr31_batch_worker(void* arg)
+{
+	int r;
+	struct tr31_batch_job_t* job = arg;
+	struct tr31_kbpk_t prepared_kbpk;
+
+	if (!job->kbpk) {
+		tr31_batch_work(job, NULL);
+		return NULL;
+	}
+
+	// each worker prepares its own key block protection key because the
+	// cipher contexts of a prepared key block protection key are not thread
+	// safe
+	r = tr31_kbpk_init(job->kbpk, &prepared_kbpk);
+	if (r) {
+		// the key block protection key was validated before the workers
+		// were started and therefore this is unlikely
+		tr31_batch_fail(job, r);
+		tr31_kbpk_cleanup(&prepared_kbpk);
+		return NULL;
+	}
+
+	tr31_batch_work(job, &prepared_kbpk);
+	tr31_kbpk_cleanup(&prepared_kbpk);
+
+	return NULL;
+}
+#endif
+
+static int tr31_batch_run(struct tr31_batch_job_t* job, unsigned int workers)
+{
+	int r;
+	struct tr31_kbpk_t prepared_kbpk;
+	struct tr31_kbpk_t* kbpk = NULL;
+
+	// prepare key block protection key before any work is done such that
+	// invalid key block protection keys are reported for the whole batch
+	// and such that the calling thread can use it as a worker
+	if (job->kbpk) {
+		r = tr31_kbpk_init(job->kbpk, &prepared_kbpk);
+		if (r) {
+			tr31_kbpk_cleanup(&prepared_kbpk);
+			// return error value as-is
+			return r;
+		}
+		kbpk = &prepared_kbpk;
+	}
+
+	atomic_init(&job->next, 0);
+
+#ifdef HAVE_PTHREAD
+	size_t chunk_count = (job->count + TR31_BATCH_CHUNK_SIZE - 1) / TR31_BATCH_CHUNK_SIZE;
+	if (!workers) {
+		long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+		workers = cpu_count > 0 ? cpu_count : 1;
+	}
+	if (workers > TR31_BATCH_MAX_WORKERS) {
+		workers = TR31_BATCH_MAX_WORKERS;
+	}
+	if (workers > chunk_count) {
+		// no point in starting workers that will not receive any chunks
+		workers = chunk_count ? chunk_count : 1;
+	}
+
+	// the calling thread is also a worker
+	pthread_t threads[TR31_BATCH_MAX_WORKERS - 1];
+	unsigned int thread_count = 0;
+	for (; thread_count < workers - 1; ++thread_count) {
+		r = pthread_create(&threads[thread_count], NULL, &tr31_batch_worker, job);
+		if (r) {
+			// continue with the workers that were started
+			break;
+		}
+	}
+	tr31_batch_work(job, kbpk);
+	for (unsigned int i = 0; i < thread_count; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+#else
+	// no thread support; the calling thread processes the whole batch
+	(void)workers;
+	tr31_batch_work(job, kbpk);
+#endif
+
+	if (kbpk) {
+		tr31_kbpk_cleanup(kbpk);
+	}
+
+	return 0;
+}
+
+int tr31_import_batch(
+	const struct tr31_key_block_ref_t* key_blocks,
+	size_t count,
+	const struct tr31_key_t* kbpk,
+	struct tr31_ctx_t* ctx,
+	int* results
+)
+{
+	return tr31_import_batch_parallel(key_blocks, count, kbpk, ctx, results, 1);
+}
+
+int tr31_import_batch_parallel(
+	const struct tr31_key_block_ref_t* key_blocks,
+	size_t count,
+	const struct tr31_key_t* kbpk,
+	struct tr31_ctx_t* ctx,
+	int* results,
+	unsigned int workers
+)
+{
+	struct tr31_batch_job_t job;
+
+	if (!key_blocks || !ctx || !results) {
+		return -1;
+	}
+
+	memset(&job, 0, sizeof(job));
+	job.process_chunk = &tr31_batch_import_chunk;
+	job.kbpk = kbpk;
+	job.count = count;
+	job.key_blocks_in = key_blocks;
+	job.ctx = ctx;
+	job.results = results;
+
+	return tr31_batch_run(&job, workers);
+}
+
+int tr31_peek(
+	const char* key_block,
+	size_t key_block_len,
+	struct tr31_peek_t* peek
+)
+{
+	int r;
+	const struct tr31_header_t* header;
+	size_t opt_blk_len_total = 0;
+	unsigned int enc_block_size;
+	size_t offset;
+
+	if (!key_block || !peek) {
+		return -1;
+	}
+	header = (const struct tr31_header_t*)key_block;
+
+	// NOTE: only the optional block references in use are populated to avoid
+	// clearing the whole optional block reference array for every key block
+	memset(peek, 0, offsetof(struct tr31_peek_t, opt_blocks));
+
+	// validate minimum length
+	if (key_block_len < TR31_MIN_KEY_BLOCK_LENGTH) {
+		return TR31_ERROR_INVALID_LENGTH;
+	}
+
+	// validate key block format version
+	// set associated authenticator length
 	// set encryption block size for header length validation
-	switch (ctx->version) {
+	peek->version = header->version_id;
+	switch (peek->version) {
 		case TR31_VERSION_A:
 		case TR31_VERSION_C:
-			ctx->authenticator_length = 4; // 4 bytes; 8 ASCII hex digits
+			peek->authenticator_length = 8; // 4 bytes; 8 ASCII hex digits
 			enc_block_size = DES_BLOCK_SIZE;
 			break;
 
 		case TR31_VERSION_B:
-			ctx->authenticator_length = 8; // 8 bytes; 16 ASCII hex digits
+			peek->authenticator_length = 16; // 8 bytes; 16 ASCII hex digits
 			enc_block_size = DES_BLOCK_SIZE;
 			break;
 
 		case TR31_VERSION_D:
-			ctx->authenticator_length = 16; // 16 bytes; 32 ASCII hex digits
+			peek->authenticator_length = 32; // 16 bytes; 32 ASCII hex digits
 			enc_block_size = AES_BLOCK_SIZE;
 			break;
 
 		default:
-			// invalid format version
-			return -1;
+			return TR31_ERROR_UNSUPPORTED_VERSION;
+	}
+
+	// decode key block length field
+	peek->length = dec_to_int(header->length, sizeof(header->length));
+	if (peek->length != key_block_len) {
+		return TR31_ERROR_INVALID_LENGTH_FIELD;
+	}
+
+	// decode header fields associated with wrapped key
+	r = tr31_key_init(
+		ntohs(header->key_usage),
+		header->algorithm,
+		header->mode_of_use,
+		header->key_version,
+		header->exportability,
+		NULL,
+		0,
+		&peek->key
+	);
+	if (r) {
+		// return error value as-is
+		return r;
+	}
+
+	// decode number of optional blocks field
+	int opt_blocks_count = dec_to_int(header->opt_blocks_count, sizeof(header->opt_blocks_count));
+	if (opt_blocks_count < 0) {
+		return TR31_ERROR_INVALID_NUMBER_OF_OPTIONAL_BLOCKS_FIELD;
+	}
+	peek->opt_blocks_count = opt_blocks_count;
+
+	// index optional blocks
+	// see TR-31:2018, A.5.6
+	offset = sizeof(*header); // optional blocks, if any, are after the header
+	for (int i = 0; i < opt_blocks_count; ++i) {
+		// ensure that current offset is valid for minimal optional block
+		if (offset + sizeof(struct tr31_opt_blk_t) > key_block_len) {
+			return TR31_ERROR_INVALID_LENGTH;
+		}
+		const struct tr31_opt_blk_t* opt_blk = (const void*)(key_block + offset);
+
+		// ensure that optional block length is valid
+		int opt_blk_len = hex_to_int(opt_blk->length, sizeof(opt_blk->length));
+		if (opt_blk_len < 0) {
+			// parse error
+			return TR31_ERROR_INVALID_LENGTH;
+		}
+		if (opt_blk_len == 0) {
+			// extended optional block length not supported
+			return TR31_ERROR_INVALID_LENGTH;
+		}
+		if (opt_blk_len < sizeof(struct tr31_opt_blk_t)) {
+			// optional block length must be at least 4 bytes (2 byte id + 2 byte length)
+			return TR31_ERROR_INVALID_LENGTH;
+		}
+		if (offset + opt_blk_len > key_block_len) {
+			// optional block length exceeds total key block length
+			return TR31_ERROR_INVALID_LENGTH;
+		}
+		opt_blk_len_total += opt_blk_len;
+
+		// populate optional block reference
+		peek->opt_blocks[i].id = ntohs(opt_blk->id);
+		peek->opt_blocks[i].offset = offset + sizeof(struct tr31_opt_blk_t);
+		peek->opt_blocks[i].length = opt_blk_len - sizeof(struct tr31_opt_blk_t);
+
+		// advance current offset
+		offset += opt_blk_len;
 	}
 
 	// TR-31:2018, A.2 (page 18) indicates that the total length of all
@@ -740,42 +1304,137 @@ int tr31_import(
 		return TR31_ERROR_INVALID_OPTIONAL_BLOCK_DATA;
 	}
 
-	// ensure that current pointer is valid for minimal payload and authenticator
-	if (ptr - (void*)header + TR31_MIN_PAYLOAD_LENGTH + (ctx->authenticator_length * 2) > key_block_len) {
-		r = TR31_ERROR_INVALID_LENGTH;
-		goto error;
+	// ensure that current offset is valid for minimal payload and authenticator
+	if (offset + TR31_MIN_PAYLOAD_LENGTH + peek->authenticator_length > key_block_len) {
+		return TR31_ERROR_INVALID_LENGTH;
 	}
 
-	// update header data in context object
-	ctx->header_length = ptr - (void*)header;
-	ctx->header = (void*)header;
+	// populate payload and authenticator references
+	peek->header_length = offset;
+	peek->payload_offset = offset;
+	peek->payload_length = key_block_len - offset - peek->authenticator_length;
+	peek->authenticator_offset = key_block_len - peek->authenticator_length;
+
+	return 0;
+}
+
+static int tr31_import_internal(
+	const char* key_block,
+	size_t key_block_len,
+	struct tr31_kbpk_t* kbpk,
+	void* arena,
+	size_t arena_len,
+	struct tr31_ctx_t* ctx,
+	struct tr31_deferred_auth_t* deferred
+)
+{
+	int r;
+
+	r = tr31_import_unwrap(key_block, key_block_len, kbpk, arena, arena_len, ctx, deferred);
+
+	// if verification was deferred, the import is completed by
+	// tr31_import_deferred_finish()
+	if (!deferred || !deferred->pending) {
+		tr31_stats_import_done(r);
+	}
+
+	return r;
+}
+
+static int tr31_import_unwrap(
+	const char* key_block,
+	size_t key_block_len,
+	struct tr31_kbpk_t* kbpk,
+	void* arena,
+	size_t arena_len,
+	struct tr31_ctx_t* ctx,
+	struct tr31_deferred_auth_t* deferred
+)
+{
+	int r;
+	struct tr31_peek_t peek;
+	uint64_t stage_begin;
+
+	// validate minimum length
+	if (key_block_len < TR31_MIN_KEY_BLOCK_LENGTH) {
+		return TR31_ERROR_INVALID_LENGTH;
+	}
+
+	// initialise TR-31 context object
+	r = tr31_init(((const struct tr31_header_t*)key_block)->version_id, NULL, ctx);
+	if (r) {
+		// return error value as-is
+		return r;
+	}
+	ctx->arena = arena;
+	ctx->arena_length = arena_len;
+
+	// validate header and index optional blocks, payload and authenticator
+	// NOTE: header fields are populated even if the key block is invalid
+	// because callers may use them to parse a partial key block header
+	stage_begin = tr31_stats_stage_begin();
+	r = tr31_peek(key_block, key_block_len, &peek);
+	tr31_stats_stage_end(TR31_STATS_STAGE_PARSE, stage_begin);
+	ctx->length = peek.length;
+	ctx->key = peek.key; // no key data yet
+	ctx->opt_blocks_count = peek.opt_blocks_count;
+	if (r) {
+		// return error value as-is
+		return r;
+	}
+	ctx->header_length = peek.header_length;
+	ctx->header = key_block;
+	ctx->payload_length = peek.payload_length / 2;
+	ctx->authenticator_length = peek.authenticator_length / 2;
 
-	// determine payload length
-	size_t key_block_payload_length = key_block_len - ctx->header_length - (ctx->authenticator_length * 2);
-	ctx->payload_length = key_block_payload_length / 2;
+	// decode optional blocks
+	stage_begin = tr31_stats_stage_begin();
+	if (ctx->opt_blocks_count) {
+		r = tr31_ctx_alloc(ctx, ctx->opt_blocks_count * sizeof(ctx->opt_blocks[0]), (void**)&ctx->opt_blocks);
+		if (r) {
+			// return error value as-is
+			goto error;
+		}
+	}
+	for (size_t i = 0; i < ctx->opt_blocks_count; ++i) {
+		ctx->opt_blocks[i].id = peek.opt_blocks[i].id;
+		ctx->opt_blocks[i].data_length = peek.opt_blocks[i].length / 2;
+		r = tr31_ctx_alloc(ctx, ctx->opt_blocks[i].data_length, &ctx->opt_blocks[i].data);
+		if (r) {
+			// return error value as-is
+			goto error;
+		}
+		r = tr31_hex_to_bin(key_block + peek.opt_blocks[i].offset, ctx->opt_blocks[i].data, ctx->opt_blocks[i].data_length);
+		if (r) {
+			r = TR31_ERROR_INVALID_OPTIONAL_BLOCK_DATA;
+			goto error;
+		}
+	}
 
 	// add payload data to context object
-	ctx->payload = calloc(1, ctx->payload_length);
-	r = hex_to_bin(ptr, ctx->payload, ctx->payload_length);
+	r = tr31_ctx_alloc(ctx, ctx->payload_length, &ctx->payload);
 	if (r) {
-		r = TR31_ERROR_INVALID_PAYLOAD_FIELD;
+		// return error value as-is
 		goto error;
 	}
-	ptr += key_block_payload_length;
-
-	// ensure that current point is valid for remaining authenticator
-	if (ptr - (void*)header + (ctx->authenticator_length * 2) != key_block_len) {
-		r = TR31_ERROR_INVALID_LENGTH;
+	r = tr31_hex_to_bin(key_block + peek.payload_offset, ctx->payload, ctx->payload_length);
+	if (r) {
+		r = TR31_ERROR_INVALID_PAYLOAD_FIELD;
 		goto error;
 	}
 
 	// add authenticator to context object
-	ctx->authenticator = calloc(1, ctx->authenticator_length);
-	r = hex_to_bin(ptr, ctx->authenticator, ctx->authenticator_length);
+	r = tr31_ctx_alloc(ctx, ctx->authenticator_length, &ctx->authenticator);
+	if (r) {
+		// return error value as-is
+		goto error;
+	}
+	r = tr31_hex_to_bin(key_block + peek.authenticator_offset, ctx->authenticator, ctx->authenticator_length);
 	if (r) {
 		r = TR31_ERROR_INVALID_AUTHENTICATOR_FIELD;
 		goto error;
 	}
+	tr31_stats_stage_end(TR31_STATS_STAGE_HEX_DECODE, stage_begin);
 
 	// if no key block protection key was provided, we are done
 	if (!kbpk) {
@@ -787,7 +1446,7 @@ int tr31_import(
 		case TR31_VERSION_A:
 		case TR31_VERSION_C: {
 			// only allow TDES key block protection keys
-			if (kbpk->algorithm != TR31_KEY_ALGORITHM_TDES) {
+			if (kbpk->key.algorithm != TR31_KEY_ALGORITHM_TDES) {
 				r = TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM;
 				goto error;
 			}
@@ -807,20 +1466,12 @@ int tr31_import(
 				goto error;
 			}
 
-			// validate payload length field
-			if (ctx->key.length != TDES2_KEY_SIZE &&
-				ctx->key.length != TDES3_KEY_SIZE
-			) {
-				r = TR31_ERROR_INVALID_KEY_LENGTH;
-				goto error;
-			}
-
 			break;
 		}
 
 		case TR31_VERSION_B: {
 			// only allow TDES key block protection keys
-			if (kbpk->algorithm != TR31_KEY_ALGORITHM_TDES) {
+			if (kbpk->key.algorithm != TR31_KEY_ALGORITHM_TDES) {
 				r = TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM;
 				goto error;
 			}
@@ -834,26 +1485,18 @@ int tr31_import(
 			}
 
 			// decrypt and verify payload
-			r = tr31_tdes_decrypt_verify_derivation_binding(ctx, kbpk);
+			r = tr31_decrypt_verify_derivation_binding(ctx, kbpk, deferred);
 			if (r) {
 				// return error value as-is
 				goto error;
 			}
 
-			// validate payload length field
-			if (ctx->key.length != TDES2_KEY_SIZE &&
-				ctx->key.length != TDES3_KEY_SIZE
-			) {
-				r = TR31_ERROR_INVALID_KEY_LENGTH;
-				goto error;
-			}
-
 			break;
 		}
 
 		case TR31_VERSION_D: {
 			// only allow AES key block protection keys
-			if (kbpk->algorithm != TR31_KEY_ALGORITHM_AES) {
+			if (kbpk->key.algorithm != TR31_KEY_ALGORITHM_AES) {
 				r = TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM;
 				goto error;
 			}
@@ -870,45 +1513,110 @@ int tr31_import(
 			}
 
 			// decrypt and verify payload
-			r = tr31_aes_decrypt_verify_derivation_binding(ctx, kbpk);
+			r = tr31_decrypt_verify_derivation_binding(ctx, kbpk, deferred);
 			if (r) {
 				// return error value as-is
 				goto error;
 			}
 
-			// validate payload length field
-			switch (ctx->key.algorithm) {
-				case TR31_KEY_ALGORITHM_TDES:
-					if (ctx->key.length != TDES2_KEY_SIZE &&
-						ctx->key.length != TDES3_KEY_SIZE
-					) {
-						r = TR31_ERROR_INVALID_KEY_LENGTH;
-						goto error;
-					}
-					break;
-
-				case TR31_KEY_ALGORITHM_AES:
-					if (ctx->key.length != AES128_KEY_SIZE &&
-						ctx->key.length != AES192_KEY_SIZE &&
-						ctx->key.length != AES256_KEY_SIZE
-					) {
-						r = TR31_ERROR_INVALID_KEY_LENGTH;
-						goto error;
-					}
-					break;
+			break;
+		}
 
-				default:
-					// unsupported; continue
-					break;
+		default:
+			// invalid format version
+			return -1;
+	}
+
+	// if verification was deferred, the payload length field is validated
+	// by tr31_import_deferred_finish()
+	if (deferred && deferred->pending) {
+		r = 0;
+		goto exit;
+	}
+
+	// validate payload length field
+	r = tr31_import_validate_key_length(ctx);
+	if (r) {
+		// return error value as-is
+		goto error;
+	}
+
+	r = 0;
+	goto exit;
+
+error:
+	tr31_release(ctx);
+exit:
+	return r;
+}
+
+static int tr31_import_validate_key_length(const struct tr31_ctx_t* ctx)
+{
+	switch (ctx->version) {
+		case TR31_VERSION_A:
+		case TR31_VERSION_B:
+		case TR31_VERSION_C:
+			if (ctx->key.length != TDES2_KEY_SIZE &&
+				ctx->key.length != TDES3_KEY_SIZE
+			) {
+				return TR31_ERROR_INVALID_KEY_LENGTH;
 			}
+			return 0;
 
-			break;
-		}
+		case TR31_VERSION_D:
+			switch (ctx->key.algorithm) {
+				case TR31_KEY_ALGORITHM_TDES:
+					if (ctx->key.length != TDES2_KEY_SIZE &&
+						ctx->key.length != TDES3_KEY_SIZE
+					) {
+						return TR31_ERROR_INVALID_KEY_LENGTH;
+					}
+					return 0;
+
+				case TR31_KEY_ALGORITHM_AES:
+					if (ctx->key.length != AES128_KEY_SIZE &&
+						ctx->key.length != AES192_KEY_SIZE &&
+						ctx->key.length != AES256_KEY_SIZE
+					) {
+						return TR31_ERROR_INVALID_KEY_LENGTH;
+					}
+					return 0;
+
+				default:
+					// unsupported; continue
+					return 0;
+			}
 
 		default:
 			// invalid format version
 			return -1;
 	}
+}
+
+static int tr31_import_deferred_finish(struct tr31_ctx_t* ctx, struct tr31_deferred_auth_t* deferred)
+{
+	int r;
+	const struct tr31_payload_t* decrypted_payload = (const struct tr31_payload_t*)deferred->decrypted_payload;
+
+	// verify authenticator
+	if (deferred->cmac_job->result) {
+		r = TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED;
+		goto error;
+	}
+
+	// extract key data
+	r = tr31_ctx_set_key_data(ctx, decrypted_payload->data, deferred->key_length);
+	if (r) {
+		// return error value as-is
+		goto error;
+	}
+
+	// validate payload length field
+	r = tr31_import_validate_key_length(ctx);
+	if (r) {
+		// return error value as-is
+		goto error;
+	}
 
 	r = 0;
 	goto exit;
@@ -916,6 +1624,9 @@ int tr31_import(
 error:
 	tr31_release(ctx);
 exit:
+	// cleanse sensitive buffers
+	tr31_cleanse(deferred, sizeof(*deferred));
+	tr31_stats_import_done(r);
 	return r;
 }
 
@@ -925,12 +1636,75 @@ int tr31_export(
 	char* key_block,
 	size_t key_block_len
 )
+{
+	int r;
+	struct tr31_kbpk_t prepared_kbpk;
+
+	if (!ctx || !kbpk || !key_block || !key_block_len) {
+		return -1;
+	}
+
+	r = tr31_kbpk_init(kbpk, &prepared_kbpk);
+	if (r) {
+		tr31_kbpk_cleanup(&prepared_kbpk);
+		// return error value as-is
+		return r;
+	}
+
+	r = tr31_export_prepared(ctx, &prepared_kbpk, key_block, key_block_len);
+	tr31_kbpk_cleanup(&prepared_kbpk);
+
+	return r;
+}
+
+int tr31_export_prepared(
+	struct tr31_ctx_t* ctx,
+	struct tr31_kbpk_t* kbpk,
+	char* key_block,
+	size_t key_block_len
+)
+{
+	return tr31_export_internal(ctx, kbpk, key_block, key_block_len, NULL);
+}
+
+static int tr31_export_internal(
+	struct tr31_ctx_t* ctx,
+	struct tr31_kbpk_t* kbpk,
+	char* key_block,
+	size_t key_block_len,
+	struct tr31_deferred_auth_t* deferred
+)
+{
+	int r;
+
+	r = tr31_export_wrap(ctx, kbpk, key_block, key_block_len, deferred);
+	if (r && ctx && key_block && key_block_len) {
+		tr31_export_clear(ctx, key_block, key_block_len);
+	}
+
+	// if authentication was deferred, the export is completed by
+	// tr31_export_deferred_finish()
+	if (!deferred || !deferred->pending) {
+		tr31_stats_export_done(r);
+	}
+
+	return r;
+}
+
+static int tr31_export_wrap(
+	struct tr31_ctx_t* ctx,
+	struct tr31_kbpk_t* kbpk,
+	char* key_block,
+	size_t key_block_len,
+	struct tr31_deferred_auth_t* deferred
+)
 {
 	int r;
 	struct tr31_header_t* header;
 	size_t opt_blk_len_total = 0;
 	unsigned int enc_block_size;
 	void* ptr;
+	uint64_t stage_begin;
 
 	if (!ctx || !kbpk || !key_block || !key_block_len) {
 		return -1;
@@ -943,10 +1717,12 @@ int tr31_export(
 	--key_block_len;
 
 	// validate minimum length
+	// note that the output buffer is not cleared in advance because it may
+	// be much larger than the key block (see tr31_export_batch_contiguous())
+	// and is instead cleared by tr31_export_clear() upon failure
 	if (key_block_len < TR31_MIN_KEY_BLOCK_LENGTH) {
 		return TR31_ERROR_INVALID_LENGTH;
 	}
-	memset(key_block, 0, key_block_len);
 
 	// validate key block format version
 	// set associated payload length and authenticator length
@@ -1011,14 +1787,21 @@ int tr31_export(
 			!ctx->opt_blocks[i].data_length &&
 			!ctx->opt_blocks[i].data
 		) {
-			if (!ctx->key.kcv_len) {
-				return TR31_ERROR_KCV_NOT_AVAILABLE;
+			// compute KCV now if it was deferred
+			r = tr31_key_get_kcv(&ctx->key);
+			if (r) {
+				// return error value as-is
+				return r;
 			}
 
 			// build optional block KC (KCV of wrapped key)
 			// see TR-31:2018, A.5.8 KCV Optional Block Format
 			ctx->opt_blocks[i].data_length = ctx->key.kcv_len + 1; // +1 for KCV algorithm
-			ctx->opt_blocks[i].data = calloc(1, ctx->opt_blocks[i].data_length);
+			r = tr31_ctx_alloc(ctx, ctx->opt_blocks[i].data_length, &ctx->opt_blocks[i].data);
+			if (r) {
+				// return error value as-is
+				return r;
+			}
 			memcpy(ctx->opt_blocks[i].data, &ctx->key.kcv_algorithm, 1);
 			memcpy(ctx->opt_blocks[i].data + 1, ctx->key.kcv, ctx->key.kcv_len);
 		}
@@ -1028,20 +1811,28 @@ int tr31_export(
 			!ctx->opt_blocks[i].data_length &&
 			!ctx->opt_blocks[i].data
 		) {
-			if (!kbpk->kcv_len) {
-				return TR31_ERROR_KCV_NOT_AVAILABLE;
+			// compute KCV now if it was deferred
+			r = tr31_key_get_kcv(&kbpk->key);
+			if (r) {
+				// return error value as-is
+				return r;
 			}
 
 			// build optional block KP (KCV of KBPK)
 			// see TR-31:2018, A.5.8 KCV Optional Block Format
-			ctx->opt_blocks[i].data_length = kbpk->kcv_len + 1; // +1 for KCV algorithm
-			ctx->opt_blocks[i].data = calloc(1, ctx->opt_blocks[i].data_length);
-			memcpy(ctx->opt_blocks[i].data, &kbpk->kcv_algorithm, 1);
-			memcpy(ctx->opt_blocks[i].data + 1, kbpk->kcv, kbpk->kcv_len);
+			ctx->opt_blocks[i].data_length = kbpk->key.kcv_len + 1; // +1 for KCV algorithm
+			r = tr31_ctx_alloc(ctx, ctx->opt_blocks[i].data_length, &ctx->opt_blocks[i].data);
+			if (r) {
+				// return error value as-is
+				return r;
+			}
+			memcpy(ctx->opt_blocks[i].data, &kbpk->key.kcv_algorithm, 1);
+			memcpy(ctx->opt_blocks[i].data + 1, kbpk->key.kcv, kbpk->key.kcv_len);
 		}
 	}
 
 	// populate optional blocks
+	stage_begin = tr31_stats_stage_begin();
 	for (size_t i = 0; i < ctx->opt_blocks_count; ++i) {
 		// ensure that current pointer is valid for minimal optional block
 		if (ptr + sizeof(struct tr31_opt_blk_t) - (void*)header > key_block_len) {
@@ -1066,7 +1857,7 @@ int tr31_export(
 			// optional block payload length is non-zero but optional block data is missing
 			return TR31_ERROR_INVALID_OPTIONAL_BLOCK_DATA;
 		}
-		r = bin_to_hex(
+		r = tr31_bin_to_hex(
 			ctx->opt_blocks[i].data,
 			ctx->opt_blocks[i].data_length,
 			opt_blk->data,
@@ -1079,6 +1870,7 @@ int tr31_export(
 		// advance current pointer
 		ptr += opt_blk_len;
 	}
+	tr31_stats_stage_end(TR31_STATS_STAGE_HEX_ENCODE, stage_begin);
 
 	// TR-31:2018, A.2 (page 18) indicates that the total length of all
 	// optional blocks will be a must be a multiple of the encryption block
@@ -1133,98 +1925,777 @@ int tr31_export(
 		return TR31_ERROR_INVALID_LENGTH;
 	}
 
-	// update key block length in header
-	ctx->length = final_key_block_len;
-	int_to_dec(ctx->length, header->length, sizeof(header->length));
+	// update key block length in header
+	ctx->length = final_key_block_len;
+	int_to_dec(ctx->length, header->length, sizeof(header->length));
+
+	switch (ctx->version) {
+		case TR31_VERSION_A:
+		case TR31_VERSION_C:
+			// only allow TDES key block protection keys
+			if (kbpk->key.algorithm != TR31_KEY_ALGORITHM_TDES) {
+				return TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM;
+			}
+
+			// encrypt and sign payload
+			// this will populate:
+			//   ctx->payload
+			//   ctx->authenticator
+			r = tr31_tdes_encrypt_sign_variant_binding(ctx, kbpk);
+			if (r) {
+				// return error value as-is
+				return r;
+			}
+			break;
+
+		case TR31_VERSION_B:
+			// only allow TDES key block protection keys
+			if (kbpk->key.algorithm != TR31_KEY_ALGORITHM_TDES) {
+				return TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM;
+			}
+
+			// sign and encrypt payload
+			// this will populate:
+			//   ctx->payload
+			//   ctx->authenticator
+			r = tr31_encrypt_sign_derivation_binding(ctx, kbpk, deferred);
+			if (r) {
+				// return error value as-is
+				return r;
+			}
+			break;
+
+		case TR31_VERSION_D:
+			// only allow AES key block protection keys
+			if (kbpk->key.algorithm != TR31_KEY_ALGORITHM_AES) {
+				return TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM;
+			}
+
+			// sign and encrypt payload
+			// this will populate:
+			//   ctx->payload
+			//   ctx->authenticator
+			r = tr31_encrypt_sign_derivation_binding(ctx, kbpk, deferred);
+			if (r) {
+				// return error value as-is
+				return r;
+			}
+			break;
+
+		default:
+			// invalid format version
+			return -3;
+	}
+
+	// if authentication was deferred, the key block is completed by
+	// tr31_export_deferred_finish()
+	if (deferred && deferred->pending) {
+		return 0;
+	}
+
+	return tr31_export_finish(ctx, key_block);
+}
+
+static int tr31_export_deferred_finish(
+	struct tr31_ctx_t* ctx,
+	struct tr31_kbpk_t* kbpk,
+	struct tr31_deferred_auth_t* deferred,
+	char* key_block
+)
+{
+	int r;
+	uint64_t stage_begin;
+
+	// add authenticator to context object
+	memcpy(ctx->authenticator, deferred->cmac_job->cmac, ctx->authenticator_length);
+	tr31_cleanse(deferred->cmac_job->cmac, sizeof(deferred->cmac_job->cmac));
+
+	// encrypt key payload; note that the authenticator is used as the IV
+	stage_begin = tr31_stats_stage_begin();
+	r = tr31_cipher_encrypt_cbc(kbpk->derived_kbek, ctx->authenticator, deferred->decrypted_payload, ctx->payload_length, ctx->payload);
+	tr31_stats_stage_end(TR31_STATS_STAGE_ENCRYPT, stage_begin);
+	tr31_cleanse(deferred, sizeof(*deferred));
+	if (r) {
+		goto exit;
+	}
+
+	r = tr31_export_finish(ctx, key_block);
+	if (r) {
+		goto exit;
+	}
+
+	r = 0;
+	goto exit;
+
+exit:
+	if (r) {
+		// the final key block length was validated before the authenticator
+		// was generated
+		tr31_export_clear(ctx, key_block, ctx->length + 1);
+	}
+	tr31_stats_export_done(r);
+	return r;
+}
+
+static void tr31_export_clear(const struct tr31_ctx_t* ctx, char* key_block, size_t key_block_len)
+{
+	size_t len;
+
+	// the output buffer may be much larger than the key block (see
+	// tr31_export_batch_contiguous()) and therefore only the part of the
+	// output buffer that may have been populated is cleared
+	len = sizeof(struct tr31_header_t)
+		+ 4 + AES_BLOCK_SIZE // maximum length of optional block PB
+		+ (ctx->payload_length * 2)
+		+ (ctx->authenticator_length * 2);
+	for (size_t i = 0; ctx->opt_blocks && i < ctx->opt_blocks_count; ++i) {
+		len += (ctx->opt_blocks[i].data_length * 2) + 4;
+	}
+	if (len < ctx->length + 1) {
+		len = ctx->length + 1;
+	}
+	if (len > key_block_len) {
+		len = key_block_len;
+	}
+
+	memset(key_block, 0, len);
+}
+
+static int tr31_export_finish(struct tr31_ctx_t* ctx, char* key_block)
+{
+	int r;
+	char* ptr;
+	uint64_t stage_begin;
+
+	// ensure that encrypted payload and authenticator are available
+	if (!ctx->payload || !ctx->authenticator) {
+		// internal error
+		return -4;
+	}
+
+	// payload is after the header, including optional blocks
+	// note that the final key block length was validated before the
+	// authenticator was generated
+	ptr = key_block + ctx->header_length;
+
+	// add payload to key block
+	stage_begin = tr31_stats_stage_begin();
+	r = tr31_bin_to_hex(ctx->payload, ctx->payload_length, ptr, ctx->payload_length * 2);
+	if (r) {
+		// internal error
+		return -5;
+	}
+	ptr += (ctx->payload_length * 2);
+
+	// add authenticator to key block
+	r = tr31_bin_to_hex(ctx->authenticator, ctx->authenticator_length, ptr, ctx->authenticator_length * 2);
+	if (r) {
+		// internal error
+		return -6;
+	}
+	ptr += (ctx->authenticator_length * 2);
+	tr31_stats_stage_end(TR31_STATS_STAGE_HEX_ENCODE, stage_begin);
+
+	// null-terminate key block
+	*ptr = 0;
+
+	return 0;
+}
+
+int tr31_export_batch(
+	struct tr31_ctx_t* ctx,
+	size_t count,
+	const struct tr31_key_t* kbpk,
+	char* const* key_blocks,
+	const size_t* key_block_lens,
+	int* results
+)
+{
+	return tr31_export_batch_parallel(ctx, count, kbpk, key_blocks, key_block_lens, results, 1);
+}
+
+int tr31_export_batch_parallel(
+	struct tr31_ctx_t* ctx,
+	size_t count,
+	const struct tr31_key_t* kbpk,
+	char* const* key_blocks,
+	const size_t* key_block_lens,
+	int* results,
+	unsigned int workers
+)
+{
+	struct tr31_batch_job_t job;
+
+	if (!ctx || !kbpk || !key_blocks || !key_block_lens || !results) {
+		return -1;
+	}
+
+	memset(&job, 0, sizeof(job));
+	job.process_chunk = &tr31_batch_export_chunk;
+	job.kbpk = kbpk;
+	job.count = count;
+	job.key_blocks_out = key_blocks;
+	job.key_block_lens = key_block_lens;
+	job.ctx = ctx;
+	job.results = results;
+
+	return tr31_batch_run(&job, workers);
+}
+
+int tr31_export_batch_contiguous(
+	struct tr31_ctx_t* ctx,
+	size_t count,
+	const struct tr31_key_t* kbpk,
+	char* buf,
+	size_t buf_len,
+	struct tr31_key_block_ref_t* key_blocks,
+	int* results
+)
+{
+	int r;
+	struct tr31_kbpk_t prepared_kbpk;
+	size_t offset = 0;
+
+	if (!ctx || !kbpk || !buf || !key_blocks || !results) {
+		return -1;
+	}
+
+	// prepare key block protection key once for the whole batch
+	r = tr31_kbpk_init(kbpk, &prepared_kbpk);
+	if (r) {
+		tr31_kbpk_cleanup(&prepared_kbpk);
+		// return error value as-is
+		return r;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		key_blocks[i].key_block = NULL;
+		key_blocks[i].length = 0;
+
+		if (offset >= buf_len) {
+			results[i] = TR31_ERROR_INVALID_LENGTH;
+			continue;
+		}
+
+		// report the result for each key block and continue with the next
+		results[i] = tr31_export_prepared(&ctx[i], &prepared_kbpk, buf + offset, buf_len - offset);
+		if (results[i]) {
+			// failed key blocks do not consume output buffer space
+			continue;
+		}
+
+		// each key block is followed by its null-termination
+		key_blocks[i].key_block = buf + offset;
+		key_blocks[i].length = ctx[i].length;
+		offset += ctx[i].length + 1;
+	}
+
+	tr31_kbpk_cleanup(&prepared_kbpk);
+
+	return 0;
+}
+
+int tr31_translate(
+	const char* key_block,
+	size_t key_block_len,
+	const struct tr31_key_t* import_kbpk,
+	const struct tr31_key_t* export_kbpk,
+	const struct tr31_translate_t* translate,
+	char* out,
+	size_t out_len
+)
+{
+	int r;
+	struct tr31_kbpk_t prepared_import_kbpk;
+	struct tr31_kbpk_t prepared_export_kbpk;
+
+	if (!key_block || !import_kbpk || !export_kbpk || !out || !out_len) {
+		return -1;
+	}
+
+	r = tr31_kbpk_init(import_kbpk, &prepared_import_kbpk);
+	if (r) {
+		tr31_kbpk_cleanup(&prepared_import_kbpk);
+		// return error value as-is
+		return r;
+	}
+
+	r = tr31_kbpk_init(export_kbpk, &prepared_export_kbpk);
+	if (r) {
+		tr31_kbpk_cleanup(&prepared_export_kbpk);
+		tr31_kbpk_cleanup(&prepared_import_kbpk);
+		// return error value as-is
+		return r;
+	}
+
+	r = tr31_translate_prepared(
+		key_block,
+		key_block_len,
+		&prepared_import_kbpk,
+		&prepared_export_kbpk,
+		translate,
+		out,
+		out_len
+	);
+	tr31_kbpk_cleanup(&prepared_export_kbpk);
+	tr31_kbpk_cleanup(&prepared_import_kbpk);
+
+	return r;
+}
+
+int tr31_translate_prepared(
+	const char* key_block,
+	size_t key_block_len,
+	struct tr31_kbpk_t* import_kbpk,
+	struct tr31_kbpk_t* export_kbpk,
+	const struct tr31_translate_t* translate,
+	char* out,
+	size_t out_len
+)
+{
+	int r;
+	struct tr31_ctx_t ctx;
+	void* arena;
+	size_t arena_len;
+
+	if (!key_block || !import_kbpk || !export_kbpk || !out || !out_len) {
+		return -1;
+	}
+
+	// ensure that the context object can be released regardless of where
+	// the import failed
+	memset(&ctx, 0, sizeof(ctx));
+
+	// the decrypted key data is only held by a locked scratch arena that is
+	// owned by this function
+	// longer key blocks are rejected by the import before the arena is used
+	if (key_block_len > TR31_MAX_KEY_BLOCK_LENGTH) {
+		arena_len = TR31_IMPORT_ARENA_LENGTH(TR31_MAX_KEY_BLOCK_LENGTH);
+	} else {
+		arena_len = TR31_IMPORT_ARENA_LENGTH(key_block_len);
+	}
+	arena = tr31_secmem_scratch_alloc(arena_len);
+	if (!arena) {
+		return -2;
+	}
+
+	// import key block such that the decrypted key data is available in the
+	// context object
+	r = tr31_import_internal(key_block, key_block_len, import_kbpk, arena, arena_len, &ctx, NULL);
+	if (r) {
+		// return error value as-is
+		goto exit;
+	}
+
+	// move all other context object data to the heap such that it can be
+	// remapped and extended by tr31_export()
+	r = tr31_translate_detach(&ctx);
+	if (r) {
+		// return error value as-is
+		goto exit;
+	}
+
+	// remap header fields and optional blocks
+	r = tr31_translate_remap(&ctx, translate);
+	if (r) {
+		// return error value as-is
+		goto exit;
+	}
+
+	// ensure that the output key block can be imported
+	r = tr31_import_validate_key_length(&ctx);
+	if (r) {
+		// return error value as-is
+		goto exit;
+	}
+
+	// ensure that the key is not protected by a weaker KBPK
+	if (tr31_translate_key_strength(&ctx.key) > tr31_translate_key_strength(&export_kbpk->key)) {
+		r = TR31_ERROR_KBPK_TOO_WEAK;
+		goto exit;
+	}
+
+	// export the same context object such that the key data is not copied
+	r = tr31_export_internal(&ctx, export_kbpk, out, out_len, NULL);
+	if (r) {
+		// return error value as-is
+		goto exit;
+	}
+
+	r = 0;
+	goto exit;
+
+exit:
+	if (!ctx.arena) {
+		// key data remains owned by the arena after detaching
+		ctx.key.data = NULL;
+		ctx.key.length = 0;
+	}
+	tr31_release(&ctx);
+	tr31_secmem_scratch_free(arena, arena_len);
+	return r;
+}
+
+static int tr31_translate_detach(struct tr31_ctx_t* ctx)
+{
+	struct tr31_opt_ctx_t* opt_blocks = NULL;
+
+	// copy optional blocks because the optional block array cannot grow
+	// within the arena
+	if (ctx->opt_blocks && ctx->opt_blocks_count) {
+		opt_blocks = tr31_alloc(ctx->opt_blocks_count * sizeof(struct tr31_opt_ctx_t));
+		if (!opt_blocks) {
+			return -1;
+		}
+
+		for (size_t i = 0; i < ctx->opt_blocks_count; ++i) {
+			opt_blocks[i].id = ctx->opt_blocks[i].id;
+			if (!ctx->opt_blocks[i].data || !ctx->opt_blocks[i].data_length) {
+				continue;
+			}
+
+			opt_blocks[i].data = tr31_alloc(ctx->opt_blocks[i].data_length);
+			if (!opt_blocks[i].data) {
+				for (size_t j = 0; j < i; ++j) {
+					tr31_free(opt_blocks[j].data, opt_blocks[j].data_length);
+				}
+				tr31_free(opt_blocks, ctx->opt_blocks_count * sizeof(struct tr31_opt_ctx_t));
+				return -1;
+			}
+			opt_blocks[i].data_length = ctx->opt_blocks[i].data_length;
+			memcpy(opt_blocks[i].data, ctx->opt_blocks[i].data, opt_blocks[i].data_length);
+		}
+	}
+	ctx->opt_blocks = opt_blocks;
+
+	// the payload and authenticator of the input key block are replaced by
+	// those of the output key block while the key data remains in the arena
+	ctx->payload = NULL;
+	ctx->authenticator = NULL;
+	ctx->arena = NULL;
+	ctx->arena_length = 0;
+	ctx->arena_used = 0;
+
+	return 0;
+}
+
+static int tr31_translate_remap(struct tr31_ctx_t* ctx, const struct tr31_translate_t* translate)
+{
+	int r;
+	unsigned int flags = 0;
+	size_t opt_blocks_count = 0;
+	bool has_KC = false;
+	bool has_KP = false;
+
+	if (translate) {
+		struct tr31_key_t key;
+		char key_version[2];
+
+		// validate format version
+		switch (translate->version) {
+			case 0:
+				// retain format version
+				break;
+
+			case TR31_VERSION_A:
+			case TR31_VERSION_B:
+			case TR31_VERSION_C:
+			case TR31_VERSION_D:
+				ctx->version = translate->version;
+				break;
+
+			default:
+				return TR31_ERROR_UNSUPPORTED_VERSION;
+		}
+
+		// validate remapped header fields without copying the key data
+		r = tr31_key_get_key_version(&ctx->key, key_version);
+		if (r) {
+			// return error value as-is
+			return r;
+		}
+		r = tr31_key_init(
+			translate->usage ? translate->usage : ctx->key.usage,
+			ctx->key.algorithm,
+			translate->mode_of_use ? translate->mode_of_use : ctx->key.mode_of_use,
+			translate->key_version ? translate->key_version : key_version,
+			translate->exportability ? translate->exportability : ctx->key.exportability,
+			NULL,
+			0,
+			&key
+		);
+		if (r) {
+			// return error value as-is
+			return r;
+		}
+		ctx->key.usage = key.usage;
+		ctx->key.mode_of_use = key.mode_of_use;
+		ctx->key.key_version = key.key_version;
+		ctx->key.key_version_value = key.key_version_value;
+		ctx->key.exportability = key.exportability;
+
+		flags = translate->flags;
+	}
+
+	// retain optional blocks in their original order, except for those that
+	// depend on the output key block
+	for (size_t i = 0; ctx->opt_blocks && i < ctx->opt_blocks_count; ++i) {
+		struct tr31_opt_ctx_t opt_block = ctx->opt_blocks[i];
+
+		// optional block PB is regenerated by tr31_export() as required by
+		// the encryption block size of the output format version
+		if ((flags & TR31_TRANSLATE_DROP_OPT_BLOCKS) ||
+			opt_block.id == TR31_OPT_BLOCK_PB
+		) {
+			tr31_free(opt_block.data, opt_block.data_length);
+			continue;
+		}
+
+		// optional block KP without data is recomputed by tr31_export() for
+		// the output key block protection key
+		if (opt_block.id == TR31_OPT_BLOCK_KP) {
+			tr31_free(opt_block.data, opt_block.data_length);
+			opt_block.data = NULL;
+			opt_block.data_length = 0;
+			has_KP = true;
+		}
+		if (opt_block.id == TR31_OPT_BLOCK_KC) {
+			has_KC = true;
+		}
+
+		ctx->opt_blocks[opt_blocks_count++] = opt_block;
+	}
+
+	// shrink optional block array if optional blocks were omitted
+	if (ctx->opt_blocks && opt_blocks_count != ctx->opt_blocks_count) {
+		if (opt_blocks_count) {
+			struct tr31_opt_ctx_t* opt_blocks;
+
+			opt_blocks = tr31_realloc(
+				ctx->opt_blocks,
+				ctx->opt_blocks_count * sizeof(struct tr31_opt_ctx_t),
+				opt_blocks_count * sizeof(struct tr31_opt_ctx_t)
+			);
+			if (!opt_blocks) {
+				// omitted optional blocks were already released
+				for (size_t i = opt_blocks_count; i < ctx->opt_blocks_count; ++i) {
+					ctx->opt_blocks[i].data = NULL;
+					ctx->opt_blocks[i].data_length = 0;
+				}
+				return -1;
+			}
+			ctx->opt_blocks = opt_blocks;
+		} else {
+			tr31_free(ctx->opt_blocks, ctx->opt_blocks_count * sizeof(struct tr31_opt_ctx_t));
+			ctx->opt_blocks = NULL;
+		}
+		ctx->opt_blocks_count = opt_blocks_count;
+	}
+
+	// add optional blocks to be computed by tr31_export()
+	if ((flags & TR31_TRANSLATE_ADD_KC) && !has_KC) {
+		r = tr31_opt_block_add_KC(ctx);
+		if (r) {
+			// return error value as-is
+			return r;
+		}
+	}
+	if ((flags & TR31_TRANSLATE_ADD_KP) && !has_KP) {
+		r = tr31_opt_block_add_KP(ctx);
+		if (r) {
+			// return error value as-is
+			return r;
+		}
+	}
+
+	return 0;
+}
+
+static unsigned int tr31_translate_key_strength(const struct tr31_key_t* key)
+{
+	// security strength in bits
+	// see NIST SP 800-57 Part 1 Rev. 5, table 2
+	switch (key->algorithm) {
+		case TR31_KEY_ALGORITHM_TDES:
+			if (key->length >= TDES3_KEY_SIZE) {
+				return 112;
+			}
+			if (key->length >= TDES2_KEY_SIZE) {
+				return 80;
+			}
+			return 56;
+
+		case TR31_KEY_ALGORITHM_AES:
+			return key->length * 8;
+
+		default:
+			// unknown; not compared
+			return 0;
+	}
+}
+
+static int tr31_kbpk_init(const struct tr31_key_t* key, struct tr31_kbpk_t* kbpk)
+{
+	memset(kbpk, 0, sizeof(*kbpk));
+
+	if (!key->data || !key->length) {
+		return -1;
+	}
+	if (key->length > sizeof(kbpk->key_data)) {
+		return TR31_ERROR_UNSUPPORTED_KBPK_LENGTH;
+	}
+
+	// copy key block protection key such that the caller's key object need
+	// not outlive the prepared key block protection key
+	kbpk->key = *key;
+	memcpy(kbpk->key_data, key->data, key->length);
+	kbpk->key.data = kbpk->key_data;
+
+	return 0;
+}
+
+static void tr31_kbpk_cleanup(struct tr31_kbpk_t* kbpk)
+{
+	tr31_cipher_free(kbpk->variant_kbek);
+	tr31_cipher_free(kbpk->variant_kbak);
+	tr31_cipher_free(kbpk->derived_kbek);
+	tr31_cipher_free(kbpk->derived_kbak);
+	if (kbpk->rand_pool) {
+		tr31_rand_pool_cleanse(kbpk->rand_pool);
+	}
+
+	// cleanse sensitive buffers
+	tr31_cleanse(kbpk, sizeof(*kbpk));
+}
+
+static int tr31_kbpk_setup_variant(struct tr31_kbpk_t* kbpk)
+{
+	int r;
+	uint8_t kbek[TDES3_KEY_SIZE];
+	uint8_t kbak[TDES3_KEY_SIZE];
+	uint64_t stage_begin;
+
+	if (kbpk->variant_kbek && kbpk->variant_kbak) {
+		// already available
+		return 0;
+	}
+	stage_begin = tr31_stats_stage_begin();
+
+	// output key block encryption key variant and key block authentication key variant
+	r = tr31_tdes_kbpk_variant(kbpk->key.data, kbpk->key.length, kbek, kbak);
+	if (r) {
+		// return error value as-is
+		goto exit;
+	}
+
+	r = tr31_tdes_cipher_new(kbek, kbpk->key.length, &kbpk->variant_kbek);
+	if (r) {
+		// return error value as-is
+		goto exit;
+	}
+	r = tr31_tdes_cipher_new(kbak, kbpk->key.length, &kbpk->variant_kbak);
+	if (r) {
+		tr31_cipher_free(kbpk->variant_kbek);
+		kbpk->variant_kbek = NULL;
+		// return error value as-is
+		goto exit;
+	}
+	tr31_stats_stage_end(TR31_STATS_STAGE_KBPK, stage_begin);
+
+	r = 0;
+	goto exit;
 
-	switch (ctx->version) {
-		case TR31_VERSION_A:
-		case TR31_VERSION_C:
-			// only allow TDES key block protection keys
-			if (kbpk->algorithm != TR31_KEY_ALGORITHM_TDES) {
-				return TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM;
-			}
+exit:
+	// cleanse sensitive buffers
+	tr31_cleanse(kbek, sizeof(kbek));
+	tr31_cleanse(kbak, sizeof(kbak));
 
-			// encrypt and sign payload
-			// this will populate:
-			//   ctx->payload
-			//   ctx->authenticator
-			r = tr31_tdes_encrypt_sign_variant_binding(ctx, kbpk);
+	return r;
+}
+
+static int tr31_kbpk_setup_derivation(struct tr31_kbpk_t* kbpk)
+{
+	int r;
+	uint8_t kbek[AES256_KEY_SIZE];
+	uint8_t kbak[AES256_KEY_SIZE];
+	uint64_t stage_begin;
+
+	if (kbpk->derived_kbek && kbpk->derived_kbak) {
+		// already available
+		return 0;
+	}
+	stage_begin = tr31_stats_stage_begin();
+
+	// derive key block encryption key and key block authentication key from key block protection key
+	switch (kbpk->key.algorithm) {
+		case TR31_KEY_ALGORITHM_TDES:
+			r = tr31_tdes_kbpk_derive(kbpk->key.data, kbpk->key.length, kbek, kbak);
 			if (r) {
 				// return error value as-is
-				return r;
-			}
-			break;
-
-		case TR31_VERSION_B:
-			// only allow TDES key block protection keys
-			if (kbpk->algorithm != TR31_KEY_ALGORITHM_TDES) {
-				return TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM;
+				goto exit;
 			}
-
-			// sign and encrypt payload
-			// this will populate:
-			//   ctx->payload
-			//   ctx->authenticator
-			r = tr31_tdes_encrypt_sign_derivation_binding(ctx, kbpk);
+			r = tr31_tdes_cipher_new(kbek, kbpk->key.length, &kbpk->derived_kbek);
 			if (r) {
 				// return error value as-is
-				return r;
+				goto exit;
 			}
+			r = tr31_tdes_cipher_new(kbak, kbpk->key.length, &kbpk->derived_kbak);
 			break;
 
-		case TR31_VERSION_D:
-			// only allow AES key block protection keys
-			if (kbpk->algorithm != TR31_KEY_ALGORITHM_AES) {
-				return TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM;
+		case TR31_KEY_ALGORITHM_AES:
+			r = tr31_aes_kbpk_derive(kbpk->key.data, kbpk->key.length, kbek, kbak);
+			if (r) {
+				// return error value as-is
+				goto exit;
 			}
-
-			// sign and encrypt payload
-			// this will populate:
-			//   ctx->payload
-			//   ctx->authenticator
-			r = tr31_aes_encrypt_sign_derivation_binding(ctx, kbpk);
+			r = tr31_aes_cipher_new(kbek, kbpk->key.length, &kbpk->derived_kbek);
 			if (r) {
 				// return error value as-is
-				return r;
+				goto exit;
 			}
+			r = tr31_aes_cipher_new(kbak, kbpk->key.length, &kbpk->derived_kbak);
 			break;
 
 		default:
-			// invalid format version
-			return -3;
-	}
-
-	// ensure that encrypted payload and authenticator are available
-	if (!ctx->payload || !ctx->authenticator) {
-		// internal error
-		return -4;
+			r = TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM;
+			goto exit;
 	}
-
-	// add payload to key block
-	r = bin_to_hex(ctx->payload, ctx->payload_length, ptr, key_block_len);
 	if (r) {
-		// internal error
-		return -5;
+		tr31_cipher_free(kbpk->derived_kbek);
+		kbpk->derived_kbek = NULL;
+		// return error value as-is
+		goto exit;
 	}
-	ptr += (ctx->payload_length * 2);
+	tr31_stats_stage_end(TR31_STATS_STAGE_KBPK, stage_begin);
 
-	// add authenticator to key block
-	r = bin_to_hex(ctx->authenticator, ctx->authenticator_length, ptr, key_block_len);
-	if (r) {
-		// internal error
-		return -6;
-	}
+	r = 0;
+	goto exit;
 
-	return 0;
+exit:
+	// cleanse sensitive buffers
+	tr31_cleanse(kbek, sizeof(kbek));
+	tr31_cleanse(kbak, sizeof(kbak));
+
+	return r;
 }
 
-static int tr31_tdes_decrypt_verify_variant_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk)
+static void tr31_kbpk_rand(struct tr31_kbpk_t* kbpk, void* buf, size_t len)
+{
+	uint64_t stage_begin = tr31_stats_stage_begin();
+
+	if (kbpk->rand_pool) {
+		tr31_rand_pool_get(kbpk->rand_pool, buf, len);
+	} else {
+		tr31_rand(buf, len);
+	}
+	tr31_stats_stage_end(TR31_STATS_STAGE_RAND, stage_begin);
+}
+
+static int tr31_tdes_decrypt_verify_variant_binding(struct tr31_ctx_t* ctx, struct tr31_kbpk_t* kbpk)
 {
 	int r;
-	uint8_t kbek[TDES3_KEY_SIZE];
-	uint8_t kbak[TDES3_KEY_SIZE];
 	size_t key_length;
+	uint64_t stage_begin;
 
 	// buffer for decryption
 	uint8_t decrypted_payload_buf[ctx->payload_length];
@@ -1235,22 +2706,26 @@ static int tr31_tdes_decrypt_verify_variant_binding(struct tr31_ctx_t* ctx, cons
 	memcpy(mac_input, ctx->header, ctx->header_length);
 	memcpy(mac_input + ctx->header_length, ctx->payload, ctx->payload_length);
 
-	// output key block encryption key variant and key block authentication key variant
-	r = tr31_tdes_kbpk_variant(kbpk->data, kbpk->length, kbek, kbak);
+	// prepare key block encryption key variant and key block authentication key variant
+	r = tr31_kbpk_setup_variant(kbpk);
 	if (r) {
 		// return error value as-is
 		goto error;
 	}
 
 	// verify authenticator
-	r = tr31_tdes_verify_cbcmac(kbak, kbpk->length, mac_input, sizeof(mac_input), ctx->authenticator);
+	stage_begin = tr31_stats_stage_begin();
+	r = tr31_cipher_verify_cbcmac(kbpk->variant_kbak, mac_input, sizeof(mac_input), ctx->authenticator);
+	tr31_stats_stage_end(TR31_STATS_STAGE_MAC_VERIFY, stage_begin);
 	if (r) {
 		r = TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED;
 		goto error;
 	}
 
 	// decrypt key payload; note that the TR-31 header is used as the IV
-	r = tr31_tdes_decrypt_cbc(kbek, kbpk->length, ctx->header, ctx->payload, ctx->payload_length, decrypted_payload);
+	stage_begin = tr31_stats_stage_begin();
+	r = tr31_cipher_decrypt_cbc(kbpk->variant_kbek, ctx->header, ctx->payload, ctx->payload_length, decrypted_payload);
+	tr31_stats_stage_end(TR31_STATS_STAGE_DECRYPT, stage_begin);
 	if (r) {
 		// return error value as-is
 		goto error;
@@ -1265,7 +2740,7 @@ static int tr31_tdes_decrypt_verify_variant_binding(struct tr31_ctx_t* ctx, cons
 	}
 
 	// extract key data
-	r = tr31_key_set_data(&ctx->key, decrypted_payload->data, key_length);
+	r = tr31_ctx_set_key_data(ctx, decrypted_payload->data, key_length);
 	if (r) {
 		// return error value as-is
 		goto error;
@@ -1278,25 +2753,30 @@ static int tr31_tdes_decrypt_verify_variant_binding(struct tr31_ctx_t* ctx, cons
 error:
 exit:
 	// cleanse sensitive buffers
-	tr31_cleanse(kbek, sizeof(kbek));
-	tr31_cleanse(kbak, sizeof(kbak));
 	tr31_cleanse(decrypted_payload_buf, sizeof(decrypted_payload_buf));
 	tr31_cleanse(mac_input, sizeof(mac_input));
 
 	return r;
 }
 
-static int tr31_tdes_encrypt_sign_variant_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk)
+static int tr31_tdes_encrypt_sign_variant_binding(struct tr31_ctx_t* ctx, struct tr31_kbpk_t* kbpk)
 {
 	int r;
-	uint8_t kbek[TDES3_KEY_SIZE];
-	uint8_t kbak[TDES3_KEY_SIZE];
+	uint64_t stage_begin;
 
 	// add payload data to context object
-	ctx->payload = calloc(1, ctx->payload_length);
+	r = tr31_ctx_alloc(ctx, ctx->payload_length, &ctx->payload);
+	if (r) {
+		// return error value as-is
+		return r;
+	}
 
 	// add authenticator to context object
-	ctx->authenticator = calloc(1, ctx->authenticator_length);
+	r = tr31_ctx_alloc(ctx, ctx->authenticator_length, &ctx->authenticator);
+	if (r) {
+		// return error value as-is
+		return r;
+	}
 
 	// buffer for encrypted
 	uint8_t decrypted_payload_buf[ctx->payload_length];
@@ -1308,29 +2788,34 @@ static int tr31_tdes_encrypt_sign_variant_binding(struct tr31_ctx_t* ctx, const
 	// populate payload key
 	decrypted_payload->length = htons(ctx->key.length * 8); // payload length is big endian and in bits, not bytes
 	memcpy(decrypted_payload->data, ctx->key.data, ctx->key.length);
-	tr31_rand(
+	tr31_kbpk_rand(
+		kbpk,
 		decrypted_payload->data + ctx->key.length,
 		ctx->payload_length - sizeof(struct tr31_payload_t) - ctx->key.length
 	);
 
-	// output key block encryption key variant and key block authentication key variant
-	r = tr31_tdes_kbpk_variant(kbpk->data, kbpk->length, kbek, kbak);
+	// prepare key block encryption key variant and key block authentication key variant
+	r = tr31_kbpk_setup_variant(kbpk);
 	if (r) {
 		// return error value as-is
 		goto error;
 	}
 
 	// encrypt key payload; note that the TR-31 header is used as the IV
-	r = tr31_tdes_encrypt_cbc(kbek, kbpk->length, ctx->header, decrypted_payload, ctx->payload_length, ctx->payload);
+	stage_begin = tr31_stats_stage_begin();
+	r = tr31_cipher_encrypt_cbc(kbpk->variant_kbek, ctx->header, decrypted_payload, ctx->payload_length, ctx->payload);
+	tr31_stats_stage_end(TR31_STATS_STAGE_ENCRYPT, stage_begin);
 	if (r) {
 		// return error value as-is
 		goto error;
 	}
 
 	// generate authenticator
+	stage_begin = tr31_stats_stage_begin();
 	memcpy(mac_input, ctx->header, ctx->header_length);
 	memcpy(mac_input + ctx->header_length, ctx->payload, ctx->payload_length);
-	r = tr31_tdes_cbcmac(kbak, kbpk->length, mac_input, sizeof(mac_input), ctx->authenticator);
+	r = tr31_cipher_cbcmac(kbpk->variant_kbak, mac_input, sizeof(mac_input), ctx->authenticator);
+	tr31_stats_stage_end(TR31_STATS_STAGE_MAC_GENERATE, stage_begin);
 	if (r) {
 		// return error value as-is
 		goto error;
@@ -1343,35 +2828,41 @@ static int tr31_tdes_encrypt_sign_variant_binding(struct tr31_ctx_t* ctx, const
 error:
 exit:
 	// cleanse sensitive buffers
-	tr31_cleanse(kbek, sizeof(kbek));
-	tr31_cleanse(kbak, sizeof(kbak));
 	tr31_cleanse(decrypted_payload_buf, sizeof(decrypted_payload_buf));
 	tr31_cleanse(mac_input, sizeof(mac_input));
 
 	return r;
 }
 
-static int tr31_tdes_decrypt_verify_derivation_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk)
+static int tr31_decrypt_verify_derivation_binding(struct tr31_ctx_t* ctx, struct tr31_kbpk_t* kbpk, struct tr31_deferred_auth_t* deferred)
 {
 	int r;
-	uint8_t kbek[TDES3_KEY_SIZE];
-	uint8_t kbak[TDES3_KEY_SIZE];
+	struct tr31_cmac_ctx_t cmac_ctx;
 	size_t key_length;
+	uint64_t stage_begin;
 
-	// buffer for decryption and CMAC verification
-	uint8_t decrypted_key_block[ctx->header_length + ctx->payload_length];
-	memcpy(decrypted_key_block, ctx->header, ctx->header_length);
-	struct tr31_payload_t* decrypted_payload = (struct tr31_payload_t*)(decrypted_key_block + ctx->header_length);
+	// buffer for decryption
+	uint8_t decrypted_payload_buf[ctx->payload_length];
+	struct tr31_payload_t* decrypted_payload = (struct tr31_payload_t*)decrypted_payload_buf;
 
-	// derive key block encryption key and key block authentication key from key block protection key
-	r = tr31_tdes_kbpk_derive(kbpk->data, kbpk->length, kbek, kbak);
+	if (deferred && ctx->payload_length <= sizeof(deferred->decrypted_payload)) {
+		// decrypted payload must remain available until verification
+		decrypted_payload = (struct tr31_payload_t*)deferred->decrypted_payload;
+	} else {
+		deferred = NULL;
+	}
+
+	// prepare key block encryption key and key block authentication key
+	r = tr31_kbpk_setup_derivation(kbpk);
 	if (r) {
 		// return error value as-is
 		goto error;
 	}
 
 	// decrypt key payload; note that the authenticator is used as the IV
-	r = tr31_tdes_decrypt_cbc(kbek, kbpk->length, ctx->authenticator, ctx->payload, ctx->payload_length, decrypted_payload);
+	stage_begin = tr31_stats_stage_begin();
+	r = tr31_cipher_decrypt_cbc(kbpk->derived_kbek, ctx->authenticator, ctx->payload, ctx->payload_length, decrypted_payload);
+	tr31_stats_stage_end(TR31_STATS_STAGE_DECRYPT, stage_begin);
 	if (r) {
 		// return error value as-is
 		goto error;
@@ -1385,75 +2876,49 @@ static int tr31_tdes_decrypt_verify_derivation_binding(struct tr31_ctx_t* ctx, c
 		goto error;
 	}
 
+	if (deferred) {
+		// defer verification of authenticator to caller
+		memset(deferred->cmac_job, 0, sizeof(*deferred->cmac_job));
+		deferred->cmac_job->cipher = kbpk->derived_kbak;
+		deferred->cmac_job->buf[0] = ctx->header;
+		deferred->cmac_job->len[0] = ctx->header_length;
+		deferred->cmac_job->buf[1] = decrypted_payload;
+		deferred->cmac_job->len[1] = ctx->payload_length;
+		deferred->cmac_job->cmac_verify = ctx->authenticator;
+		deferred->key_length = key_length;
+		deferred->pending = true;
+		r = 0;
+		goto exit;
+	}
+
 	// verify authenticator
-	r = tr31_tdes_verify_cmac(kbak, kbpk->length, decrypted_key_block, sizeof(decrypted_key_block), ctx->authenticator);
+	// the header and the decrypted payload are processed incrementally such
+	// that they need not be concatenated
+	stage_begin = tr31_stats_stage_begin();
+	r = tr31_cmac_init(&cmac_ctx, kbpk->derived_kbak);
 	if (r) {
-		r = TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED;
+		// return error value as-is
 		goto error;
 	}
-
-	// extract key data
-	r = tr31_key_set_data(&ctx->key, decrypted_payload->data, key_length);
+	r = tr31_cmac_update(&cmac_ctx, ctx->header, ctx->header_length);
 	if (r) {
 		// return error value as-is
 		goto error;
 	}
-
-	// success
-	r = 0;
-	goto exit;
-
-error:
-exit:
-	// cleanse sensitive buffers
-	tr31_cleanse(kbek, sizeof(kbek));
-	tr31_cleanse(kbak, sizeof(kbak));
-	tr31_cleanse(decrypted_key_block, sizeof(decrypted_key_block));
-
-	return r;
-}
-
-static int tr31_tdes_encrypt_sign_derivation_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk)
-{
-	int r;
-	uint8_t kbek[TDES3_KEY_SIZE];
-	uint8_t kbak[TDES3_KEY_SIZE];
-
-	// add payload data to context object
-	ctx->payload = calloc(1, ctx->payload_length);
-
-	// add authenticator to context object
-	ctx->authenticator = calloc(1, ctx->authenticator_length);
-
-	// buffer for CMAC generation and encryption
-	uint8_t decrypted_key_block[ctx->header_length + ctx->payload_length];
-	memcpy(decrypted_key_block, ctx->header, ctx->header_length);
-	struct tr31_payload_t* decrypted_payload = (struct tr31_payload_t*)(decrypted_key_block + ctx->header_length);
-
-	// populate payload key
-	decrypted_payload->length = htons(ctx->key.length * 8); // payload length is big endian and in bits, not bytes
-	memcpy(decrypted_payload->data, ctx->key.data, ctx->key.length);
-	tr31_rand(
-		decrypted_payload->data + ctx->key.length,
-		ctx->payload_length - sizeof(struct tr31_payload_t) - ctx->key.length
-	);
-
-	// derive key block encryption key and key block authentication key from key block protection key
-	r = tr31_tdes_kbpk_derive(kbpk->data, kbpk->length, kbek, kbak);
+	r = tr31_cmac_update(&cmac_ctx, decrypted_payload, ctx->payload_length);
 	if (r) {
 		// return error value as-is
 		goto error;
 	}
-
-	// generate authenticator
-	r = tr31_tdes_cmac(kbak, kbpk->length, decrypted_key_block, sizeof(decrypted_key_block), ctx->authenticator);
+	r = tr31_cmac_verify_final(&cmac_ctx, ctx->authenticator);
+	tr31_stats_stage_end(TR31_STATS_STAGE_MAC_VERIFY, stage_begin);
 	if (r) {
-		// return error value as-is
+		r = TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED;
 		goto error;
 	}
 
-	// encrypt key payload; note that the authenticator is used as the IV
-	r = tr31_tdes_encrypt_cbc(kbek, kbpk->length, ctx->authenticator, decrypted_payload, ctx->payload_length, ctx->payload);
+	// extract key data
+	r = tr31_ctx_set_key_data(ctx, decrypted_payload->data, key_length);
 	if (r) {
 		// return error value as-is
 		goto error;
@@ -1464,118 +2929,107 @@ static int tr31_tdes_encrypt_sign_derivation_binding(struct tr31_ctx_t* ctx, con
 	goto exit;
 
 error:
+	if (deferred) {
+		tr31_cleanse(deferred->decrypted_payload, sizeof(deferred->decrypted_payload));
+	}
 exit:
 	// cleanse sensitive buffers
-	tr31_cleanse(kbek, sizeof(kbek));
-	tr31_cleanse(kbak, sizeof(kbak));
-	tr31_cleanse(decrypted_key_block, sizeof(decrypted_key_block));
+	tr31_cleanse(&cmac_ctx, sizeof(cmac_ctx));
+	tr31_cleanse(decrypted_payload_buf, sizeof(decrypted_payload_buf));
 
 	return r;
 }
 
-static int tr31_aes_decrypt_verify_derivation_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk)
+static int tr31_encrypt_sign_derivation_binding(struct tr31_ctx_t* ctx, struct tr31_kbpk_t* kbpk, struct tr31_deferred_auth_t* deferred)
 {
 	int r;
-	uint8_t kbek[AES256_KEY_SIZE];
-	uint8_t kbak[AES256_KEY_SIZE];
-	size_t key_length;
-
-	// buffer for decryption and CMAC verification
-	uint8_t decrypted_key_block[ctx->header_length + ctx->payload_length];
-	memcpy(decrypted_key_block, ctx->header, ctx->header_length);
-	struct tr31_payload_t* decrypted_payload = (struct tr31_payload_t*)(decrypted_key_block + ctx->header_length);
+	struct tr31_cmac_ctx_t cmac_ctx;
+	uint64_t stage_begin;
 
-	// derive key block encryption key and key block authentication key from key block protection key
-	r = tr31_aes_kbpk_derive(kbpk->data, kbpk->length, kbek, kbak);
+	// add payload data to context object
+	r = tr31_ctx_alloc(ctx, ctx->payload_length, &ctx->payload);
 	if (r) {
 		// return error value as-is
-		goto error;
+		return r;
 	}
 
-	// decrypt key payload; note that the authenticator is used as the IV
-	r = tr31_aes_decrypt_cbc(kbek, kbpk->length, ctx->authenticator, ctx->payload, ctx->payload_length, decrypted_payload);
+	// add authenticator to context object
+	r = tr31_ctx_alloc(ctx, ctx->authenticator_length, &ctx->authenticator);
 	if (r) {
 		// return error value as-is
-		goto error;
-	}
-
-	// extract payload length field
-	key_length = ntohs(decrypted_payload->length) / 8; // payload length is big endian and in bits, not bytes
-	if (key_length > ctx->payload_length - 2) {
-		// invalid key length relative to encrypted payload length
-		r = TR31_ERROR_INVALID_KEY_LENGTH;
-		goto error;
+		return r;
 	}
 
-	// verify authenticator
-	r = tr31_aes_verify_cmac(kbak, kbpk->length, decrypted_key_block, sizeof(decrypted_key_block), ctx->authenticator);
-	if (r) {
-		r = TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED;
-		goto error;
-	}
+	// buffer for CMAC generation and encryption
+	uint8_t decrypted_payload_buf[ctx->payload_length];
+	struct tr31_payload_t* decrypted_payload = (struct tr31_payload_t*)decrypted_payload_buf;
 
-	// extract key data
-	r = tr31_key_set_data(&ctx->key, decrypted_payload->data, key_length);
-	if (r) {
-		// return error value as-is
-		goto error;
+	if (deferred && ctx->payload_length <= sizeof(deferred->decrypted_payload)) {
+		// decrypted payload must remain available until authentication
+		decrypted_payload = (struct tr31_payload_t*)deferred->decrypted_payload;
+	} else {
+		deferred = NULL;
 	}
 
-	// success
-	r = 0;
-	goto exit;
-
-error:
-exit:
-	// cleanse sensitive buffers
-	tr31_cleanse(kbek, sizeof(kbek));
-	tr31_cleanse(kbak, sizeof(kbak));
-	tr31_cleanse(decrypted_key_block, sizeof(decrypted_key_block));
-
-	return r;
-}
-
-static int tr31_aes_encrypt_sign_derivation_binding(struct tr31_ctx_t* ctx, const struct tr31_key_t* kbpk)
-{
-	int r;
-	uint8_t kbek[AES256_KEY_SIZE];
-	uint8_t kbak[AES256_KEY_SIZE];
-
-	// add payload data to context object
-	ctx->payload = calloc(1, ctx->payload_length);
-
-	// add authenticator to context object
-	ctx->authenticator = calloc(1, ctx->authenticator_length);
-
-	// buffer for CMAC generation and encryption
-	uint8_t decrypted_key_block[ctx->header_length + ctx->payload_length];
-	memcpy(decrypted_key_block, ctx->header, ctx->header_length);
-	struct tr31_payload_t* decrypted_payload = (struct tr31_payload_t*)(decrypted_key_block + ctx->header_length);
-
 	// populate payload key
 	decrypted_payload->length = htons(ctx->key.length * 8); // payload length is big endian and in bits, not bytes
 	memcpy(decrypted_payload->data, ctx->key.data, ctx->key.length);
-	tr31_rand(
+	tr31_kbpk_rand(
+		kbpk,
 		decrypted_payload->data + ctx->key.length,
 		ctx->payload_length - sizeof(struct tr31_payload_t) - ctx->key.length
 	);
 
-	// derive key block encryption key and key block authentication key from key block protection key
-	r = tr31_aes_kbpk_derive(kbpk->data, kbpk->length, kbek, kbak);
+	// prepare key block encryption key and key block authentication key
+	r = tr31_kbpk_setup_derivation(kbpk);
 	if (r) {
 		// return error value as-is
 		goto error;
 	}
 
+	if (deferred) {
+		// defer generation of authenticator and encryption to caller
+		memset(deferred->cmac_job, 0, sizeof(*deferred->cmac_job));
+		deferred->cmac_job->cipher = kbpk->derived_kbak;
+		deferred->cmac_job->buf[0] = ctx->header;
+		deferred->cmac_job->len[0] = ctx->header_length;
+		deferred->cmac_job->buf[1] = decrypted_payload;
+		deferred->cmac_job->len[1] = ctx->payload_length;
+		deferred->pending = true;
+		r = 0;
+		goto exit;
+	}
+
 	// generate authenticator
-	r = tr31_aes_cmac(kbak, kbpk->length, decrypted_key_block, sizeof(decrypted_key_block), ctx->authenticator);
+	// the header and the decrypted payload are processed incrementally such
+	// that they need not be concatenated
+	stage_begin = tr31_stats_stage_begin();
+	r = tr31_cmac_init(&cmac_ctx, kbpk->derived_kbak);
+	if (r) {
+		// return error value as-is
+		goto error;
+	}
+	r = tr31_cmac_update(&cmac_ctx, ctx->header, ctx->header_length);
+	if (r) {
+		// return error value as-is
+		goto error;
+	}
+	r = tr31_cmac_update(&cmac_ctx, decrypted_payload, ctx->payload_length);
+	if (r) {
+		// return error value as-is
+		goto error;
+	}
+	r = tr31_cmac_final(&cmac_ctx, ctx->authenticator);
 	if (r) {
 		// return error value as-is
 		goto error;
 	}
+	tr31_stats_stage_end(TR31_STATS_STAGE_MAC_GENERATE, stage_begin);
 
 	// encrypt key payload; note that the authenticator is used as the IV
-	r = tr31_aes_encrypt_cbc(kbek, kbpk->length, ctx->authenticator, decrypted_payload, ctx->payload_length, ctx->payload);
+	stage_begin = tr31_stats_stage_begin();
+	r = tr31_cipher_encrypt_cbc(kbpk->derived_kbek, ctx->authenticator, decrypted_payload, ctx->payload_length, ctx->payload);
+	tr31_stats_stage_end(TR31_STATS_STAGE_ENCRYPT, stage_begin);
 	if (r) {
 		// return error value as-is
 		goto error;
@@ -1586,11 +3040,13 @@ static int tr31_aes_encrypt_sign_derivation_binding(struct tr31_ctx_t* ctx, cons
 	goto exit;
 
 error:
+	if (deferred) {
+		tr31_cleanse(deferred->decrypted_payload, sizeof(deferred->decrypted_payload));
+	}
 exit:
 	// cleanse sensitive buffers
-	tr31_cleanse(kbek, sizeof(kbek));
-	tr31_cleanse(kbak, sizeof(kbak));
-	tr31_cleanse(decrypted_key_block, sizeof(decrypted_key_block));
+	tr31_cleanse(&cmac_ctx, sizeof(cmac_ctx));
+	tr31_cleanse(decrypted_payload_buf, sizeof(decrypted_payload_buf));
 
 	return r;
 }
@@ -1601,24 +3057,38 @@ void tr31_release(struct tr31_ctx_t* ctx)
 		return;
 	}
 
+	if (ctx->arena) {
+		// all context object data was allocated from the caller provided
+		// arena and only needs to be cleansed
+		tr31_cleanse(ctx->arena, ctx->arena_used);
+		ctx->arena = NULL;
+		ctx->arena_length = 0;
+		ctx->arena_used = 0;
+		ctx->key.data = NULL;
+		ctx->opt_blocks = NULL;
+		ctx->payload = NULL;
+		ctx->authenticator = NULL;
+		return;
+	}
+
 	tr31_key_release(&ctx->key);
 
 	if (ctx->opt_blocks) {
 		for (size_t i = 0; i < ctx->opt_blocks_count; ++i) {
-			free(ctx->opt_blocks[i].data);
+			tr31_free(ctx->opt_blocks[i].data, ctx->opt_blocks[i].data_length);
 			ctx->opt_blocks[i].data = NULL;
 		}
 
-		free(ctx->opt_blocks);
+		tr31_free(ctx->opt_blocks, ctx->opt_blocks_count * sizeof(ctx->opt_blocks[0]));
 		ctx->opt_blocks = NULL;
 	}
 
 	if (ctx->payload) {
-		free(ctx->payload);
+		tr31_free(ctx->payload, ctx->payload_length);
 		ctx->payload = NULL;
 	}
 	if (ctx->authenticator) {
-		free(ctx->authenticator);
+		tr31_free(ctx->authenticator, ctx->authenticator_length);
 		ctx->authenticator = NULL;
 	}
 }
@@ -1647,6 +3117,8 @@ const char* tr31_get_error_string(enum tr31_error_t error)
 		case TR31_ERROR_INVALID_KEY_LENGTH: return "Invalid key length";
 		case TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED: return "Key block verification failed";
 		case TR31_ERROR_KCV_NOT_AVAILABLE: return "Key check value not available";
+		case TR31_ERROR_INSUFFICIENT_ARENA: return "Insufficient arena for context object";
+		case TR31_ERROR_KBPK_TOO_WEAK: return "Key block protection key too weak for key";
 	}
 
 	return "Unknown error";
@@ -154,10 +154,31 @@ struct tr31_key_t {
 	void* data; ///< Key data
 
 	uint8_t kcv_algorithm; ///< KCV algorithm (@ref TR31_OPT_BLOCK_KCV_LEGACY or @ref TR31_OPT_BLOCK_KCV_CMAC)
-	size_t kcv_len; ///< Key Check Value (KCV) length in bytes
+	size_t kcv_len; ///< Key Check Value (KCV) length in bytes. Zero until computed; see @ref tr31_key_get_kcv().
 	uint8_t kcv[5]; ///< Key Check Value (KCV)
 };
 
+/// TR-31 Key Check Value (KCV) computation modes
+enum tr31_kcv_mode_t {
+	TR31_KCV_MODE_LAZY = 0, ///< Compute KCV on demand using @ref tr31_key_get_kcv() (default)
+	TR31_KCV_MODE_EAGER, ///< Compute KCV whenever key data is populated
+};
+
+/**
+ * @brief Memory allocator used for all library allocations
+ * Memory returned by the allocation functions must be suitably aligned for
+ * any object type, like memory returned by malloc(). The library always
+ * provides the size of the allocation when resizing or freeing it, such that
+ * size class allocators do not need to track it.
+ */
+struct tr31_allocator_t {
+	void* (*alloc)(void* ctx, size_t size); ///< Allocate @p size bytes. Required.
+	void* (*realloc)(void* ctx, void* ptr, size_t old_size, size_t new_size); ///< Resize allocation. Optional; if NULL, @ref alloc and @ref free are used instead.
+	void (*free)(void* ctx, void* ptr, size_t size); ///< Free allocation. Required. May do nothing if allocations are released in bulk by the caller.
+	void (*secure_free)(void* ctx, void* ptr, size_t size); ///< Free allocation that contained sensitive data after the library cleansed it. Optional; if NULL, @ref free is used instead.
+	void* ctx; ///< Opaque pointer provided to every allocator function
+};
+
 /// TR-31 optional block context object
 struct tr31_opt_ctx_t {
 	unsigned int id; ///< TR-31 optional block identifier
@@ -193,8 +214,89 @@ struct tr31_ctx_t {
 
 	size_t authenticator_length; ///< TR-31 authenticator data length in bytes
 	void* authenticator; ///< Decoded TR-31 authenticator data for internal use only. @warning For internal use only!
+
+	void* arena; ///< Caller provided arena from which context object data is allocated for internal use only. @warning For internal use only!
+	size_t arena_length; ///< Caller provided arena length in bytes for internal use only. @warning For internal use only!
+	size_t arena_used; ///< Caller provided arena usage in bytes for internal use only. @warning For internal use only!
+};
+
+#define TR31_MAX_OPT_BLOCKS_COUNT (99) ///< Maximum number of TR-31 optional blocks; see TR-31:2018, A.2, table 4
+
+/**
+ * Arena length that is sufficient for @ref tr31_import_arena() to decode any
+ * TR-31 key block of the specified length. This allows for the maximum number
+ * of optional blocks, the decoded data and the alignment of each allocation.
+ * @param key_block_len TR-31 key block length in bytes
+ */
+#define TR31_IMPORT_ARENA_LENGTH(key_block_len) ((TR31_MAX_OPT_BLOCKS_COUNT + 4) * (sizeof(struct tr31_opt_ctx_t) + 16) + (key_block_len))
+
+/// TR-31 key block reference for batch processing
+struct tr31_key_block_ref_t {
+	const char* key_block; ///< TR-31 key block. Need not be null terminated. At least the header must be ASCII encoded.
+	size_t length; ///< TR-31 key block length in bytes
+};
+
+/// TR-31 optional block reference into key block string
+struct tr31_opt_block_ref_t {
+	unsigned int id; ///< TR-31 optional block identifier
+	size_t offset; ///< Offset of optional block data (ASCII hex digits) from start of key block, in bytes
+	size_t length; ///< Optional block data length in ASCII hex digits
+};
+
+/**
+ * @brief TR-31 key block header information
+ * Populated by @ref tr31_peek() without decoding the payload or
+ * authenticator. All offsets refer to the original key block string.
+ */
+struct tr31_peek_t {
+	enum tr31_version_t version; ///< TR-31 key block format version
+	size_t length; ///< TR-31 key block length in bytes
+
+	struct tr31_key_t key; ///< TR-31 key attributes. Key data and KCV are not available.
+
+	size_t header_length; ///< TR-31 header length in bytes, including optional blocks
+
+	size_t payload_offset; ///< Offset of payload (ASCII hex digits) from start of key block, in bytes
+	size_t payload_length; ///< Payload length in ASCII hex digits
+
+	size_t authenticator_offset; ///< Offset of authenticator (ASCII hex digits) from start of key block, in bytes
+	size_t authenticator_length; ///< Authenticator length in ASCII hex digits
+
+	size_t opt_blocks_count; ///< TR-31 number of optional blocks
+	struct tr31_opt_block_ref_t opt_blocks[TR31_MAX_OPT_BLOCKS_COUNT]; ///< TR-31 optional block references. Only the first @ref opt_blocks_count entries are populated.
 };
 
+// TR-31 key block translation flags; see @ref tr31_translate_t
+#define TR31_TRANSLATE_DROP_OPT_BLOCKS  (0x01) ///< Translation flag: Omit the optional blocks of the input key block from the output key block
+#define TR31_TRANSLATE_ADD_KC           (0x02) ///< Translation flag: Add optional block KC (KCV of wrapped key) to the output key block, if not present
+#define TR31_TRANSLATE_ADD_KP           (0x04) ///< Translation flag: Add optional block KP (KCV of KBPK) to the output key block, if not present
+
+/**
+ * @brief TR-31 key block translation parameters
+ * Used by @ref tr31_translate() to remap the header fields of the output key
+ * block. Fields that are zero, or NULL, retain the corresponding field of the
+ * input key block.
+ */
+struct tr31_translate_t {
+	uint8_t version; ///< TR-31 format version of output key block
+	unsigned int usage; ///< TR-31 key usage of output key block
+	unsigned int mode_of_use; ///< TR-31 key mode of use of output key block
+	const char* key_version; ///< TR-31 key version field of output key block. Two ASCII characters; need not be null terminated.
+	unsigned int exportability; ///< TR-31 key exportability of output key block
+	unsigned int flags; ///< Translation flags. See @ref TR31_TRANSLATE_DROP_OPT_BLOCKS, @ref TR31_TRANSLATE_ADD_KC and @ref TR31_TRANSLATE_ADD_KP.
+};
+
+/**
+ * @brief Prepared TR-31 key block protection key (KBPK) object
+ * This opaque object caches the keys derived from a key block protection key,
+ * as well as the associated cipher contexts, such that they need not be
+ * recomputed for every key block. Use @ref tr31_kbpk_prepare() to create it.
+ *
+ * @note This object is not thread safe. Use a separate object per thread.
+ * @note Use @ref tr31_kbpk_free() to release internal resources when done.
+ */
+struct tr31_kbpk_t;
+
 /// TR-31 library errors
 enum tr31_error_t {
 	TR31_ERROR_INVALID_LENGTH = 1, ///< Invalid key block length
@@ -214,6 +316,52 @@ enum tr31_error_t {
 	TR31_ERROR_INVALID_KEY_LENGTH, ///< Invalid key length; possibly incorrect key block protection key
 	TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED, ///< Key block verification failed; possibly incorrect key block protection key
 	TR31_ERROR_KCV_NOT_AVAILABLE, ///< Key Check Value (KCV) of either the wrapped key or Key Block Protection Key (KBPK) not available
+	TR31_ERROR_INSUFFICIENT_ARENA, ///< Caller provided arena is too small for context object data
+	TR31_ERROR_KBPK_TOO_WEAK, ///< Key block protection key is weaker than the wrapped key
+};
+
+/// TR-31 processing stages measured by instrumentation; see @ref tr31_stats_get()
+enum tr31_stats_stage_t {
+	TR31_STATS_STAGE_PARSE = 0, ///< Key block header parsing and validation, including optional block indexing
+	TR31_STATS_STAGE_HEX_DECODE, ///< Hex decoding of optional blocks, payload and authenticator
+	TR31_STATS_STAGE_HEX_ENCODE, ///< Hex encoding of optional blocks, payload and authenticator
+	TR31_STATS_STAGE_KBPK, ///< Key block protection key (KBPK) variant computation or key derivation
+	TR31_STATS_STAGE_DECRYPT, ///< Payload decryption
+	TR31_STATS_STAGE_ENCRYPT, ///< Payload encryption
+	TR31_STATS_STAGE_MAC_VERIFY, ///< Authenticator verification
+	TR31_STATS_STAGE_MAC_GENERATE, ///< Authenticator generation
+	TR31_STATS_STAGE_KCV, ///< Key Check Value (KCV) computation
+	TR31_STATS_STAGE_RAND, ///< Random payload padding generation
+
+	TR31_STATS_STAGE_COUNT, ///< Number of stages
+};
+
+/**
+ * Number of error counters in #tr31_stats_t, indexed by #tr31_error_t.
+ * @note This value determines the size of #tr31_stats_t and is therefore part
+ *       of the ABI. It provides room for future #tr31_error_t values and must
+ *       not change when such values are added.
+ */
+#define TR31_STATS_ERROR_COUNT (32)
+
+/// TR-31 processing stage counters
+struct tr31_stats_stage_counter_t {
+	uint64_t count; ///< Number of times the stage was performed. Batch functions may perform a stage once for multiple key blocks.
+	uint64_t nsec; ///< Total duration of the stage in nanoseconds
+};
+
+/**
+ * @brief TR-31 instrumentation counters
+ * @note All members are 64-bit counters; see @ref tr31_stats_get().
+ */
+struct tr31_stats_t {
+	uint64_t imports; ///< Number of completed key block imports, including failed imports
+	uint64_t imports_failed; ///< Number of failed key block imports
+	uint64_t exports; ///< Number of completed key block exports, including failed exports
+	uint64_t exports_failed; ///< Number of failed key block exports
+	uint64_t internal_errors; ///< Number of imports and exports that failed due to internal errors
+	uint64_t errors[TR31_STATS_ERROR_COUNT]; ///< Number of imports and exports that failed, indexed by #tr31_error_t. For example, verification failures are counted by @ref TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED.
+	struct tr31_stats_stage_counter_t stages[TR31_STATS_STAGE_COUNT]; ///< Stage counters, indexed by #tr31_stats_stage_t
 };
 
 /**
@@ -269,8 +417,9 @@ int tr31_key_copy(
 );
 
 /**
- * Populate key data in TR-31 key object. This function will also populate the
- * KCV in the TR-31 key object when possible.
+ * Populate key data in TR-31 key object. The KCV in the TR-31 key object is
+ * only populated if @ref TR31_KCV_MODE_EAGER is selected. Otherwise use
+ * @ref tr31_key_get_kcv() to compute it when required.
  * @note This function requires a populated TR-31 key object
  *       (after @ref tr31_key_init(), @ref tr31_key_copy() or @ref tr31_export())
  *
@@ -281,6 +430,86 @@ int tr31_key_copy(
  */
 int tr31_key_set_data(struct tr31_key_t* key, const void* data, size_t length);
 
+/**
+ * Populate Key Check Value (KCV) in TR-31 key object, if not yet available.
+ * Upon success, the @ref tr31_key_t.kcv_algorithm, @ref tr31_key_t.kcv and
+ * @ref tr31_key_t.kcv_len fields are valid.
+ *
+ * @param key TR-31 key object
+ * @return Zero for success. Less than zero for internal error. Greater than zero for data error. @see #tr31_error_t
+ */
+int tr31_key_get_kcv(struct tr31_key_t* key);
+
+/**
+ * Select when the Key Check Value (KCV) of a TR-31 key object is computed.
+ * By default, the KCV is computed on demand to avoid a block cipher key
+ * schedule whenever key data is populated, for example by @ref tr31_import().
+ * @note This setting applies to the whole process.
+ *
+ * @param mode KCV computation mode
+ */
+void tr31_set_kcv_mode(enum tr31_kcv_mode_t mode);
+
+/**
+ * Enable secure memory pool for key data. Once enabled, key data of TR-31 key
+ * objects, for example populated by @ref tr31_key_set_data() or
+ * @ref tr31_import(), is allocated from a few large memory regions that are
+ * locked into RAM and excluded from core dumps, instead of from the heap.
+ * Slots are allocated and released in constant time and are cleansed upon
+ * release. Key data that does not fit in a slot, or that is requested when
+ * all regions are exhausted, is allocated from the heap.
+ * @note This setting applies to the whole process. Key data that was
+ *       populated before the pool was enabled remains on the heap.
+ *
+ * @param region_size Size of each locked memory region in bytes. Zero for default.
+ * @return Zero for success. Less than zero for internal error, for example if memory could not be locked.
+ */
+int tr31_secmem_enable(size_t region_size);
+
+/**
+ * Disable secure memory pool and cleanse and unmap its memory regions.
+ * @note All TR-31 key objects that have key data in the pool must be released
+ *       using @ref tr31_key_release() or @ref tr31_release() beforehand.
+ *
+ * @return Zero for success. Greater than zero if key data is still allocated from the pool, in which case the pool remains enabled.
+ */
+int tr31_secmem_disable(void);
+
+/**
+ * Select the memory allocator used for all library allocations, including
+ * context object data, key data, optional blocks, prepared KBPKs and cipher
+ * objects. Allocations made internally by the crypto library are not affected.
+ * @note This setting applies to the whole process. It must be selected while
+ *       no other library functions are in use and while no library objects
+ *       that were allocated by a different allocator remain.
+ *
+ * @param allocator Allocator functions. NULL to select the C library allocator.
+ * @return Zero for success. Less than zero for internal error, for example if a required function is absent.
+ */
+int tr31_set_allocator(const struct tr31_allocator_t* allocator);
+
+/**
+ * Retrieve instrumentation counters of all threads since the previous
+ * @ref tr31_stats_reset(). Each thread records its counters in thread local
+ * storage without contention and the counters of threads that have exited
+ * are retained. This function may be called from any thread, for example by
+ * a metrics exporter, while other threads use the library.
+ * @note Instrumentation is only available if the library was built with
+ *       the `ENABLE_STATS` option. Otherwise the counters remain zero.
+ *
+ * @param stats Instrumentation counters output
+ * @return Zero for success. Less than zero for internal error. Greater than zero if instrumentation is not available.
+ */
+int tr31_stats_get(struct tr31_stats_t* stats);
+
+/**
+ * Reset instrumentation counters of all threads such that subsequent calls to
+ * @ref tr31_stats_get() only report activity after this call.
+ *
+ * @return Zero for success. Less than zero for internal error. Greater than zero if instrumentation is not available.
+ */
+int tr31_stats_reset(void);
+
 /**
  * Decode TR-31 key version field and populate it in TR-31 key object
  * @param key TR-31 key object
@@ -365,6 +594,45 @@ int tr31_opt_block_add_HM(
 	uint8_t hash_algorithm
 );
 
+/**
+ * Prepare TR-31 key block protection key (KBPK) for use by
+ * @ref tr31_import_prepared() and @ref tr31_export_prepared(). The keys
+ * derived from the KBPK are computed on first use and then retained by the
+ * prepared KBPK object until it is released.
+ * @note Use @ref tr31_kbpk_free() to release internal resources when done.
+ *
+ * @param key TR-31 key block protection key. The key data is copied and need not outlive the prepared KBPK object.
+ * @param kbpk Prepared TR-31 key block protection key object output
+ * @return Zero for success. Less than zero for internal error. Greater than zero for data error. @see #tr31_error_t
+ */
+int tr31_kbpk_prepare(const struct tr31_key_t* key, struct tr31_kbpk_t** kbpk);
+
+/**
+ * Release prepared TR-31 key block protection key (KBPK) object. This
+ * function will also cleanse all cached key material.
+ * @param kbpk Prepared TR-31 key block protection key object
+ */
+void tr31_kbpk_free(struct tr31_kbpk_t* kbpk);
+
+/**
+ * Peek at TR-31 key block header without decoding or decrypting the payload.
+ * This function validates the header and optional block index and populates
+ * references into the original key block string. It does not allocate memory
+ * and does not validate the optional block data, payload or authenticator
+ * hex digits. This allows routing decisions, such as which key block
+ * protection key to use, to be made before the key block is imported.
+ *
+ * @param key_block TR-31 key block. Need not be null terminated. At least the header must be ASCII encoded.
+ * @param key_block_len TR-31 key block length in bytes
+ * @param peek TR-31 key block header information output
+ * @return Zero for success. Less than zero for internal error. Greater than zero for data error. @see #tr31_error_t
+ */
+int tr31_peek(
+	const char* key_block,
+	size_t key_block_len,
+	struct tr31_peek_t* peek
+);
+
 /**
  * Import TR-31 key block. This function will also decrypt the key data if possible.
  * @note This function will populate a new TR-31 context object.
@@ -381,6 +649,148 @@ int tr31_import(
 	struct tr31_ctx_t* ctx
 );
 
+/**
+ * Import TR-31 key block from a length-delimited buffer. This function
+ * behaves like @ref tr31_import() but the key block need not be null
+ * terminated and is parsed in place. This allows key blocks to be imported
+ * directly from within a larger message buffer.
+ * @note This function will populate a new TR-31 context object.
+ *       Use @ref tr31_release() to release internal resources when done.
+ *       The buffer must outlive the context object.
+ *
+ * @param key_block TR-31 key block. Need not be null terminated. At least the header must be ASCII encoded.
+ * @param key_block_len TR-31 key block length in bytes
+ * @param kbpk TR-31 key block protection key. NULL if not available or decryption is not required.
+ * @param ctx TR-31 context object output
+ * @return Zero for success. Less than zero for internal error. Greater than zero for data error. @see #tr31_error_t
+ */
+int tr31_import_buf(
+	const char* key_block,
+	size_t key_block_len,
+	const struct tr31_key_t* kbpk,
+	struct tr31_ctx_t* ctx
+);
+
+/**
+ * Import TR-31 key block using prepared key block protection key (KBPK).
+ * This function will also decrypt the key data if possible.
+ * @note This function will populate a new TR-31 context object.
+ *       Use @ref tr31_release() to release internal resources when done.
+ *
+ * @param key_block TR-31 key block. Null terminated. At least the header must be ASCII encoded.
+ * @param kbpk Prepared TR-31 key block protection key. NULL if not available or decryption is not required.
+ * @param ctx TR-31 context object output
+ * @return Zero for success. Less than zero for internal error. Greater than zero for data error. @see #tr31_error_t
+ */
+int tr31_import_prepared(
+	const char* key_block,
+	struct tr31_kbpk_t* kbpk,
+	struct tr31_ctx_t* ctx
+);
+
+/**
+ * Import TR-31 key block from a length-delimited buffer using prepared key
+ * block protection key (KBPK). This function behaves like
+ * @ref tr31_import_prepared() but the key block need not be null terminated
+ * and is parsed in place.
+ * @note This function will populate a new TR-31 context object.
+ *       Use @ref tr31_release() to release internal resources when done.
+ *       The buffer must outlive the context object.
+ *
+ * @param key_block TR-31 key block. Need not be null terminated. At least the header must be ASCII encoded.
+ * @param key_block_len TR-31 key block length in bytes
+ * @param kbpk Prepared TR-31 key block protection key. NULL if not available or decryption is not required.
+ * @param ctx TR-31 context object output
+ * @return Zero for success. Less than zero for internal error. Greater than zero for data error. @see #tr31_error_t
+ */
+int tr31_import_buf_prepared(
+	const char* key_block,
+	size_t key_block_len,
+	struct tr31_kbpk_t* kbpk,
+	struct tr31_ctx_t* ctx
+);
+
+/**
+ * Import TR-31 key block into caller provided arena. This function behaves
+ * like @ref tr31_import_buf_prepared() but allocates all context object data
+ * from the arena instead of the heap. When used with a prepared KBPK of
+ * which the keys have already been set up by a previous key block, the
+ * library performs no heap allocations for the import.
+ * @note This function will populate a new TR-31 context object.
+ *       Use @ref tr31_release() to cleanse the used part of the arena when
+ *       done. The arena must outlive the context object and optional blocks
+ *       cannot be added to the context object.
+ *
+ * @param key_block TR-31 key block. Need not be null terminated. At least the header must be ASCII encoded.
+ * @param key_block_len TR-31 key block length in bytes
+ * @param kbpk Prepared TR-31 key block protection key. NULL if not available or decryption is not required.
+ * @param arena Caller provided arena. See @ref TR31_IMPORT_ARENA_LENGTH for the required length.
+ * @param arena_len Length of caller provided arena in bytes
+ * @param ctx TR-31 context object output
+ * @return Zero for success. Less than zero for internal error. Greater than zero for data error. @ref TR31_ERROR_INSUFFICIENT_ARENA if the arena is too small. @see #tr31_error_t
+ */
+int tr31_import_arena(
+	const char* key_block,
+	size_t key_block_len,
+	struct tr31_kbpk_t* kbpk,
+	void* arena,
+	size_t arena_len,
+	struct tr31_ctx_t* ctx
+);
+
+/**
+ * Import multiple TR-31 key blocks that are protected by the same key block
+ * protection key (KBPK). The KBPK is prepared only once for the whole batch
+ * and the outcome of each key block is reported individually such that a
+ * single invalid key block does not abort the batch.
+ * @note This function will populate a new TR-31 context object for each key block.
+ *       Use @ref tr31_release() to release internal resources of each
+ *       successfully imported key block when done. The context objects of
+ *       failed key blocks are released by this function.
+ *
+ * @param key_blocks Array of TR-31 key block references
+ * @param count Number of TR-31 key blocks
+ * @param kbpk TR-31 key block protection key. NULL if not available or decryption is not required.
+ * @param ctx Array of @p count TR-31 context objects output
+ * @param results Array of @p count results output. Each result has the same meaning as the return value of @ref tr31_import().
+ * @return Zero if the batch was processed (see @p results for the outcome of each key block). Less than zero for internal error. Greater than zero for KBPK data error. @see #tr31_error_t
+ */
+int tr31_import_batch(
+	const struct tr31_key_block_ref_t* key_blocks,
+	size_t count,
+	const struct tr31_key_t* kbpk,
+	struct tr31_ctx_t* ctx,
+	int* results
+);
+
+/**
+ * Import multiple TR-31 key blocks that are protected by the same key block
+ * protection key (KBPK) using multiple worker threads. This function behaves
+ * like @ref tr31_import_batch() and each key block is reported at the same
+ * index regardless of the number of workers.
+ *
+ * The workers claim chunks of key blocks from the batch until none remain
+ * and each worker prepares its own KBPK. The calling thread is also used as
+ * a worker. If the library was built without thread support, the calling
+ * thread processes the whole batch.
+ *
+ * @param key_blocks Array of TR-31 key block references
+ * @param count Number of TR-31 key blocks
+ * @param kbpk TR-31 key block protection key. NULL if not available or decryption is not required.
+ * @param ctx Array of @p count TR-31 context objects output
+ * @param results Array of @p count results output. Each result has the same meaning as the return value of @ref tr31_import().
+ * @param workers Number of workers, including the calling thread. Zero to use the number of online processors.
+ * @return Zero if the batch was processed (see @p results for the outcome of each key block). Less than zero for internal error. Greater than zero for KBPK data error. @see #tr31_error_t
+ */
+int tr31_import_batch_parallel(
+	const struct tr31_key_block_ref_t* key_blocks,
+	size_t count,
+	const struct tr31_key_t* kbpk,
+	struct tr31_ctx_t* ctx,
+	int* results,
+	unsigned int workers
+);
+
 /**
  * Export TR-31 key block. This function will create and encrypt the key block.
  * @note This function requires a populated TR-31 context object to be provided. See #tr31_ctx_t for populating manually.
@@ -398,6 +808,167 @@ int tr31_export(
 	size_t key_block_len
 );
 
+/**
+ * Export TR-31 key block using prepared key block protection key (KBPK).
+ * This function will create and encrypt the key block.
+ * @note This function requires a populated TR-31 context object to be provided. See #tr31_ctx_t for populating manually.
+ *
+ * @param ctx TR-31 context object input
+ * @param kbpk Prepared TR-31 key block protection key.
+ * @param key_block TR-31 key block output. Null terminated. At least the header will be ASCII encoded.
+ * @param key_block_len TR-31 key block output buffer length.
+ * @return Zero for success. Less than zero for internal error. Greater than zero for data error. @see #tr31_error_t
+ */
+int tr31_export_prepared(
+	struct tr31_ctx_t* ctx,
+	struct tr31_kbpk_t* kbpk,
+	char* key_block,
+	size_t key_block_len
+);
+
+/**
+ * Export multiple TR-31 key blocks that are protected by the same key block
+ * protection key (KBPK). The KBPK is prepared only once for the whole batch
+ * and the outcome of each key block is reported individually such that a
+ * single failed key block does not abort the batch.
+ * @note This function requires populated TR-31 context objects to be provided. See #tr31_ctx_t for populating manually.
+ *
+ * @param ctx Array of @p count TR-31 context objects input
+ * @param count Number of TR-31 key blocks
+ * @param kbpk TR-31 key block protection key.
+ * @param key_blocks Array of @p count TR-31 key block output buffers. Each will be null terminated.
+ * @param key_block_lens Array of @p count TR-31 key block output buffer lengths.
+ * @param results Array of @p count results output. Each result has the same meaning as the return value of @ref tr31_export().
+ * @return Zero if the batch was processed (see @p results for the outcome of each key block). Less than zero for internal error. Greater than zero for KBPK data error. @see #tr31_error_t
+ */
+int tr31_export_batch(
+	struct tr31_ctx_t* ctx,
+	size_t count,
+	const struct tr31_key_t* kbpk,
+	char* const* key_blocks,
+	const size_t* key_block_lens,
+	int* results
+);
+
+/**
+ * Export multiple TR-31 key blocks that are protected by the same key block
+ * protection key (KBPK) using multiple worker threads. This function behaves
+ * like @ref tr31_export_batch() and each key block is reported at the same
+ * index regardless of the number of workers.
+ * @see tr31_import_batch_parallel() for the behaviour of the workers
+ *
+ * @param ctx Array of @p count TR-31 context objects input
+ * @param count Number of TR-31 key blocks
+ * @param kbpk TR-31 key block protection key.
+ * @param key_blocks Array of @p count TR-31 key block output buffers. Each will be null terminated.
+ * @param key_block_lens Array of @p count TR-31 key block output buffer lengths.
+ * @param results Array of @p count results output. Each result has the same meaning as the return value of @ref tr31_export().
+ * @param workers Number of workers, including the calling thread. Zero to use the number of online processors.
+ * @return Zero if the batch was processed (see @p results for the outcome of each key block). Less than zero for internal error. Greater than zero for KBPK data error. @see #tr31_error_t
+ */
+int tr31_export_batch_parallel(
+	struct tr31_ctx_t* ctx,
+	size_t count,
+	const struct tr31_key_t* kbpk,
+	char* const* key_blocks,
+	const size_t* key_block_lens,
+	int* results,
+	unsigned int workers
+);
+
+/**
+ * Export multiple TR-31 key blocks that are protected by the same key block
+ * protection key (KBPK) into a single contiguous output buffer. Each key
+ * block is null terminated and immediately followed by the next successfully
+ * exported key block. Failed key blocks do not consume output buffer space.
+ * @note This function requires populated TR-31 context objects to be provided. See #tr31_ctx_t for populating manually.
+ *
+ * @param ctx Array of @p count TR-31 context objects input
+ * @param count Number of TR-31 key blocks
+ * @param kbpk TR-31 key block protection key.
+ * @param buf Contiguous TR-31 key block output buffer.
+ * @param buf_len Contiguous TR-31 key block output buffer length.
+ * @param key_blocks Array of @p count TR-31 key block references output. Each references the key block within @p buf or is NULL if the key block failed.
+ * @param results Array of @p count results output. Each result has the same meaning as the return value of @ref tr31_export().
+ * @return Zero if the batch was processed (see @p results for the outcome of each key block). Less than zero for internal error. Greater than zero for KBPK data error. @see #tr31_error_t
+ */
+int tr31_export_batch_contiguous(
+	struct tr31_ctx_t* ctx,
+	size_t count,
+	const struct tr31_key_t* kbpk,
+	char* buf,
+	size_t buf_len,
+	struct tr31_key_block_ref_t* key_blocks,
+	int* results
+);
+
+/**
+ * Translate TR-31 key block from one key block protection key (KBPK) to
+ * another, for example to rotate the KBPK or to change the format version.
+ * The key block is imported, its header fields are remapped as specified by
+ * @p translate, and the same context object is exported again. The key block
+ * header is therefore only parsed once and the decrypted key data is never
+ * copied to another context object.
+ *
+ * The key block is imported into a scratch arena that is locked into memory
+ * and is cleansed before this function returns, regardless of whether the
+ * secure memory pool was enabled using @ref tr31_secmem_enable(). The
+ * decrypted key data is therefore never held by heap memory. During
+ * decryption and encryption, the key data is also present in stack buffers
+ * that are cleansed before this function returns.
+ *
+ * The optional blocks of the input key block are retained, unless
+ * @ref TR31_TRANSLATE_DROP_OPT_BLOCKS is specified, except that optional
+ * block PB is regenerated as required by the output format version and that
+ * optional block KP is recomputed for the output KBPK.
+ *
+ * The translation fails if the output format version does not support the
+ * key length, or with @ref TR31_ERROR_KBPK_TOO_WEAK if the output KBPK is
+ * weaker than the key, for example when translating an AES key to a key block
+ * protected by a TDES KBPK.
+ *
+ * @param key_block Input TR-31 key block. Need not be null terminated. At least the header must be ASCII encoded.
+ * @param key_block_len Input TR-31 key block length in bytes
+ * @param import_kbpk TR-31 key block protection key of input key block
+ * @param export_kbpk TR-31 key block protection key of output key block
+ * @param translate TR-31 key block translation parameters. NULL to retain all header fields and optional blocks.
+ * @param out Output TR-31 key block. Null terminated. At least the header will be ASCII encoded.
+ * @param out_len Output TR-31 key block buffer length.
+ * @return Zero for success. Less than zero for internal error. Greater than zero for data error. @see #tr31_error_t
+ */
+int tr31_translate(
+	const char* key_block,
+	size_t key_block_len,
+	const struct tr31_key_t* import_kbpk,
+	const struct tr31_key_t* export_kbpk,
+	const struct tr31_translate_t* translate,
+	char* out,
+	size_t out_len
+);
+
+/**
+ * Translate TR-31 key block from one prepared key block protection key
+ * (KBPK) to another. This function behaves like @ref tr31_translate().
+ *
+ * @param key_block Input TR-31 key block. Need not be null terminated. At least the header must be ASCII encoded.
+ * @param key_block_len Input TR-31 key block length in bytes
+ * @param import_kbpk Prepared TR-31 key block protection key of input key block
+ * @param export_kbpk Prepared TR-31 key block protection key of output key block
+ * @param translate TR-31 key block translation parameters. NULL to retain all header fields and optional blocks.
+ * @param out Output TR-31 key block. Null terminated. At least the header will be ASCII encoded.
+ * @param out_len Output TR-31 key block buffer length.
+ * @return Zero for success. Less than zero for internal error. Greater than zero for data error. @see #tr31_error_t
+ */
+int tr31_translate_prepared(
+	const char* key_block,
+	size_t key_block_len,
+	struct tr31_kbpk_t* import_kbpk,
+	struct tr31_kbpk_t* export_kbpk,
+	const struct tr31_translate_t* translate,
+	char* out,
+	size_t out_len
+);
+
 /**
  * Release TR-31 context object resources
  * @param ctx TR-31 context object
@@ -471,6 +1042,34 @@ const char* tr31_get_opt_block_id_string(unsigned int opt_block_id);
  */
 const char* tr31_get_opt_block_data_string(const struct tr31_opt_ctx_t* opt_block);
 
+/**
+ * Decode ASCII hex digits to binary data.
+ *
+ * Both upper and lower case hex digits are accepted. This function uses
+ * vectorised implementations where available on the current processor.
+ *
+ * @param hex ASCII hex digits. Need not be null-terminated but must provide
+ *            at least @p bin_len * 2 characters.
+ * @param bin Binary output buffer
+ * @param bin_len Length of binary output buffer in bytes
+ * @return Zero for success. Less than zero for internal error. Greater than zero for invalid hex digits.
+ */
+int tr31_hex_to_bin(const char* hex, void* bin, size_t bin_len);
+
+/**
+ * Encode binary data as upper case ASCII hex digits.
+ *
+ * This function does not null-terminate the output. This function uses
+ * vectorised implementations where available on the current processor.
+ *
+ * @param bin Binary input data
+ * @param bin_len Length of binary input data in bytes
+ * @param hex ASCII hex digit output buffer
+ * @param hex_len Length of ASCII hex digit output buffer. Must be at least @p bin_len * 2.
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_bin_to_hex(const void* bin, size_t bin_len, char* hex, size_t hex_len);
+
 __END_DECLS
 
 #endif
@@ -0,0 +1,117 @@
+/**
+ * @file tr31_alloc.c
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "tr31.h"
+#include "tr31_alloc.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// selected allocator; all members are NULL when the C library allocator is used
+static struct tr31_allocator_t tr31_allocator;
+
+int tr31_set_allocator(const struct tr31_allocator_t* allocator)
+{
+	if (!allocator) {
+		// restore C library allocator
+		memset(&tr31_allocator, 0, sizeof(tr31_allocator));
+		return 0;
+	}
+
+	if (!allocator->alloc || !allocator->free) {
+		return -1;
+	}
+
+	tr31_allocator = *allocator;
+	return 0;
+}
+
+void* tr31_alloc(size_t size)
+{
+	void* ptr;
+
+	if (!tr31_allocator.alloc) {
+		return calloc(1, size);
+	}
+
+	ptr = tr31_allocator.alloc(tr31_allocator.ctx, size);
+	if (!ptr) {
+		return NULL;
+	}
+	memset(ptr, 0, size);
+
+	return ptr;
+}
+
+void* tr31_realloc(void* ptr, size_t old_size, size_t new_size)
+{
+	void* new_ptr;
+
+	if (!tr31_allocator.alloc) {
+		new_ptr = realloc(ptr, new_size);
+	} else if (tr31_allocator.realloc) {
+		new_ptr = tr31_allocator.realloc(tr31_allocator.ctx, ptr, old_size, new_size);
+	} else {
+		// emulate resize for allocators without it
+		new_ptr = tr31_allocator.alloc(tr31_allocator.ctx, new_size);
+		if (new_ptr && ptr) {
+			memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+			tr31_allocator.free(tr31_allocator.ctx, ptr, old_size);
+		}
+	}
+	if (!new_ptr) {
+		return NULL;
+	}
+
+	if (new_size > old_size) {
+		memset((char*)new_ptr + old_size, 0, new_size - old_size);
+	}
+
+	return new_ptr;
+}
+
+void tr31_free(void* ptr, size_t size)
+{
+	if (!ptr) {
+		return;
+	}
+
+	if (!tr31_allocator.free) {
+		free(ptr);
+		return;
+	}
+
+	tr31_allocator.free(tr31_allocator.ctx, ptr, size);
+}
+
+void tr31_free_cleansed(void* ptr, size_t size)
+{
+	if (!ptr) {
+		return;
+	}
+
+	if (!tr31_allocator.secure_free) {
+		tr31_free(ptr, size);
+		return;
+	}
+
+	tr31_allocator.secure_free(tr31_allocator.ctx, ptr, size);
+}
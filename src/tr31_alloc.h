@@ -0,0 +1,68 @@
+/**
+ * @file tr31_alloc.h
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTR31_ALLOC_H
+#define LIBTR31_ALLOC_H
+
+#include <sys/cdefs.h>
+#include <stddef.h>
+
+__BEGIN_DECLS
+
+/**
+ * Allocate zeroed buffer using the allocator selected by
+ * @ref tr31_set_allocator()
+ *
+ * @param size Size of buffer in bytes
+ * @return Pointer to buffer. NULL if allocation failed.
+ */
+void* tr31_alloc(size_t size);
+
+/**
+ * Resize buffer that was allocated using @ref tr31_alloc(). Bytes beyond the
+ * previous size are zeroed.
+ *
+ * @param ptr Pointer to buffer. May be NULL if @p old_size is zero.
+ * @param old_size Previous size of buffer in bytes
+ * @param new_size New size of buffer in bytes
+ * @return Pointer to resized buffer. NULL if allocation failed, in which case the previous buffer remains valid.
+ */
+void* tr31_realloc(void* ptr, size_t old_size, size_t new_size);
+
+/**
+ * Free buffer that was allocated using @ref tr31_alloc()
+ *
+ * @param ptr Pointer to buffer. May be NULL.
+ * @param size Size of buffer in bytes
+ */
+void tr31_free(void* ptr, size_t size);
+
+/**
+ * Free buffer that was allocated using @ref tr31_alloc() and that contained
+ * sensitive data. The caller is responsible for cleansing the buffer first.
+ *
+ * @param ptr Pointer to buffer. May be NULL.
+ * @param size Size of buffer in bytes
+ */
+void tr31_free_cleansed(void* ptr, size_t size);
+
+__END_DECLS
+
+#endif
@@ -19,14 +19,28 @@
  */
 
 #include "tr31_crypto.h"
+#include "tr31_alloc.h"
 #include "tr31_config.h"
 #include "tr31.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h> // for getpid
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #define TR31_KBEK_VARIANT_XOR (0x45)
 #define TR31_KBAK_VARIANT_XOR (0x4D)
 
+#define TR31_RAND_RESEED_INTERVAL (1024) // Number of DRBG requests after which the DRBG is reseeded
+
+#define TR31_CMAC_CHUNK_SIZE (16 * AES_BLOCK_SIZE) // Number of bytes processed per cipher invocation by tr31_cmac_update()
+
 // see NIST SP 800-38B, section 5.3
 static const uint8_t tr31_subkey_r64[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1B };
 static const uint8_t tr31_subkey_r128[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x87 };
@@ -50,690 +64,1410 @@ static const uint8_t tr31_derive_kbak_aes256_input[] = { 0x01, 0x00, 0x01, 0x00,
 #include <mbedtls/aes.h>
 #include <mbedtls/entropy.h>
 #include <mbedtls/ctr_drbg.h>
+#elif defined(USE_OPENSSL)
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#endif
+
+#ifdef HAVE_AESNI
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define TR31_AESNI_MAX_ROUNDS (14) // Number of rounds for AES-256
+
+// round keys of built-in AES-NI engine
+struct tr31_aesni_key_t {
+	unsigned int rounds; // zero if round keys are not yet available
+	_Alignas(16) uint8_t rk[(TR31_AESNI_MAX_ROUNDS + 1) * AES_BLOCK_SIZE];
+};
+#endif
+
+// keyed cipher object
+// the key schedule of each direction is only performed when first required
+struct tr31_cipher_t {
+	unsigned int algorithm; // TR31_KEY_ALGORITHM_TDES or TR31_KEY_ALGORITHM_AES
+	size_t block_size;
+	size_t key_len;
+	uint8_t key[AES256_KEY_SIZE];
+
+	bool enc_ready;
+	bool dec_ready;
+#if defined(USE_MBEDTLS)
+	union {
+		mbedtls_des3_context des3;
+		mbedtls_aes_context aes;
+	} enc, dec;
+#elif defined(USE_OPENSSL)
+	EVP_CIPHER_CTX* enc;
+	EVP_CIPHER_CTX* dec;
+#endif
+
+	// CMAC subkeys
+	bool subkeys_ready;
+	uint8_t k1[AES_BLOCK_SIZE];
+	uint8_t k2[AES_BLOCK_SIZE];
+
+#ifdef HAVE_AESNI
+	// built-in AES-NI engine is used instead of the crypto library when the
+	// processor supports it
+	bool aesni;
+	struct tr31_aesni_key_t aesni_enc;
+	struct tr31_aesni_key_t aesni_dec;
+#endif
+};
+
+#if defined(USE_MBEDTLS)
 
-static int tr31_tdes_encrypt(const void* key, size_t key_len, const void* iv, const void* plaintext, size_t plen, void* ciphertext)
+static int tr31_cipher_impl_setkey(struct tr31_cipher_t* cipher, bool enc)
 {
 	int r;
-	mbedtls_des3_context ctx;
-	uint8_t iv_buf[DES_BLOCK_SIZE];
 
-	// ensure that plaintext length is a multiple of the DES block length
-	if ((plen & (DES_BLOCK_SIZE-1)) != 0) {
-		return -1;
-	}
+	if (cipher->algorithm == TR31_KEY_ALGORITHM_TDES) {
+		mbedtls_des3_context* ctx = enc ? &cipher->enc.des3 : &cipher->dec.des3;
 
-	// only allow a single block for ECB block mode
-	if (!iv && plen != DES_BLOCK_SIZE) {
-		return -2;
+		mbedtls_des3_init(ctx);
+		switch (cipher->key_len) {
+			case TDES2_KEY_SIZE: // double length 3DES key
+				r = enc ? mbedtls_des3_set2key_enc(ctx, cipher->key) : mbedtls_des3_set2key_dec(ctx, cipher->key);
+				break;
+
+			case TDES3_KEY_SIZE: // triple length 3DES key
+				r = enc ? mbedtls_des3_set3key_enc(ctx, cipher->key) : mbedtls_des3_set3key_dec(ctx, cipher->key);
+				break;
+
+			default:
+				mbedtls_des3_free(ctx);
+				return -3;
+		}
+		if (r) {
+			mbedtls_des3_free(ctx);
+			return -4;
+		}
+
+	} else {
+		mbedtls_aes_context* ctx = enc ? &cipher->enc.aes : &cipher->dec.aes;
+
+		mbedtls_aes_init(ctx);
+		if (enc) {
+			r = mbedtls_aes_setkey_enc(ctx, cipher->key, cipher->key_len * 8);
+		} else {
+			r = mbedtls_aes_setkey_dec(ctx, cipher->key, cipher->key_len * 8);
+		}
+		if (r) {
+			mbedtls_aes_free(ctx);
+			return -4;
+		}
 	}
 
-	mbedtls_des3_init(&ctx);
+	return 0;
+}
 
-	switch (key_len) {
-		case TDES2_KEY_SIZE: // double length 3DES key
-			r = mbedtls_des3_set2key_enc(&ctx, key);
-			break;
+static int tr31_cipher_impl_crypt(struct tr31_cipher_t* cipher, bool enc, const void* iv, const void* input, size_t len, void* output)
+{
+	int r;
+	uint8_t iv_buf[AES_BLOCK_SIZE];
 
-		case TDES3_KEY_SIZE: // triple length 3DES key
-			r = mbedtls_des3_set3key_enc(&ctx, key);
-			break;
+	if (cipher->algorithm == TR31_KEY_ALGORITHM_TDES) {
+		mbedtls_des3_context* ctx = enc ? &cipher->enc.des3 : &cipher->dec.des3;
 
-		default:
-			r = -3;
-			goto exit;
+		if (iv) { // IV implies CBC block mode
+			memcpy(iv_buf, iv, DES_BLOCK_SIZE);
+			r = mbedtls_des3_crypt_cbc(ctx, enc ? MBEDTLS_DES_ENCRYPT : MBEDTLS_DES_DECRYPT, len, iv_buf, input, output);
+		} else {
+			r = mbedtls_des3_crypt_ecb(ctx, input, output);
+		}
+
+	} else {
+		mbedtls_aes_context* ctx = enc ? &cipher->enc.aes : &cipher->dec.aes;
+
+		if (iv) { // IV implies CBC block mode
+			memcpy(iv_buf, iv, AES_BLOCK_SIZE);
+			r = mbedtls_aes_crypt_cbc(ctx, enc ? MBEDTLS_AES_ENCRYPT : MBEDTLS_AES_DECRYPT, len, iv_buf, input, output);
+		} else {
+			r = mbedtls_aes_crypt_ecb(ctx, enc ? MBEDTLS_AES_ENCRYPT : MBEDTLS_AES_DECRYPT, input, output);
+		}
 	}
 	if (r) {
-		r = -4;
-		goto exit;
+		return -5;
 	}
 
-	if (iv) { // IV implies CBC block mode
-		memcpy(iv_buf, iv, DES_BLOCK_SIZE);
-		r = mbedtls_des3_crypt_cbc(&ctx, MBEDTLS_DES_ENCRYPT, plen, iv_buf, plaintext, ciphertext);
+	return 0;
+}
+
+static void tr31_cipher_impl_free(struct tr31_cipher_t* cipher)
+{
+	if (cipher->algorithm == TR31_KEY_ALGORITHM_TDES) {
+		if (cipher->enc_ready) {
+			mbedtls_des3_free(&cipher->enc.des3);
+		}
+		if (cipher->dec_ready) {
+			mbedtls_des3_free(&cipher->dec.des3);
+		}
 	} else {
-		r = mbedtls_des3_crypt_ecb(&ctx, plaintext, ciphertext);
-	}
-	if (r) {
-		r = -5;
-		goto exit;
+		if (cipher->enc_ready) {
+			mbedtls_aes_free(&cipher->enc.aes);
+		}
+		if (cipher->dec_ready) {
+			mbedtls_aes_free(&cipher->dec.aes);
+		}
 	}
+}
 
-	r = 0;
-	goto exit;
+// long-lived DRBG shared by all threads
+// the entropy source is only gathered when the DRBG is seeded or reseeded
+static mbedtls_entropy_context tr31_rand_entropy;
+static mbedtls_ctr_drbg_context tr31_rand_ctr_drbg;
+static bool tr31_rand_seeded = false;
+static pid_t tr31_rand_pid; // process ID at which the DRBG was last seeded
 
-exit:
-	mbedtls_des3_free(&ctx);
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t tr31_rand_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t tr31_rand_once = PTHREAD_ONCE_INIT;
 
-	return r;
+// hold the DRBG lock across fork() such that the child process does not
+// inherit a lock held by another thread
+static void tr31_rand_atfork_prepare(void)
+{
+	pthread_mutex_lock(&tr31_rand_mutex);
+}
+
+static void tr31_rand_atfork_release(void)
+{
+	pthread_mutex_unlock(&tr31_rand_mutex);
 }
 
-static int tr31_tdes_decrypt(const void* key, size_t key_len, const void* iv, const void* ciphertext, size_t clen, void* plaintext)
+static void tr31_rand_register_atfork(void)
+{
+	pthread_atfork(&tr31_rand_atfork_prepare, &tr31_rand_atfork_release, &tr31_rand_atfork_release);
+}
+#endif
+
+static void tr31_rand_impl(void* buf, size_t len)
 {
 	int r;
-	mbedtls_des3_context ctx;
-	uint8_t iv_buf[DES_BLOCK_SIZE];
+	uint8_t* ptr = buf;
 
-	// ensure that ciphertext length is a multiple of the DES block length
-	if ((clen & (DES_BLOCK_SIZE-1)) != 0) {
-		return -1;
+#ifdef HAVE_PTHREAD
+	pthread_once(&tr31_rand_once, &tr31_rand_register_atfork);
+	pthread_mutex_lock(&tr31_rand_mutex);
+#endif
+
+	if (!tr31_rand_seeded) {
+		mbedtls_entropy_init(&tr31_rand_entropy);
+		mbedtls_ctr_drbg_init(&tr31_rand_ctr_drbg);
+		r = mbedtls_ctr_drbg_seed(&tr31_rand_ctr_drbg, mbedtls_entropy_func, &tr31_rand_entropy, NULL, 0);
+		if (r) {
+			// retry seeding upon next invocation
+			mbedtls_ctr_drbg_free(&tr31_rand_ctr_drbg);
+			mbedtls_entropy_free(&tr31_rand_entropy);
+			goto exit;
+		}
+		mbedtls_ctr_drbg_set_reseed_interval(&tr31_rand_ctr_drbg, TR31_RAND_RESEED_INTERVAL);
+		tr31_rand_pid = getpid();
+		tr31_rand_seeded = true;
+
+	} else if (tr31_rand_pid != getpid()) {
+		// reseed after fork() such that parent and child processes do not
+		// produce the same random output
+		r = mbedtls_ctr_drbg_reseed(&tr31_rand_ctr_drbg, NULL, 0);
+		if (r) {
+			goto exit;
+		}
+		tr31_rand_pid = getpid();
 	}
 
-	// only allow a single block for ECB block mode
-	if (!iv && clen != DES_BLOCK_SIZE) {
-		return -2;
+	// honour maximum request length of DRBG
+	while (len) {
+		size_t chunk_len = len < MBEDTLS_CTR_DRBG_MAX_REQUEST ? len : MBEDTLS_CTR_DRBG_MAX_REQUEST;
+
+		r = mbedtls_ctr_drbg_random(&tr31_rand_ctr_drbg, ptr, chunk_len);
+		if (r) {
+			goto exit;
+		}
+		ptr += chunk_len;
+		len -= chunk_len;
 	}
 
-	mbedtls_des3_init(&ctx);
+exit:
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&tr31_rand_mutex);
+#endif
+	return;
+}
 
-	switch (key_len) {
-		case TDES2_KEY_SIZE: // double length 3DES key
-			r = mbedtls_des3_set2key_dec(&ctx, key);
-			break;
+#elif defined(USE_OPENSSL)
 
-		case TDES3_KEY_SIZE: // triple length 3DES key
-			r = mbedtls_des3_set3key_dec(&ctx, key);
-			break;
+static int tr31_cipher_impl_setkey(struct tr31_cipher_t* cipher, bool enc)
+{
+	int r;
+	const EVP_CIPHER* evp_cipher;
+	EVP_CIPHER_CTX* ctx;
 
-		default:
-			r = -3;
-			goto exit;
-	}
-	if (r) {
-		r = -4;
-		goto exit;
-	}
+	// always use CBC block mode such that the same context can be used for
+	// both ECB and CBC block modes; see tr31_cipher_impl_crypt()
+	if (cipher->algorithm == TR31_KEY_ALGORITHM_TDES) {
+		switch (cipher->key_len) {
+			case TDES2_KEY_SIZE: // double length 3DES key
+				evp_cipher = EVP_des_ede_cbc();
+				break;
+
+			case TDES3_KEY_SIZE: // triple length 3DES key
+				evp_cipher = EVP_des_ede3_cbc();
+				break;
 
-	if (iv) { // IV implies CBC block mode
-		memcpy(iv_buf, iv, DES_BLOCK_SIZE);
-		r = mbedtls_des3_crypt_cbc(&ctx, MBEDTLS_DES_DECRYPT, clen, iv_buf, ciphertext, plaintext);
+			default:
+				return -3;
+		}
 	} else {
-		r = mbedtls_des3_crypt_ecb(&ctx, ciphertext, plaintext);
+		switch (cipher->key_len) {
+			case AES128_KEY_SIZE:
+				evp_cipher = EVP_aes_128_cbc();
+				break;
+
+			case AES192_KEY_SIZE:
+				evp_cipher = EVP_aes_192_cbc();
+				break;
+
+			case AES256_KEY_SIZE:
+				evp_cipher = EVP_aes_256_cbc();
+				break;
+
+			default:
+				return -3;
+		}
 	}
-	if (r) {
-		r = -5;
-		goto exit;
+
+	ctx = EVP_CIPHER_CTX_new();
+	if (!ctx) {
+		return -4;
 	}
 
-	r = 0;
-	goto exit;
+	r = EVP_CipherInit_ex(ctx, evp_cipher, NULL, cipher->key, NULL, enc);
+	if (!r) {
+		EVP_CIPHER_CTX_free(ctx);
+		return -4;
+	}
 
-exit:
-	mbedtls_des3_free(&ctx);
+	// disable padding
+	EVP_CIPHER_CTX_set_padding(ctx, 0);
 
-	return r;
+	if (enc) {
+		cipher->enc = ctx;
+	} else {
+		cipher->dec = ctx;
+	}
+
+	return 0;
 }
 
-static int tr31_aes_encrypt(const void* key, size_t key_len, const void* iv, const void* plaintext, size_t plen, void* ciphertext)
+static int tr31_cipher_impl_crypt(struct tr31_cipher_t* cipher, bool enc, const void* iv, const void* input, size_t len, void* output)
 {
 	int r;
-	mbedtls_aes_context ctx;
-	uint8_t iv_buf[AES_BLOCK_SIZE];
-
-	// ensure that plaintext length is a multiple of the AES block length
-	if ((plen & (AES_BLOCK_SIZE-1)) != 0) {
-		return -1;
-	}
-
-	// only allow a single block for ECB block mode
-	if (!iv && plen != AES_BLOCK_SIZE) {
-		return -2;
+	EVP_CIPHER_CTX* ctx = enc ? cipher->enc : cipher->dec;
+	static const uint8_t zero_iv[AES_BLOCK_SIZE] = { 0 };
+	int outl;
+
+	// ECB block mode is only used for a single block and is therefore
+	// performed as CBC block mode using a zero IV
+	// reinitialising the context with only an IV retains the key schedule
+	r = EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv ? iv : zero_iv, -1);
+	if (!r) {
+		return -5;
 	}
 
-	if (key_len != AES128_KEY_SIZE &&
-		key_len != AES192_KEY_SIZE &&
-		key_len != AES256_KEY_SIZE
-	) {
-		return -3;
+	outl = 0;
+	r = EVP_CipherUpdate(ctx, output, &outl, input, len);
+	if (!r || outl != len) {
+		return -5;
 	}
 
-	mbedtls_aes_init(&ctx);
-	r = mbedtls_aes_setkey_enc(&ctx, key, key_len * 8);
-	if (r) {
-		r = -4;
-		goto exit;
-	}
+	return 0;
+}
 
-	if (iv) { // IV implies CBC block mode
-		memcpy(iv_buf, iv, AES_BLOCK_SIZE);
-		r = mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_ENCRYPT, plen, iv_buf, plaintext, ciphertext);
-	} else {
-		r = mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_ENCRYPT, plaintext, ciphertext);
+static void tr31_cipher_impl_free(struct tr31_cipher_t* cipher)
+{
+	if (cipher->enc_ready) {
+		EVP_CIPHER_CTX_free(cipher->enc);
+		cipher->enc = NULL;
 	}
-	if (r) {
-		r = -5;
-		goto exit;
+	if (cipher->dec_ready) {
+		EVP_CIPHER_CTX_free(cipher->dec);
+		cipher->dec = NULL;
 	}
+}
 
-	r = 0;
-	goto exit;
+static void tr31_rand_impl(void* buf, size_t len)
+{
+	// OpenSSL maintains long-lived, thread-safe DRBG instances that are
+	// reseeded periodically and after fork()
+	RAND_bytes(buf, len);
+}
 
-exit:
-	mbedtls_aes_free(&ctx);
+#endif
 
-	return r;
-}
+#ifdef HAVE_AESNI
 
-static int tr31_aes_decrypt(const void* key, size_t key_len, const void* iv, const void* ciphertext, size_t clen, void* plaintext)
+static bool tr31_aesni_available(void)
 {
-	int r;
-	mbedtls_aes_context ctx;
-	uint8_t iv_buf[AES_BLOCK_SIZE];
+	// 0 = unknown, 1 = unavailable, 2 = available
+	static atomic_int have_aesni = 0;
+	int value;
 
-	// ensure that ciphertext length is a multiple of the AES block length
-	if ((clen & (AES_BLOCK_SIZE-1)) != 0) {
-		return -1;
-	}
+	value = atomic_load_explicit(&have_aesni, memory_order_relaxed);
+	if (!value) {
+		unsigned int eax, ebx, ecx, edx;
 
-	// only allow a single block for ECB block mode
-	if (!iv && clen != AES_BLOCK_SIZE) {
-		return -2;
+		value = 1;
+		if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES)) {
+			value = 2;
+		}
+		atomic_store_explicit(&have_aesni, value, memory_order_relaxed);
 	}
 
-	if (key_len != AES128_KEY_SIZE &&
-		key_len != AES192_KEY_SIZE &&
-		key_len != AES256_KEY_SIZE
-	) {
-		return -3;
-	}
+	return value == 2;
+}
 
-	mbedtls_aes_init(&ctx);
-	r = mbedtls_aes_setkey_dec(&ctx, key, key_len * 8);
-	if (r) {
-		r = -4;
-		goto exit;
-	}
+// apply AES S-box to each byte of a word; optionally rotate the word first
+// AESKEYGENASSIST is used instead of a table lookup to avoid key dependent
+// memory access during key expansion
+__attribute__((target("aes")))
+static uint32_t tr31_aesni_subword(uint32_t word, bool rotate)
+{
+	__m128i x;
 
-	if (iv) { // IV implies CBC block mode
-		memcpy(iv_buf, iv, AES_BLOCK_SIZE);
-		r = mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_DECRYPT, clen, iv_buf, ciphertext, plaintext);
-	} else {
-		r = mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_DECRYPT, ciphertext, plaintext);
+	// AESKEYGENASSIST applies SubWord to the second and fourth dwords and
+	// additionally applies RotWord to the result of the second dword
+	x = _mm_aeskeygenassist_si128(_mm_set_epi32(0, 0, (int)word, 0), 0);
+	if (rotate) {
+		x = _mm_srli_si128(x, 4);
 	}
-	if (r) {
-		r = -5;
-		goto exit;
+	return _mm_cvtsi128_si32(x);
+}
+
+// see FIPS 197, section 5.2
+__attribute__((target("aes")))
+static void tr31_aesni_setkey_enc(struct tr31_aesni_key_t* key, const void* aes_key, size_t aes_key_len)
+{
+	unsigned int nk = aes_key_len / 4;
+	unsigned int nr = nk + 6;
+	uint32_t w[(TR31_AESNI_MAX_ROUNDS + 1) * 4];
+	uint8_t rcon = 0x01;
+
+	memcpy(w, aes_key, aes_key_len);
+	for (unsigned int i = nk; i < (nr + 1) * 4; ++i) {
+		uint32_t temp = w[i - 1];
+
+		if (i % nk == 0) {
+			// words are little endian; round constant is in the first byte
+			temp = tr31_aesni_subword(temp, true) ^ rcon;
+			rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x1B : 0x00);
+		} else if (nk > 6 && i % nk == 4) {
+			temp = tr31_aesni_subword(temp, false);
+		}
+		w[i] = w[i - nk] ^ temp;
 	}
 
-	r = 0;
-	goto exit;
+	memcpy(key->rk, w, (nr + 1) * AES_BLOCK_SIZE);
+	key->rounds = nr;
+	tr31_cleanse(w, sizeof(w));
+}
 
-exit:
-	mbedtls_aes_free(&ctx);
+// see FIPS 197, section 5.3.5 (equivalent inverse cipher)
+__attribute__((target("aes")))
+static void tr31_aesni_setkey_dec(struct tr31_aesni_key_t* key, const struct tr31_aesni_key_t* enc_key)
+{
+	const __m128i* ek = (const __m128i*)enc_key->rk;
+	__m128i* dk = (__m128i*)key->rk;
+	unsigned int nr = enc_key->rounds;
 
-	return r;
+	dk[0] = ek[nr];
+	for (unsigned int i = 1; i < nr; ++i) {
+		dk[i] = _mm_aesimc_si128(ek[nr - i]);
+	}
+	dk[nr] = ek[0];
+	key->rounds = nr;
 }
 
-static void tr31_rand_impl(void* buf, size_t len)
+__attribute__((target("aes")))
+static void tr31_aesni_encrypt(const struct tr31_aesni_key_t* key, const void* iv, const void* input, size_t len, void* output)
 {
-	mbedtls_entropy_context entropy;
-	mbedtls_ctr_drbg_context ctr_drbg;
+	const __m128i* rk = (const __m128i*)key->rk;
+	const uint8_t* in = input;
+	uint8_t* out = output;
+	__m128i block;
+	__m128i chain;
+
+	chain = iv ? _mm_loadu_si128(iv) : _mm_setzero_si128();
+	for (size_t i = 0; i < len; i += AES_BLOCK_SIZE) {
+		block = _mm_loadu_si128((const void*)(in + i));
+		block = _mm_xor_si128(block, chain); // chaining value is zero for ECB
+		block = _mm_xor_si128(block, rk[0]);
+		for (unsigned int round = 1; round < key->rounds; ++round) {
+			block = _mm_aesenc_si128(block, rk[round]);
+		}
+		block = _mm_aesenclast_si128(block, rk[key->rounds]);
+		_mm_storeu_si128((void*)(out + i), block);
 
-	mbedtls_entropy_init(&entropy);
-	mbedtls_ctr_drbg_init(&ctr_drbg);
-	mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0);
-	mbedtls_ctr_drbg_random(&ctr_drbg, buf, len);
-	mbedtls_ctr_drbg_free(&ctr_drbg);
+		if (iv) {
+			chain = block;
+		}
+	}
 }
 
-#elif defined(USE_OPENSSL)
-#include <openssl/evp.h>
-#include <openssl/rand.h>
-
-static int tr31_tdes_encrypt(const void* key, size_t key_len, const void* iv, const void* plaintext, size_t plen, void* ciphertext)
+__attribute__((target("aes")))
+static void tr31_aesni_decrypt(const struct tr31_aesni_key_t* key, const void* iv, const void* input, size_t len, void* output)
 {
-	int r;
-	EVP_CIPHER_CTX* ctx;
-	int clen;
-	int clen2;
+	const __m128i* rk = (const __m128i*)key->rk;
+	const uint8_t* in = input;
+	uint8_t* out = output;
+	__m128i ciphertext;
+	__m128i block;
+	__m128i chain;
+
+	chain = iv ? _mm_loadu_si128(iv) : _mm_setzero_si128();
+	for (size_t i = 0; i < len; i += AES_BLOCK_SIZE) {
+		ciphertext = _mm_loadu_si128((const void*)(in + i));
+		block = _mm_xor_si128(ciphertext, rk[0]);
+		for (unsigned int round = 1; round < key->rounds; ++round) {
+			block = _mm_aesdec_si128(block, rk[round]);
+		}
+		block = _mm_aesdeclast_si128(block, rk[key->rounds]);
+		block = _mm_xor_si128(block, chain); // chaining value is zero for ECB
+		_mm_storeu_si128((void*)(out + i), block);
 
-	// ensure that plaintext length is a multiple of the DES block length
-	if ((plen & (DES_BLOCK_SIZE-1)) != 0) {
-		return -1;
+		if (iv) {
+			chain = ciphertext;
+		}
 	}
+}
 
-	// only allow a single block for ECB block mode
-	if (!iv && plen != DES_BLOCK_SIZE) {
-		return -2;
+static int tr31_aesni_crypt(struct tr31_cipher_t* cipher, bool enc, const void* iv, const void* input, size_t len, void* output)
+{
+	// perform key schedule for this direction, if not done yet
+	// the decryption key schedule is derived from the encryption key schedule
+	if (!cipher->aesni_enc.rounds) {
+		tr31_aesni_setkey_enc(&cipher->aesni_enc, cipher->key, cipher->key_len);
+	}
+	if (!enc && !cipher->aesni_dec.rounds) {
+		tr31_aesni_setkey_dec(&cipher->aesni_dec, &cipher->aesni_enc);
 	}
 
-	ctx = EVP_CIPHER_CTX_new();
+	if (enc) {
+		tr31_aesni_encrypt(&cipher->aesni_enc, iv, input, len, output);
+	} else {
+		tr31_aesni_decrypt(&cipher->aesni_dec, iv, input, len, output);
+	}
+
+	return 0;
+}
+
+#endif
+
+static int tr31_cipher_setup(struct tr31_cipher_t* cipher, unsigned int algorithm, const void* key, size_t key_len)
+{
+	memset(cipher, 0, sizeof(*cipher));
 
-	switch (key_len) {
-		case TDES2_KEY_SIZE: // double length 3DES key
-			if (iv) { // IV implies CBC block mode
-				r = EVP_EncryptInit_ex(ctx, EVP_des_ede_cbc(), NULL, key, iv);
-			} else { // no IV implies ECB block mode
-				r = EVP_EncryptInit_ex(ctx, EVP_des_ede_ecb(), NULL, key, NULL);
+	switch (algorithm) {
+		case TR31_KEY_ALGORITHM_TDES:
+			if (key_len != TDES2_KEY_SIZE && key_len != TDES3_KEY_SIZE) {
+				return -3;
 			}
+			cipher->block_size = DES_BLOCK_SIZE;
 			break;
 
-		case TDES3_KEY_SIZE: // triple length 3DES key
-			if (iv) { // IV implies CBC block mode
-				r = EVP_EncryptInit_ex(ctx, EVP_des_ede3_cbc(), NULL, key, iv);
-			} else { // no IV implies ECB block mode
-				r = EVP_EncryptInit_ex(ctx, EVP_des_ede3_ecb(), NULL, key, NULL);
+		case TR31_KEY_ALGORITHM_AES:
+			if (key_len != AES128_KEY_SIZE &&
+				key_len != AES192_KEY_SIZE &&
+				key_len != AES256_KEY_SIZE
+			) {
+				return -3;
 			}
+			cipher->block_size = AES_BLOCK_SIZE;
+#ifdef HAVE_AESNI
+			cipher->aesni = tr31_aesni_available();
+#endif
 			break;
 
 		default:
-			r = -3;
-			goto exit;
-	}
-	if (!r) {
-		r = -4;
-		goto exit;
-	}
-
-	// disable padding
-	EVP_CIPHER_CTX_set_padding(ctx, 0);
-
-	clen = 0;
-	r = EVP_EncryptUpdate(ctx, ciphertext, &clen, plaintext, plen);
-	if (!r) {
-		r = -5;
-		goto exit;
+			return -3;
 	}
 
-	clen2 = 0;
-	r = EVP_EncryptFinal_ex(ctx, ciphertext + clen, &clen2);
-	if (!r) {
-		r = -6;
-		goto exit;
-	}
+	cipher->algorithm = algorithm;
+	cipher->key_len = key_len;
+	memcpy(cipher->key, key, key_len);
 
-	r = 0;
-	goto exit;
+	return 0;
+}
 
-exit:
-	EVP_CIPHER_CTX_free(ctx);
-	return r;
+static void tr31_cipher_cleanup(struct tr31_cipher_t* cipher)
+{
+	tr31_cipher_impl_free(cipher);
+	tr31_cleanse(cipher, sizeof(*cipher));
 }
 
-static int tr31_tdes_decrypt(const void* key, size_t key_len, const void* iv, const void* ciphertext, size_t clen, void* plaintext)
+static int tr31_cipher_crypt(struct tr31_cipher_t* cipher, bool enc, const void* iv, const void* input, size_t len, void* output)
 {
 	int r;
-	EVP_CIPHER_CTX* ctx;
-	int plen;
-	int plen2;
 
-	// ensure that ciphertext length is a multiple of the DES block length
-	if ((clen & (DES_BLOCK_SIZE-1)) != 0) {
+	// ensure that input length is a multiple of the cipher block length
+	if ((len & (cipher->block_size-1)) != 0) {
 		return -1;
 	}
 
 	// only allow a single block for ECB block mode
-	if (!iv && clen != DES_BLOCK_SIZE) {
+	if (!iv && len != cipher->block_size) {
 		return -2;
 	}
 
-	ctx = EVP_CIPHER_CTX_new();
-
-	switch (key_len) {
-		case TDES2_KEY_SIZE: // double length 3DES key
-			if (iv) { // IV implies CBC block mode
-				r = EVP_DecryptInit_ex(ctx, EVP_des_ede_cbc(), NULL, key, iv);
-			} else { // no IV implies ECB block mode
-				r = EVP_DecryptInit_ex(ctx, EVP_des_ede_ecb(), NULL, key, NULL);
-			}
-			break;
-
-		case TDES3_KEY_SIZE: // triple length 3DES key
-			if (iv) { // IV implies CBC block mode
-				r = EVP_DecryptInit_ex(ctx, EVP_des_ede3_cbc(), NULL, key, iv);
-			} else { // no IV implies ECB block mode
-				r = EVP_DecryptInit_ex(ctx, EVP_des_ede3_ecb(), NULL, key, NULL);
-			}
-			break;
-
-		default:
-			r = -3;
-			goto exit;
-	}
-	if (!r) {
-		r = -4;
-		goto exit;
+#ifdef HAVE_AESNI
+	if (cipher->aesni) {
+		return tr31_aesni_crypt(cipher, enc, iv, input, len, output);
 	}
+#endif
 
-	// disable padding
-	EVP_CIPHER_CTX_set_padding(ctx, 0);
+	// perform key schedule for this direction, if not done yet
+	if (enc && !cipher->enc_ready) {
+		r = tr31_cipher_impl_setkey(cipher, true);
+		if (r) {
+			return r;
+		}
+		cipher->enc_ready = true;
+	}
+	if (!enc && !cipher->dec_ready) {
+		r = tr31_cipher_impl_setkey(cipher, false);
+		if (r) {
+			return r;
+		}
+		cipher->dec_ready = true;
+	}
 
-	plen = 0;
-	r = EVP_DecryptUpdate(ctx, plaintext, &plen, ciphertext, clen);
-	if (!r) {
-		r = -5;
-		goto exit;
+	return tr31_cipher_impl_crypt(cipher, enc, iv, input, len, output);
+}
+
+static int tr31_memcmp(const void* a, const void* b, size_t n)
+{
+	int r = 0;
+	const uint8_t* ptr_a = a;
+	const uint8_t* ptr_b = b;
+
+	while (n) {
+		r |= *ptr_a ^ *ptr_b;
+		++ptr_a;
+		++ptr_b;
+		--n;
 	}
 
-	plen2 = 0;
-	r = EVP_DecryptFinal_ex(ctx, plaintext + plen, &plen2);
-	if (!r) {
-		r = -6;
-		goto exit;
+	// not-not is to sanitise result
+	return !!r;
+}
+
+static int tr31_lshift(uint8_t* x, size_t len)
+{
+	uint8_t lsb;
+	uint8_t msb;
+
+	x += (len - 1);
+	lsb = 0x00;
+	while (len--) {
+		msb = *x & 0x80;
+		*x <<= 1;
+		*x |= lsb;
+		--x;
+		lsb = msb >> 7;
 	}
 
-	r = 0;
-	goto exit;
+	// return carry bit
+	return lsb;
+}
+
+static void tr31_xor(uint8_t* x, const uint8_t* y, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		*x ^= *y;
+		++x;
+		++y;
+	}
+}
+
+static int tr31_crypt_oneshot(unsigned int algorithm, bool enc, const void* key, size_t key_len, const void* iv, const void* input, size_t len, void* output)
+{
+	int r;
+	struct tr31_cipher_t cipher;
+
+	r = tr31_cipher_setup(&cipher, algorithm, key, key_len);
+	if (r) {
+		return r;
+	}
+
+	r = tr31_cipher_crypt(&cipher, enc, iv, input, len, output);
+	tr31_cipher_cleanup(&cipher);
 
-exit:
-	EVP_CIPHER_CTX_free(ctx);
 	return r;
 }
 
-static int tr31_aes_encrypt(const void* key, size_t key_len, const void* iv, const void* plaintext, size_t plen, void* ciphertext)
+int tr31_tdes_cipher_new(const void* key, size_t key_len, struct tr31_cipher_t** cipher)
 {
 	int r;
-	EVP_CIPHER_CTX* ctx;
-	int clen;
-	int clen2;
 
-	// ensure that plaintext length is a multiple of the AES block length
-	if ((plen & (AES_BLOCK_SIZE-1)) != 0) {
+	if (!key || !cipher) {
 		return -1;
 	}
 
-	// only allow a single block for ECB block mode
-	if (!iv && plen != AES_BLOCK_SIZE) {
+	*cipher = tr31_alloc(sizeof(**cipher));
+	if (!*cipher) {
+		return -1;
+	}
+
+	r = tr31_cipher_setup(*cipher, TR31_KEY_ALGORITHM_TDES, key, key_len);
+	if (r) {
+		tr31_cipher_free(*cipher);
+		*cipher = NULL;
+		return r;
+	}
+
+	return 0;
+}
+
+int tr31_aes_cipher_new(const void* key, size_t key_len, struct tr31_cipher_t** cipher)
+{
+	int r;
+
+	if (!key || !cipher) {
+		return -1;
+	}
+
+	*cipher = tr31_alloc(sizeof(**cipher));
+	if (!*cipher) {
+		return -1;
+	}
+
+	r = tr31_cipher_setup(*cipher, TR31_KEY_ALGORITHM_AES, key, key_len);
+	if (r) {
+		tr31_cipher_free(*cipher);
+		*cipher = NULL;
+		return r;
+	}
+
+	return 0;
+}
+
+void tr31_cipher_free(struct tr31_cipher_t* cipher)
+{
+	if (!cipher) {
+		return;
+	}
+
+	tr31_cipher_cleanup(cipher);
+	tr31_free_cleansed(cipher, sizeof(*cipher));
+}
+
+size_t tr31_cipher_block_size(const struct tr31_cipher_t* cipher)
+{
+	if (!cipher) {
+		return 0;
+	}
+
+	return cipher->block_size;
+}
+
+int tr31_cipher_encrypt_ecb(struct tr31_cipher_t* cipher, const void* plaintext, void* ciphertext)
+{
+	if (!cipher || !plaintext || !ciphertext) {
+		return -1;
+	}
+
+	return tr31_cipher_crypt(cipher, true, NULL, plaintext, cipher->block_size, ciphertext);
+}
+
+int tr31_cipher_decrypt_ecb(struct tr31_cipher_t* cipher, const void* ciphertext, void* plaintext)
+{
+	if (!cipher || !ciphertext || !plaintext) {
+		return -1;
+	}
+
+	return tr31_cipher_crypt(cipher, false, NULL, ciphertext, cipher->block_size, plaintext);
+}
+
+int tr31_cipher_encrypt_cbc(struct tr31_cipher_t* cipher, const void* iv, const void* plaintext, size_t plen, void* ciphertext)
+{
+	if (!cipher || !iv || !plaintext || !ciphertext) {
+		return -1;
+	}
+
+	return tr31_cipher_crypt(cipher, true, iv, plaintext, plen, ciphertext);
+}
+
+int tr31_cipher_decrypt_cbc(struct tr31_cipher_t* cipher, const void* iv, const void* ciphertext, size_t clen, void* plaintext)
+{
+	if (!cipher || !iv || !ciphertext || !plaintext) {
+		return -1;
+	}
+
+	return tr31_cipher_crypt(cipher, false, iv, ciphertext, clen, plaintext);
+}
+
+int tr31_cipher_cbcmac(struct tr31_cipher_t* cipher, const void* buf, size_t len, void* mac)
+{
+	int r;
+	uint8_t iv[DES_BLOCK_SIZE];
+	const void* ptr = buf;
+
+	if (!cipher || !buf || !mac) {
+		return -1;
+	}
+	if (cipher->algorithm != TR31_KEY_ALGORITHM_TDES) {
 		return -2;
 	}
 
-	ctx = EVP_CIPHER_CTX_new();
+	// see ISO 9797-1:2011 MAC algorithm 1
 
-	switch (key_len) {
-		case AES128_KEY_SIZE:
-			if (iv) { // IV implies CBC block mode
-				r = EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, key, iv);
-			} else { // no IV implies ECB block mode
-				r = EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), NULL, key, NULL);
-			}
-			break;
+	// compute CBC-MAC
+	memset(iv, 0, sizeof(iv)); // start with zero IV
+	for (size_t i = 0; i < len; i += DES_BLOCK_SIZE) {
+		r = tr31_cipher_crypt(cipher, true, iv, ptr, DES_BLOCK_SIZE, iv);
+		if (r) {
+			// internal error
+			return r;
+		}
 
-		case AES192_KEY_SIZE:
-			if (iv) { // IV implies CBC block mode
-				r = EVP_EncryptInit_ex(ctx, EVP_aes_192_cbc(), NULL, key, iv);
-			} else { // no IV implies ECB block mode
-				r = EVP_EncryptInit_ex(ctx, EVP_aes_192_ecb(), NULL, key, NULL);
-			}
-			break;
+		ptr += DES_BLOCK_SIZE;
+	}
 
-		case AES256_KEY_SIZE:
-			if (iv) { // IV implies CBC block mode
-				r = EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv);
-			} else { // no IV implies ECB block mode
-				r = EVP_EncryptInit_ex(ctx, EVP_aes_256_ecb(), NULL, key, NULL);
-			}
-			break;
+	// copy MAC output
+	memcpy(mac, iv, DES_MAC_SIZE);
 
-		default:
-			r = -3;
-			goto exit;
+	return 0;
+}
+
+int tr31_cipher_verify_cbcmac(struct tr31_cipher_t* cipher, const void* buf, size_t len, const void* mac_verify)
+{
+	int r;
+	uint8_t mac[DES_MAC_SIZE];
+
+	r = tr31_cipher_cbcmac(cipher, buf, len, mac);
+	if (r) {
+		return r;
 	}
-	if (!r) {
-		r = -4;
-		goto exit;
+
+	return tr31_memcmp(mac, mac_verify, sizeof(mac));
+}
+
+static int tr31_cipher_derive_subkeys(struct tr31_cipher_t* cipher)
+{
+	int r;
+	const uint8_t* subkey_r;
+	uint8_t zero[AES_BLOCK_SIZE];
+	uint8_t l_buf[AES_BLOCK_SIZE];
+
+	// subkeys only depend on the key and are therefore derived only once
+	if (cipher->subkeys_ready) {
+		return 0;
 	}
 
-	// disable padding
-	EVP_CIPHER_CTX_set_padding(ctx, 0);
+	// see NIST SP 800-38B, section 5.3
+	if (cipher->block_size == DES_BLOCK_SIZE) {
+		subkey_r = tr31_subkey_r64;
+	} else {
+		subkey_r = tr31_subkey_r128;
+	}
 
-	clen = 0;
-	r = EVP_EncryptUpdate(ctx, ciphertext, &clen, plaintext, plen);
-	if (!r) {
-		r = -5;
-		goto exit;
+	// see NIST SP 800-38B, section 6.1
+
+	// encrypt zero block with input key
+	memset(zero, 0, sizeof(zero));
+	r = tr31_cipher_crypt(cipher, true, NULL, zero, cipher->block_size, l_buf);
+	if (r) {
+		// internal error
+		return r;
 	}
 
-	clen2 = 0;
-	r = EVP_EncryptFinal_ex(ctx, ciphertext + clen, &clen2);
-	if (!r) {
-		r = -6;
-		goto exit;
+	// generate K1 subkey
+	memcpy(cipher->k1, l_buf, cipher->block_size);
+	r = tr31_lshift(cipher->k1, cipher->block_size);
+	// if carry bit is set, XOR with R64/R128
+	if (r) {
+		tr31_xor(cipher->k1, subkey_r, cipher->block_size);
 	}
 
-	r = 0;
-	goto exit;
+	// generate K2 subkey
+	memcpy(cipher->k2, cipher->k1, cipher->block_size);
+	r = tr31_lshift(cipher->k2, cipher->block_size);
+	// if carry bit is set, XOR with R64/R128
+	if (r) {
+		tr31_xor(cipher->k2, subkey_r, cipher->block_size);
+	}
 
-exit:
-	EVP_CIPHER_CTX_free(ctx);
-	return r;
+	// cleanup
+	tr31_cleanse(l_buf, sizeof(l_buf));
+
+	cipher->subkeys_ready = true;
+	return 0;
 }
 
-static int tr31_aes_decrypt(const void* key, size_t key_len, const void* iv, const void* ciphertext, size_t clen, void* plaintext)
+int tr31_cmac_init(struct tr31_cmac_ctx_t* ctx, struct tr31_cipher_t* cipher)
 {
 	int r;
-	EVP_CIPHER_CTX* ctx;
-	int plen;
-	int plen2;
 
-	// ensure that ciphertext length is a multiple of the AES block length
-	if ((clen & (AES_BLOCK_SIZE-1)) != 0) {
+	if (!ctx || !cipher) {
 		return -1;
 	}
 
-	// only allow a single block for ECB block mode
-	if (!iv && clen != AES_BLOCK_SIZE) {
-		return -2;
+	// derive CMAC subkeys
+	r = tr31_cipher_derive_subkeys(cipher);
+	if (r) {
+		// internal error
+		return r;
 	}
 
-	ctx = EVP_CIPHER_CTX_new();
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->cipher = cipher;
 
-	switch (key_len) {
-		case AES128_KEY_SIZE:
-			if (iv) { // IV implies CBC block mode
-				r = EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, key, iv);
-			} else { // no IV implies ECB block mode
-				r = EVP_DecryptInit_ex(ctx, EVP_aes_128_ecb(), NULL, key, NULL);
-			}
-			break;
+	return 0;
+}
 
-		case AES192_KEY_SIZE:
-			if (iv) { // IV implies CBC block mode
-				r = EVP_DecryptInit_ex(ctx, EVP_aes_192_cbc(), NULL, key, iv);
-			} else { // no IV implies ECB block mode
-				r = EVP_DecryptInit_ex(ctx, EVP_aes_192_ecb(), NULL, key, NULL);
-			}
-			break;
+int tr31_cmac_update(struct tr31_cmac_ctx_t* ctx, const void* buf, size_t len)
+{
+	int r;
+	size_t block_size;
+	const uint8_t* ptr = buf;
+	uint8_t chunk[TR31_CMAC_CHUNK_SIZE];
 
-		case AES256_KEY_SIZE:
-			if (iv) { // IV implies CBC block mode
-				r = EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv);
-			} else { // no IV implies ECB block mode
-				r = EVP_DecryptInit_ex(ctx, EVP_aes_256_ecb(), NULL, key, NULL);
-			}
-			break;
+	if (!ctx || !ctx->cipher || (!buf && len)) {
+		return -1;
+	}
+	if (!len) {
+		return 0;
+	}
+	block_size = ctx->cipher->block_size;
 
-		default:
-			r = -3;
-			goto exit;
+	// NOTE: the last block must be retained until tr31_cmac_final() because
+	// it is processed differently. Therefore the pending block is only
+	// processed once more message input is available.
+
+	// complete pending block, if any
+	if (ctx->pending_len) {
+		size_t fill_len = block_size - ctx->pending_len;
+		if (fill_len > len) {
+			fill_len = len;
+		}
+		memcpy(ctx->pending + ctx->pending_len, ptr, fill_len);
+		ctx->pending_len += fill_len;
+		ptr += fill_len;
+		len -= fill_len;
+
+		if (!len) {
+			// pending block may be the last block
+			return 0;
+		}
+
+		// more message input is available; process pending block
+		r = tr31_cipher_crypt(ctx->cipher, true, ctx->state, ctx->pending, block_size, ctx->state);
+		if (r) {
+			// internal error
+			return r;
+		}
+		ctx->pending_len = 0;
 	}
-	if (!r) {
-		r = -4;
-		goto exit;
+
+	// process all complete blocks except the last block in chunks using CBC
+	// such that the cipher is invoked once per chunk instead of once per block
+	while (len > block_size) {
+		size_t chunk_len = (len - 1) & ~(block_size - 1);
+		if (chunk_len > sizeof(chunk)) {
+			chunk_len = sizeof(chunk);
+		}
+
+		r = tr31_cipher_crypt(ctx->cipher, true, ctx->state, ptr, chunk_len, chunk);
+		if (r) {
+			// internal error
+			tr31_cleanse(chunk, sizeof(chunk));
+			return r;
+		}
+
+		// last ciphertext block is the chaining value for the next block
+		memcpy(ctx->state, chunk + chunk_len - block_size, block_size);
+		ptr += chunk_len;
+		len -= chunk_len;
 	}
+	tr31_cleanse(chunk, sizeof(chunk));
 
-	// disable padding
-	EVP_CIPHER_CTX_set_padding(ctx, 0);
+	// retain remaining message input as pending block
+	memcpy(ctx->pending, ptr, len);
+	ctx->pending_len = len;
 
-	plen = 0;
-	r = EVP_DecryptUpdate(ctx, plaintext, &plen, ciphertext, clen);
-	if (!r) {
-		r = -5;
-		goto exit;
+	return 0;
+}
+
+int tr31_cmac_final(struct tr31_cmac_ctx_t* ctx, void* cmac)
+{
+	int r;
+	size_t block_size;
+
+	if (!ctx || !ctx->cipher || !cmac) {
+		return -1;
 	}
+	block_size = ctx->cipher->block_size;
 
-	plen2 = 0;
-	r = EVP_DecryptFinal_ex(ctx, plaintext + plen, &plen2);
-	if (!r) {
-		r = -6;
-		goto exit;
+	// See NIST SP 800-38B, section 6.2
+	// See ISO 9797-1:2011 MAC algorithm 5
+	// If CMAC message input (M) is a multiple of the cipher block size, then
+	// the last message input block is XOR'd with subkey K1.
+	// If CMAC message input (M) is not a multiple of the cipher block size,
+	// then the last message input block is padded and XOR'd with subkey K2.
+	// The cipher is applied in CBC mode to all message input blocks,
+	// including the modified last block.
+
+	// prepare last block
+	if (ctx->pending_len == block_size) {
+		// if message input is a multple of cipher block size,
+		// use subkey K1
+		tr31_xor(ctx->state, ctx->cipher->k1, block_size);
+	} else {
+		// if message input is not a multple of cipher block size,
+		// use subkey K2
+		tr31_xor(ctx->state, ctx->cipher->k2, block_size);
+
+		// pad last block with 1 bit followed by zeros
+		ctx->pending[ctx->pending_len] = 0x80;
+		if (ctx->pending_len + 1 < block_size) {
+			memset(ctx->pending + ctx->pending_len + 1, 0, block_size - ctx->pending_len - 1);
+		}
 	}
 
-	r = 0;
-	goto exit;
+	// process last block
+	r = tr31_cipher_crypt(ctx->cipher, true, ctx->state, ctx->pending, block_size, cmac);
+
+	// cleanup
+	tr31_cleanse(ctx, sizeof(*ctx));
 
-exit:
-	EVP_CIPHER_CTX_free(ctx);
 	return r;
 }
 
-static void tr31_rand_impl(void* buf, size_t len)
+int tr31_cmac_verify_final(struct tr31_cmac_ctx_t* ctx, const void* cmac_verify)
 {
-	RAND_bytes(buf, len);
+	int r;
+	size_t block_size;
+	uint8_t cmac[AES_BLOCK_SIZE];
+
+	if (!ctx || !ctx->cipher || !cmac_verify) {
+		return -1;
+	}
+	block_size = ctx->cipher->block_size;
+
+	r = tr31_cmac_final(ctx, cmac);
+	if (r) {
+		return r;
+	}
+
+	r = tr31_memcmp(cmac, cmac_verify, block_size);
+	tr31_cleanse(cmac, sizeof(cmac));
+
+	return r;
 }
 
-#endif
+int tr31_cipher_cmac(struct tr31_cipher_t* cipher, const void* buf, size_t len, void* cmac)
+{
+	int r;
+	struct tr31_cmac_ctx_t ctx;
 
-static int tr31_memcmp(const void* a, const void* b, size_t n)
+	if (!cipher || !buf || !cmac) {
+		return -1;
+	}
+
+	r = tr31_cmac_init(&ctx, cipher);
+	if (r) {
+		return r;
+	}
+
+	r = tr31_cmac_update(&ctx, buf, len);
+	if (r) {
+		tr31_cleanse(&ctx, sizeof(ctx));
+		return r;
+	}
+
+	return tr31_cmac_final(&ctx, cmac);
+}
+
+int tr31_cipher_verify_cmac(struct tr31_cipher_t* cipher, const void* buf, size_t len, const void* cmac_verify)
 {
-	int r = 0;
-	const uint8_t* ptr_a = a;
-	const uint8_t* ptr_b = b;
+	int r;
+	uint8_t cmac[AES_BLOCK_SIZE];
 
-	while (n) {
-		r |= *ptr_a ^ *ptr_b;
-		++ptr_a;
-		++ptr_b;
-		--n;
+	r = tr31_cipher_cmac(cipher, buf, len, cmac);
+	if (r) {
+		return r;
 	}
 
-	// not-not is to sanitise result
-	return !!r;
+	return tr31_memcmp(cmac, cmac_verify, cipher->block_size);
 }
 
-int tr31_tdes_encrypt_ecb(const void* key, size_t key_len, const void* plaintext, void* ciphertext)
+#ifdef HAVE_AESNI
+
+// message input of a CMAC job processed by a lane of a multi-buffer engine
+struct tr31_cmac_lane_t {
+	struct tr31_cmac_job_t* job; // NULL if lane is idle
+	unsigned int seg; // current message input segment
+	size_t offset; // offset within current message input segment
+	size_t remaining; // remaining message input length
+};
+
+static void tr31_cmac_lane_start(struct tr31_cmac_lane_t* lane, struct tr31_cmac_job_t* job)
 {
-	return tr31_tdes_encrypt(key, key_len, NULL, plaintext, DES_BLOCK_SIZE, ciphertext);
+	lane->job = job;
+	lane->seg = 0;
+	lane->offset = 0;
+	lane->remaining = job->len[0] + job->len[1];
 }
 
-int tr31_tdes_decrypt_ecb(const void* key, size_t key_len, const void* ciphertext, void* plaintext)
+// read message input of lane across segment boundaries
+static void tr31_cmac_lane_read(struct tr31_cmac_lane_t* lane, uint8_t* block, size_t len)
 {
-	return tr31_tdes_decrypt(key, key_len, NULL, ciphertext, DES_BLOCK_SIZE, plaintext);
+	while (len) {
+		size_t n = lane->job->len[lane->seg] - lane->offset;
+		if (!n) {
+			++lane->seg;
+			lane->offset = 0;
+			continue;
+		}
+		if (n > len) {
+			n = len;
+		}
+
+		memcpy(block, (const uint8_t*)lane->job->buf[lane->seg] + lane->offset, n);
+		block += n;
+		len -= n;
+		lane->offset += n;
+		lane->remaining -= n;
+	}
 }
 
-int tr31_tdes_encrypt_cbc(const void* key, size_t key_len, const void* iv, const void* plaintext, size_t plen, void* ciphertext)
+// provide next message input block of lane and prepare it if it is the
+// last block (see tr31_cmac_final()); blocks that are neither the last block
+// nor span message input segments are provided without copying them
+static const uint8_t* tr31_cmac_lane_next_block(struct tr31_cmac_lane_t* lane, uint8_t* block, size_t block_size, bool* last)
 {
-	return tr31_tdes_encrypt(key, key_len, iv, plaintext, plen, ciphertext);
+	const struct tr31_cipher_t* cipher = lane->job->cipher;
+	size_t len;
+
+	if (lane->remaining > block_size) {
+		// not the last block
+		*last = false;
+
+		if (lane->offset == lane->job->len[lane->seg]) {
+			++lane->seg;
+			lane->offset = 0;
+		}
+		if (lane->job->len[lane->seg] - lane->offset >= block_size) {
+			const uint8_t* ptr = (const uint8_t*)lane->job->buf[lane->seg] + lane->offset;
+			lane->offset += block_size;
+			lane->remaining -= block_size;
+			return ptr;
+		}
+
+		tr31_cmac_lane_read(lane, block, block_size);
+		return block;
+	}
+
+	*last = true;
+	len = lane->remaining;
+	tr31_cmac_lane_read(lane, block, len);
+	if (len == block_size) {
+		// last block is complete; use subkey K1
+		tr31_xor(block, cipher->k1, block_size);
+	} else {
+		// last block is incomplete; pad and use subkey K2
+		block[len] = 0x80;
+		memset(block + len + 1, 0, block_size - len - 1);
+		tr31_xor(block, cipher->k2, block_size);
+	}
+
+	return block;
 }
 
-int tr31_tdes_decrypt_cbc(const void* key, size_t key_len, const void* iv, const void* ciphertext, size_t clen, void* plaintext)
+// process the AES-NI jobs of the job array that use the specified number of
+// rounds such that each lane processes a job until it is done and then
+// continues with the next such job
+// all lanes therefore use the same number of rounds and the rounds below need
+// not distinguish between lanes
+__attribute__((target("aes")))
+static void tr31_aesni_cmac_multi(struct tr31_cmac_job_t* jobs, size_t count, unsigned int rounds)
 {
-	return tr31_tdes_decrypt(key, key_len, iv, ciphertext, clen, plaintext);
+	struct tr31_cmac_lane_t lanes[TR31_CMAC_MULTI_LANES];
+	const __m128i* rk[TR31_CMAC_MULTI_LANES];
+	__m128i state[TR31_CMAC_MULTI_LANES];
+	bool last[TR31_CMAC_MULTI_LANES];
+	_Alignas(16) uint8_t block[AES_BLOCK_SIZE];
+	size_t next = 0;
+
+	memset(lanes, 0, sizeof(lanes));
+	memset(state, 0, sizeof(state));
+	while (true) {
+		const __m128i* active_rk = NULL;
+
+		// assign remaining jobs to idle lanes
+		for (unsigned int l = 0; l < TR31_CMAC_MULTI_LANES; ++l) {
+			while (!lanes[l].job && next < count) {
+				struct tr31_cmac_job_t* job = &jobs[next++];
+				if (!job->cipher->aesni ||
+					job->cipher->aesni_enc.rounds != rounds
+				) {
+					// processed by another engine or another invocation
+					continue;
+				}
+
+				tr31_cmac_lane_start(&lanes[l], job);
+				rk[l] = (const __m128i*)job->cipher->aesni_enc.rk;
+				state[l] = _mm_setzero_si128();
+			}
+
+			if (lanes[l].job) {
+				active_rk = rk[l];
+			}
+		}
+		if (!active_rk) {
+			// no active lanes
+			break;
+		}
+
+		// XOR next message input block of each lane into its chaining value
+		// idle lanes process the round keys of an active lane such that the
+		// rounds below need not distinguish between active and idle lanes
+		for (unsigned int l = 0; l < TR31_CMAC_MULTI_LANES; ++l) {
+			if (!lanes[l].job) {
+				rk[l] = active_rk;
+				continue;
+			}
+
+			const uint8_t* ptr = tr31_cmac_lane_next_block(&lanes[l], block, AES_BLOCK_SIZE, &last[l]);
+			state[l] = _mm_xor_si128(state[l], _mm_loadu_si128((const void*)ptr));
+			state[l] = _mm_xor_si128(state[l], rk[l][0]);
+		}
+
+		// interleave the AES rounds of all lanes
+		for (unsigned int round = 1; round < rounds; ++round) {
+			for (unsigned int l = 0; l < TR31_CMAC_MULTI_LANES; ++l) {
+				state[l] = _mm_aesenc_si128(state[l], rk[l][round]);
+			}
+		}
+		for (unsigned int l = 0; l < TR31_CMAC_MULTI_LANES; ++l) {
+			state[l] = _mm_aesenclast_si128(state[l], rk[l][rounds]);
+		}
+
+		// output CMAC of lanes that processed their last block
+		for (unsigned int l = 0; l < TR31_CMAC_MULTI_LANES; ++l) {
+			if (lanes[l].job && last[l]) {
+				_mm_storeu_si128((void*)lanes[l].job->cmac, state[l]);
+				lanes[l].job = NULL;
+			}
+		}
+	}
+
+	// cleanse sensitive buffers
+	tr31_cleanse(state, sizeof(state));
+	tr31_cleanse(block, sizeof(block));
 }
 
-int tr31_tdes_cbcmac(const void* key, size_t key_len, const void* buf, size_t len, void* mac)
+#endif
+
+int tr31_cmac_multi(struct tr31_cmac_job_t* jobs, size_t count)
 {
 	int r;
-	uint8_t iv[DES_BLOCK_SIZE];
-	const void* ptr = buf;
+	struct tr31_cmac_ctx_t ctx;
+	bool have_aesni_jobs = false;
 
-	// see ISO 9797-1:2011 MAC algorithm 1
+	if (!jobs && count) {
+		return -1;
+	}
 
-	// compute CBC-MAC
-	memset(iv, 0, sizeof(iv)); // start with zero IV
-	for (size_t i = 0; i < len; i += DES_BLOCK_SIZE) {
-		r = tr31_tdes_encrypt_cbc(key, key_len, iv, ptr, DES_BLOCK_SIZE, iv);
+	for (size_t i = 0; i < count; ++i) {
+		struct tr31_cmac_job_t* job = &jobs[i];
+
+		if (!job->cipher ||
+			(!job->buf[0] && job->len[0]) ||
+			(!job->buf[1] && job->len[1])
+		) {
+			return -1;
+		}
+
+		// derive CMAC subkeys
+		r = tr31_cipher_derive_subkeys(job->cipher);
 		if (r) {
 			// internal error
 			return r;
 		}
 
-		ptr += DES_BLOCK_SIZE;
+#ifdef HAVE_AESNI
+		if (job->cipher->aesni) {
+			// perform key schedule now such that the multi-buffer engine
+			// only reads the cipher objects
+			if (!job->cipher->aesni_enc.rounds) {
+				tr31_aesni_setkey_enc(&job->cipher->aesni_enc, job->cipher->key, job->cipher->key_len);
+			}
+			have_aesni_jobs = true;
+			continue;
+		}
+#endif
+
+		// process job individually
+		r = tr31_cmac_init(&ctx, job->cipher);
+		if (r) {
+			return r;
+		}
+		for (unsigned int seg = 0; seg < 2; ++seg) {
+			r = tr31_cmac_update(&ctx, job->buf[seg], job->len[seg]);
+			if (r) {
+				tr31_cleanse(&ctx, sizeof(ctx));
+				return r;
+			}
+		}
+		r = tr31_cmac_final(&ctx, job->cmac);
+		if (r) {
+			return r;
+		}
+	}
+
+	if (have_aesni_jobs) {
+#ifdef HAVE_AESNI
+		// process AES-128, AES-192 and AES-256 jobs separately
+		for (unsigned int rounds = 10; rounds <= TR31_AESNI_MAX_ROUNDS; rounds += 2) {
+			tr31_aesni_cmac_multi(jobs, count, rounds);
+		}
+#endif
+	}
+
+	return 0;
+}
+
+int tr31_cmac_verify_multi(struct tr31_cmac_job_t* jobs, size_t count)
+{
+	int r;
+
+	if (!jobs && count) {
+		return -1;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		if (!jobs[i].cmac_verify) {
+			return -1;
+		}
+	}
+
+	r = tr31_cmac_multi(jobs, count);
+	if (r) {
+		return r;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		jobs[i].result = tr31_memcmp(jobs[i].cmac, jobs[i].cmac_verify, jobs[i].cipher->block_size);
+		tr31_cleanse(jobs[i].cmac, sizeof(jobs[i].cmac));
+	}
+
+	return 0;
+}
+
+int tr31_cipher_kcv(struct tr31_cipher_t* cipher, void* kcv)
+{
+	int r;
+	uint8_t input[AES_BLOCK_SIZE];
+	uint8_t ciphertext[AES_BLOCK_SIZE];
+
+	if (!cipher || !kcv) {
+		return -1;
+	}
+
+	// use input block populated with 0x00
+	memset(input, 0x00, sizeof(input));
+
+	if (cipher->algorithm == TR31_KEY_ALGORITHM_TDES) {
+		// see ANSI X9.24-1:2017, A.2 Legacy Approach
+
+		// zero KCV in case of error
+		memset(kcv, 0, TDES_KCV_SIZE);
+
+		// encrypt zero block with input key
+		r = tr31_cipher_crypt(cipher, true, NULL, input, DES_BLOCK_SIZE, ciphertext);
+		if (r) {
+			// internal error
+			return r;
+		}
+
+		// KCV is always first 3 bytes of ciphertext
+		memcpy(kcv, ciphertext, TDES_KCV_SIZE);
+
+	} else {
+		// see ANSI X9.24-1:2017, A.3 CMAC-based Check values
+
+		// zero KCV in case of error
+		memset(kcv, 0, AES_KCV_SIZE);
+
+		// Compute CMAC of input block using input key
+		r = tr31_cipher_cmac(cipher, input, AES_BLOCK_SIZE, ciphertext);
+		if (r) {
+			// internal error
+			return r;
+		}
+
+		// KCV is always first 5 bytes of ciphertext
+		memcpy(kcv, ciphertext, AES_KCV_SIZE);
 	}
 
-	// copy MAC output
-	memcpy(mac, iv, DES_MAC_SIZE);
+	tr31_cleanse(ciphertext, sizeof(ciphertext));
 
 	return 0;
 }
 
-int tr31_tdes_verify_cbcmac(const void* key, size_t key_len, const void* buf, size_t len, const void* mac_verify)
+int tr31_tdes_encrypt_ecb(const void* key, size_t key_len, const void* plaintext, void* ciphertext)
 {
-	int r;
-	uint8_t mac[DES_MAC_SIZE];
-
-	r = tr31_tdes_cbcmac(key, key_len, buf, len, mac);
-	if (r) {
-		return r;
-	}
-
-	return tr31_memcmp(mac, mac_verify, sizeof(mac));
+	return tr31_crypt_oneshot(TR31_KEY_ALGORITHM_TDES, true, key, key_len, NULL, plaintext, DES_BLOCK_SIZE, ciphertext);
 }
 
-static int tr31_lshift(uint8_t* x, size_t len)
+int tr31_tdes_decrypt_ecb(const void* key, size_t key_len, const void* ciphertext, void* plaintext)
 {
-	uint8_t lsb;
-	uint8_t msb;
-
-	x += (len - 1);
-	lsb = 0x00;
-	while (len--) {
-		msb = *x & 0x80;
-		*x <<= 1;
-		*x |= lsb;
-		--x;
-		lsb = msb >> 7;
-	}
+	return tr31_crypt_oneshot(TR31_KEY_ALGORITHM_TDES, false, key, key_len, NULL, ciphertext, DES_BLOCK_SIZE, plaintext);
+}
 
-	// return carry bit
-	return lsb;
+int tr31_tdes_encrypt_cbc(const void* key, size_t key_len, const void* iv, const void* plaintext, size_t plen, void* ciphertext)
+{
+	return tr31_crypt_oneshot(TR31_KEY_ALGORITHM_TDES, true, key, key_len, iv, plaintext, plen, ciphertext);
 }
 
-static void tr31_xor(uint8_t* x, const uint8_t* y, size_t len)
+int tr31_tdes_decrypt_cbc(const void* key, size_t key_len, const void* iv, const void* ciphertext, size_t clen, void* plaintext)
 {
-	for (size_t i = 0; i < len; ++i) {
-		*x ^= *y;
-		++x;
-		++y;
-	}
+	return tr31_crypt_oneshot(TR31_KEY_ALGORITHM_TDES, false, key, key_len, iv, ciphertext, clen, plaintext);
 }
 
-static int tr31_tdes_derive_subkeys(const void* key, size_t key_len, void* k1, void* k2)
+int tr31_tdes_cbcmac(const void* key, size_t key_len, const void* buf, size_t len, void* mac)
 {
 	int r;
-	uint8_t zero[DES_BLOCK_SIZE];
-	uint8_t l_buf[DES_BLOCK_SIZE];
-
-	// see NIST SP 800-38B, section 6.1
+	struct tr31_cipher_t cipher;
 
-	// encrypt zero block with input key
-	memset(zero, 0, sizeof(zero));
-	r = tr31_tdes_encrypt_ecb(key, key_len, zero, l_buf);
+	r = tr31_cipher_setup(&cipher, TR31_KEY_ALGORITHM_TDES, key, key_len);
 	if (r) {
-		// internal error
 		return r;
 	}
 
-	// generate K1 subkey
-	memcpy(k1, l_buf, DES_BLOCK_SIZE);
-	r = tr31_lshift(k1, DES_BLOCK_SIZE);
-	// if carry bit is set, XOR with R64
-	if (r) {
-		tr31_xor(k1, tr31_subkey_r64, sizeof(tr31_subkey_r64));
-	}
+	r = tr31_cipher_cbcmac(&cipher, buf, len, mac);
+	tr31_cipher_cleanup(&cipher);
 
-	// generate K2 subkey
-	memcpy(k2, k1, DES_BLOCK_SIZE);
-	r = tr31_lshift(k2, DES_BLOCK_SIZE);
-	// if carry bit is set, XOR with R64
+	return r;
+}
+
+int tr31_tdes_verify_cbcmac(const void* key, size_t key_len, const void* buf, size_t len, const void* mac_verify)
+{
+	int r;
+	uint8_t mac[DES_MAC_SIZE];
+
+	r = tr31_tdes_cbcmac(key, key_len, buf, len, mac);
 	if (r) {
-		tr31_xor(k2, tr31_subkey_r64, sizeof(tr31_subkey_r64));
+		return r;
 	}
 
-	// cleanup
-	tr31_cleanse(l_buf, sizeof(l_buf));
-
-	return 0;
+	return tr31_memcmp(mac, mac_verify, sizeof(mac));
 }
 
 int tr31_tdes_cmac(const void* key, size_t key_len, const void* buf, size_t len, void* cmac)
 {
 	int r;
-	uint8_t k1[DES_BLOCK_SIZE];
-	uint8_t k2[DES_BLOCK_SIZE];
-	uint8_t iv[DES_BLOCK_SIZE];
-	const void* ptr = buf;
-
-	size_t last_block_len;
-	uint8_t last_block[DES_BLOCK_SIZE];
+	struct tr31_cipher_t cipher;
 
 	if (!key || !buf || !cmac) {
 		return -1;
@@ -742,76 +1476,15 @@ int tr31_tdes_cmac(const void* key, size_t key_len, const void* buf, size_t len,
 		return -2;
 	}
 
-	// See NIST SP 800-38B, section 6.2
-	// See ISO 9797-1:2011 MAC algorithm 5
-	// If CMAC message input (M) is a multiple of the cipher block size, then
-	// the last message input block is XOR'd with subkey K1.
-	// If CMAC message input (M) is not a multiple of the cipher block size,
-	// then the last message input block is padded and XOR'd with subkey K2.
-	// The cipher is applied in CBC mode to all message input blocks,
-	// including the modified last block.
-
-	// derive CMAC subkeys
-	r = tr31_tdes_derive_subkeys(key, key_len, k1, k2);
-	if (r) {
-		// internal error
-		return r;
-	}
-
-	// compute CMAC
-	// see NIST SP 800-38B, section 6.2
-	// see ISO 9797-1:2011 MAC algorithm 5
-	memset(iv, 0, sizeof(iv)); // start with zero IV
-	if (len > DES_BLOCK_SIZE) {
-		// for all blocks except the last block
-		for (size_t i = 0; i < len - DES_BLOCK_SIZE; i += DES_BLOCK_SIZE) {
-			r = tr31_tdes_encrypt_cbc(key, key_len, iv, ptr, DES_BLOCK_SIZE, iv);
-			if (r) {
-				// internal error
-				return r;
-			}
-
-			ptr += DES_BLOCK_SIZE;
-		}
-	}
-
-	// prepare last block
-	last_block_len = len - (ptr - buf);
-	if (last_block_len == DES_BLOCK_SIZE) {
-		// if message input is a multple of cipher block size,
-		// use subkey K1
-		tr31_xor(iv, k1, sizeof(iv));
-	} else {
-		// if message input is a multple of cipher block size,
-		// use subkey K2
-		tr31_xor(iv, k2, sizeof(iv));
-
-		// build new last block
-		memcpy(last_block, ptr, last_block_len);
-
-		// pad last block with 1 bit followed by zeros
-		last_block[last_block_len] = 0x80;
-		if (last_block_len + 1 < DES_BLOCK_SIZE) {
-			memset(last_block + last_block_len + 1, 0, DES_BLOCK_SIZE - last_block_len - 1);
-		}
-
-		ptr = last_block;
-	}
-
-	// process last block
-	r = tr31_tdes_encrypt_cbc(key, key_len, iv, ptr, DES_BLOCK_SIZE, cmac);
+	r = tr31_cipher_setup(&cipher, TR31_KEY_ALGORITHM_TDES, key, key_len);
 	if (r) {
-		// internal error
 		return r;
 	}
 
-	// cleanup
-	tr31_cleanse(k1, sizeof(k1));
-	tr31_cleanse(k2, sizeof(k2));
-	tr31_cleanse(iv, sizeof(iv));
-	tr31_cleanse(last_block, sizeof(last_block));
+	r = tr31_cipher_cmac(&cipher, buf, len, cmac);
+	tr31_cipher_cleanup(&cipher);
 
-	return 0;
+	return r;
 }
 
 int tr31_tdes_verify_cmac(const void* key, size_t key_len, const void* buf, size_t len, const void* cmac_verify)
@@ -851,6 +1524,7 @@ int tr31_tdes_kbpk_variant(const void* kbpk, size_t kbpk_len, void* kbek, void*
 int tr31_tdes_kbpk_derive(const void* kbpk, size_t kbpk_len, void* kbek, void* kbak)
 {
 	int r;
+	struct tr31_cipher_t cipher;
 	uint8_t kbxk_input[8];
 
 	if (!kbpk || !kbek || !kbak) {
@@ -879,13 +1553,21 @@ int tr31_tdes_kbpk_derive(const void* kbpk, size_t kbpk_len, void* kbek, void* k
 			return -2;
 	}
 
+	// the same KBPK key schedule and CMAC subkeys are used for all CMAC
+	// computations below
+	r = tr31_cipher_setup(&cipher, TR31_KEY_ALGORITHM_TDES, kbpk, kbpk_len);
+	if (r) {
+		// internal error
+		return r;
+	}
+
 	// derive key block encryption key
 	for (size_t kbek_len = 0; kbek_len < kbpk_len; kbek_len += DES_BLOCK_SIZE) {
 		// TDES CMAC creates key material of size DES_BLOCK_SIZE
-		r = tr31_tdes_cmac(kbpk, kbpk_len, kbxk_input, sizeof(kbxk_input), kbek + kbek_len);
+		r = tr31_cipher_cmac(&cipher, kbxk_input, sizeof(kbxk_input), kbek + kbek_len);
 		if (r) {
 			// internal error
-			return r;
+			goto exit;
 		}
 
 		// increment key derivation input counter
@@ -903,30 +1585,35 @@ int tr31_tdes_kbpk_derive(const void* kbpk, size_t kbpk_len, void* kbek, void* k
 			break;
 
 		default:
-			return -3;
+			r = -3;
+			goto exit;
 	}
 
 	// derive key block authentication key
 	for (size_t kbak_len = 0; kbak_len < kbpk_len; kbak_len += DES_BLOCK_SIZE) {
 		// TDES CMAC creates key material of size DES_BLOCK_SIZE
-		r = tr31_tdes_cmac(kbpk, kbpk_len, kbxk_input, sizeof(kbxk_input), kbak + kbak_len);
+		r = tr31_cipher_cmac(&cipher, kbxk_input, sizeof(kbxk_input), kbak + kbak_len);
 		if (r) {
 			// internal error
-			return r;
+			goto exit;
 		}
 
 		// increment key derivation input counter
 		kbxk_input[0]++;
 	}
 
-	return 0;
+	r = 0;
+	goto exit;
+
+exit:
+	tr31_cipher_cleanup(&cipher);
+	return r;
 }
 
 int tr31_tdes_kcv(const void* key, size_t key_len, void* kcv)
 {
 	int r;
-	uint8_t zero[DES_BLOCK_SIZE];
-	uint8_t ciphertext[DES_BLOCK_SIZE];
+	struct tr31_cipher_t cipher;
 
 	if (!key || !kcv) {
 		return -1;
@@ -935,95 +1622,42 @@ int tr31_tdes_kcv(const void* key, size_t key_len, void* kcv)
 		return -2;
 	}
 
-	// see ANSI X9.24-1:2017, A.2 Legacy Approach
-
-	// zero KCV in case of error
-	memset(kcv, 0, TDES_KCV_SIZE);
-
-	// encrypt zero block with input key
-	memset(zero, 0, sizeof(zero));
-	r = tr31_tdes_encrypt_ecb(key, key_len, zero, ciphertext);
+	r = tr31_cipher_setup(&cipher, TR31_KEY_ALGORITHM_TDES, key, key_len);
 	if (r) {
 		// internal error
 		return r;
 	}
 
-	// KCV is always first 3 bytes of ciphertext
-	memcpy(kcv, ciphertext, TDES_KCV_SIZE);
+	r = tr31_cipher_kcv(&cipher, kcv);
+	tr31_cipher_cleanup(&cipher);
 
-	tr31_cleanse(ciphertext, sizeof(ciphertext));
-
-	return 0;
+	return r;
 }
 
 int tr31_aes_encrypt_ecb(const void* key, size_t key_len, const void* plaintext, void* ciphertext)
 {
-	return tr31_aes_encrypt(key, key_len, NULL, plaintext, AES_BLOCK_SIZE, ciphertext);
+	return tr31_crypt_oneshot(TR31_KEY_ALGORITHM_AES, true, key, key_len, NULL, plaintext, AES_BLOCK_SIZE, ciphertext);
 }
 
 int tr31_aes_decrypt_ecb(const void* key, size_t key_len, const void* ciphertext, void* plaintext)
 {
-	return tr31_aes_decrypt(key, key_len, NULL, ciphertext, AES_BLOCK_SIZE, plaintext);
+	return tr31_crypt_oneshot(TR31_KEY_ALGORITHM_AES, false, key, key_len, NULL, ciphertext, AES_BLOCK_SIZE, plaintext);
 }
 
 int tr31_aes_encrypt_cbc(const void* key, size_t key_len, const void* iv, const void* plaintext, size_t plen, void* ciphertext)
 {
-	return tr31_aes_encrypt(key, key_len, iv, plaintext, plen, ciphertext);
+	return tr31_crypt_oneshot(TR31_KEY_ALGORITHM_AES, true, key, key_len, iv, plaintext, plen, ciphertext);
 }
 
 int tr31_aes_decrypt_cbc(const void* key, size_t key_len, const void* iv, const void* ciphertext, size_t clen, void* plaintext)
 {
-	return tr31_aes_decrypt(key, key_len, iv, ciphertext, clen, plaintext);
-}
-
-static int tr31_aes_derive_subkeys(const void* key, size_t key_len, void* k1, void* k2)
-{
-	int r;
-	uint8_t zero[AES_BLOCK_SIZE];
-	uint8_t l_buf[AES_BLOCK_SIZE];
-
-	// see NIST SP 800-38B, section 6.1
-
-	// encrypt zero block with input key
-	memset(zero, 0, sizeof(zero));
-	r = tr31_aes_encrypt_ecb(key, key_len, zero, l_buf);
-	if (r) {
-		// internal error
-		return r;
-	}
-
-	// generate K1 subkey
-	memcpy(k1, l_buf, AES_BLOCK_SIZE);
-	r = tr31_lshift(k1, AES_BLOCK_SIZE);
-	// if carry bit is set, XOR with R128
-	if (r) {
-		tr31_xor(k1, tr31_subkey_r128, sizeof(tr31_subkey_r128));
-	}
-
-	// generate K2 subkey
-	memcpy(k2, k1, AES_BLOCK_SIZE);
-	r = tr31_lshift(k2, AES_BLOCK_SIZE);
-	// if carry bit is set, XOR with R128
-	if (r) {
-		tr31_xor(k2, tr31_subkey_r128, sizeof(tr31_subkey_r128));
-	}
-
-	// cleanup
-	tr31_cleanse(l_buf, sizeof(l_buf));
-
-	return 0;
+	return tr31_crypt_oneshot(TR31_KEY_ALGORITHM_AES, false, key, key_len, iv, ciphertext, clen, plaintext);
 }
 
 int tr31_aes_cmac(const void* key, size_t key_len, const void* buf, size_t len, void* cmac)
 {
 	int r;
-	uint8_t k1[AES_BLOCK_SIZE];
-	uint8_t k2[AES_BLOCK_SIZE];
-	uint8_t iv[AES_BLOCK_SIZE];
-	const void* ptr = buf;
-
-	size_t last_block_len;
-	uint8_t last_block[AES_BLOCK_SIZE];
+	struct tr31_cipher_t cipher;
 
 	if (!key || !buf || !cmac) {
 		return -1;
@@ -1035,70 +1669,15 @@ int tr31_aes_cmac(const void* key, size_t key_len, const void* buf, size_t len,
 		return -2;
 	}
 
-	// See NIST SP 800-38B, section 6.2
-	// See ISO 9797-1:2011 MAC algorithm 5
-	// If CMAC message input (M) is a multiple of the cipher block size, then
-	// the last message input block is XOR'd with subkey K1.
-	// If CMAC message input (M) is not a multiple of the cipher block size,
-	// then the last message input block is padded and XOR'd with subkey K2.
-	// The cipher is applied in CBC mode to all message input blocks,
-	// including the modified last block.
-
-	// derive CMAC subkeys
-	r = tr31_aes_derive_subkeys(key, key_len, k1, k2);
+	r = tr31_cipher_setup(&cipher, TR31_KEY_ALGORITHM_AES, key, key_len);
 	if (r) {
-		// internal error
 		return r;
 	}
 
-	// compute CMAC
-	// see NIST SP 800-38B, section 6.2
-	// see ISO 9797-1:2011 MAC algorithm 5
-	memset(iv, 0, sizeof(iv)); // start with zero IV
-	if (len > AES_BLOCK_SIZE) {
-		// for all blocks except the last block
-		for (size_t i = 0; i < len - AES_BLOCK_SIZE; i += AES_BLOCK_SIZE) {
-			r = tr31_aes_encrypt_cbc(key, key_len, iv, ptr, AES_BLOCK_SIZE, iv);
-			if (r) {
-				// internal error
-				return r;
-			}
-
-			ptr += AES_BLOCK_SIZE;
-		}
-	}
-
-	// prepare last block
-	last_block_len = len - (ptr - buf);
-	if (last_block_len == AES_BLOCK_SIZE) {
-		// if message input is a multple of cipher block size,
-		// use subkey K1
-		tr31_xor(iv, k1, sizeof(iv));
-	} else {
-		// if message input is a multple of cipher block size,
-		// use subkey K2
-		tr31_xor(iv, k2, sizeof(iv));
-
-		// build new last block
-		memcpy(last_block, ptr, last_block_len);
-
-		// pad last block with 1 bit followed by zeros
-		last_block[last_block_len] = 0x80;
-		if (last_block_len + 1 < AES_BLOCK_SIZE) {
-			memset(last_block + last_block_len + 1, 0, AES_BLOCK_SIZE - last_block_len - 1);
-		}
-
-		ptr = last_block;
-	}
-
-	// process last block
-	r = tr31_aes_encrypt_cbc(key, key_len, iv, ptr, AES_BLOCK_SIZE, cmac);
-	if (r) {
-		// internal error
-		return r;
-	}
+	r = tr31_cipher_cmac(&cipher, buf, len, cmac);
+	tr31_cipher_cleanup(&cipher);
 
-	return 0;
+	return r;
 }
 
 int tr31_aes_verify_cmac(const void* key, size_t key_len, const void* buf, size_t len, const void* cmac_verify)
@@ -1117,6 +1696,7 @@ int tr31_aes_verify_cmac(const void* key, size_t key_len, const void* buf, size_
 int tr31_aes_kbpk_derive(const void* kbpk, size_t kbpk_len, void* kbek, void* kbak)
 {
 	int r;
+	struct tr31_cipher_t cipher;
 	uint8_t kbxk_input[8];
 
 	if (!kbpk || !kbek || !kbak) {
@@ -1153,6 +1733,14 @@ int tr31_aes_kbpk_derive(const void* kbpk, size_t kbpk_len, void* kbek, void* kb
 			return -2;
 	}
 
+	// the same KBPK key schedule and CMAC subkeys are used for all CMAC
+	// computations below
+	r = tr31_cipher_setup(&cipher, TR31_KEY_ALGORITHM_AES, kbpk, kbpk_len);
+	if (r) {
+		// internal error
+		return r;
+	}
+
 	// derive key block encryption key
 	for (size_t kbek_len = 0; kbek_len < kbpk_len; kbek_len += AES_BLOCK_SIZE) {
 		// AES CMAC creates key material of size AES_BLOCK_SIZE
@@ -1163,19 +1751,19 @@ int tr31_aes_kbpk_derive(const void* kbpk, size_t kbpk_len, void* kbek, void* kb
 		if (kbpk_len - kbek_len < AES_BLOCK_SIZE) {
 			uint8_t cmac[AES_BLOCK_SIZE];
 
-			r = tr31_aes_cmac(kbpk, kbpk_len, kbxk_input, sizeof(kbxk_input), cmac);
+			r = tr31_cipher_cmac(&cipher, kbxk_input, sizeof(kbxk_input), cmac);
 			if (r) {
 				// internal error
-				return r;
+				goto exit;
 			}
 
 			memcpy(kbek + kbek_len, cmac, kbpk_len - kbek_len);
 			tr31_cleanse(cmac, sizeof(cmac));
 		} else {
-			r = tr31_aes_cmac(kbpk, kbpk_len, kbxk_input, sizeof(kbxk_input), kbek + kbek_len);
+			r = tr31_cipher_cmac(&cipher, kbxk_input, sizeof(kbxk_input), kbek + kbek_len);
 			if (r) {
 				// internal error
-				return r;
+				goto exit;
 			}
 		}
 
@@ -1198,7 +1786,8 @@ int tr31_aes_kbpk_derive(const void* kbpk, size_t kbpk_len, void* kbek, void* kb
 			break;
 
 		default:
-			return -3;
+			r = -3;
+			goto exit;
 	}
 
 	// derive key block authentication key
@@ -1211,19 +1800,19 @@ int tr31_aes_kbpk_derive(const void* kbpk, size_t kbpk_len, void* kbek, void* kb
 		if (kbpk_len - kbak_len < AES_BLOCK_SIZE) {
 			uint8_t cmac[AES_BLOCK_SIZE];
 
-			r = tr31_aes_cmac(kbpk, kbpk_len, kbxk_input, sizeof(kbxk_input), cmac);
+			r = tr31_cipher_cmac(&cipher, kbxk_input, sizeof(kbxk_input), cmac);
 			if (r) {
 				// internal error
-				return r;
+				goto exit;
 			}
 
 			memcpy(kbak + kbak_len, cmac, kbpk_len - kbak_len);
 			tr31_cleanse(cmac, sizeof(cmac));
 		} else {
-			r = tr31_aes_cmac(kbpk, kbpk_len, kbxk_input, sizeof(kbxk_input), kbak + kbak_len);
+			r = tr31_cipher_cmac(&cipher, kbxk_input, sizeof(kbxk_input), kbak + kbak_len);
 			if (r) {
 				// internal error
-				return r;
+				goto exit;
 			}
 		}
 
@@ -1231,14 +1820,18 @@ int tr31_aes_kbpk_derive(const void* kbpk, size_t kbpk_len, void* kbek, void* kb
 		kbxk_input[0]++;
 	}
 
-	return 0;
+	r = 0;
+	goto exit;
+
+exit:
+	tr31_cipher_cleanup(&cipher);
+	return r;
 }
 
 int tr31_aes_kcv(const void* key, size_t key_len, void* kcv)
 {
 	int r;
-	uint8_t input[AES_BLOCK_SIZE];
-	uint8_t ciphertext[AES_BLOCK_SIZE];
+	struct tr31_cipher_t cipher;
 
 	if (!key || !kcv) {
 		return -1;
@@ -1250,27 +1843,16 @@ int tr31_aes_kcv(const void* key, size_t key_len, void* kcv)
 		return -2;
 	}
 
-	// see ANSI X9.24-1:2017, A.3 CMAC-based Check values
-
-	// zero KCV in case of error
-	memset(kcv, 0, AES_KCV_SIZE);
-
-	// use input block populated with 0x00
-	memset(input, 0x00, sizeof(input));
-
-	// Compute CMAC of input block using input key
-	r = tr31_aes_cmac(key, key_len, input, sizeof(input), ciphertext);
+	r = tr31_cipher_setup(&cipher, TR31_KEY_ALGORITHM_AES, key, key_len);
 	if (r) {
 		// internal error
 		return r;
 	}
 
-	// KCV is always first 5 bytes of ciphertext
-	memcpy(kcv, ciphertext, AES_KCV_SIZE);
-
-	tr31_cleanse(ciphertext, sizeof(ciphertext));
+	r = tr31_cipher_kcv(&cipher, kcv);
+	tr31_cipher_cleanup(&cipher);
 
-	return 0;
+	return r;
 }
 
 void tr31_cleanse(void* buf, size_t len)
@@ -1289,3 +1871,51 @@ void tr31_rand(void* buf, size_t len)
 {
 	tr31_rand_impl(buf, len);
 }
+
+void tr31_rand_pool_init(struct tr31_rand_pool_t* pool)
+{
+	pool->pid = 0;
+	pool->used = sizeof(pool->buf); // fill upon first use
+}
+
+void tr31_rand_pool_get(struct tr31_rand_pool_t* pool, void* buf, size_t len)
+{
+	uint8_t* ptr = buf;
+	long pid = getpid();
+
+	if (pool->pid != pid) {
+		// discard random data that may have been inherited from parent
+		// process because it may also be used by the parent process
+		pool->pid = pid;
+		pool->used = sizeof(pool->buf);
+	}
+
+	while (len) {
+		size_t chunk_len;
+
+		if (pool->used == sizeof(pool->buf)) {
+			// fill pool in bulk
+			tr31_rand(pool->buf, sizeof(pool->buf));
+			pool->used = 0;
+		}
+
+		chunk_len = sizeof(pool->buf) - pool->used;
+		if (chunk_len > len) {
+			chunk_len = len;
+		}
+		memcpy(ptr, pool->buf + pool->used, chunk_len);
+
+		// do not retain random data that has already been served
+		tr31_cleanse(pool->buf + pool->used, chunk_len);
+
+		pool->used += chunk_len;
+		ptr += chunk_len;
+		len -= chunk_len;
+	}
+}
+
+void tr31_rand_pool_cleanse(struct tr31_rand_pool_t* pool)
+{
+	tr31_cleanse(pool, sizeof(*pool));
+	tr31_rand_pool_init(pool);
+}
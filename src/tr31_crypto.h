@@ -23,6 +23,7 @@
 
 #include <sys/cdefs.h>
 #include <stddef.h>
+#include <stdint.h>
 
 __BEGIN_DECLS
 
@@ -54,6 +55,242 @@ __BEGIN_DECLS
 #define TR31_AES192_KEY_UNDER_AES_LENGTH AES_CIPHERTEXT_LENGTH(2 + AES192_KEY_SIZE) ///< 2-byte length + AES-192 key + AES padding, in bytes
 #define TR31_AES256_KEY_UNDER_AES_LENGTH AES_CIPHERTEXT_LENGTH(2 + AES256_KEY_SIZE) ///< 2-byte length + AES-256 key + AES padding, in bytes
 
+/**
+ * Keyed cipher object. This is an opaque object that retains the key schedule
+ * of a TDES or AES key such that it can be reused for multiple ECB, CBC, CMAC
+ * and KCV operations without repeating the key schedule.
+ * @note A keyed cipher object is not thread safe and must not be used by
+ *       multiple threads simultaneously.
+ */
+struct tr31_cipher_t;
+
+/**
+ * Create TDES keyed cipher object
+ * @note Use @ref tr31_cipher_free() to release the object when done.
+ *
+ * @param key Key
+ * @param key_len Length of key in bytes
+ * @param cipher Keyed cipher object output
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_tdes_cipher_new(const void* key, size_t key_len, struct tr31_cipher_t** cipher);
+
+/**
+ * Create AES keyed cipher object
+ * @note Use @ref tr31_cipher_free() to release the object when done.
+ *
+ * @param key Key
+ * @param key_len Length of key in bytes
+ * @param cipher Keyed cipher object output
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_aes_cipher_new(const void* key, size_t key_len, struct tr31_cipher_t** cipher);
+
+/**
+ * Cleanse and release keyed cipher object
+ * @param cipher Keyed cipher object
+ */
+void tr31_cipher_free(struct tr31_cipher_t* cipher);
+
+/**
+ * Retrieve block size of keyed cipher object
+ * @param cipher Keyed cipher object
+ * @return Block size in bytes. Either @ref DES_BLOCK_SIZE or @ref AES_BLOCK_SIZE.
+ */
+size_t tr31_cipher_block_size(const struct tr31_cipher_t* cipher);
+
+/**
+ * Encrypt single block using ECB and keyed cipher object
+ * @param cipher Keyed cipher object
+ * @param plaintext Plaintext of cipher block size to encrypt
+ * @param ciphertext Encrypted output
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_cipher_encrypt_ecb(struct tr31_cipher_t* cipher, const void* plaintext, void* ciphertext);
+
+/**
+ * Decrypt single block using ECB and keyed cipher object
+ * @param cipher Keyed cipher object
+ * @param ciphertext Ciphertext of cipher block size to decrypt
+ * @param plaintext Decrypted output
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_cipher_decrypt_ecb(struct tr31_cipher_t* cipher, const void* ciphertext, void* plaintext);
+
+/**
+ * Encrypt using CBC and keyed cipher object
+ * @param cipher Keyed cipher object
+ * @param iv Initialization vector
+ * @param plaintext Plaintext to encrypt
+ * @param plen Length of plaintext in bytes. Must be a multiple of cipher block size.
+ * @param ciphertext Encrypted output
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_cipher_encrypt_cbc(struct tr31_cipher_t* cipher, const void* iv, const void* plaintext, size_t plen, void* ciphertext);
+
+/**
+ * Decrypt using CBC and keyed cipher object
+ * @param cipher Keyed cipher object
+ * @param iv Initialization vector
+ * @param ciphertext Ciphertext to decrypt
+ * @param clen Length of ciphertext in bytes. Must be a multiple of cipher block size.
+ * @param plaintext Decrypted output
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_cipher_decrypt_cbc(struct tr31_cipher_t* cipher, const void* iv, const void* ciphertext, size_t clen, void* plaintext);
+
+/**
+ * Compute CBC-MAC using TDES keyed cipher object
+ * @see ISO 9797-1:2011 MAC algorithm 1
+ * @param cipher TDES keyed cipher object
+ * @param buf Input buffer
+ * @param len Length of input buffer in bytes
+ * @param mac CBC-MAC output of length @ref DES_MAC_SIZE
+ * @return Zero for success. Non-zero for error.
+ */
+int tr31_cipher_cbcmac(struct tr31_cipher_t* cipher, const void* buf, size_t len, void* mac);
+
+/**
+ * Verify using CBC-MAC and TDES keyed cipher object
+ * @see ISO 9797-1:2011 MAC algorithm 1
+ * @param cipher TDES keyed cipher object
+ * @param buf Input buffer
+ * @param len Length of input buffer in bytes
+ * @param mac_verify CBC-MAC of length @ref DES_MAC_SIZE to verify
+ * @return Zero for success. Non-zero for verification failure.
+ */
+int tr31_cipher_verify_cbcmac(struct tr31_cipher_t* cipher, const void* buf, size_t len, const void* mac_verify);
+
+/**
+ * Compute CMAC using keyed cipher object. The CMAC subkeys are derived once
+ * and retained by the keyed cipher object.
+ * @remark See NIST SP 800-38B, section 6.2
+ * @remark See ISO 9797-1:2011 MAC algorithm 5
+ * @param cipher Keyed cipher object
+ * @param buf Input buffer
+ * @param len Length of input buffer in bytes
+ * @param cmac CMAC output of cipher block size
+ * @return Zero for success. Non-zero for error.
+ */
+int tr31_cipher_cmac(struct tr31_cipher_t* cipher, const void* buf, size_t len, void* cmac);
+
+/**
+ * Incremental CMAC context object. Use @ref tr31_cmac_init(),
+ * @ref tr31_cmac_update() and @ref tr31_cmac_final() to compute the CMAC of
+ * message input that is not available in a single contiguous buffer.
+ * @warning The fields of this object are for internal use only!
+ */
+struct tr31_cmac_ctx_t {
+	struct tr31_cipher_t* cipher; ///< Keyed cipher object
+	uint8_t state[AES_BLOCK_SIZE]; ///< CBC chaining value
+	uint8_t pending[AES_BLOCK_SIZE]; ///< Pending message input block
+	size_t pending_len; ///< Length of pending message input block in bytes
+};
+
+/**
+ * Initialise incremental CMAC context object
+ * @note The keyed cipher object must remain valid until @ref tr31_cmac_final()
+ *
+ * @param ctx Incremental CMAC context object
+ * @param cipher Keyed cipher object
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_cmac_init(struct tr31_cmac_ctx_t* ctx, struct tr31_cipher_t* cipher);
+
+/**
+ * Process message input using incremental CMAC context object
+ * @param ctx Incremental CMAC context object
+ * @param buf Input buffer
+ * @param len Length of input buffer in bytes
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_cmac_update(struct tr31_cmac_ctx_t* ctx, const void* buf, size_t len);
+
+/**
+ * Finalise incremental CMAC context object and output CMAC
+ * @remark See NIST SP 800-38B, section 6.2
+ * @remark See ISO 9797-1:2011 MAC algorithm 5
+ * @param ctx Incremental CMAC context object. Cleansed after use.
+ * @param cmac CMAC output of cipher block size
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_cmac_final(struct tr31_cmac_ctx_t* ctx, void* cmac);
+
+/**
+ * Finalise incremental CMAC context object and verify CMAC
+ * @remark See NIST SP 800-38B, section 6.3
+ * @remark See ISO 9797-1:2011 MAC algorithm 5
+ * @param ctx Incremental CMAC context object. Cleansed after use.
+ * @param cmac_verify CMAC of cipher block size to verify
+ * @return Zero for success. Non-zero for verification failure.
+ */
+int tr31_cmac_verify_final(struct tr31_cmac_ctx_t* ctx, const void* cmac_verify);
+
+/**
+ * Verify using CMAC and keyed cipher object
+ * @remark See NIST SP 800-38B, section 6.3
+ * @remark See ISO 9797-1:2011 MAC algorithm 5
+ * @param cipher Keyed cipher object
+ * @param buf Input buffer to verify
+ * @param len Length of input buffer in bytes
+ * @param cmac_verify CMAC of cipher block size to verify
+ * @return Zero for success. Non-zero for verification failure.
+ */
+int tr31_cipher_verify_cmac(struct tr31_cipher_t* cipher, const void* buf, size_t len, const void* cmac_verify);
+
+/// Number of independent CMAC computations that are interleaved by @ref tr31_cmac_multi()
+#define TR31_CMAC_MULTI_LANES (8)
+
+/**
+ * CMAC job object for @ref tr31_cmac_multi() and @ref tr31_cmac_verify_multi().
+ * The message input consists of up to two segments that are processed as if
+ * they were concatenated such that, for example, a key block header and a
+ * decrypted payload need not be copied into a single buffer.
+ */
+struct tr31_cmac_job_t {
+	struct tr31_cipher_t* cipher; ///< Keyed cipher object
+	const void* buf[2]; ///< Message input segments. Unused segments must be NULL and of zero length.
+	size_t len[2]; ///< Lengths of message input segments in bytes
+	const void* cmac_verify; ///< CMAC of cipher block size to verify. Only used by @ref tr31_cmac_verify_multi().
+	uint8_t cmac[AES_BLOCK_SIZE]; ///< CMAC output of cipher block size. Cleansed by @ref tr31_cmac_verify_multi().
+	int result; ///< Verification result. Zero for success. Non-zero for verification failure.
+};
+
+/**
+ * Compute CMAC for multiple independent messages. The jobs may use the same
+ * or different keyed cipher objects. When the built-in AES-NI engine is
+ * available, the CMAC chains of up to @ref TR31_CMAC_MULTI_LANES AES jobs of
+ * the same AES key length are processed together such that the latency of
+ * each AES invocation is hidden by the AES invocations of the other jobs.
+ * Other jobs are processed individually.
+ * @remark See NIST SP 800-38B, section 6.2
+ * @remark See ISO 9797-1:2011 MAC algorithm 5
+ * @param jobs Array of CMAC job objects
+ * @param count Number of CMAC job objects
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_cmac_multi(struct tr31_cmac_job_t* jobs, size_t count);
+
+/**
+ * Verify CMAC for multiple independent messages. See @ref tr31_cmac_multi().
+ * The verification result of each job is provided by its result field.
+ * @remark See NIST SP 800-38B, section 6.3
+ * @remark See ISO 9797-1:2011 MAC algorithm 5
+ * @param jobs Array of CMAC job objects
+ * @param count Number of CMAC job objects
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_cmac_verify_multi(struct tr31_cmac_job_t* jobs, size_t count);
+
+/**
+ * Compute Key Check Value (KCV) using keyed cipher object. This will compute
+ * the legacy KCV for TDES and the CMAC-based KCV for AES.
+ * @param cipher Keyed cipher object
+ * @param kcv Key Check Value output of length @ref TDES_KCV_SIZE for TDES or @ref AES_KCV_SIZE for AES
+ * @return Zero for success. Less than zero for internal error.
+ */
+int tr31_cipher_kcv(struct tr31_cipher_t* cipher, void* kcv);
+
 /**
  * Encrypt using TDES ECB
  * @param key Key
@@ -275,11 +512,49 @@ void tr31_cleanse(void* buf, size_t len);
 
 /**
  * Generate random data
+ * @note The underlying random number generator is seeded once, shared by all
+ *       threads, reseeded periodically and reseeded after fork().
+ *
  * @param buf Pointer to buffer
  * @param len Length of buffer in bytes
  */
 void tr31_rand(void* buf, size_t len);
 
+#define TR31_RAND_POOL_SIZE (1024) ///< Random data pool size in bytes
+
+/**
+ * Random data pool object. This object is filled in bulk using
+ * @ref tr31_rand() and serves many small requests, such as key block padding,
+ * without invoking the random number generator for each request.
+ * @note This object is not thread safe. Use a separate object per thread.
+ * @warning The fields of this object are for internal use only!
+ */
+struct tr31_rand_pool_t {
+	long pid; ///< Process ID at which the pool was filled. Prevents reuse of random data after fork().
+	size_t used; ///< Number of bytes already served from pool
+	uint8_t buf[TR31_RAND_POOL_SIZE]; ///< Random data
+};
+
+/**
+ * Initialise random data pool object. The pool is filled when first used.
+ * @param pool Random data pool object
+ */
+void tr31_rand_pool_init(struct tr31_rand_pool_t* pool);
+
+/**
+ * Retrieve random data from random data pool object
+ * @param pool Random data pool object
+ * @param buf Pointer to buffer
+ * @param len Length of buffer in bytes
+ */
+void tr31_rand_pool_get(struct tr31_rand_pool_t* pool, void* buf, size_t len);
+
+/**
+ * Cleanse random data pool object
+ * @param pool Random data pool object
+ */
+void tr31_rand_pool_cleanse(struct tr31_rand_pool_t* pool);
+
 __END_DECLS
 
 #endif
@@ -0,0 +1,331 @@
+/**
+ * @file tr31_hex.c
+ *
+ * Copyright (c) 2020, 2021 ono//connect
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "tr31.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// SSE2 is part of the x86-64 baseline; AVX2 is selected at runtime
+#define TR31_HEX_USE_SSE2
+#define TR31_HEX_USE_AVX2
+#include <immintrin.h>
+#endif
+
+// ASCII hex digit to nibble value, offset by 0x10 such that zero indicates an
+// invalid digit; this avoids the need to initialise every other table entry
+static const uint8_t hex_digit_value[256] = {
+	['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+	['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+	['A'] = 0x1A, ['B'] = 0x1B, ['C'] = 0x1C, ['D'] = 0x1D, ['E'] = 0x1E, ['F'] = 0x1F,
+	['a'] = 0x1A, ['b'] = 0x1B, ['c'] = 0x1C, ['d'] = 0x1D, ['e'] = 0x1E, ['f'] = 0x1F,
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static int hex_decode_scalar(const char* hex, uint8_t* bin, size_t bin_len)
+{
+	uint8_t invalid = 0;
+
+	for (size_t i = 0; i < bin_len; ++i) {
+		uint8_t msn = hex_digit_value[(uint8_t)hex[i * 2]];
+		uint8_t lsn = hex_digit_value[(uint8_t)hex[(i * 2) + 1]];
+
+		// accumulate invalid digits instead of branching per digit
+		invalid |= (msn ^ 0x10) & 0xF0;
+		invalid |= (lsn ^ 0x10) & 0xF0;
+
+		bin[i] = (msn << 4) | (lsn & 0xF);
+	}
+
+	return invalid ? 1 : 0;
+}
+
+static void hex_encode_scalar(const uint8_t* bin, size_t bin_len, char* hex)
+{
+	for (size_t i = 0; i < bin_len; ++i) {
+		hex[i * 2] = hex_digits[bin[i] >> 4];
+		hex[(i * 2) + 1] = hex_digits[bin[i] & 0xF];
+	}
+}
+
+#ifdef TR31_HEX_USE_SSE2
+// convert 16 ASCII hex digits to nibble values in 16-bit lanes; return mask of valid digits
+static inline __m128i hex_digits_to_nibbles_sse2(__m128i digits, int* valid_mask)
+{
+	__m128i lower;
+	__m128i is_digit;
+	__m128i is_alpha;
+
+	// NOTE: signed comparisons also reject characters from 0x80 upwards
+	is_digit = _mm_and_si128(
+		_mm_cmpgt_epi8(digits, _mm_set1_epi8('0' - 1)),
+		_mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), digits)
+	);
+	lower = _mm_or_si128(digits, _mm_set1_epi8(0x20));
+	is_alpha = _mm_and_si128(
+		_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+		_mm_cmpgt_epi8(_mm_set1_epi8('f' + 1), lower)
+	);
+	*valid_mask = _mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha));
+
+	return _mm_or_si128(
+		_mm_and_si128(is_digit, _mm_sub_epi8(digits, _mm_set1_epi8('0'))),
+		_mm_and_si128(is_alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)))
+	);
+}
+
+// combine nibble pairs into byte values in 16-bit lanes
+static inline __m128i hex_nibbles_to_words_sse2(__m128i nibbles)
+{
+	// first digit of each pair is the most significant nibble and occupies
+	// the low byte of each little endian 16-bit lane
+	return _mm_or_si128(
+		_mm_and_si128(_mm_slli_epi16(nibbles, 4), _mm_set1_epi16(0x00F0)),
+		_mm_srli_epi16(nibbles, 8)
+	);
+}
+
+static int hex_decode_sse2(const char* hex, uint8_t* bin, size_t bin_len)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= bin_len; i += 16) {
+		int valid0;
+		int valid1;
+		__m128i words0;
+		__m128i words1;
+
+		words0 = hex_nibbles_to_words_sse2(
+			hex_digits_to_nibbles_sse2(_mm_loadu_si128((const void*)(hex + (i * 2))), &valid0)
+		);
+		words1 = hex_nibbles_to_words_sse2(
+			hex_digits_to_nibbles_sse2(_mm_loadu_si128((const void*)(hex + (i * 2) + 16)), &valid1)
+		);
+		if ((valid0 & valid1) != 0xFFFF) {
+			return 1;
+		}
+
+		_mm_storeu_si128((void*)(bin + i), _mm_packus_epi16(words0, words1));
+	}
+
+	return hex_decode_scalar(hex + (i * 2), bin + i, bin_len - i);
+}
+
+// convert 16 nibble values to ASCII hex digits
+static inline __m128i hex_nibbles_to_digits_sse2(__m128i nibbles)
+{
+	__m128i alpha_adjust;
+
+	// add 7 to nibble values above 9 to skip the gap between '9' and 'A'
+	alpha_adjust = _mm_and_si128(
+		_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)),
+		_mm_set1_epi8('A' - '9' - 1)
+	);
+	return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), alpha_adjust);
+}
+
+static void hex_encode_sse2(const uint8_t* bin, size_t bin_len, char* hex)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= bin_len; i += 16) {
+		__m128i bytes;
+		__m128i msn;
+		__m128i lsn;
+
+		bytes = _mm_loadu_si128((const void*)(bin + i));
+		msn = _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0F));
+		lsn = _mm_and_si128(bytes, _mm_set1_epi8(0x0F));
+
+		_mm_storeu_si128((void*)(hex + (i * 2)), hex_nibbles_to_digits_sse2(_mm_unpacklo_epi8(msn, lsn)));
+		_mm_storeu_si128((void*)(hex + (i * 2) + 16), hex_nibbles_to_digits_sse2(_mm_unpackhi_epi8(msn, lsn)));
+	}
+
+	hex_encode_scalar(bin + i, bin_len - i, hex + (i * 2));
+}
+#endif
+
+#ifdef TR31_HEX_USE_AVX2
+__attribute__((target("avx2")))
+static inline __m256i hex_digits_to_nibbles_avx2(__m256i digits, unsigned int* valid_mask)
+{
+	__m256i lower;
+	__m256i is_digit;
+	__m256i is_alpha;
+
+	// NOTE: signed comparisons also reject characters from 0x80 upwards
+	is_digit = _mm256_and_si256(
+		_mm256_cmpgt_epi8(digits, _mm256_set1_epi8('0' - 1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), digits)
+	);
+	lower = _mm256_or_si256(digits, _mm256_set1_epi8(0x20));
+	is_alpha = _mm256_and_si256(
+		_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower)
+	);
+	*valid_mask = _mm256_movemask_epi8(_mm256_or_si256(is_digit, is_alpha));
+
+	return _mm256_or_si256(
+		_mm256_and_si256(is_digit, _mm256_sub_epi8(digits, _mm256_set1_epi8('0'))),
+		_mm256_and_si256(is_alpha, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10)))
+	);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hex_nibbles_to_words_avx2(__m256i nibbles)
+{
+	return _mm256_or_si256(
+		_mm256_and_si256(_mm256_slli_epi16(nibbles, 4), _mm256_set1_epi16(0x00F0)),
+		_mm256_srli_epi16(nibbles, 8)
+	);
+}
+
+__attribute__((target("avx2")))
+static int hex_decode_avx2(const char* hex, uint8_t* bin, size_t bin_len)
+{
+	size_t i = 0;
+
+	for (; i + 32 <= bin_len; i += 32) {
+		unsigned int valid0;
+		unsigned int valid1;
+		__m256i words0;
+		__m256i words1;
+		__m256i packed;
+
+		words0 = hex_nibbles_to_words_avx2(
+			hex_digits_to_nibbles_avx2(_mm256_loadu_si256((const void*)(hex + (i * 2))), &valid0)
+		);
+		words1 = hex_nibbles_to_words_avx2(
+			hex_digits_to_nibbles_avx2(_mm256_loadu_si256((const void*)(hex + (i * 2) + 32)), &valid1)
+		);
+		if ((valid0 & valid1) != 0xFFFFFFFF) {
+			return 1;
+		}
+
+		// packing operates per 128-bit lane; restore byte order afterwards
+		packed = _mm256_packus_epi16(words0, words1);
+		packed = _mm256_permute4x64_epi64(packed, 0xD8);
+		_mm256_storeu_si256((void*)(bin + i), packed);
+	}
+
+	return hex_decode_sse2(hex + (i * 2), bin + i, bin_len - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hex_nibbles_to_digits_avx2(__m256i nibbles)
+{
+	__m256i alpha_adjust;
+
+	alpha_adjust = _mm256_and_si256(
+		_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)),
+		_mm256_set1_epi8('A' - '9' - 1)
+	);
+	return _mm256_add_epi8(_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')), alpha_adjust);
+}
+
+__attribute__((target("avx2")))
+static void hex_encode_avx2(const uint8_t* bin, size_t bin_len, char* hex)
+{
+	size_t i = 0;
+
+	for (; i + 32 <= bin_len; i += 32) {
+		__m256i bytes;
+		__m256i msn;
+		__m256i lsn;
+		__m256i lo;
+		__m256i hi;
+
+		bytes = _mm256_loadu_si256((const void*)(bin + i));
+		msn = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x0F));
+		lsn = _mm256_and_si256(bytes, _mm256_set1_epi8(0x0F));
+
+		// unpacking operates per 128-bit lane; restore digit order afterwards
+		lo = hex_nibbles_to_digits_avx2(_mm256_unpacklo_epi8(msn, lsn));
+		hi = hex_nibbles_to_digits_avx2(_mm256_unpackhi_epi8(msn, lsn));
+		_mm256_storeu_si256((void*)(hex + (i * 2)), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((void*)(hex + (i * 2) + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	hex_encode_sse2(bin + i, bin_len - i, hex + (i * 2));
+}
+
+static bool hex_have_avx2(void)
+{
+	// 0 = unknown, 1 = unavailable, 2 = available
+	static atomic_int have_avx2 = 0;
+	int value;
+
+	value = atomic_load_explicit(&have_avx2, memory_order_relaxed);
+	if (!value) {
+		__builtin_cpu_init();
+		value = __builtin_cpu_supports("avx2") ? 2 : 1;
+		atomic_store_explicit(&have_avx2, value, memory_order_relaxed);
+	}
+
+	return value == 2;
+}
+#endif
+
+int tr31_hex_to_bin(const char* hex, void* bin, size_t bin_len)
+{
+	if (!hex || (!bin && bin_len)) {
+		return -1;
+	}
+
+#ifdef TR31_HEX_USE_AVX2
+	if (bin_len >= 32 && hex_have_avx2()) {
+		return hex_decode_avx2(hex, bin, bin_len);
+	}
+#endif
+#ifdef TR31_HEX_USE_SSE2
+	return hex_decode_sse2(hex, bin, bin_len);
+#else
+	return hex_decode_scalar(hex, bin, bin_len);
+#endif
+}
+
+int tr31_bin_to_hex(const void* bin, size_t bin_len, char* hex, size_t hex_len)
+{
+	if (!hex || (!bin && bin_len)) {
+		return -1;
+	}
+
+	// minimum string length
+	if (hex_len < bin_len * 2) {
+		return -2;
+	}
+
+#ifdef TR31_HEX_USE_AVX2
+	if (bin_len >= 32 && hex_have_avx2()) {
+		hex_encode_avx2(bin, bin_len, hex);
+		return 0;
+	}
+#endif
+#ifdef TR31_HEX_USE_SSE2
+	hex_encode_sse2(bin, bin_len, hex);
+#else
+	hex_encode_scalar(bin, bin_len, hex);
+#endif
+
+	return 0;
+}
@@ -0,0 +1,301 @@
+/**
+ * @file tr31_secmem.c
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE // for MAP_ANONYMOUS and MADV_DONTDUMP
+
+#include "tr31.h"
+#include "tr31_secmem.h"
+#include "tr31_alloc.h"
+#include "tr31_crypto.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sched.h> // for sched_yield
+#include <sys/mman.h>
+#include <unistd.h> // for sysconf
+
+struct tr31_secmem_region_t {
+	uint8_t* base;
+	size_t length;
+};
+
+// free slots form a singly linked list through their first bytes
+struct tr31_secmem_slot_t {
+	struct tr31_secmem_slot_t* next;
+};
+
+// pool state is protected by tr31_secmem_lock, except for the enabled flag
+// which allows the heap fallback to skip the lock while the pool is disabled
+static atomic_flag tr31_secmem_lock = ATOMIC_FLAG_INIT;
+static atomic_bool tr31_secmem_enabled = false;
+static size_t tr31_secmem_region_size = 0;
+static struct tr31_secmem_region_t tr31_secmem_regions[TR31_SECMEM_MAX_REGIONS];
+static size_t tr31_secmem_region_count = 0;
+static struct tr31_secmem_slot_t* tr31_secmem_free_list = NULL;
+static size_t tr31_secmem_slots_used = 0;
+
+static void tr31_secmem_lock_acquire(void)
+{
+	// critical sections only update the free list, except when a new region
+	// is mapped, and therefore a spinlock is sufficient
+	while (atomic_flag_test_and_set_explicit(&tr31_secmem_lock, memory_order_acquire)) {
+		sched_yield();
+	}
+}
+
+static void tr31_secmem_lock_release(void)
+{
+	atomic_flag_clear_explicit(&tr31_secmem_lock, memory_order_release);
+}
+
+static int tr31_secmem_region_add(void)
+{
+	struct tr31_secmem_region_t* region;
+	uint8_t* base;
+	size_t slot_count;
+
+	if (tr31_secmem_region_count >= TR31_SECMEM_MAX_REGIONS) {
+		// pool exhausted
+		return 1;
+	}
+
+	base = mmap(NULL, tr31_secmem_region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+
+#ifdef MADV_DONTDUMP
+	// exclude from core dumps; this is best effort because older kernels do
+	// not support it and locking the region remains worthwhile regardless
+	madvise(base, tr31_secmem_region_size, MADV_DONTDUMP);
+#endif
+
+	// lock region into RAM; this also populates all of its pages such that
+	// slot allocation never faults
+	if (mlock(base, tr31_secmem_region_size)) {
+		munmap(base, tr31_secmem_region_size);
+		return -1;
+	}
+
+	region = &tr31_secmem_regions[tr31_secmem_region_count++];
+	region->base = base;
+	region->length = tr31_secmem_region_size;
+
+	// add slots to free list such that the lowest address is allocated first
+	slot_count = region->length / TR31_SECMEM_SLOT_SIZE;
+	for (size_t i = slot_count; i > 0; --i) {
+		struct tr31_secmem_slot_t* slot;
+
+		slot = (struct tr31_secmem_slot_t*)(base + ((i - 1) * TR31_SECMEM_SLOT_SIZE));
+		slot->next = tr31_secmem_free_list;
+		tr31_secmem_free_list = slot;
+	}
+
+	return 0;
+}
+
+static bool tr31_secmem_owns(const void* ptr)
+{
+	const uint8_t* p = ptr;
+
+	for (size_t i = 0; i < tr31_secmem_region_count; ++i) {
+		const struct tr31_secmem_region_t* region = &tr31_secmem_regions[i];
+		if (p >= region->base && p < region->base + region->length) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int tr31_secmem_enable(size_t region_size)
+{
+	int r;
+	long page_size;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0) {
+		return -1;
+	}
+
+	if (!region_size) {
+		region_size = TR31_SECMEM_DEFAULT_REGION_SIZE;
+	}
+	// round up to whole pages because locking applies to whole pages
+	region_size = (region_size + page_size - 1) & ~((size_t)page_size - 1);
+
+	tr31_secmem_lock_acquire();
+
+	if (atomic_load_explicit(&tr31_secmem_enabled, memory_order_relaxed)) {
+		// already enabled
+		r = 0;
+		goto exit;
+	}
+
+	// map first region immediately such that failure to lock memory is
+	// reported to the caller instead of silently falling back to the heap
+	tr31_secmem_region_size = region_size;
+	r = tr31_secmem_region_add();
+	if (r) {
+		r = -1;
+		goto exit;
+	}
+	atomic_store_explicit(&tr31_secmem_enabled, true, memory_order_relaxed);
+
+exit:
+	tr31_secmem_lock_release();
+	return r;
+}
+
+int tr31_secmem_disable(void)
+{
+	tr31_secmem_lock_acquire();
+
+	if (tr31_secmem_slots_used) {
+		// key data is still allocated from the pool
+		tr31_secmem_lock_release();
+		return 1;
+	}
+
+	atomic_store_explicit(&tr31_secmem_enabled, false, memory_order_relaxed);
+	for (size_t i = 0; i < tr31_secmem_region_count; ++i) {
+		struct tr31_secmem_region_t* region = &tr31_secmem_regions[i];
+
+		tr31_cleanse(region->base, region->length);
+		munlock(region->base, region->length);
+		munmap(region->base, region->length);
+		region->base = NULL;
+		region->length = 0;
+	}
+	tr31_secmem_region_count = 0;
+	tr31_secmem_free_list = NULL;
+
+	tr31_secmem_lock_release();
+	return 0;
+}
+
+void* tr31_secmem_alloc(size_t length)
+{
+	if (length &&
+		length <= TR31_SECMEM_SLOT_SIZE &&
+		atomic_load_explicit(&tr31_secmem_enabled, memory_order_relaxed)
+	) {
+		struct tr31_secmem_slot_t* slot;
+
+		tr31_secmem_lock_acquire();
+		// pool may have been disabled concurrently; re-check while holding
+		// the lock to avoid adding regions that are never released
+		if (atomic_load_explicit(&tr31_secmem_enabled, memory_order_relaxed)) {
+			if (!tr31_secmem_free_list) {
+				// failure leaves the free list empty and is handled below
+				tr31_secmem_region_add();
+			}
+			slot = tr31_secmem_free_list;
+			if (slot) {
+				tr31_secmem_free_list = slot->next;
+				++tr31_secmem_slots_used;
+			}
+		} else {
+			slot = NULL;
+		}
+		tr31_secmem_lock_release();
+
+		if (slot) {
+			// remainder of slot was cleansed when it was released
+			slot->next = NULL;
+			return slot;
+		}
+
+		// pool exhausted or disabled; fall back to heap
+	}
+
+	return tr31_alloc(length);
+}
+
+void tr31_secmem_free(void* ptr, size_t length)
+{
+	if (!ptr) {
+		return;
+	}
+
+	tr31_cleanse(ptr, length);
+
+	// pool slots are identified by address because key data may have been
+	// allocated from the heap before the pool was enabled
+	if (length <= TR31_SECMEM_SLOT_SIZE &&
+		atomic_load_explicit(&tr31_secmem_enabled, memory_order_relaxed)
+	) {
+		tr31_secmem_lock_acquire();
+		if (tr31_secmem_owns(ptr)) {
+			struct tr31_secmem_slot_t* slot = ptr;
+
+			slot->next = tr31_secmem_free_list;
+			tr31_secmem_free_list = slot;
+			--tr31_secmem_slots_used;
+			tr31_secmem_lock_release();
+			return;
+		}
+		tr31_secmem_lock_release();
+	}
+
+	tr31_free_cleansed(ptr, length);
+}
+
+void* tr31_secmem_scratch_alloc(size_t length)
+{
+	void* ptr;
+
+	if (!length) {
+		return NULL;
+	}
+
+	// anonymous mappings are zeroed and page aligned such that no other data
+	// shares the locked pages
+	ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+		return NULL;
+	}
+
+#ifdef MADV_DONTDUMP
+	// exclude from core dumps; best effort (see tr31_secmem_region_add())
+	madvise(ptr, length, MADV_DONTDUMP);
+#endif
+
+	if (mlock(ptr, length)) {
+		munmap(ptr, length);
+		return NULL;
+	}
+
+	return ptr;
+}
+
+void tr31_secmem_scratch_free(void* ptr, size_t length)
+{
+	if (!ptr) {
+		return;
+	}
+
+	tr31_cleanse(ptr, length);
+	munlock(ptr, length);
+	munmap(ptr, length);
+}
@@ -0,0 +1,72 @@
+/**
+ * @file tr31_secmem.h
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTR31_SECMEM_H
+#define LIBTR31_SECMEM_H
+
+#include <sys/cdefs.h>
+#include <stddef.h>
+
+__BEGIN_DECLS
+
+#define TR31_SECMEM_SLOT_SIZE (64) ///< Secure memory slot size in bytes; sufficient for any TDES or AES key
+#define TR31_SECMEM_DEFAULT_REGION_SIZE (64 * 1024) ///< Default secure memory region size in bytes
+#define TR31_SECMEM_MAX_REGIONS (16) ///< Maximum number of secure memory regions
+
+/**
+ * Allocate zeroed buffer for sensitive data. If the secure memory pool is
+ * enabled and the length fits in a slot, the buffer is allocated from locked
+ * memory. Otherwise the buffer is allocated from the heap.
+ *
+ * @param length Length of buffer in bytes
+ * @return Pointer to buffer. NULL if allocation failed.
+ */
+void* tr31_secmem_alloc(size_t length);
+
+/**
+ * Cleanse and free buffer that was allocated using @ref tr31_secmem_alloc().
+ *
+ * @param ptr Pointer to buffer. May be NULL.
+ * @param length Length of buffer in bytes, as provided to @ref tr31_secmem_alloc()
+ */
+void tr31_secmem_free(void* ptr, size_t length);
+
+/**
+ * Allocate zeroed scratch buffer for sensitive data from locked memory,
+ * regardless of whether the secure memory pool is enabled. This is intended
+ * for short-lived buffers that are larger than a secure memory slot.
+ *
+ * @param length Length of buffer in bytes
+ * @return Pointer to buffer. NULL if allocation or locking failed.
+ */
+void* tr31_secmem_scratch_alloc(size_t length);
+
+/**
+ * Cleanse, unlock and free buffer that was allocated using
+ * @ref tr31_secmem_scratch_alloc().
+ *
+ * @param ptr Pointer to buffer. May be NULL.
+ * @param length Length of buffer in bytes, as provided to @ref tr31_secmem_scratch_alloc()
+ */
+void tr31_secmem_scratch_free(void* ptr, size_t length);
+
+__END_DECLS
+
+#endif
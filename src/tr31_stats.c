@@ -0,0 +1,267 @@
+/**
+ * @file tr31_stats.c
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L // for clock_gettime
+
+#include "tr31.h"
+#include "tr31_config.h"
+#include "tr31_stats.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ensure that every error value has an error counter
+// update this when adding error values
+_Static_assert(TR31_ERROR_KBPK_TOO_WEAK < TR31_STATS_ERROR_COUNT, "TR31_STATS_ERROR_COUNT too small for tr31_error_t");
+
+#ifdef HAVE_STATS
+
+#include <time.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+// all members of struct tr31_stats_t are 64-bit counters such that they can
+// be processed as an array
+#define TR31_STATS_COUNTER_COUNT (sizeof(struct tr31_stats_t) / sizeof(uint64_t))
+#define TR31_STATS_COUNTER_INDEX(field) (offsetof(struct tr31_stats_t, field) / sizeof(uint64_t))
+_Static_assert(sizeof(struct tr31_stats_t) == TR31_STATS_COUNTER_COUNT * sizeof(uint64_t), "struct tr31_stats_t must only contain 64-bit counters");
+_Static_assert(sizeof(struct tr31_stats_stage_counter_t) == 2 * sizeof(uint64_t), "struct tr31_stats_stage_counter_t must only contain count and nsec");
+
+// counters of a single thread
+// only the owning thread updates its counters while any thread may read them
+struct tr31_stats_thread_t {
+	_Atomic uint64_t counters[TR31_STATS_COUNTER_COUNT];
+	bool registered;
+	struct tr31_stats_thread_t* prev;
+	struct tr31_stats_thread_t* next;
+};
+
+static _Thread_local struct tr31_stats_thread_t tr31_stats_thread;
+
+// list of registered threads, the counters of threads that have exited, and
+// the counters at the time of the previous reset are protected by
+// tr31_stats_lock
+static struct tr31_stats_thread_t* tr31_stats_threads = NULL;
+static uint64_t tr31_stats_retired[TR31_STATS_COUNTER_COUNT];
+static uint64_t tr31_stats_baseline[TR31_STATS_COUNTER_COUNT];
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t tr31_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t tr31_stats_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tr31_stats_key;
+static bool tr31_stats_key_valid = false;
+#endif
+
+static void tr31_stats_lock_acquire(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&tr31_stats_lock);
+#endif
+}
+
+static void tr31_stats_lock_release(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&tr31_stats_lock);
+#endif
+}
+
+static void tr31_stats_thread_unregister(void* arg)
+{
+	struct tr31_stats_thread_t* thread = arg;
+
+	// retain counters of exiting thread
+	tr31_stats_lock_acquire();
+	for (size_t i = 0; i < TR31_STATS_COUNTER_COUNT; ++i) {
+		tr31_stats_retired[i] += atomic_load_explicit(&thread->counters[i], memory_order_relaxed);
+		atomic_store_explicit(&thread->counters[i], 0, memory_order_relaxed);
+	}
+	if (thread->prev) {
+		thread->prev->next = thread->next;
+	} else {
+		tr31_stats_threads = thread->next;
+	}
+	if (thread->next) {
+		thread->next->prev = thread->prev;
+	}
+	thread->prev = NULL;
+	thread->next = NULL;
+	thread->registered = false;
+	tr31_stats_lock_release();
+}
+
+#ifdef HAVE_PTHREAD
+static void tr31_stats_key_create(void)
+{
+	// the key destructor is invoked when a thread exits, before its thread
+	// local storage is released
+	tr31_stats_key_valid = pthread_key_create(&tr31_stats_key, &tr31_stats_thread_unregister) == 0;
+}
+#endif
+
+static struct tr31_stats_thread_t* tr31_stats_thread_get(void)
+{
+	struct tr31_stats_thread_t* thread = &tr31_stats_thread;
+
+	if (thread->registered) {
+		return thread;
+	}
+
+#ifdef HAVE_PTHREAD
+	pthread_once(&tr31_stats_key_once, &tr31_stats_key_create);
+	if (tr31_stats_key_valid) {
+		pthread_setspecific(tr31_stats_key, thread);
+	}
+#endif
+
+	tr31_stats_lock_acquire();
+	thread->prev = NULL;
+	thread->next = tr31_stats_threads;
+	if (tr31_stats_threads) {
+		tr31_stats_threads->prev = thread;
+	}
+	tr31_stats_threads = thread;
+	thread->registered = true;
+	tr31_stats_lock_release();
+
+	return thread;
+}
+
+static inline void tr31_stats_counter_add(struct tr31_stats_thread_t* thread, size_t idx, uint64_t value)
+{
+	// only the owning thread updates its counters and therefore an atomic
+	// read-modify-write operation is not required
+	atomic_store_explicit(
+		&thread->counters[idx],
+		atomic_load_explicit(&thread->counters[idx], memory_order_relaxed) + value,
+		memory_order_relaxed
+	);
+}
+
+static void tr31_stats_result(size_t count_idx, size_t failed_idx, int r)
+{
+	struct tr31_stats_thread_t* thread = tr31_stats_thread_get();
+
+	tr31_stats_counter_add(thread, count_idx, 1);
+	if (!r) {
+		return;
+	}
+
+	tr31_stats_counter_add(thread, failed_idx, 1);
+	if (r < 0) {
+		tr31_stats_counter_add(thread, TR31_STATS_COUNTER_INDEX(internal_errors), 1);
+	} else if (r < TR31_STATS_ERROR_COUNT) {
+		tr31_stats_counter_add(thread, TR31_STATS_COUNTER_INDEX(errors) + r, 1);
+	}
+}
+
+static void tr31_stats_sum(uint64_t* totals)
+{
+	// caller must hold tr31_stats_lock
+	memcpy(totals, tr31_stats_retired, sizeof(tr31_stats_retired));
+	for (struct tr31_stats_thread_t* thread = tr31_stats_threads; thread; thread = thread->next) {
+		for (size_t i = 0; i < TR31_STATS_COUNTER_COUNT; ++i) {
+			totals[i] += atomic_load_explicit(&thread->counters[i], memory_order_relaxed);
+		}
+	}
+}
+
+uint64_t tr31_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void tr31_stats_stage_add(enum tr31_stats_stage_t stage, uint64_t nsec)
+{
+	struct tr31_stats_thread_t* thread = tr31_stats_thread_get();
+	size_t idx = TR31_STATS_COUNTER_INDEX(stages) + (stage * 2);
+
+	tr31_stats_counter_add(thread, idx, 1);
+	tr31_stats_counter_add(thread, idx + 1, nsec);
+}
+
+void tr31_stats_import_done(int r)
+{
+	tr31_stats_result(TR31_STATS_COUNTER_INDEX(imports), TR31_STATS_COUNTER_INDEX(imports_failed), r);
+}
+
+void tr31_stats_export_done(int r)
+{
+	tr31_stats_result(TR31_STATS_COUNTER_INDEX(exports), TR31_STATS_COUNTER_INDEX(exports_failed), r);
+}
+
+int tr31_stats_get(struct tr31_stats_t* stats)
+{
+	uint64_t totals[TR31_STATS_COUNTER_COUNT];
+
+	if (!stats) {
+		return -1;
+	}
+
+	tr31_stats_lock_acquire();
+	tr31_stats_sum(totals);
+	for (size_t i = 0; i < TR31_STATS_COUNTER_COUNT; ++i) {
+		totals[i] -= tr31_stats_baseline[i];
+	}
+	tr31_stats_lock_release();
+
+	memcpy(stats, totals, sizeof(*stats));
+	return 0;
+}
+
+int tr31_stats_reset(void)
+{
+	// counters are never modified by other threads and therefore a reset
+	// records the current counters as the baseline for subsequent snapshots
+	tr31_stats_lock_acquire();
+	tr31_stats_sum(tr31_stats_baseline);
+	tr31_stats_lock_release();
+
+	return 0;
+}
+
+#else
+
+int tr31_stats_get(struct tr31_stats_t* stats)
+{
+	if (!stats) {
+		return -1;
+	}
+
+	// instrumentation not available
+	memset(stats, 0, sizeof(*stats));
+	return 1;
+}
+
+int tr31_stats_reset(void)
+{
+	// instrumentation not available
+	return 1;
+}
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ * @file tr31_stats.h
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTR31_STATS_H
+#define LIBTR31_STATS_H
+
+#include "tr31.h"
+#include "tr31_config.h"
+
+#include <sys/cdefs.h>
+#include <stdint.h>
+
+__BEGIN_DECLS
+
+#ifdef HAVE_STATS
+
+/**
+ * Retrieve monotonic timestamp
+ * @return Timestamp in nanoseconds
+ */
+uint64_t tr31_stats_now(void);
+
+/**
+ * Record duration of stage for the calling thread
+ * @param stage Processing stage
+ * @param nsec Duration in nanoseconds
+ */
+void tr31_stats_stage_add(enum tr31_stats_stage_t stage, uint64_t nsec);
+
+/**
+ * Record completed key block import for the calling thread
+ * @param r Result of import
+ */
+void tr31_stats_import_done(int r);
+
+/**
+ * Record completed key block export for the calling thread
+ * @param r Result of export
+ */
+void tr31_stats_export_done(int r);
+
+/**
+ * Begin measurement of stage
+ * @return Opaque value to be provided to @ref tr31_stats_stage_end()
+ */
+static inline uint64_t tr31_stats_stage_begin(void)
+{
+	return tr31_stats_now();
+}
+
+/**
+ * End measurement of stage and record it for the calling thread
+ * @param stage Processing stage
+ * @param begin Value returned by @ref tr31_stats_stage_begin()
+ */
+static inline void tr31_stats_stage_end(enum tr31_stats_stage_t stage, uint64_t begin)
+{
+	tr31_stats_stage_add(stage, tr31_stats_now() - begin);
+}
+
+#else
+
+// instrumentation is compiled out; these are optimised away entirely
+
+static inline uint64_t tr31_stats_stage_begin(void)
+{
+	return 0;
+}
+
+static inline void tr31_stats_stage_end(enum tr31_stats_stage_t stage, uint64_t begin)
+{
+	(void)stage;
+	(void)begin;
+}
+
+static inline void tr31_stats_import_done(int r)
+{
+	(void)r;
+}
+
+static inline void tr31_stats_export_done(int r)
+{
+	(void)r;
+}
+
+#endif
+
+__END_DECLS
+
+#endif
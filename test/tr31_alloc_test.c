@@ -0,0 +1,318 @@
+/**
+ * @file tr31_alloc_test.c
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "tr31.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// allocation header that records the size to verify the size provided when
+// the allocation is resized or freed
+struct test_alloc_hdr_t {
+	size_t size;
+	uint32_t magic;
+	_Alignas(16) uint8_t data[];
+};
+#define TEST_ALLOC_MAGIC (0x7E5A110C)
+
+struct test_alloc_stats_t {
+	size_t alloc_count;
+	size_t realloc_count;
+	size_t free_count;
+	size_t secure_free_count;
+	size_t outstanding;
+	bool error;
+};
+
+static struct test_alloc_hdr_t* test_alloc_hdr(struct test_alloc_stats_t* stats, void* ptr, size_t size)
+{
+	struct test_alloc_hdr_t* hdr = (void*)((uint8_t*)ptr - offsetof(struct test_alloc_hdr_t, data));
+
+	if (hdr->magic != TEST_ALLOC_MAGIC || hdr->size != size) {
+		fprintf(stderr, "Allocation size mismatch; expected %zu; got %zu\n", hdr->size, size);
+		stats->error = true;
+	}
+
+	return hdr;
+}
+
+static void* test_alloc(void* ctx, size_t size)
+{
+	struct test_alloc_stats_t* stats = ctx;
+	struct test_alloc_hdr_t* hdr;
+
+	hdr = malloc(sizeof(*hdr) + size);
+	if (!hdr) {
+		return NULL;
+	}
+	// fill with garbage to verify that the library zeroes allocations
+	memset(hdr->data, 0xA5, size);
+	hdr->size = size;
+	hdr->magic = TEST_ALLOC_MAGIC;
+
+	++stats->alloc_count;
+	++stats->outstanding;
+	return hdr->data;
+}
+
+static void* test_realloc(void* ctx, void* ptr, size_t old_size, size_t new_size)
+{
+	struct test_alloc_stats_t* stats = ctx;
+	struct test_alloc_hdr_t* hdr;
+
+	if (!ptr) {
+		return test_alloc(ctx, new_size);
+	}
+
+	hdr = test_alloc_hdr(stats, ptr, old_size);
+	hdr = realloc(hdr, sizeof(*hdr) + new_size);
+	if (!hdr) {
+		return NULL;
+	}
+	hdr->size = new_size;
+
+	++stats->realloc_count;
+	return hdr->data;
+}
+
+static void test_free(void* ctx, void* ptr, size_t size)
+{
+	struct test_alloc_stats_t* stats = ctx;
+
+	free(test_alloc_hdr(stats, ptr, size));
+	++stats->free_count;
+	--stats->outstanding;
+}
+
+static void test_secure_free(void* ctx, void* ptr, size_t size)
+{
+	struct test_alloc_stats_t* stats = ctx;
+
+	test_free(ctx, ptr, size);
+	++stats->secure_free_count;
+}
+
+static int test_export_import(void)
+{
+	int r;
+	uint8_t kbpk_data[32];
+	uint8_t key_data[16];
+	struct tr31_key_t kbpk;
+	struct tr31_key_t key;
+	struct tr31_kbpk_t* prepared_kbpk = NULL;
+	struct tr31_ctx_t export_ctx;
+	struct tr31_ctx_t import_ctx;
+	char key_block[1024];
+	uint8_t hm = TR31_OPT_BLOCK_HM_SHA256;
+
+	for (size_t i = 0; i < sizeof(kbpk_data); ++i) {
+		kbpk_data[i] = i;
+	}
+	for (size_t i = 0; i < sizeof(key_data); ++i) {
+		key_data[i] = 0xF0 - i;
+	}
+
+	r = tr31_key_init(
+		TR31_KEY_USAGE_TR31_KBPK,
+		TR31_KEY_ALGORITHM_AES,
+		TR31_KEY_MODE_OF_USE_ENC_DEC,
+		"00",
+		TR31_KEY_EXPORT_NONE,
+		kbpk_data,
+		sizeof(kbpk_data),
+		&kbpk
+	);
+	if (r) {
+		fprintf(stderr, "tr31_key_init() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_key_init(
+		TR31_KEY_USAGE_DATA,
+		TR31_KEY_ALGORITHM_AES,
+		TR31_KEY_MODE_OF_USE_ENC_DEC,
+		"00",
+		TR31_KEY_EXPORT_TRUSTED,
+		key_data,
+		sizeof(key_data),
+		&key
+	);
+	if (r) {
+		fprintf(stderr, "tr31_key_init() failed; r=%d\n", r);
+		return 1;
+	}
+
+	r = tr31_kbpk_prepare(&kbpk, &prepared_kbpk);
+	if (r) {
+		fprintf(stderr, "tr31_kbpk_prepare() failed; r=%d\n", r);
+		return 1;
+	}
+
+	// export with several optional blocks to grow the optional block array
+	r = tr31_init(TR31_VERSION_D, &key, &export_ctx);
+	if (r) {
+		fprintf(stderr, "tr31_init() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_opt_block_add_KC(&export_ctx);
+	if (r) {
+		fprintf(stderr, "tr31_opt_block_add_KC() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_opt_block_add_KP(&export_ctx);
+	if (r) {
+		fprintf(stderr, "tr31_opt_block_add_KP() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_opt_block_add(&export_ctx, TR31_OPT_BLOCK_HM, &hm, sizeof(hm));
+	if (r) {
+		fprintf(stderr, "tr31_opt_block_add() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_export_prepared(&export_ctx, prepared_kbpk, key_block, sizeof(key_block));
+	if (r) {
+		fprintf(stderr, "tr31_export_prepared() failed; r=%d\n", r);
+		return 1;
+	}
+
+	r = tr31_import_prepared(key_block, prepared_kbpk, &import_ctx);
+	if (r) {
+		fprintf(stderr, "tr31_import_prepared() failed; r=%d\n", r);
+		return 1;
+	}
+	if (import_ctx.key.length != sizeof(key_data) ||
+		memcmp(import_ctx.key.data, key_data, sizeof(key_data)) != 0 ||
+		import_ctx.opt_blocks_count < export_ctx.opt_blocks_count
+	) {
+		fprintf(stderr, "Imported key block is incorrect\n");
+		return 1;
+	}
+
+	tr31_release(&import_ctx);
+	tr31_release(&export_ctx);
+	tr31_kbpk_free(prepared_kbpk);
+	tr31_key_release(&key);
+	tr31_key_release(&kbpk);
+
+	return 0;
+}
+
+static int test_allocator(const struct tr31_allocator_t* allocator, struct test_alloc_stats_t* stats)
+{
+	int r;
+
+	r = tr31_set_allocator(allocator);
+	if (r) {
+		fprintf(stderr, "tr31_set_allocator() failed; r=%d\n", r);
+		return 1;
+	}
+
+	r = test_export_import();
+	if (r) {
+		return r;
+	}
+
+	r = tr31_set_allocator(NULL);
+	if (r) {
+		fprintf(stderr, "tr31_set_allocator() failed to restore default; r=%d\n", r);
+		return 1;
+	}
+
+	if (stats->error) {
+		return 1;
+	}
+	if (!stats->alloc_count || !stats->secure_free_count) {
+		fprintf(stderr, "Allocator was not used; alloc_count=%zu; secure_free_count=%zu\n", stats->alloc_count, stats->secure_free_count);
+		return 1;
+	}
+	if (stats->outstanding) {
+		fprintf(stderr, "Allocations were not freed; outstanding=%zu\n", stats->outstanding);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(void)
+{
+	int r;
+	struct test_alloc_stats_t stats;
+	struct tr31_allocator_t allocator;
+
+	// test allocator with all functions
+	memset(&stats, 0, sizeof(stats));
+	allocator = (struct tr31_allocator_t){
+		.alloc = &test_alloc,
+		.realloc = &test_realloc,
+		.free = &test_free,
+		.secure_free = &test_secure_free,
+		.ctx = &stats,
+	};
+	r = test_allocator(&allocator, &stats);
+	if (r) {
+		return 1;
+	}
+	if (!stats.realloc_count) {
+		fprintf(stderr, "Allocator resize function was not used\n");
+		return 1;
+	}
+
+	// test allocator without resize function
+	memset(&stats, 0, sizeof(stats));
+	allocator.realloc = NULL;
+	r = test_allocator(&allocator, &stats);
+	if (r) {
+		return 1;
+	}
+
+	// test allocator without optional functions such that free is also used
+	// for sensitive data
+	allocator.secure_free = NULL;
+	memset(&stats, 0, sizeof(stats));
+	r = tr31_set_allocator(&allocator);
+	if (r) {
+		fprintf(stderr, "tr31_set_allocator() failed; r=%d\n", r);
+		return 1;
+	}
+	r = test_export_import();
+	if (r) {
+		return r;
+	}
+	tr31_set_allocator(NULL);
+	if (stats.error || !stats.alloc_count || stats.outstanding) {
+		fprintf(stderr, "Allocator without optional functions failed; alloc_count=%zu; outstanding=%zu\n", stats.alloc_count, stats.outstanding);
+		return 1;
+	}
+
+	// required functions must be present
+	allocator.free = NULL;
+	r = tr31_set_allocator(&allocator);
+	if (r >= 0) {
+		fprintf(stderr, "tr31_set_allocator() failed to detect missing free function; r=%d\n", r);
+		return 1;
+	}
+
+	printf("All tests passed.\n");
+
+	return 0;
+}
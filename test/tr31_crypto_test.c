@@ -65,6 +65,44 @@ static const uint8_t test6_kbak_derive_verify[] = {
 	0x3E, 0x06, 0x73, 0x48, 0x38, 0x88, 0xF9, 0xB7, 0xF9, 0xB7, 0x51, 0x78, 0x27, 0xF9, 0x50, 0x22,
 };
 
+// NIST SP 800-38B, D.1
+static const uint8_t test7_key[] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+static const uint8_t test7_msg[] = {
+	0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A,
+	0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C, 0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51,
+	0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11, 0xE5, 0xFB, 0xC1, 0x19, 0x1A, 0x0A, 0x52, 0xEF,
+	0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17, 0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10,
+};
+static const size_t test7_msg_len[] = { 0, 16, 40, 64 };
+static const uint8_t test7_cmac_verify[][16] = {
+	{ 0xBB, 0x1D, 0x69, 0x29, 0xE9, 0x59, 0x37, 0x28, 0x7F, 0xA3, 0x7D, 0x12, 0x9B, 0x75, 0x67, 0x46 },
+	{ 0x07, 0x0A, 0x16, 0xB4, 0x6B, 0x4D, 0x41, 0x44, 0xF7, 0x9B, 0xDD, 0x9D, 0xD0, 0x4A, 0x28, 0x7C },
+	{ 0xDF, 0xA6, 0x67, 0x47, 0xDE, 0x9A, 0xE6, 0x30, 0x30, 0xCA, 0x32, 0x61, 0x14, 0x97, 0xC8, 0x27 },
+	{ 0x51, 0xF0, 0xBE, 0xBF, 0x7E, 0x3B, 0x9D, 0x92, 0xFC, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3C, 0xFE },
+};
+
+// FIPS 197, Appendix C
+static const uint8_t test9_key[] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F,
+};
+static const size_t test9_key_len[] = { 16, 24, 32 };
+static const uint8_t test9_plaintext[] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF };
+static const uint8_t test9_ciphertext_verify[][16] = {
+	{ 0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04, 0x30, 0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4, 0xC5, 0x5A },
+	{ 0xDD, 0xA9, 0x7C, 0xA4, 0x86, 0x4C, 0xDF, 0xE0, 0x6E, 0xAF, 0x70, 0xA0, 0xEC, 0x0D, 0x71, 0x91 },
+	{ 0x8E, 0xA2, 0xB7, 0xCA, 0x51, 0x67, 0x45, 0xBF, 0xEA, 0xFC, 0x49, 0x90, 0x4B, 0x49, 0x60, 0x89 },
+};
+
+// NIST SP 800-38A, F.2.1
+static const uint8_t test10_iv[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F };
+static const uint8_t test10_ciphertext_verify[] = {
+	0x76, 0x49, 0xAB, 0xAC, 0x81, 0x19, 0xB2, 0x46, 0xCE, 0xE9, 0x8E, 0x9B, 0x12, 0xE9, 0x19, 0x7D,
+	0x50, 0x86, 0xCB, 0x9B, 0x50, 0x72, 0x19, 0xEE, 0x95, 0xDB, 0x11, 0x3A, 0x91, 0x76, 0x78, 0xB2,
+	0x73, 0xBE, 0xD6, 0xB8, 0xE3, 0xC1, 0x74, 0x3B, 0x71, 0x16, 0xE6, 0x9E, 0x22, 0x22, 0x95, 0x16,
+	0x3F, 0xF1, 0xCA, 0xA1, 0x68, 0x1F, 0xAC, 0x09, 0x12, 0x0E, 0xCA, 0x30, 0x75, 0x86, 0xE1, 0xA7,
+};
+
 int main(void)
 {
 	int r;
@@ -176,6 +214,276 @@ int main(void)
 		return 1;
 	}
 
+	// NIST SP 800-38B, D.1
+	for (size_t i = 0; i < sizeof(test7_msg_len) / sizeof(test7_msg_len[0]); ++i) {
+		uint8_t test7_cmac[AES_BLOCK_SIZE];
+
+		r = tr31_aes_cmac(test7_key, sizeof(test7_key), test7_msg, test7_msg_len[i], test7_cmac);
+		if (r) {
+			fprintf(stderr, "tr31_aes_cmac() failed; r=%d\n", r);
+			return r;
+		}
+		if (memcmp(test7_cmac, test7_cmac_verify[i], sizeof(test7_cmac_verify[i])) != 0) {
+			fprintf(stderr, "AES CMAC is invalid\n");
+			return 1;
+		}
+	}
+
+	// reuse the same keyed cipher object for all NIST SP 800-38B, D.1 examples
+	struct tr31_cipher_t* test7_cipher;
+	r = tr31_aes_cipher_new(test7_key, sizeof(test7_key), &test7_cipher);
+	if (r) {
+		fprintf(stderr, "tr31_aes_cipher_new() failed; r=%d\n", r);
+		return r;
+	}
+	for (size_t i = 0; i < sizeof(test7_msg_len) / sizeof(test7_msg_len[0]); ++i) {
+		r = tr31_cipher_verify_cmac(test7_cipher, test7_msg, test7_msg_len[i], test7_cmac_verify[i]);
+		if (r) {
+			fprintf(stderr, "tr31_cipher_verify_cmac() failed; r=%d\n", r);
+			tr31_cipher_free(test7_cipher);
+			return 1;
+		}
+	}
+
+	// keyed cipher object must produce the same output as the one-shot functions
+	uint8_t test7_ciphertext[sizeof(test7_msg)];
+	uint8_t test7_ciphertext_verify[sizeof(test7_msg)];
+	uint8_t test7_plaintext[sizeof(test7_msg)];
+	r = tr31_cipher_encrypt_cbc(test7_cipher, test7_key, test7_msg, sizeof(test7_msg), test7_ciphertext);
+	if (r) {
+		fprintf(stderr, "tr31_cipher_encrypt_cbc() failed; r=%d\n", r);
+		tr31_cipher_free(test7_cipher);
+		return r;
+	}
+	r = tr31_aes_encrypt_cbc(test7_key, sizeof(test7_key), test7_key, test7_msg, sizeof(test7_msg), test7_ciphertext_verify);
+	if (r) {
+		fprintf(stderr, "tr31_aes_encrypt_cbc() failed; r=%d\n", r);
+		tr31_cipher_free(test7_cipher);
+		return r;
+	}
+	if (memcmp(test7_ciphertext, test7_ciphertext_verify, sizeof(test7_ciphertext_verify)) != 0) {
+		fprintf(stderr, "Keyed cipher CBC encryption is invalid\n");
+		tr31_cipher_free(test7_cipher);
+		return 1;
+	}
+	r = tr31_cipher_decrypt_cbc(test7_cipher, test7_key, test7_ciphertext, sizeof(test7_ciphertext), test7_plaintext);
+	if (r) {
+		fprintf(stderr, "tr31_cipher_decrypt_cbc() failed; r=%d\n", r);
+		tr31_cipher_free(test7_cipher);
+		return r;
+	}
+	if (memcmp(test7_plaintext, test7_msg, sizeof(test7_msg)) != 0) {
+		fprintf(stderr, "Keyed cipher CBC decryption is invalid\n");
+		tr31_cipher_free(test7_cipher);
+		return 1;
+	}
+	r = tr31_cipher_encrypt_ecb(test7_cipher, test7_msg, test7_ciphertext);
+	if (r) {
+		fprintf(stderr, "tr31_cipher_encrypt_ecb() failed; r=%d\n", r);
+		tr31_cipher_free(test7_cipher);
+		return r;
+	}
+	r = tr31_cipher_decrypt_ecb(test7_cipher, test7_ciphertext, test7_plaintext);
+	if (r) {
+		fprintf(stderr, "tr31_cipher_decrypt_ecb() failed; r=%d\n", r);
+		tr31_cipher_free(test7_cipher);
+		return r;
+	}
+	if (memcmp(test7_plaintext, test7_msg, AES_BLOCK_SIZE) != 0) {
+		fprintf(stderr, "Keyed cipher ECB decryption is invalid\n");
+		tr31_cipher_free(test7_cipher);
+		return 1;
+	}
+
+	// incremental CMAC must produce the same output regardless of how the
+	// message is split; use odd sizes to cross block boundaries
+	static const size_t test7_split_len[] = { 0, 1, 15, 17, 0, 3, 28 };
+	struct tr31_cmac_ctx_t test7_cmac_ctx;
+	size_t test7_offset = 0;
+	r = tr31_cmac_init(&test7_cmac_ctx, test7_cipher);
+	if (r) {
+		fprintf(stderr, "tr31_cmac_init() failed; r=%d\n", r);
+		tr31_cipher_free(test7_cipher);
+		return r;
+	}
+	for (size_t i = 0; i < sizeof(test7_split_len) / sizeof(test7_split_len[0]); ++i) {
+		r = tr31_cmac_update(&test7_cmac_ctx, test7_msg + test7_offset, test7_split_len[i]);
+		if (r) {
+			fprintf(stderr, "tr31_cmac_update() failed; r=%d\n", r);
+			tr31_cipher_free(test7_cipher);
+			return r;
+		}
+		test7_offset += test7_split_len[i];
+	}
+	r = tr31_cmac_verify_final(&test7_cmac_ctx, test7_cmac_verify[3]);
+	if (r) {
+		fprintf(stderr, "Incremental AES CMAC is invalid; r=%d\n", r);
+		tr31_cipher_free(test7_cipher);
+		return 1;
+	}
+	tr31_cipher_free(test7_cipher);
+
+	// test random data pool across refills
+	// random data must not repeat when served in small or large requests
+	struct tr31_rand_pool_t test8_pool;
+	uint8_t test8_buf[(TR31_RAND_POOL_SIZE * 2) + 15];
+	const uint8_t test8_zero[16] = { 0 };
+	tr31_rand_pool_init(&test8_pool);
+	memset(test8_buf, 0, sizeof(test8_buf));
+	for (size_t i = 0; i + 15 <= sizeof(test8_buf); i += 15) {
+		tr31_rand_pool_get(&test8_pool, test8_buf + i, 15);
+	}
+	tr31_rand_pool_get(&test8_pool, test8_buf, TR31_RAND_POOL_SIZE + 1);
+	for (size_t i = 0; i + sizeof(test8_zero) <= sizeof(test8_buf); i += sizeof(test8_zero)) {
+		if (memcmp(test8_buf + i, test8_zero, sizeof(test8_zero)) == 0) {
+			fprintf(stderr, "Random data pool did not serve random data\n");
+			return 1;
+		}
+	}
+	if (memcmp(test8_buf, test8_buf + TR31_RAND_POOL_SIZE, 16) == 0) {
+		fprintf(stderr, "Random data pool repeated random data\n");
+		return 1;
+	}
+	tr31_rand_pool_cleanse(&test8_pool);
+
+	// test AES block cipher for all key lengths
+	// decryption is tested first to ensure that it does not depend on a
+	// prior encryption key schedule
+	for (size_t i = 0; i < sizeof(test9_key_len) / sizeof(test9_key_len[0]); ++i) {
+		struct tr31_cipher_t* test9_cipher;
+		uint8_t test9_buf[16];
+
+		r = tr31_aes_cipher_new(test9_key, test9_key_len[i], &test9_cipher);
+		if (r) {
+			fprintf(stderr, "tr31_aes_cipher_new() failed; r=%d\n", r);
+			return 1;
+		}
+		r = tr31_cipher_decrypt_ecb(test9_cipher, test9_ciphertext_verify[i], test9_buf);
+		if (r) {
+			fprintf(stderr, "tr31_cipher_decrypt_ecb() failed; r=%d\n", r);
+			tr31_cipher_free(test9_cipher);
+			return 1;
+		}
+		if (memcmp(test9_buf, test9_plaintext, sizeof(test9_plaintext)) != 0) {
+			fprintf(stderr, "AES-%zu decryption is incorrect\n", test9_key_len[i] * 8);
+			tr31_cipher_free(test9_cipher);
+			return 1;
+		}
+		r = tr31_cipher_encrypt_ecb(test9_cipher, test9_plaintext, test9_buf);
+		if (r) {
+			fprintf(stderr, "tr31_cipher_encrypt_ecb() failed; r=%d\n", r);
+			tr31_cipher_free(test9_cipher);
+			return 1;
+		}
+		if (memcmp(test9_buf, test9_ciphertext_verify[i], sizeof(test9_buf)) != 0) {
+			fprintf(stderr, "AES-%zu encryption is incorrect\n", test9_key_len[i] * 8);
+			tr31_cipher_free(test9_cipher);
+			return 1;
+		}
+		tr31_cipher_free(test9_cipher);
+	}
+
+	// test AES-CBC in place
+	struct tr31_cipher_t* test10_cipher;
+	uint8_t test10_buf[sizeof(test7_msg)];
+	r = tr31_aes_cipher_new(test7_key, sizeof(test7_key), &test10_cipher);
+	if (r) {
+		fprintf(stderr, "tr31_aes_cipher_new() failed; r=%d\n", r);
+		return 1;
+	}
+	memcpy(test10_buf, test7_msg, sizeof(test7_msg));
+	r = tr31_cipher_encrypt_cbc(test10_cipher, test10_iv, test10_buf, sizeof(test10_buf), test10_buf);
+	if (r) {
+		fprintf(stderr, "tr31_cipher_encrypt_cbc() failed; r=%d\n", r);
+		tr31_cipher_free(test10_cipher);
+		return 1;
+	}
+	if (memcmp(test10_buf, test10_ciphertext_verify, sizeof(test10_ciphertext_verify)) != 0) {
+		fprintf(stderr, "AES-CBC encryption is incorrect\n");
+		tr31_cipher_free(test10_cipher);
+		return 1;
+	}
+	r = tr31_cipher_decrypt_cbc(test10_cipher, test10_iv, test10_buf, sizeof(test10_buf), test10_buf);
+	if (r) {
+		fprintf(stderr, "tr31_cipher_decrypt_cbc() failed; r=%d\n", r);
+		tr31_cipher_free(test10_cipher);
+		return 1;
+	}
+	if (memcmp(test10_buf, test7_msg, sizeof(test7_msg)) != 0) {
+		fprintf(stderr, "AES-CBC decryption is incorrect\n");
+		tr31_cipher_free(test10_cipher);
+		return 1;
+	}
+	tr31_cipher_free(test10_cipher);
+
+	// test multi-buffer CMAC using different keys, message lengths and
+	// message input segments, including more jobs than lanes
+	struct tr31_cipher_t* test11_ciphers[3];
+	struct tr31_cmac_job_t test11_jobs[(TR31_CMAC_MULTI_LANES * 2) + 3];
+	uint8_t test11_cmac_verify[sizeof(test11_jobs) / sizeof(test11_jobs[0])][AES_BLOCK_SIZE];
+	const size_t test11_count = sizeof(test11_jobs) / sizeof(test11_jobs[0]);
+	r = tr31_aes_cipher_new(test7_key, sizeof(test7_key), &test11_ciphers[0]);
+	if (r) {
+		fprintf(stderr, "tr31_aes_cipher_new() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_aes_cipher_new(test9_key, sizeof(test9_key), &test11_ciphers[1]);
+	if (r) {
+		fprintf(stderr, "tr31_aes_cipher_new() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_tdes_cipher_new(test9_key, 24, &test11_ciphers[2]);
+	if (r) {
+		fprintf(stderr, "tr31_tdes_cipher_new() failed; r=%d\n", r);
+		return 1;
+	}
+	memset(test11_jobs, 0, sizeof(test11_jobs));
+	for (size_t i = 0; i < test11_count; ++i) {
+		struct tr31_cipher_t* cipher = test11_ciphers[i % 3];
+		size_t len = i < 4 ? test7_msg_len[i] : (i * 7) % (sizeof(test7_msg) + 1);
+		size_t split = i % 4 == 0 ? 0 : (i % 4 == 1 ? len : len / 3);
+
+		test11_jobs[i].cipher = cipher;
+		test11_jobs[i].buf[0] = split ? test7_msg : NULL;
+		test11_jobs[i].len[0] = split;
+		test11_jobs[i].buf[1] = len - split ? test7_msg + split : NULL;
+		test11_jobs[i].len[1] = len - split;
+		r = tr31_cipher_cmac(cipher, test7_msg, len, test11_cmac_verify[i]);
+		if (r) {
+			fprintf(stderr, "tr31_cipher_cmac() failed; r=%d\n", r);
+			return 1;
+		}
+	}
+	r = tr31_cmac_multi(test11_jobs, test11_count);
+	if (r) {
+		fprintf(stderr, "tr31_cmac_multi() failed; r=%d\n", r);
+		return 1;
+	}
+	for (size_t i = 0; i < test11_count; ++i) {
+		if (memcmp(test11_jobs[i].cmac, test11_cmac_verify[i], tr31_cipher_block_size(test11_jobs[i].cipher)) != 0) {
+			fprintf(stderr, "Multi-buffer CMAC %zu is incorrect\n", i);
+			return 1;
+		}
+	}
+	for (size_t i = 0; i < test11_count; ++i) {
+		test11_jobs[i].cmac_verify = test11_cmac_verify[i];
+	}
+	test11_jobs[3].cmac_verify = test7_cmac_verify[0]; // incorrect CMAC
+	r = tr31_cmac_verify_multi(test11_jobs, test11_count);
+	if (r) {
+		fprintf(stderr, "tr31_cmac_verify_multi() failed; r=%d\n", r);
+		return 1;
+	}
+	for (size_t i = 0; i < test11_count; ++i) {
+		if ((i == 3) != (test11_jobs[i].result != 0)) {
+			fprintf(stderr, "Multi-buffer CMAC verification %zu is incorrect\n", i);
+			return 1;
+		}
+	}
+	for (size_t i = 0; i < 3; ++i) {
+		tr31_cipher_free(test11_ciphers[i]);
+	}
+
 	printf("All tests passed.\n");
 
 	return 0;
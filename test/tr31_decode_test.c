@@ -40,7 +40,9 @@ int main(void)
 {
 	int r;
 	struct tr31_ctx_t test_tr31;
+	struct tr31_peek_t test_peek;
 	uint8_t* data;
+	char test_msg[sizeof(test1_tr31_ascii) + 16];
 
 	// test key block decoding for format version B with KS optional block
 	r = tr31_import(test1_tr31_ascii, NULL, &test_tr31);
@@ -194,6 +196,89 @@ int main(void)
 	}
 	tr31_release(&test_tr31);
 
+	// test key block decoding from within a larger message buffer
+	memset(test_msg, 'F', sizeof(test_msg));
+	memcpy(test_msg + 8, test1_tr31_ascii, strlen(test1_tr31_ascii));
+	r = tr31_import_buf(test_msg + 8, strlen(test1_tr31_ascii), NULL, &test_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_import_buf() failed; r=%d\n", r);
+		goto exit;
+	}
+	if (test_tr31.version != TR31_VERSION_B ||
+		test_tr31.length != 104 ||
+		test_tr31.header != test_msg + 8 ||
+		test_tr31.opt_blocks_count != 1 ||
+		test_tr31.opt_blocks[0].id != TR31_OPT_BLOCK_KS ||
+		test_tr31.opt_blocks[0].data_length != sizeof(test1_ksn_verify) ||
+		memcmp(test_tr31.opt_blocks[0].data, test1_ksn_verify, sizeof(test1_ksn_verify)) != 0 ||
+		test_tr31.payload_length != 24 ||
+		test_tr31.authenticator_length != 8
+	) {
+		fprintf(stderr, "TR-31 context is incorrect\n");
+		r = 1;
+		goto exit;
+	}
+	tr31_release(&test_tr31);
+
+	// the length must match the key block length field exactly
+	r = tr31_import_buf(test_msg + 8, strlen(test1_tr31_ascii) + 8, NULL, &test_tr31);
+	if (r != TR31_ERROR_INVALID_LENGTH_FIELD) {
+		fprintf(stderr, "tr31_import_buf() did not fail as expected; r=%d\n", r);
+		r = 1;
+		goto exit;
+	}
+	tr31_release(&test_tr31);
+
+	// test header peek for format version B with KS, KC and KP optional blocks
+	r = tr31_peek(test4_tr31_ascii, strlen(test4_tr31_ascii), &test_peek);
+	if (r) {
+		fprintf(stderr, "tr31_peek() failed; r=%d\n", r);
+		goto exit;
+	}
+	if (test_peek.version != TR31_VERSION_B ||
+		test_peek.length != 128 ||
+		test_peek.key.usage != TR31_KEY_USAGE_DUKPT_IPEK ||
+		test_peek.key.algorithm != TR31_KEY_ALGORITHM_TDES ||
+		test_peek.key.mode_of_use != TR31_KEY_MODE_OF_USE_DERIVE ||
+		test_peek.key.key_version != TR31_KEY_VERSION_IS_UNUSED ||
+		test_peek.key.exportability != TR31_KEY_EXPORT_NONE ||
+		test_peek.key.data != NULL ||
+		test_peek.header_length != 64 ||
+		test_peek.opt_blocks_count != 3 ||
+		test_peek.opt_blocks[0].id != TR31_OPT_BLOCK_KS ||
+		test_peek.opt_blocks[0].offset != 20 ||
+		test_peek.opt_blocks[0].length != 20 ||
+		test_peek.opt_blocks[1].id != TR31_OPT_BLOCK_KC ||
+		test_peek.opt_blocks[1].offset != 44 ||
+		test_peek.opt_blocks[1].length != 8 ||
+		test_peek.opt_blocks[2].id != TR31_OPT_BLOCK_KP ||
+		test_peek.opt_blocks[2].offset != 56 ||
+		test_peek.opt_blocks[2].length != 8 ||
+		test_peek.payload_offset != 64 ||
+		test_peek.payload_length != 48 ||
+		test_peek.authenticator_offset != 112 ||
+		test_peek.authenticator_length != 16 ||
+		memcmp(test4_tr31_ascii + test_peek.opt_blocks[1].offset, "000169E3", test_peek.opt_blocks[1].length) != 0
+	) {
+		fprintf(stderr, "TR-31 peek is incorrect\n");
+		r = 1;
+		goto exit;
+	}
+
+	// test header peek errors
+	r = tr31_peek(test4_tr31_ascii, strlen(test4_tr31_ascii) - 2, &test_peek);
+	if (r != TR31_ERROR_INVALID_LENGTH_FIELD) {
+		fprintf(stderr, "tr31_peek() did not fail as expected; r=%d\n", r);
+		r = 1;
+		goto exit;
+	}
+	r = tr31_peek("E0104B1TX00S0100KS18820220A0200001E00000", 40, &test_peek);
+	if (r != TR31_ERROR_UNSUPPORTED_VERSION) {
+		fprintf(stderr, "tr31_peek() did not fail as expected; r=%d\n", r);
+		r = 1;
+		goto exit;
+	}
+
 	printf("All tests passed.\n");
 	r = 0;
 	goto exit;
@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // example data generated using a Thales payShield 10k HSM
@@ -93,6 +94,16 @@ int main(void)
 	int r;
 	struct tr31_key_t test_kbpk;
 	struct tr31_ctx_t test_tr31;
+	struct tr31_ctx_t test_batch_tr31[5];
+	int test_batch_results[5];
+	char test_batch_unterminated[sizeof(test1_tr31_format_b) + 8];
+	char test_batch_tampered[sizeof(test7_tr31_ascii)];
+	const size_t test_parallel_count = 1000;
+	struct tr31_key_block_ref_t* test_parallel_key_blocks = NULL;
+	struct tr31_ctx_t* test_parallel_tr31 = NULL;
+	int* test_parallel_results = NULL;
+	struct tr31_kbpk_t* test_prepared_kbpk = NULL;
+	uint8_t test_arena[TR31_IMPORT_ARENA_LENGTH(sizeof(test4_tr31_ascii))];
 
 	// populate key block protection key
 	memset(&test_kbpk, 0, sizeof(test_kbpk));
@@ -134,7 +145,14 @@ int main(void)
 		r = 1;
 		goto exit;
 	}
-	if (memcmp(test_tr31.key.kcv, test1_tr31_kcv_verify, sizeof(test1_tr31_kcv_verify)) != 0) {
+	if (test_tr31.key.kcv_len != 0) {
+		fprintf(stderr, "TR-31 key data KCV was computed eagerly\n");
+		r = 1;
+		goto exit;
+	}
+	if (tr31_key_get_kcv(&test_tr31.key) != 0 ||
+		memcmp(test_tr31.key.kcv, test1_tr31_kcv_verify, sizeof(test1_tr31_kcv_verify)) != 0
+	) {
 		fprintf(stderr, "TR-31 key data KCV is incorrect\n");
 		r = 1;
 		goto exit;
@@ -173,7 +191,9 @@ int main(void)
 		r = 1;
 		goto exit;
 	}
-	if (memcmp(test_tr31.key.kcv, test1_tr31_kcv_verify, sizeof(test1_tr31_kcv_verify)) != 0) {
+	if (tr31_key_get_kcv(&test_tr31.key) != 0 ||
+		memcmp(test_tr31.key.kcv, test1_tr31_kcv_verify, sizeof(test1_tr31_kcv_verify)) != 0
+	) {
 		fprintf(stderr, "TR-31 key data KCV is incorrect\n");
 		r = 1;
 		goto exit;
@@ -212,7 +232,9 @@ int main(void)
 		r = 1;
 		goto exit;
 	}
-	if (memcmp(test_tr31.key.kcv, test1_tr31_kcv_verify, sizeof(test1_tr31_kcv_verify)) != 0) {
+	if (tr31_key_get_kcv(&test_tr31.key) != 0 ||
+		memcmp(test_tr31.key.kcv, test1_tr31_kcv_verify, sizeof(test1_tr31_kcv_verify)) != 0
+	) {
 		fprintf(stderr, "TR-31 key data KCV is incorrect\n");
 		r = 1;
 		goto exit;
@@ -257,7 +279,9 @@ int main(void)
 		r = 1;
 		goto exit;
 	}
-	if (memcmp(test_tr31.key.kcv, test2_tr31_kcv_verify, sizeof(test2_tr31_kcv_verify)) != 0) {
+	if (tr31_key_get_kcv(&test_tr31.key) != 0 ||
+		memcmp(test_tr31.key.kcv, test2_tr31_kcv_verify, sizeof(test2_tr31_kcv_verify)) != 0
+	) {
 		fprintf(stderr, "TR-31 key data KCV is incorrect\n");
 		r = 1;
 		goto exit;
@@ -302,7 +326,9 @@ int main(void)
 		r = 1;
 		goto exit;
 	}
-	if (memcmp(test_tr31.key.kcv, test3_tr31_kcv_verify, sizeof(test3_tr31_kcv_verify)) != 0) {
+	if (tr31_key_get_kcv(&test_tr31.key) != 0 ||
+		memcmp(test_tr31.key.kcv, test3_tr31_kcv_verify, sizeof(test3_tr31_kcv_verify)) != 0
+	) {
 		fprintf(stderr, "TR-31 key data KCV is incorrect\n");
 		r = 1;
 		goto exit;
@@ -351,7 +377,9 @@ int main(void)
 		r = 1;
 		goto exit;
 	}
-	if (memcmp(test_tr31.key.kcv, test4_tr31_kcv_verify, sizeof(test4_tr31_kcv_verify)) != 0) {
+	if (tr31_key_get_kcv(&test_tr31.key) != 0 ||
+		memcmp(test_tr31.key.kcv, test4_tr31_kcv_verify, sizeof(test4_tr31_kcv_verify)) != 0
+	) {
 		fprintf(stderr, "TR-31 key data KCV is incorrect\n");
 		r = 1;
 		goto exit;
@@ -400,7 +428,9 @@ int main(void)
 		r = 1;
 		goto exit;
 	}
-	if (memcmp(test_tr31.key.kcv, test5_tr31_kcv_verify, sizeof(test5_tr31_kcv_verify)) != 0) {
+	if (tr31_key_get_kcv(&test_tr31.key) != 0 ||
+		memcmp(test_tr31.key.kcv, test5_tr31_kcv_verify, sizeof(test5_tr31_kcv_verify)) != 0
+	) {
 		fprintf(stderr, "TR-31 key data KCV is incorrect\n");
 		r = 1;
 		goto exit;
@@ -445,7 +475,9 @@ int main(void)
 		r = 1;
 		goto exit;
 	}
-	if (memcmp(test_tr31.key.kcv, test6_tr31_kcv_verify, sizeof(test6_tr31_kcv_verify)) != 0) {
+	if (tr31_key_get_kcv(&test_tr31.key) != 0 ||
+		memcmp(test_tr31.key.kcv, test6_tr31_kcv_verify, sizeof(test6_tr31_kcv_verify)) != 0
+	) {
 		fprintf(stderr, "TR-31 key data KCV is incorrect\n");
 		r = 1;
 		goto exit;
@@ -490,7 +522,9 @@ int main(void)
 		r = 1;
 		goto exit;
 	}
-	if (memcmp(test_tr31.key.kcv, test7_tr31_kcv_verify, sizeof(test7_tr31_kcv_verify)) != 0) {
+	if (tr31_key_get_kcv(&test_tr31.key) != 0 ||
+		memcmp(test_tr31.key.kcv, test7_tr31_kcv_verify, sizeof(test7_tr31_kcv_verify)) != 0
+	) {
 		fprintf(stderr, "TR-31 key data KCV is incorrect\n");
 		r = 1;
 		goto exit;
@@ -535,18 +569,277 @@ int main(void)
 		r = 1;
 		goto exit;
 	}
-	if (memcmp(test_tr31.key.kcv, test8_tr31_kcv_verify, sizeof(test8_tr31_kcv_verify)) != 0) {
+	if (tr31_key_get_kcv(&test_tr31.key) != 0 ||
+		memcmp(test_tr31.key.kcv, test8_tr31_kcv_verify, sizeof(test8_tr31_kcv_verify)) != 0
+	) {
+		fprintf(stderr, "TR-31 key data KCV is incorrect\n");
+		r = 1;
+		goto exit;
+	}
+	tr31_release(&test_tr31);
+
+	// test batch key block decryption using the same KBPK; the invalid key
+	// block must not prevent the remaining key blocks from being imported
+	memset(&test_kbpk, 0, sizeof(test_kbpk));
+	test_kbpk.usage = TR31_KEY_USAGE_KEK;
+	test_kbpk.algorithm = TR31_KEY_ALGORITHM_TDES;
+	test_kbpk.mode_of_use = TR31_KEY_MODE_OF_USE_ENC_DEC;
+	test_kbpk.length = sizeof(test1_kbpk);
+	test_kbpk.data = (void*)test1_kbpk;
+	memcpy(test_batch_unterminated, test1_tr31_format_b, strlen(test1_tr31_format_b));
+	memset(test_batch_unterminated + strlen(test1_tr31_format_b), 'X', sizeof(test_batch_unterminated) - strlen(test1_tr31_format_b));
+	const struct tr31_key_block_ref_t test_batch[] = {
+		{ test1_tr31_format_a, strlen(test1_tr31_format_a) },
+		{ test_batch_unterminated, strlen(test1_tr31_format_b) },
+		{ test2_tr31_ascii, strlen(test2_tr31_ascii) }, // different KBPK
+		{ test1_tr31_format_c, strlen(test1_tr31_format_c) },
+		{ test1_tr31_format_c, strlen(test1_tr31_format_c) - 1 }, // truncated
+	};
+	static const int test_batch_results_verify[] = {
+		0,
+		0,
+		TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED,
+		0,
+		TR31_ERROR_INVALID_LENGTH_FIELD,
+	};
+	r = tr31_import_batch(test_batch, sizeof(test_batch) / sizeof(test_batch[0]), &test_kbpk, test_batch_tr31, test_batch_results);
+	if (r) {
+		fprintf(stderr, "tr31_import_batch() failed; r=%d\n", r);
+		goto exit;
+	}
+	for (size_t i = 0; i < sizeof(test_batch) / sizeof(test_batch[0]); ++i) {
+		if (test_batch_results[i] != test_batch_results_verify[i]) {
+			fprintf(stderr, "tr31_import_batch() result %zu is incorrect; r=%d\n", i, test_batch_results[i]);
+			r = 1;
+			goto exit;
+		}
+		if (test_batch_results[i]) {
+			continue;
+		}
+		if (test_batch_tr31[i].key.length != sizeof(test1_tr31_key_verify) ||
+			memcmp(test_batch_tr31[i].key.data, test1_tr31_key_verify, sizeof(test1_tr31_key_verify)) != 0
+		) {
+			fprintf(stderr, "TR-31 key data is incorrect\n");
+			r = 1;
+			goto exit;
+		}
+		tr31_release(&test_batch_tr31[i]);
+	}
+
+	// test parallel batch key block decryption; the results must be in the
+	// same order as the key blocks regardless of which worker processed them
+	test_parallel_key_blocks = calloc(test_parallel_count, sizeof(test_parallel_key_blocks[0]));
+	test_parallel_tr31 = calloc(test_parallel_count, sizeof(test_parallel_tr31[0]));
+	test_parallel_results = calloc(test_parallel_count, sizeof(test_parallel_results[0]));
+	for (size_t i = 0; i < test_parallel_count; ++i) {
+		test_parallel_key_blocks[i] = test_batch[i % (sizeof(test_batch) / sizeof(test_batch[0]))];
+	}
+	for (unsigned int workers = 1; workers <= 4; ++workers) {
+		r = tr31_import_batch_parallel(test_parallel_key_blocks, test_parallel_count, &test_kbpk, test_parallel_tr31, test_parallel_results, workers);
+		if (r) {
+			fprintf(stderr, "tr31_import_batch_parallel() failed; r=%d\n", r);
+			goto exit;
+		}
+		for (size_t i = 0; i < test_parallel_count; ++i) {
+			if (test_parallel_results[i] != test_batch_results_verify[i % (sizeof(test_batch) / sizeof(test_batch[0]))]) {
+				fprintf(stderr, "tr31_import_batch_parallel() result %zu is incorrect for %u workers; r=%d\n", i, workers, test_parallel_results[i]);
+				r = 1;
+				goto exit;
+			}
+			if (test_parallel_results[i]) {
+				continue;
+			}
+			if (test_parallel_tr31[i].key.length != sizeof(test1_tr31_key_verify) ||
+				memcmp(test_parallel_tr31[i].key.data, test1_tr31_key_verify, sizeof(test1_tr31_key_verify)) != 0
+			) {
+				fprintf(stderr, "TR-31 key data is incorrect\n");
+				r = 1;
+				goto exit;
+			}
+			tr31_release(&test_parallel_tr31[i]);
+		}
+	}
+
+	// test batch key block decryption for format version D; the
+	// authenticators of multiple key blocks are verified together and
+	// therefore verification failures must be reported for the correct
+	// key blocks
+	memset(&test_kbpk, 0, sizeof(test_kbpk));
+	test_kbpk.usage = TR31_KEY_USAGE_KEK;
+	test_kbpk.algorithm = TR31_KEY_ALGORITHM_AES;
+	test_kbpk.mode_of_use = TR31_KEY_MODE_OF_USE_ENC_DEC;
+	test_kbpk.length = sizeof(test7_kbpk);
+	test_kbpk.data = (void*)test7_kbpk;
+	memcpy(test_batch_tampered, test7_tr31_ascii, sizeof(test7_tr31_ascii));
+	test_batch_tampered[sizeof(test7_tr31_ascii) - 2] ^= 0x01; // modify authenticator
+	for (size_t i = 0; i < 100; ++i) {
+		if (i % 13 == 5) {
+			test_parallel_key_blocks[i].key_block = test_batch_tampered;
+		} else if (i % 3) {
+			test_parallel_key_blocks[i].key_block = test7_tr31_ascii;
+		} else {
+			test_parallel_key_blocks[i].key_block = test8_tr31_ascii;
+		}
+		test_parallel_key_blocks[i].length = strlen(test_parallel_key_blocks[i].key_block);
+	}
+	r = tr31_import_batch(test_parallel_key_blocks, 100, &test_kbpk, test_parallel_tr31, test_parallel_results);
+	if (r) {
+		fprintf(stderr, "tr31_import_batch() failed; r=%d\n", r);
+		goto exit;
+	}
+	for (size_t i = 0; i < 100; ++i) {
+		const void* key_verify = i % 3 ? test7_tr31_key_verify : test8_tr31_key_verify;
+		size_t key_verify_len = i % 3 ? sizeof(test7_tr31_key_verify) : sizeof(test8_tr31_key_verify);
+
+		if (i % 13 == 5) {
+			if (test_parallel_results[i] != TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED) {
+				fprintf(stderr, "tr31_import_batch() result %zu is incorrect; r=%d\n", i, test_parallel_results[i]);
+				r = 1;
+				goto exit;
+			}
+			continue;
+		}
+		if (test_parallel_results[i]) {
+			fprintf(stderr, "tr31_import_batch() result %zu is incorrect; r=%d\n", i, test_parallel_results[i]);
+			r = 1;
+			goto exit;
+		}
+		if (test_parallel_tr31[i].key.length != key_verify_len ||
+			memcmp(test_parallel_tr31[i].key.data, key_verify, key_verify_len) != 0
+		) {
+			fprintf(stderr, "TR-31 key data is incorrect\n");
+			r = 1;
+			goto exit;
+		}
+		tr31_release(&test_parallel_tr31[i]);
+	}
+
+	// test key block decryption into caller provided arena
+	memset(&test_kbpk, 0, sizeof(test_kbpk));
+	test_kbpk.usage = TR31_KEY_USAGE_TR31_KBPK;
+	test_kbpk.algorithm = TR31_KEY_ALGORITHM_TDES;
+	test_kbpk.mode_of_use = TR31_KEY_MODE_OF_USE_ENC_DEC;
+	test_kbpk.length = sizeof(test4_kbpk);
+	test_kbpk.data = (void*)test4_kbpk;
+	r = tr31_kbpk_prepare(&test_kbpk, &test_prepared_kbpk);
+	if (r) {
+		fprintf(stderr, "tr31_kbpk_prepare() failed; r=%d\n", r);
+		goto exit;
+	}
+	memset(test_arena, 0, sizeof(test_arena));
+	r = tr31_import_arena(test4_tr31_ascii, strlen(test4_tr31_ascii), test_prepared_kbpk, test_arena, sizeof(test_arena), &test_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_import_arena() failed; r=%d\n", r);
+		goto exit;
+	}
+	if ((void*)test_tr31.key.data < (void*)test_arena ||
+		(void*)test_tr31.key.data >= (void*)test_arena + sizeof(test_arena) ||
+		(void*)test_tr31.opt_blocks < (void*)test_arena ||
+		(void*)test_tr31.opt_blocks >= (void*)test_arena + sizeof(test_arena)
+	) {
+		fprintf(stderr, "TR-31 context object data not allocated from arena\n");
+		r = 1;
+		goto exit;
+	}
+	if (test_tr31.opt_blocks_count != 1 ||
+		test_tr31.opt_blocks[0].id != TR31_OPT_BLOCK_KS ||
+		test_tr31.opt_blocks[0].data_length != sizeof(test4_tr31_ksn_verify) ||
+		memcmp(test_tr31.opt_blocks[0].data, test4_tr31_ksn_verify, sizeof(test4_tr31_ksn_verify)) != 0
+	) {
+		fprintf(stderr, "TR-31 optional block is incorrect\n");
+		r = 1;
+		goto exit;
+	}
+	if (test_tr31.key.length != sizeof(test4_tr31_key_verify) ||
+		memcmp(test_tr31.key.data, test4_tr31_key_verify, sizeof(test4_tr31_key_verify)) != 0 ||
+		tr31_key_get_kcv(&test_tr31.key) != 0 ||
+		memcmp(test_tr31.key.kcv, test4_tr31_kcv_verify, sizeof(test4_tr31_kcv_verify)) != 0
+	) {
+		fprintf(stderr, "TR-31 key data is incorrect\n");
+		r = 1;
+		goto exit;
+	}
+	tr31_release(&test_tr31);
+	for (size_t i = 0; i < sizeof(test_arena); ++i) {
+		if (test_arena[i]) {
+			fprintf(stderr, "Arena not cleansed\n");
+			r = 1;
+			goto exit;
+		}
+	}
+
+	// test key block decryption into an arena that is too small
+	r = tr31_import_arena(test4_tr31_ascii, strlen(test4_tr31_ascii), test_prepared_kbpk, test_arena, 32, &test_tr31);
+	if (r != TR31_ERROR_INSUFFICIENT_ARENA) {
+		fprintf(stderr, "tr31_import_arena() did not fail as expected; r=%d\n", r);
+		r = 1;
+		goto exit;
+	}
+
+	// test eager KCV computation
+	tr31_set_kcv_mode(TR31_KCV_MODE_EAGER);
+	r = tr31_import(test4_tr31_ascii, &test_kbpk, &test_tr31);
+	tr31_set_kcv_mode(TR31_KCV_MODE_LAZY);
+	if (r) {
+		fprintf(stderr, "tr31_import() failed; r=%d\n", r);
+		goto exit;
+	}
+	if (test_tr31.key.kcv_len != sizeof(test4_tr31_kcv_verify) ||
+		memcmp(test_tr31.key.kcv, test4_tr31_kcv_verify, sizeof(test4_tr31_kcv_verify)) != 0
+	) {
 		fprintf(stderr, "TR-31 key data KCV is incorrect\n");
 		r = 1;
 		goto exit;
 	}
 	tr31_release(&test_tr31);
 
+	// test key block decryption using secure memory pool
+	r = tr31_secmem_enable(0);
+	if (r) {
+		fprintf(stderr, "tr31_secmem_enable() failed; r=%d\n", r);
+		goto exit;
+	}
+	memset(&test_kbpk, 0, sizeof(test_kbpk));
+	test_kbpk.usage = TR31_KEY_USAGE_KEK;
+	test_kbpk.algorithm = TR31_KEY_ALGORITHM_AES;
+	test_kbpk.mode_of_use = TR31_KEY_MODE_OF_USE_ENC_DEC;
+	test_kbpk.length = sizeof(test7_kbpk);
+	test_kbpk.data = (void*)test7_kbpk;
+	r = tr31_import(test7_tr31_ascii, &test_kbpk, &test_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_import() failed; r=%d\n", r);
+		goto exit;
+	}
+	if (test_tr31.key.length != sizeof(test7_tr31_key_verify) ||
+		memcmp(test_tr31.key.data, test7_tr31_key_verify, sizeof(test7_tr31_key_verify)) != 0
+	) {
+		fprintf(stderr, "TR-31 key data is incorrect\n");
+		r = 1;
+		goto exit;
+	}
+	// pool must remain enabled while key data is allocated from it
+	r = tr31_secmem_disable();
+	if (r <= 0) {
+		fprintf(stderr, "tr31_secmem_disable() failed to detect key data in use; r=%d\n", r);
+		r = 1;
+		goto exit;
+	}
+	tr31_release(&test_tr31);
+	r = tr31_secmem_disable();
+	if (r) {
+		fprintf(stderr, "tr31_secmem_disable() failed; r=%d\n", r);
+		goto exit;
+	}
+
 	printf("All tests passed.\n");
 	r = 0;
 	goto exit;
 
 exit:
 	tr31_release(&test_tr31);
+	tr31_kbpk_free(test_prepared_kbpk);
+	free(test_parallel_key_blocks);
+	free(test_parallel_tr31);
+	free(test_parallel_results);
 	return r;
 }
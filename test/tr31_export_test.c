@@ -181,6 +181,11 @@ int main(void)
 	int r;
 	struct tr31_ctx_t test_tr31;
 	char key_block[1024];
+	struct tr31_kbpk_t* test_prepared_kbpk = NULL;
+	struct tr31_ctx_t test_batch_tr31[4];
+	struct tr31_key_block_ref_t test_batch_key_blocks[4];
+	int test_batch_results[4];
+	size_t test_batch_count = 0;
 
 	// TR-31:2018, A.7.2.1
 	printf("Test 1...\n");
@@ -234,6 +239,28 @@ int main(void)
 	}
 	tr31_release(&test_tr31);
 
+	// Verify that output is cleared when export fails
+	r = tr31_init(TR31_VERSION_A, &test1_key, &test_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_init() failed; r=%d\n", r);
+		goto exit;
+	}
+	memset(key_block, 'X', sizeof(key_block));
+	r = tr31_export(&test_tr31, &test1_kbpk, key_block, test1_tr31_length_verify);
+	if (r != TR31_ERROR_INVALID_LENGTH) {
+		fprintf(stderr, "tr31_export() did not fail as expected; r=%d\n", r);
+		r = 1;
+		goto exit;
+	}
+	if (key_block[0] != 0 ||
+		memchr(key_block, 'X', test1_tr31_length_verify) != NULL
+	) {
+		fprintf(stderr, "tr31_export() failed to clear output\n");
+		r = 1;
+		goto exit;
+	}
+	tr31_release(&test_tr31);
+
 	// TR-31:2018, A.7.3.2
 	printf("Test 2...\n");
 	print_buf("key", test2_key.data, test2_key.length);
@@ -478,12 +505,254 @@ int main(void)
 	}
 	tr31_release(&test_tr31);
 
+	// reuse the same prepared KBPK for both key variant binding and key
+	// derivation binding, and for multiple key blocks of each
+	printf("Test 6...\n");
+	r = tr31_kbpk_prepare(&test2_kbpk, &test_prepared_kbpk);
+	if (r) {
+		fprintf(stderr, "tr31_kbpk_prepare() failed; r=%d\n", r);
+		goto exit;
+	}
+	for (size_t i = 0; i < 6; ++i) {
+		static const uint8_t test6_versions[] = { TR31_VERSION_A, TR31_VERSION_B, TR31_VERSION_C };
+		uint8_t test6_version = test6_versions[i % sizeof(test6_versions)];
+
+		r = tr31_init(test6_version, &test2_key, &test_tr31);
+		if (r) {
+			fprintf(stderr, "tr31_init() failed; r=%d\n", r);
+			goto exit;
+		}
+		r = tr31_export_prepared(&test_tr31, test_prepared_kbpk, key_block, sizeof(key_block));
+		if (r) {
+			fprintf(stderr, "tr31_export_prepared() failed; r=%d\n", r);
+			goto exit;
+		}
+		printf("TR-31: %s\n", key_block);
+		tr31_release(&test_tr31);
+
+		// import using the prepared KBPK
+		r = tr31_import_prepared(key_block, test_prepared_kbpk, &test_tr31);
+		if (r) {
+			fprintf(stderr, "tr31_import_prepared() failed; r=%d\n", r);
+			goto exit;
+		}
+		if (test_tr31.version != test6_version ||
+			test_tr31.key.length != sizeof(test2_key_raw) ||
+			memcmp(test_tr31.key.data, test2_key_raw, sizeof(test2_key_raw)) != 0)
+		{
+			fprintf(stderr, "Key verification failed\n");
+			print_buf("key.data", test_tr31.key.data, test_tr31.key.length);
+			print_buf("expected", test2_key_raw, sizeof(test2_key_raw));
+			r = 1;
+			goto exit;
+		}
+		tr31_release(&test_tr31);
+
+		// prepared and unprepared KBPK must be interchangeable
+		r = tr31_import(key_block, &test2_kbpk, &test_tr31);
+		if (r) {
+			fprintf(stderr, "tr31_import() failed; r=%d\n", r);
+			goto exit;
+		}
+		tr31_release(&test_tr31);
+	}
+	tr31_kbpk_free(test_prepared_kbpk);
+	test_prepared_kbpk = NULL;
+
+	// prepared AES KBPK with KBPK KCV optional block
+	r = tr31_kbpk_prepare(&test4_kbpk, &test_prepared_kbpk);
+	if (r) {
+		fprintf(stderr, "tr31_kbpk_prepare() failed; r=%d\n", r);
+		goto exit;
+	}
+	r = tr31_init(TR31_VERSION_D, &test4_key, &test_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_init() failed; r=%d\n", r);
+		goto exit;
+	}
+	r = tr31_opt_block_add_KC(&test_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_opt_block_add_KC() failed; r=%d\n", r);
+		goto exit;
+	}
+	r = tr31_opt_block_add_KP(&test_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_opt_block_add_KP() failed; r=%d\n", r);
+		goto exit;
+	}
+	r = tr31_export_prepared(&test_tr31, test_prepared_kbpk, key_block, sizeof(key_block));
+	if (r) {
+		fprintf(stderr, "tr31_export_prepared() failed; r=%d\n", r);
+		goto exit;
+	}
+	printf("TR-31: %s\n", key_block);
+	if (strncmp(key_block, test4_tr31_header_verify, strlen(test4_tr31_header_verify)) != 0) {
+		fprintf(stderr, "TR-31 header encoding is incorrect\n");
+		fprintf(stderr, "%s\n%s\n", key_block, test4_tr31_header_verify);
+		r = 1;
+		goto exit;
+	}
+	tr31_release(&test_tr31);
+	r = tr31_import_prepared(key_block, test_prepared_kbpk, &test_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_import_prepared() failed; r=%d\n", r);
+		goto exit;
+	}
+	if (test_tr31.key.length != sizeof(test4_key_raw) ||
+		memcmp(test_tr31.key.data, test4_key_raw, sizeof(test4_key_raw)) != 0)
+	{
+		fprintf(stderr, "Key verification failed\n");
+		print_buf("key.data", test_tr31.key.data, test_tr31.key.length);
+		print_buf("expected", test4_key_raw, sizeof(test4_key_raw));
+		r = 1;
+		goto exit;
+	}
+	tr31_release(&test_tr31);
+
+	// batch export into a contiguous buffer; the key block that uses an
+	// incompatible KBPK must not prevent the others from being exported
+	printf("Test 7...\n");
+	static const uint8_t test7_versions[] = { TR31_VERSION_A, TR31_VERSION_D, TR31_VERSION_B, TR31_VERSION_C };
+	static const int test7_results_verify[] = { 0, TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM, 0, 0 };
+	for (; test_batch_count < sizeof(test7_versions); ++test_batch_count) {
+		r = tr31_init(test7_versions[test_batch_count], &test2_key, &test_batch_tr31[test_batch_count]);
+		if (r) {
+			fprintf(stderr, "tr31_init() failed; r=%d\n", r);
+			goto exit;
+		}
+	}
+	r = tr31_export_batch_contiguous(
+		test_batch_tr31,
+		test_batch_count,
+		&test2_kbpk,
+		key_block,
+		sizeof(key_block),
+		test_batch_key_blocks,
+		test_batch_results
+	);
+	if (r) {
+		fprintf(stderr, "tr31_export_batch_contiguous() failed; r=%d\n", r);
+		goto exit;
+	}
+	for (size_t i = 0; i < test_batch_count; ++i) {
+		if (test_batch_results[i] != test7_results_verify[i]) {
+			fprintf(stderr, "tr31_export_batch_contiguous() result %zu is incorrect; r=%d\n", i, test_batch_results[i]);
+			r = 1;
+			goto exit;
+		}
+		if (test_batch_results[i]) {
+			if (test_batch_key_blocks[i].key_block) {
+				fprintf(stderr, "Failed key block must not be referenced\n");
+				r = 1;
+				goto exit;
+			}
+			continue;
+		}
+		printf("TR-31: %s\n", test_batch_key_blocks[i].key_block);
+		if (strlen(test_batch_key_blocks[i].key_block) != test_batch_key_blocks[i].length ||
+			test_batch_key_blocks[i].key_block[0] != test7_versions[i]
+		) {
+			fprintf(stderr, "TR-31 key block reference is incorrect\n");
+			r = 1;
+			goto exit;
+		}
+	}
+	if (test_batch_key_blocks[2].key_block != test_batch_key_blocks[0].key_block + test_batch_key_blocks[0].length + 1) {
+		fprintf(stderr, "TR-31 key blocks are not contiguous\n");
+		r = 1;
+		goto exit;
+	}
+	for (size_t i = 0; i < test_batch_count; ++i) {
+		tr31_release(&test_batch_tr31[i]);
+	}
+
+	// verify and decrypt the exported key blocks as a batch
+	r = tr31_import_batch(test_batch_key_blocks, test_batch_count, &test2_kbpk, test_batch_tr31, test_batch_results);
+	if (r) {
+		fprintf(stderr, "tr31_import_batch() failed; r=%d\n", r);
+		goto exit;
+	}
+	for (size_t i = 0; i < test_batch_count; ++i) {
+		if (!test_batch_key_blocks[i].key_block) {
+			// skip failed key block
+			continue;
+		}
+		if (test_batch_results[i] ||
+			test_batch_tr31[i].key.length != sizeof(test2_key_raw) ||
+			memcmp(test_batch_tr31[i].key.data, test2_key_raw, sizeof(test2_key_raw)) != 0)
+		{
+			fprintf(stderr, "Key verification failed\n");
+			r = 1;
+			goto exit;
+		}
+		tr31_release(&test_batch_tr31[i]);
+	}
+	test_batch_count = 0;
+
+	// parallel batch export into separate buffers
+	printf("Test 8...\n");
+	static char test8_key_blocks[4][128];
+	static char* const test8_key_block_ptrs[] = { test8_key_blocks[0], test8_key_blocks[1], test8_key_blocks[2], test8_key_blocks[3] };
+	static const size_t test8_key_block_lens[] = { sizeof(test8_key_blocks[0]), sizeof(test8_key_blocks[1]), sizeof(test8_key_blocks[2]), 16 };
+	static const int test8_results_verify[] = { 0, TR31_ERROR_UNSUPPORTED_KBPK_ALGORITHM, 0, TR31_ERROR_INVALID_LENGTH };
+	for (; test_batch_count < sizeof(test7_versions); ++test_batch_count) {
+		r = tr31_init(test7_versions[test_batch_count], &test2_key, &test_batch_tr31[test_batch_count]);
+		if (r) {
+			fprintf(stderr, "tr31_init() failed; r=%d\n", r);
+			goto exit;
+		}
+	}
+	r = tr31_export_batch_parallel(
+		test_batch_tr31,
+		test_batch_count,
+		&test2_kbpk,
+		test8_key_block_ptrs,
+		test8_key_block_lens,
+		test_batch_results,
+		2
+	);
+	if (r) {
+		fprintf(stderr, "tr31_export_batch_parallel() failed; r=%d\n", r);
+		goto exit;
+	}
+	for (size_t i = 0; i < test_batch_count; ++i) {
+		if (test_batch_results[i] != test8_results_verify[i]) {
+			fprintf(stderr, "tr31_export_batch_parallel() result %zu is incorrect; r=%d\n", i, test_batch_results[i]);
+			r = 1;
+			goto exit;
+		}
+		tr31_release(&test_batch_tr31[i]);
+		if (test_batch_results[i]) {
+			continue;
+		}
+		printf("TR-31: %s\n", test8_key_blocks[i]);
+
+		r = tr31_import(test8_key_blocks[i], &test2_kbpk, &test_tr31);
+		if (r) {
+			fprintf(stderr, "tr31_import() failed; r=%d\n", r);
+			goto exit;
+		}
+		if (test_tr31.key.length != sizeof(test2_key_raw) ||
+			memcmp(test_tr31.key.data, test2_key_raw, sizeof(test2_key_raw)) != 0)
+		{
+			fprintf(stderr, "Key verification failed\n");
+			r = 1;
+			goto exit;
+		}
+		tr31_release(&test_tr31);
+	}
+	test_batch_count = 0;
+
 	printf("All tests passed.\n");
 	r = 0;
 	goto exit;
 
 exit:
 	tr31_release(&test_tr31);
+	tr31_kbpk_free(test_prepared_kbpk);
+	for (size_t i = 0; i < test_batch_count; ++i) {
+		tr31_release(&test_batch_tr31[i]);
+	}
 	tr31_key_release(&test1_kbpk);
 	tr31_key_release(&test2_kbpk);
 	tr31_key_release(&test3_kbpk);
@@ -0,0 +1,121 @@
+/**
+ * @file tr31_hex_test.c
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "tr31.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// lengths chosen to exercise vectorised blocks as well as remaining bytes
+#define TEST_MAX_LEN (200)
+
+// characters adjacent to the valid hex digit ranges
+static const char test_invalid_digits[] = { '/', ':', '@', 'G', '`', 'g', ' ', 0, (char)0x80, (char)0xB0, (char)0xC1, (char)0xFF };
+
+int main(void)
+{
+	int r;
+	uint8_t bin[TEST_MAX_LEN];
+	uint8_t bin_verify[TEST_MAX_LEN];
+	char hex[TEST_MAX_LEN * 2];
+	char hex_verify[(TEST_MAX_LEN * 2) + 1];
+	uint32_t seed = 0x31A7E5C9;
+
+	for (size_t i = 0; i < sizeof(bin_verify); ++i) {
+		// simple LCG is sufficient for test data
+		seed = (seed * 1103515245) + 12345;
+		bin_verify[i] = seed >> 16;
+	}
+	for (size_t i = 0; i < sizeof(bin_verify); ++i) {
+		snprintf(hex_verify + (i * 2), 3, "%02X", bin_verify[i]);
+	}
+
+	// test encoding and decoding for all lengths and alignments
+	for (size_t len = 0; len <= TEST_MAX_LEN; ++len) {
+		size_t offset = len % 3;
+		if (len + offset > TEST_MAX_LEN) {
+			offset = 0;
+		}
+
+		memset(hex, 0, sizeof(hex));
+		r = tr31_bin_to_hex(bin_verify + offset, len, hex, len * 2);
+		if (r) {
+			fprintf(stderr, "tr31_bin_to_hex() failed; len=%zu; r=%d\n", len, r);
+			return 1;
+		}
+		if (memcmp(hex, hex_verify + (offset * 2), len * 2) != 0) {
+			fprintf(stderr, "tr31_bin_to_hex() output is incorrect; len=%zu\n", len);
+			return 1;
+		}
+
+		memset(bin, 0, sizeof(bin));
+		r = tr31_hex_to_bin(hex_verify + (offset * 2), bin, len);
+		if (r) {
+			fprintf(stderr, "tr31_hex_to_bin() failed; len=%zu; r=%d\n", len, r);
+			return 1;
+		}
+		if (memcmp(bin, bin_verify + offset, len) != 0) {
+			fprintf(stderr, "tr31_hex_to_bin() output is incorrect; len=%zu\n", len);
+			return 1;
+		}
+
+		// lower case hex digits must also be accepted
+		for (size_t i = 0; i < len * 2; ++i) {
+			hex[i] = tolower((unsigned char)hex_verify[(offset * 2) + i]);
+		}
+		memset(bin, 0, sizeof(bin));
+		r = tr31_hex_to_bin(hex, bin, len);
+		if (r) {
+			fprintf(stderr, "tr31_hex_to_bin() failed for lower case; len=%zu; r=%d\n", len, r);
+			return 1;
+		}
+		if (memcmp(bin, bin_verify + offset, len) != 0) {
+			fprintf(stderr, "tr31_hex_to_bin() output is incorrect for lower case; len=%zu\n", len);
+			return 1;
+		}
+	}
+
+	// test invalid digits at every position
+	for (size_t pos = 0; pos < TEST_MAX_LEN * 2; ++pos) {
+		for (size_t i = 0; i < sizeof(test_invalid_digits); ++i) {
+			memcpy(hex, hex_verify, TEST_MAX_LEN * 2);
+			hex[pos] = test_invalid_digits[i];
+
+			r = tr31_hex_to_bin(hex, bin, TEST_MAX_LEN);
+			if (r <= 0) {
+				fprintf(stderr, "tr31_hex_to_bin() failed to detect invalid digit 0x%02X at position %zu; r=%d\n", (uint8_t)test_invalid_digits[i], pos, r);
+				return 1;
+			}
+		}
+	}
+
+	// test insufficient output buffer
+	r = tr31_bin_to_hex(bin_verify, 16, hex, 31);
+	if (r >= 0) {
+		fprintf(stderr, "tr31_bin_to_hex() failed to detect insufficient buffer; r=%d\n", r);
+		return 1;
+	}
+
+	printf("All tests passed.\n");
+
+	return 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * @file tr31_secmem_test.c
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "tr31.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// enough keys to exhaust several small regions
+#define TEST_KEY_COUNT (300)
+
+// small region size to exercise region growth
+#define TEST_REGION_SIZE (4096)
+
+int main(void)
+{
+	int r;
+	static struct tr31_key_t keys[TEST_KEY_COUNT];
+	uint8_t key_data[TEST_KEY_COUNT][16];
+	uint8_t hmac_key_data[100];
+	struct tr31_key_t hmac_key;
+
+	r = tr31_secmem_enable(TEST_REGION_SIZE);
+	if (r) {
+		fprintf(stderr, "tr31_secmem_enable() failed; r=%d\n", r);
+		return 1;
+	}
+
+	// enabling twice must be harmless
+	r = tr31_secmem_enable(0);
+	if (r) {
+		fprintf(stderr, "tr31_secmem_enable() failed when already enabled; r=%d\n", r);
+		return 1;
+	}
+
+	// populate more keys than fit in the first region
+	for (size_t i = 0; i < TEST_KEY_COUNT; ++i) {
+		for (size_t j = 0; j < sizeof(key_data[i]); ++j) {
+			key_data[i][j] = i + j;
+		}
+		r = tr31_key_init(
+			TR31_KEY_USAGE_DATA,
+			TR31_KEY_ALGORITHM_AES,
+			TR31_KEY_MODE_OF_USE_ENC_DEC,
+			"00",
+			TR31_KEY_EXPORT_NONE,
+			key_data[i],
+			sizeof(key_data[i]),
+			&keys[i]
+		);
+		if (r) {
+			fprintf(stderr, "tr31_key_init() failed; i=%zu; r=%d\n", i, r);
+			return 1;
+		}
+	}
+
+	// key data that does not fit in a slot is allocated from the heap
+	memset(hmac_key_data, 0x5A, sizeof(hmac_key_data));
+	r = tr31_key_init(
+		TR31_KEY_USAGE_HMAC,
+		TR31_KEY_ALGORITHM_HMAC,
+		TR31_KEY_MODE_OF_USE_MAC,
+		"00",
+		TR31_KEY_EXPORT_NONE,
+		hmac_key_data,
+		sizeof(hmac_key_data),
+		&hmac_key
+	);
+	if (r) {
+		fprintf(stderr, "tr31_key_init() failed for HMAC key; r=%d\n", r);
+		return 1;
+	}
+
+	// release every other key and reuse its slot for different key data
+	for (size_t i = 0; i < TEST_KEY_COUNT; i += 2) {
+		tr31_key_release(&keys[i]);
+		key_data[i][0] ^= 0xFF;
+		r = tr31_key_set_data(&keys[i], key_data[i], sizeof(key_data[i]));
+		if (r) {
+			fprintf(stderr, "tr31_key_set_data() failed; i=%zu; r=%d\n", i, r);
+			return 1;
+		}
+	}
+
+	for (size_t i = 0; i < TEST_KEY_COUNT; ++i) {
+		if (keys[i].length != sizeof(key_data[i]) ||
+			memcmp(keys[i].data, key_data[i], sizeof(key_data[i])) != 0
+		) {
+			fprintf(stderr, "Key data is incorrect; i=%zu\n", i);
+			return 1;
+		}
+	}
+	if (hmac_key.length != sizeof(hmac_key_data) ||
+		memcmp(hmac_key.data, hmac_key_data, sizeof(hmac_key_data)) != 0
+	) {
+		fprintf(stderr, "HMAC key data is incorrect\n");
+		return 1;
+	}
+
+	// pool must remain enabled while key data is allocated from it
+	r = tr31_secmem_disable();
+	if (r <= 0) {
+		fprintf(stderr, "tr31_secmem_disable() failed to detect key data in use; r=%d\n", r);
+		return 1;
+	}
+
+	tr31_key_release(&hmac_key);
+	for (size_t i = 0; i < TEST_KEY_COUNT; ++i) {
+		tr31_key_release(&keys[i]);
+	}
+
+	r = tr31_secmem_disable();
+	if (r) {
+		fprintf(stderr, "tr31_secmem_disable() failed; r=%d\n", r);
+		return 1;
+	}
+
+	// key data must be allocated from the heap after the pool is disabled
+	r = tr31_key_set_data(&keys[0], key_data[0], sizeof(key_data[0]));
+	if (r) {
+		fprintf(stderr, "tr31_key_set_data() failed after disable; r=%d\n", r);
+		return 1;
+	}
+	if (memcmp(keys[0].data, key_data[0], sizeof(key_data[0])) != 0) {
+		fprintf(stderr, "Key data is incorrect after disable\n");
+		return 1;
+	}
+	tr31_key_release(&keys[0]);
+
+	printf("All tests passed.\n");
+
+	return 0;
+}
@@ -0,0 +1,226 @@
+/**
+ * @file tr31_stats_test.c
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "tr31.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_BATCH_COUNT (64)
+
+// TR-31:2018, A.7.4
+static const uint8_t test_kbpk_raw[] = {
+	0x88, 0xE1, 0xAB, 0x2A, 0x2E, 0x3D, 0xD3, 0x8C, 0x1F, 0xA0, 0x39, 0xA5, 0x36, 0x50, 0x0C, 0xC8,
+	0xA8, 0x7A, 0xB9, 0xD6, 0x2D, 0xC9, 0x2C, 0x01, 0x05, 0x8F, 0xA7, 0x9F, 0x44, 0x65, 0x7D, 0xE6,
+};
+static const struct tr31_key_t test_kbpk = {
+	.usage = TR31_KEY_USAGE_KEK,
+	.algorithm = TR31_KEY_ALGORITHM_AES,
+	.mode_of_use = TR31_KEY_MODE_OF_USE_ENC_DEC,
+	.length = sizeof(test_kbpk_raw),
+	.data = (void*)test_kbpk_raw,
+};
+static const char test_tr31_ascii[] = "D0112P0AE00E0000B82679114F470F540165EDFBF7E250FCEA43F810D215F8D207E2E417C07156A27E8E31DA05F7425509593D03A457DC34";
+static const uint8_t test_tr31_key_verify[] = { 0x3F, 0x41, 0x9E, 0x1C, 0xB7, 0x07, 0x94, 0x42, 0xAA, 0x37, 0x47, 0x4C, 0x2E, 0xFB, 0xF8, 0xB8 };
+
+static int test_stages(const struct tr31_stats_t* stats, const enum tr31_stats_stage_t* stages, size_t stage_count)
+{
+	for (size_t i = 0; i < stage_count; ++i) {
+		if (!stats->stages[stages[i]].count) {
+			fprintf(stderr, "Stage %d was not recorded\n", stages[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int main(void)
+{
+	int r;
+	struct tr31_stats_t stats;
+	struct tr31_ctx_t ctx;
+	struct tr31_ctx_t export_ctx;
+	char key_block[1024];
+	char tampered_key_block[1024];
+	struct tr31_key_block_ref_t key_blocks[TEST_BATCH_COUNT];
+	struct tr31_ctx_t batch_ctx[TEST_BATCH_COUNT];
+	int results[TEST_BATCH_COUNT];
+
+	r = tr31_stats_get(&stats);
+	if (r < 0) {
+		fprintf(stderr, "tr31_stats_get() failed; r=%d\n", r);
+		return 1;
+	}
+	if (r > 0) {
+		// instrumentation not available; ensure that counters are zero
+		static const struct tr31_stats_t zero_stats;
+		if (memcmp(&stats, &zero_stats, sizeof(stats)) != 0) {
+			fprintf(stderr, "tr31_stats_get() populated counters while not available\n");
+			return 1;
+		}
+		if (tr31_stats_reset() <= 0) {
+			fprintf(stderr, "tr31_stats_reset() failed to indicate that instrumentation is not available\n");
+			return 1;
+		}
+		printf("Instrumentation not available.\n");
+		printf("All tests passed.\n");
+		return 0;
+	}
+
+	// counters must be zero after reset
+	r = tr31_stats_reset();
+	if (r) {
+		fprintf(stderr, "tr31_stats_reset() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_stats_get(&stats);
+	if (r) {
+		fprintf(stderr, "tr31_stats_get() failed; r=%d\n", r);
+		return 1;
+	}
+	if (stats.imports || stats.exports || stats.stages[TR31_STATS_STAGE_PARSE].count) {
+		fprintf(stderr, "Counters not reset\n");
+		return 1;
+	}
+
+	// successful import followed by export of the imported key
+	r = tr31_import(test_tr31_ascii, &test_kbpk, &ctx);
+	if (r) {
+		fprintf(stderr, "tr31_import() failed; r=%d\n", r);
+		return 1;
+	}
+	if (ctx.key.length != sizeof(test_tr31_key_verify) ||
+		memcmp(ctx.key.data, test_tr31_key_verify, sizeof(test_tr31_key_verify)) != 0
+	) {
+		fprintf(stderr, "Imported key data is incorrect\n");
+		return 1;
+	}
+	r = tr31_init(TR31_VERSION_D, &ctx.key, &export_ctx);
+	if (r) {
+		fprintf(stderr, "tr31_init() failed; r=%d\n", r);
+		return 1;
+	}
+	tr31_release(&ctx);
+	r = tr31_opt_block_add_KC(&export_ctx);
+	if (r) {
+		fprintf(stderr, "tr31_opt_block_add_KC() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_export(&export_ctx, &test_kbpk, key_block, sizeof(key_block));
+	if (r) {
+		fprintf(stderr, "tr31_export() failed; r=%d\n", r);
+		return 1;
+	}
+	tr31_release(&export_ctx);
+
+	// import with invalid authenticator
+	strcpy(tampered_key_block, key_block);
+	tampered_key_block[strlen(key_block) - 1] = key_block[strlen(key_block) - 1] == '0' ? '1' : '0';
+	r = tr31_import(tampered_key_block, &test_kbpk, &ctx);
+	if (r != TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED) {
+		fprintf(stderr, "tr31_import() failed to detect invalid authenticator; r=%d\n", r);
+		return 1;
+	}
+	tr31_release(&ctx);
+
+	r = tr31_stats_get(&stats);
+	if (r) {
+		fprintf(stderr, "tr31_stats_get() failed; r=%d\n", r);
+		return 1;
+	}
+	if (stats.imports != 2 || stats.imports_failed != 1 ||
+		stats.exports != 1 || stats.exports_failed != 0 ||
+		stats.errors[TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED] != 1 ||
+		stats.internal_errors
+	) {
+		fprintf(stderr, "Incorrect counters; imports=%llu; imports_failed=%llu; exports=%llu; exports_failed=%llu; verification failures=%llu\n",
+			(unsigned long long)stats.imports,
+			(unsigned long long)stats.imports_failed,
+			(unsigned long long)stats.exports,
+			(unsigned long long)stats.exports_failed,
+			(unsigned long long)stats.errors[TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED]
+		);
+		return 1;
+	}
+	static const enum tr31_stats_stage_t stages[] = {
+		TR31_STATS_STAGE_PARSE,
+		TR31_STATS_STAGE_HEX_DECODE,
+		TR31_STATS_STAGE_HEX_ENCODE,
+		TR31_STATS_STAGE_KBPK,
+		TR31_STATS_STAGE_DECRYPT,
+		TR31_STATS_STAGE_ENCRYPT,
+		TR31_STATS_STAGE_MAC_VERIFY,
+		TR31_STATS_STAGE_MAC_GENERATE,
+		TR31_STATS_STAGE_KCV,
+		TR31_STATS_STAGE_RAND,
+	};
+	r = test_stages(&stats, stages, sizeof(stages) / sizeof(stages[0]));
+	if (r) {
+		return 1;
+	}
+
+	// parallel batch import such that counters of worker threads are
+	// retained after the workers exit
+	for (size_t i = 0; i < TEST_BATCH_COUNT; ++i) {
+		key_blocks[i].key_block = key_block;
+		key_blocks[i].length = strlen(key_block);
+	}
+	r = tr31_stats_reset();
+	if (r) {
+		fprintf(stderr, "tr31_stats_reset() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_import_batch_parallel(key_blocks, TEST_BATCH_COUNT, &test_kbpk, batch_ctx, results, 2);
+	if (r) {
+		fprintf(stderr, "tr31_import_batch_parallel() failed; r=%d\n", r);
+		return 1;
+	}
+	for (size_t i = 0; i < TEST_BATCH_COUNT; ++i) {
+		if (results[i]) {
+			fprintf(stderr, "tr31_import_batch_parallel() failed for key block %zu; r=%d\n", i, results[i]);
+			return 1;
+		}
+		tr31_release(&batch_ctx[i]);
+	}
+	r = tr31_stats_get(&stats);
+	if (r) {
+		fprintf(stderr, "tr31_stats_get() failed; r=%d\n", r);
+		return 1;
+	}
+	if (stats.imports != TEST_BATCH_COUNT || stats.imports_failed || stats.exports) {
+		fprintf(stderr, "Incorrect batch counters; imports=%llu; imports_failed=%llu; exports=%llu\n",
+			(unsigned long long)stats.imports,
+			(unsigned long long)stats.imports_failed,
+			(unsigned long long)stats.exports
+		);
+		return 1;
+	}
+	if (!stats.stages[TR31_STATS_STAGE_MAC_VERIFY].count) {
+		fprintf(stderr, "Batch verification was not recorded\n");
+		return 1;
+	}
+
+	printf("All tests passed.\n");
+
+	return 0;
+}
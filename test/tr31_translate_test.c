@@ -0,0 +1,373 @@
+/**
+ * @file tr31_translate_test.c
+ *
+ * Copyright (c) 2021 ono//connect
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "tr31.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// example data generated using a Thales payShield 10k HSM
+static const uint8_t test1_kbpk_raw[] = {
+	0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41,
+	0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41,
+};
+static const char test1_tr31_ascii[] = "D0112B0TN00N000037DB9B046B7B0048785690759580ABC3B9842AB4BB7717B49E92528E575785D8123559376A2553B27BE94F054F4E971C";
+static const uint8_t test1_tr31_key_verify[] = { 0x1F, 0xA1, 0xF7, 0xCE, 0xC7, 0x98, 0xD9, 0x15, 0x45, 0xDA, 0x8A, 0xE0, 0xC7, 0x79, 0x6B, 0xD9 };
+
+// TR-31:2018, A.7.3.2 KBPK used for output key blocks
+static const uint8_t test2_kbpk_raw[] = { 0x1D, 0x22, 0xBF, 0x32, 0x38, 0x7C, 0x60, 0x0A, 0xD9, 0x7F, 0x9B, 0x97, 0xA5, 0x13, 0x11, 0xAC };
+
+// example data generated using a Thales payShield 10k HSM
+static const uint8_t test3_kbpk_raw[] = { 0xAB, 0x2E, 0x09, 0xDB, 0x3E, 0xF0, 0xBA, 0x71, 0xE0, 0xCE, 0x6C, 0xD7, 0x55, 0xC2, 0x3A, 0x3B };
+static const char test3_tr31_ascii[] = "B0128B1TX00N0300KS18FFFF00A0200001E00000KC0C000169E3KP0C00ECAD626F9F1A826814AA066D86C8C18BD0E14033E1EBEC75BEDF586E6E325F3AA8C0E5";
+static const uint8_t test3_tr31_ksn_verify[] = { 0xFF, 0xFF, 0x00, 0xA0, 0x20, 0x00, 0x01, 0xE0, 0x00, 0x00 };
+
+// example data generated using a Thales payShield 10k HSM
+// AES-256 key protected by test1_kbpk_raw
+static const char test4_tr31_ascii[] = "D0144D0AN00N0000127862F945C2DED04530FAF7CDBC8B0BA10C7AA79BD5E0C2C5D6AC173BF588E4B19ACF1357178D50EA0AB193228E13958304FC6149632DFDCADF3A5B3D57E814";
+
+static int test_kbpk_init(unsigned int algorithm, const void* data, size_t length, struct tr31_key_t* kbpk)
+{
+	int r;
+
+	r = tr31_key_init(
+		TR31_KEY_USAGE_TR31_KBPK,
+		algorithm,
+		TR31_KEY_MODE_OF_USE_ENC_DEC,
+		"00",
+		TR31_KEY_EXPORT_NONE,
+		data,
+		length,
+		kbpk
+	);
+	if (r) {
+		fprintf(stderr, "tr31_key_init() failed; r=%d\n", r);
+		return 1;
+	}
+
+	return 0;
+}
+
+static const struct tr31_opt_ctx_t* test_opt_block_find(const struct tr31_ctx_t* ctx, unsigned int id)
+{
+	for (size_t i = 0; i < ctx->opt_blocks_count; ++i) {
+		if (ctx->opt_blocks[i].id == id) {
+			return &ctx->opt_blocks[i];
+		}
+	}
+
+	return NULL;
+}
+
+int main(void)
+{
+	int r;
+	struct tr31_key_t test1_kbpk;
+	struct tr31_key_t test2_kbpk;
+	struct tr31_key_t test3_kbpk;
+	struct tr31_key_t test4_kbpk;
+	struct tr31_kbpk_t* prepared_import_kbpk = NULL;
+	struct tr31_kbpk_t* prepared_export_kbpk = NULL;
+	struct tr31_translate_t translate;
+	struct tr31_ctx_t test_tr31;
+	struct tr31_ctx_t verify_tr31;
+	const struct tr31_opt_ctx_t* opt_block;
+	char key_block[1024];
+	char key_version[2];
+
+	if (test_kbpk_init(TR31_KEY_ALGORITHM_AES, test1_kbpk_raw, sizeof(test1_kbpk_raw), &test1_kbpk) ||
+		test_kbpk_init(TR31_KEY_ALGORITHM_TDES, test2_kbpk_raw, sizeof(test2_kbpk_raw), &test2_kbpk) ||
+		test_kbpk_init(TR31_KEY_ALGORITHM_TDES, test3_kbpk_raw, sizeof(test3_kbpk_raw), &test3_kbpk) ||
+		test_kbpk_init(TR31_KEY_ALGORITHM_AES, test3_kbpk_raw, sizeof(test3_kbpk_raw), &test4_kbpk)
+	) {
+		return 1;
+	}
+
+	// test translation from format version D to format version B with
+	// remapped header fields and added optional block KP
+	printf("Test 1 (format version D to B)...\n");
+	memset(&translate, 0, sizeof(translate));
+	translate.version = TR31_VERSION_B;
+	translate.key_version = "12";
+	translate.exportability = TR31_KEY_EXPORT_TRUSTED;
+	translate.flags = TR31_TRANSLATE_ADD_KP;
+	r = tr31_translate(
+		test1_tr31_ascii,
+		strlen(test1_tr31_ascii),
+		&test1_kbpk,
+		&test2_kbpk,
+		&translate,
+		key_block,
+		sizeof(key_block)
+	);
+	if (r) {
+		fprintf(stderr, "tr31_translate() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_import(key_block, &test2_kbpk, &test_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_import() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_key_get_key_version(&test_tr31.key, key_version);
+	if (r) {
+		fprintf(stderr, "tr31_key_get_key_version() failed; r=%d\n", r);
+		return 1;
+	}
+	opt_block = test_opt_block_find(&test_tr31, TR31_OPT_BLOCK_KP);
+	if (test_tr31.version != TR31_VERSION_B ||
+		test_tr31.key.usage != TR31_KEY_USAGE_BDK ||
+		test_tr31.key.algorithm != TR31_KEY_ALGORITHM_TDES ||
+		test_tr31.key.mode_of_use != TR31_KEY_MODE_OF_USE_ANY ||
+		memcmp(key_version, "12", sizeof(key_version)) != 0 ||
+		test_tr31.key.exportability != TR31_KEY_EXPORT_TRUSTED ||
+		test_tr31.key.length != sizeof(test1_tr31_key_verify) ||
+		test_tr31.key.data == NULL ||
+		memcmp(test_tr31.key.data, test1_tr31_key_verify, sizeof(test1_tr31_key_verify)) != 0 ||
+		opt_block == NULL ||
+		opt_block->data_length == 0
+	) {
+		fprintf(stderr, "Translated key block is incorrect\n");
+		fprintf(stderr, "%s\n", key_block);
+		return 1;
+	}
+	tr31_release(&test_tr31);
+	printf("Test 1 passed.\n");
+
+	// test translation that retains header fields and optional blocks
+	printf("Test 2 (format version B to D)...\n");
+	r = tr31_import(test3_tr31_ascii, &test3_kbpk, &verify_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_import() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_kbpk_prepare(&test3_kbpk, &prepared_import_kbpk);
+	if (r) {
+		fprintf(stderr, "tr31_kbpk_prepare() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_kbpk_prepare(&test1_kbpk, &prepared_export_kbpk);
+	if (r) {
+		fprintf(stderr, "tr31_kbpk_prepare() failed; r=%d\n", r);
+		return 1;
+	}
+	memset(&translate, 0, sizeof(translate));
+	translate.version = TR31_VERSION_D;
+	r = tr31_translate_prepared(
+		test3_tr31_ascii,
+		strlen(test3_tr31_ascii),
+		prepared_import_kbpk,
+		prepared_export_kbpk,
+		&translate,
+		key_block,
+		sizeof(key_block)
+	);
+	if (r) {
+		fprintf(stderr, "tr31_translate_prepared() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_import(key_block, &test1_kbpk, &test_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_import() failed; r=%d\n", r);
+		return 1;
+	}
+	if (test_tr31.version != TR31_VERSION_D ||
+		test_tr31.key.usage != verify_tr31.key.usage ||
+		test_tr31.key.algorithm != verify_tr31.key.algorithm ||
+		test_tr31.key.mode_of_use != verify_tr31.key.mode_of_use ||
+		test_tr31.key.key_version != verify_tr31.key.key_version ||
+		test_tr31.key.exportability != verify_tr31.key.exportability ||
+		test_tr31.key.length != verify_tr31.key.length ||
+		memcmp(test_tr31.key.data, verify_tr31.key.data, verify_tr31.key.length) != 0 ||
+		test_tr31.opt_blocks_count < 3 ||
+		test_tr31.opt_blocks[0].id != TR31_OPT_BLOCK_KS ||
+		test_tr31.opt_blocks[0].data_length != sizeof(test3_tr31_ksn_verify) ||
+		memcmp(test_tr31.opt_blocks[0].data, test3_tr31_ksn_verify, sizeof(test3_tr31_ksn_verify)) != 0 ||
+		test_tr31.opt_blocks[1].id != TR31_OPT_BLOCK_KC ||
+		test_tr31.opt_blocks[1].data_length != verify_tr31.opt_blocks[1].data_length ||
+		memcmp(test_tr31.opt_blocks[1].data, verify_tr31.opt_blocks[1].data, verify_tr31.opt_blocks[1].data_length) != 0 ||
+		test_tr31.opt_blocks[2].id != TR31_OPT_BLOCK_KP ||
+		(
+			test_tr31.opt_blocks[2].data_length == verify_tr31.opt_blocks[2].data_length &&
+			memcmp(test_tr31.opt_blocks[2].data, verify_tr31.opt_blocks[2].data, verify_tr31.opt_blocks[2].data_length) == 0
+		)
+	) {
+		fprintf(stderr, "Translated key block is incorrect\n");
+		fprintf(stderr, "%s\n", key_block);
+		return 1;
+	}
+	tr31_release(&test_tr31);
+	printf("Test 2 passed.\n");
+
+	// test translation that omits optional blocks
+	printf("Test 3 (omit optional blocks)...\n");
+	memset(&translate, 0, sizeof(translate));
+	translate.flags = TR31_TRANSLATE_DROP_OPT_BLOCKS;
+	r = tr31_translate_prepared(
+		test3_tr31_ascii,
+		strlen(test3_tr31_ascii),
+		prepared_import_kbpk,
+		prepared_import_kbpk,
+		&translate,
+		key_block,
+		sizeof(key_block)
+	);
+	if (r) {
+		fprintf(stderr, "tr31_translate_prepared() failed; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_import(key_block, &test3_kbpk, &test_tr31);
+	if (r) {
+		fprintf(stderr, "tr31_import() failed; r=%d\n", r);
+		return 1;
+	}
+	if (test_tr31.version != TR31_VERSION_B ||
+		test_tr31.opt_blocks_count != 0 ||
+		test_tr31.key.length != verify_tr31.key.length ||
+		memcmp(test_tr31.key.data, verify_tr31.key.data, verify_tr31.key.length) != 0
+	) {
+		fprintf(stderr, "Translated key block is incorrect\n");
+		fprintf(stderr, "%s\n", key_block);
+		return 1;
+	}
+	tr31_release(&test_tr31);
+	tr31_release(&verify_tr31);
+	printf("Test 3 passed.\n");
+
+	// test translation errors
+	printf("Test 4 (errors)...\n");
+	r = tr31_translate(
+		test3_tr31_ascii,
+		strlen(test3_tr31_ascii),
+		&test2_kbpk,
+		&test1_kbpk,
+		NULL,
+		key_block,
+		sizeof(key_block)
+	);
+	if (r != TR31_ERROR_INVALID_KEY_LENGTH &&
+		r != TR31_ERROR_KEY_BLOCK_VERIFICATION_FAILED
+	) {
+		fprintf(stderr, "tr31_translate() failed to detect incorrect KBPK; r=%d\n", r);
+		return 1;
+	}
+	memset(&translate, 0, sizeof(translate));
+	translate.version = 'X';
+	r = tr31_translate_prepared(
+		test3_tr31_ascii,
+		strlen(test3_tr31_ascii),
+		prepared_import_kbpk,
+		prepared_export_kbpk,
+		&translate,
+		key_block,
+		sizeof(key_block)
+	);
+	if (r != TR31_ERROR_UNSUPPORTED_VERSION) {
+		fprintf(stderr, "tr31_translate_prepared() failed to detect invalid format version; r=%d\n", r);
+		return 1;
+	}
+	memset(&translate, 0, sizeof(translate));
+	translate.usage = 0x5858;
+	r = tr31_translate_prepared(
+		test3_tr31_ascii,
+		strlen(test3_tr31_ascii),
+		prepared_import_kbpk,
+		prepared_export_kbpk,
+		&translate,
+		key_block,
+		sizeof(key_block)
+	);
+	if (r != TR31_ERROR_UNSUPPORTED_KEY_USAGE) {
+		fprintf(stderr, "tr31_translate_prepared() failed to detect invalid key usage; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_translate(
+		test3_tr31_ascii,
+		strlen(test3_tr31_ascii),
+		&test3_kbpk,
+		&test1_kbpk,
+		NULL,
+		key_block,
+		16
+	);
+	if (r != TR31_ERROR_INVALID_LENGTH) {
+		fprintf(stderr, "tr31_translate() failed to detect short output buffer; r=%d\n", r);
+		return 1;
+	}
+	printf("Test 4 passed.\n");
+
+	// test translation of AES key to weaker KBPK or unsupported format version
+	printf("Test 5 (weaker KBPK)...\n");
+	memset(&translate, 0, sizeof(translate));
+	translate.version = TR31_VERSION_B;
+	r = tr31_translate(
+		test4_tr31_ascii,
+		strlen(test4_tr31_ascii),
+		&test1_kbpk,
+		&test2_kbpk,
+		&translate,
+		key_block,
+		sizeof(key_block)
+	);
+	if (r != TR31_ERROR_INVALID_KEY_LENGTH) {
+		fprintf(stderr, "tr31_translate() failed to detect unsupported key length; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_translate(
+		test4_tr31_ascii,
+		strlen(test4_tr31_ascii),
+		&test1_kbpk,
+		&test4_kbpk,
+		NULL,
+		key_block,
+		sizeof(key_block)
+	);
+	if (r != TR31_ERROR_KBPK_TOO_WEAK) {
+		fprintf(stderr, "tr31_translate() failed to detect weaker KBPK; r=%d\n", r);
+		return 1;
+	}
+	r = tr31_translate(
+		test4_tr31_ascii,
+		strlen(test4_tr31_ascii),
+		&test1_kbpk,
+		&test1_kbpk,
+		NULL,
+		key_block,
+		sizeof(key_block)
+	);
+	if (r) {
+		fprintf(stderr, "tr31_translate() failed; r=%d\n", r);
+		return 1;
+	}
+	printf("Test 5 passed.\n");
+
+	tr31_kbpk_free(prepared_export_kbpk);
+	tr31_kbpk_free(prepared_import_kbpk);
+	tr31_key_release(&test4_kbpk);
+	tr31_key_release(&test3_kbpk);
+	tr31_key_release(&test2_kbpk);
+	tr31_key_release(&test1_kbpk);
+
+	printf("All tests passed.\n");
+
+	return 0;
+}